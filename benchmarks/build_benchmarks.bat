@@ -0,0 +1,3 @@
+cl /nologo /O2 /std:c++20 /EHsc /I ..\include integer_math_benchmark.cpp
+cl /nologo /O2 /std:c++20 /EHsc /I ..\include helpers_benchmark.cpp ..\src\cl_bindings_and_helpers.cpp
+cl /nologo /O2 /std:c++20 /EHsc /I ..\include /I ..\mock_icd mock_helpers_benchmark.cpp ..\src\cl_bindings_and_helpers.cpp
@@ -0,0 +1,277 @@
+// Microbenchmarks for the pure-CPU helpers of cl_bindings_and_helpers.h that sit on hot paths: version string parsing, integer_sqrt(),
+// calcSmallestBoundingBox(), the context lookup of OpenCLDeviceCollection, sorting and reversing device index collections, and custom_vector growth.
+// Inputs come from a fixed-seed generator, so every run measures the same work. Output is CSV on stdout, one line per benchmark:
+// benchmark,parameter,iterations,min_ns_per_op,median_ns_per_op
+// Pass a substring as the first argument to only run the benchmarks whose name contains it.
+// NOTE: Doesn't need an OpenCL implementation. The device sort benchmark binds clGetDeviceInfo to a fake that answers from a table.
+// Build with build_benchmarks.bat, or for example: cl /O2 /std:c++20 /EHsc /I ..\include helpers_benchmark.cpp ..\src\cl_bindings_and_helpers.cpp
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define BENCHMARK_REPETITIONS 9
+
+// xorshift64*, so that the inputs are the same on every machine and every run.
+struct BenchmarkRandom {
+	uint64_t state;
+
+	explicit BenchmarkRandom(uint64_t seed) : state(seed) { }
+
+	uint64_t next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1Dull;
+	}
+
+	uint64_t next_below(uint64_t bound) { return next() % bound; }
+};
+
+// Every benchmark folds its results into this, so that the optimizer can't throw the work away.
+static volatile uint64_t benchmarkSink;
+
+static const char* benchmarkFilter = nullptr;
+
+// Runs func() (which does opsPerCall operations) callsPerRepetition times per repetition and prints the min and the median time per operation.
+template <typename func_t>
+static void runBenchmark(const char* name, const std::string& parameter, size_t callsPerRepetition, size_t opsPerCall, func_t func) {
+	if (benchmarkFilter && !std::strstr(name, benchmarkFilter)) { return; }
+
+	uint64_t sink = 0;
+	for (size_t i = 0; i < callsPerRepetition / 8 + 1; i++) { sink += func(); }		// NOTE: Warm-up, for the caches and the branch predictor.
+
+	double timesPerOp[BENCHMARK_REPETITIONS];
+	for (size_t repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < callsPerRepetition; i++) { sink += func(); }
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		timesPerOp[repetition] = std::chrono::duration<double, std::nano>(end - start).count() / ((double)callsPerRepetition * opsPerCall);
+	}
+	benchmarkSink = benchmarkSink + sink;
+
+	std::sort(timesPerOp, timesPerOp + BENCHMARK_REPETITIONS);
+	std::printf("%s,%s,%zu,%.3f,%.3f\n", name, parameter.c_str(), callsPerRepetition * opsPerCall, timesPerOp[0], timesPerOp[BENCHMARK_REPETITIONS / 2]);
+	std::fflush(stdout);
+}
+
+static void benchmarkVersionStrings() {
+	struct VersionStringCase {
+		const char* parameter;
+		std::string string;
+	};
+
+	std::vector<VersionStringCase> cases;
+	cases.push_back({ "typical", "OpenCL 3.0 CUDA 12.2.140" });
+	cases.push_back({ "short", "OpenCL 1.2" });
+	cases.push_back({ "vendor_prefix", "OpenCL 2.1 AMD-APP (3444.0)" });
+	// NOTE: The rest are the pathological ones. Long junk before the version, numbers that overflow and get skipped,
+	// lots of digit runs without dots, and no version at all.
+	cases.push_back({ "long_junk_prefix", std::string(4096, 'x') + " OpenCL 3.0" });
+	cases.push_back({ "overflowing_numbers", "OpenCL 99999999999999999999.1 70000.70000 3.0" });
+	std::string digitRuns = "OpenCL";
+	for (size_t i = 0; i < 512; i++) { digitRuns += " 12345"; }
+	digitRuns += " 1.2";
+	cases.push_back({ "digit_runs_without_dots", digitRuns });
+	cases.push_back({ "no_version", "OpenCL with no version number at all, just a long vendor string and nothing else" });
+
+	for (const VersionStringCase& versionCase : cases) {
+		const char* string = versionCase.string.c_str();
+		runBenchmark("convertOpenCLVersionStringToVersionIdentifier", versionCase.parameter, versionCase.string.length() > 1024 ? 20000 : 1000000, 1, [string]() {
+			VersionIdentifier version = convertOpenCLVersionStringToVersionIdentifier(string);
+			return (uint64_t)version.major * 65536 + version.minor;
+		});
+	}
+}
+
+static void benchmarkIntegerSqrt() {
+	BenchmarkRandom random(1);
+	const size_t inputCount = 4096;
+	std::vector<uint32_t> inputs32(inputCount);
+	std::vector<uint64_t> inputs64(inputCount);
+	for (size_t i = 0; i < inputCount; i++) {
+		inputs32[i] = (uint32_t)random.next();
+		inputs64[i] = random.next();
+	}
+
+	runBenchmark("integer_sqrt", "uint32_random", 200, inputCount, [&inputs32]() {
+		uint64_t sum = 0;
+		for (uint32_t input : inputs32) { sum += integer_sqrt(input); }
+		return sum;
+	});
+	runBenchmark("integer_sqrt", "uint64_random", 200, inputCount, [&inputs64]() {
+		uint64_t sum = 0;
+		for (uint64_t input : inputs64) { sum += integer_sqrt(input); }
+		return sum;
+	});
+}
+
+static void benchmarkBoundingBox() {
+	BenchmarkRandom random(2);
+	const size_t inputCount = 4096;
+
+	// NOTE: Work-group sizes are the common case, primes are the worst case for the divisor search.
+	std::vector<size_t> workGroupSizes(inputCount);
+	for (size_t i = 0; i < inputCount; i++) { workGroupSizes[i] = random.next_below(1024) + 1; }
+
+	std::vector<size_t> randomAreas(inputCount);
+	for (size_t i = 0; i < inputCount; i++) { randomAreas[i] = random.next_below((size_t)1 << 30) + 1; }
+
+	std::vector<size_t> primes;
+	for (size_t candidate = ((size_t)1 << 30) - 1; primes.size() < 64; candidate -= 2) {
+		bool isPrime = true;
+		for (size_t divisor = 3; divisor * divisor <= candidate; divisor += 2) {
+			if (candidate % divisor == 0) { isPrime = false; break; }
+		}
+		if (isPrime) { primes.push_back(candidate); }
+	}
+
+	std::vector<size_t> highlyComposite = { 720720, 1441440, 4324320, 8648640, 21621600, 36756720, 61261200, 367567200 };
+
+	runBenchmark("calcSmallestBoundingBox", "work_group_sizes", 100, workGroupSizes.size(), [&workGroupSizes]() {
+		uint64_t sum = 0;
+		for (size_t area : workGroupSizes) { sum += calcSmallestBoundingBox(area).first; }
+		return sum;
+	});
+	runBenchmark("calcSmallestBoundingBox", "random_below_2^30", 10, randomAreas.size(), [&randomAreas]() {
+		uint64_t sum = 0;
+		for (size_t area : randomAreas) { sum += calcSmallestBoundingBox(area).first; }
+		return sum;
+	});
+	runBenchmark("calcSmallestBoundingBox", "large_primes", 100, primes.size(), [&primes]() {
+		uint64_t sum = 0;
+		for (size_t area : primes) { sum += calcSmallestBoundingBox(area).first; }
+		return sum;
+	});
+	runBenchmark("calcSmallestBoundingBox", "highly_composite", 1000, highlyComposite.size(), [&highlyComposite]() {
+		uint64_t sum = 0;
+		for (size_t area : highlyComposite) { sum += calcSmallestBoundingBox(area).first; }
+		return sum;
+	});
+}
+
+// Builds a collection with fake handles. Device counts per context are random, but every context gets at least one device.
+static bool buildFakeDeviceCollection(OpenCLDeviceCollection& collection, size_t contextCount, size_t deviceCount, uint64_t seed) {
+	cl_int err;
+	OpenCLDeviceCollection result(err, contextCount, deviceCount);
+	if (err != CL_SUCCESS) { return false; }
+
+	BenchmarkRandom random(seed);
+	std::vector<size_t> boundaries;
+	for (size_t i = 0; i < contextCount - 1; i++) { boundaries.push_back(random.next_below(deviceCount - contextCount + 1)); }
+	std::sort(boundaries.begin(), boundaries.end());
+	for (size_t i = 0; i < contextCount - 1; i++) { result.contextEndIndices[i] = boundaries[i] + i + 1; }
+	result.contextEndIndices[contextCount - 1] = deviceCount;
+
+	// NOTE: The contexts stay nullptr, since the collection releases its contexts when it's destroyed and the lookup only needs contextEndIndices.
+	for (size_t i = 0; i < deviceCount; i++) { result.devices[i] = (cl_device_id)(uintptr_t)(i + 1); }
+
+	collection.swap(result);
+	return true;
+}
+
+static void benchmarkContextLookup() {
+	const size_t shapes[][2] = { { 1, 1 }, { 4, 16 }, { 64, 4096 }, { 1024, 65536 } };
+	for (const size_t* shape : shapes) {
+		OpenCLDeviceCollection collection;
+		if (!buildFakeDeviceCollection(collection, shape[0], shape[1], 3)) { std::fprintf(stderr, "out of memory\n"); return; }
+
+		BenchmarkRandom random(4);
+		std::vector<size_t> lookups(4096);
+		for (size_t& lookup : lookups) { lookup = random.next_below(shape[1]); }
+
+		runBenchmark("getContextIndexForDeviceIndex", std::to_string(shape[0]) + "_contexts_" + std::to_string(shape[1]) + "_devices", 200, lookups.size(),
+					 [&collection, &lookups]() {
+			uint64_t sum = 0;
+			for (size_t lookup : lookups) { sum += collection.getContextIndexForDeviceIndex(lookup); }
+			return sum;
+		});
+	}
+}
+
+// Max work-group sizes of the fake devices, indexed by handle - 1.
+static std::vector<size_t> fakeMaxWorkGroupSizes;
+
+static cl_int CL_API_CALL fakeClGetDeviceInfo(cl_device_id device, cl_device_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	if (param_name != CL_DEVICE_MAX_WORK_GROUP_SIZE || param_value_size < sizeof(size_t)) { return CL_INVALID_VALUE; }
+	*(size_t*)param_value = fakeMaxWorkGroupSizes[(uintptr_t)device - 1];
+	if (param_value_size_ret) { *param_value_size_ret = sizeof(size_t); }
+	return CL_SUCCESS;
+}
+
+static void benchmarkDeviceIndexCollections() {
+	clGetDeviceInfo = fakeClGetDeviceInfo;
+
+	const size_t deviceCounts[] = { 16, 1024, 65536 };
+	for (size_t deviceCount : deviceCounts) {
+		OpenCLDeviceCollection collection;
+		if (!buildFakeDeviceCollection(collection, 1, deviceCount, 5)) { std::fprintf(stderr, "out of memory\n"); return; }
+		BenchmarkRandom random(6);
+		fakeMaxWorkGroupSizes.resize(deviceCount);
+		for (size_t& size : fakeMaxWorkGroupSizes) { size = (size_t)64 << random.next_below(5); }
+
+		cl_int err;
+		OpenCLDeviceIndexCollection indices = collection.createDeviceIndexCollection(err);
+		if (err != CL_SUCCESS) { std::fprintf(stderr, "out of memory\n"); return; }
+
+		size_t calls = deviceCount >= 65536 ? 5 : 65536 / deviceCount;
+		std::string parameter = std::to_string(deviceCount) + "_devices";
+
+		runBenchmark("sort_by_increasing_max_work_group_size", parameter, calls, deviceCount, [&indices]() {
+			cl_int err;
+			OpenCLDeviceIndexCollection sorted = indices.sort_by_increasing_max_work_group_size(err);
+			return (uint64_t)err + sorted[0];
+		});
+		runBenchmark("sort_with_plain_comparator", parameter, calls, deviceCount, [&indices]() {
+			cl_int err;
+			OpenCLDeviceIndexCollection sorted = indices.sort(err, [](const size_t& left, const size_t& right) { return fakeMaxWorkGroupSizes[left] < fakeMaxWorkGroupSizes[right]; });
+			return (uint64_t)err + sorted[0];
+		});
+		runBenchmark("reverse", parameter, calls * 16, deviceCount, [&indices]() {
+			cl_int err;
+			OpenCLDeviceIndexCollection reversed = indices.reverse(err);
+			return (uint64_t)err + reversed[0];
+		});
+	}
+}
+
+static void benchmarkCustomVector() {
+	const size_t elementCounts[] = { 100, 10000, 1000000 };
+	for (size_t elementCount : elementCounts) {
+		size_t calls = 10000000 / elementCount;
+		std::string parameter = std::to_string(elementCount) + "_elements";
+
+		runBenchmark("custom_vector_push_back", parameter, calls, elementCount, [elementCount]() {
+			cl_int err;
+			custom_vector<size_t> vector(err);
+			for (size_t i = 0; i < elementCount && err == CL_SUCCESS; i++) { err = vector.push_back(i); }
+			return (uint64_t)err + vector.length;
+		});
+		runBenchmark("custom_vector_push_empty_back", parameter + "_chunks_of_7", calls, elementCount / 7, [elementCount]() {
+			cl_int err;
+			custom_vector<size_t> vector(err);
+			for (size_t i = 0; i < elementCount / 7 && err == CL_SUCCESS; i++) { err = vector.push_empty_back(7); }
+			return (uint64_t)err + vector.length;
+		});
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) { benchmarkFilter = argv[1]; }
+
+	std::printf("benchmark,parameter,iterations,min_ns_per_op,median_ns_per_op\n");
+	benchmarkVersionStrings();
+	benchmarkIntegerSqrt();
+	benchmarkBoundingBox();
+	benchmarkContextLookup();
+	benchmarkDeviceIndexCollections();
+	benchmarkCustomVector();
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Microbenchmark for integer_sqrt() and calcSmallestBoundingBox(), compared against the implementations they replaced.
+// Also checks that integer_sqrt() matches the definition and that calcSmallestBoundingBox() gives exactly the same results as the old scan.
+// Build with optimizations, for example: cl /O2 /std:c++20 /EHsc /I ..\include integer_math_benchmark.cpp
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <utility>
+
+// The bisection that integer_sqrt() used to be. NOTE: It returned 0 for an input of 1 and overflowed for inputs above roughly 2^(bits - 1),
+// so it only serves as a speed reference.
+template <typename uint_t>
+static uint_t bisection_integer_sqrt(uint_t input) {
+	uint_t spanStartIndex = 0;
+	uint_t spanLengthMinusOne = input;
+	while (true) {
+		spanLengthMinusOne /= 2;
+		if (spanLengthMinusOne == 0) { return spanStartIndex; }
+		uint_t half = spanStartIndex + spanLengthMinusOne;
+		uint_t squareHalf = half * half;
+		if (squareHalf > input) { spanLengthMinusOne--; continue; }
+		if (squareHalf < input) { spanStartIndex = half; continue; }
+		return half;
+	}
+}
+
+// The linear scan that calcSmallestBoundingBox() used to be.
+template <typename uint_t>
+static std::pair<uint_t, uint_t> linear_calcSmallestBoundingBox(uint_t area) {
+	uint_t root = integer_sqrt(area);
+	for (uint_t i = root; i >= 2; i--) {
+		if (area % i == 0) { return std::make_pair(i, area / i); }
+	}
+	return std::make_pair((uint_t)1, area);
+}
+
+static_assert(integer_sqrt(0u) == 0 && integer_sqrt(15u) == 3 && integer_sqrt(16u) == 4 && integer_sqrt(UINT64_MAX) == UINT32_MAX, "integer_sqrt isn't usable at compile time");
+static_assert(calcSmallestBoundingBox(1024u).first == 32 && calcSmallestBoundingBox(768u).first == 24, "calcSmallestBoundingBox isn't usable at compile time");
+
+// NOTE: Keeps the optimizer from throwing the benchmarked calls away.
+static volatile uint64_t sink;
+
+template <typename func_t>
+static double measureNanosecondsPerCall(func_t func, uint64_t first, uint64_t count) {
+	uint64_t accumulator = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint64_t i = first; i < first + count; i++) { accumulator += func(i); }
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	sink = accumulator;
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)count;
+}
+
+int main() {
+	for (uint32_t i = 0; i < (1u << 24); i++) {
+		uint32_t root = integer_sqrt(i);
+		if ((uint64_t)root * root > i || ((uint64_t)root + 1) * ((uint64_t)root + 1) <= i) {
+			printf("MISMATCH: integer_sqrt(%u) = %u\n", i, root);
+			return 1;
+		}
+	}
+	for (uint64_t i = UINT64_MAX; i > UINT64_MAX - (1u << 20); i--) {
+		uint64_t root = integer_sqrt(i);
+		if (root > UINT32_MAX || root * root > i || (root != UINT32_MAX && (root + 1) * (root + 1) <= i)) {
+			printf("MISMATCH: integer_sqrt(%llu) = %llu\n", (unsigned long long)i, (unsigned long long)root);
+			return 1;
+		}
+	}
+	for (uint64_t i = 0; i < (1u << 20); i++) {
+		if (calcSmallestBoundingBox(i) != linear_calcSmallestBoundingBox(i)) {
+			printf("MISMATCH: calcSmallestBoundingBox(%llu)\n", (unsigned long long)i);
+			return 1;
+		}
+	}
+	printf("results match\n");
+
+	const uint64_t callCount = 1 << 22;
+	printf("%-48s %12s %12s\n", "benchmark", "old ns/call", "new ns/call");
+
+	printf("%-48s %12.2f %12.2f\n", "integer_sqrt, inputs [2^20, 2^20 + 2^22)",
+		   measureNanosecondsPerCall([](uint64_t i) { return bisection_integer_sqrt(i); }, 1 << 20, callCount),
+		   measureNanosecondsPerCall([](uint64_t i) { return integer_sqrt(i); }, 1 << 20, callCount));
+
+	printf("%-48s %12.2f %12.2f\n", "integer_sqrt, inputs [2^40, 2^40 + 2^22)",
+		   measureNanosecondsPerCall([](uint64_t i) { return bisection_integer_sqrt(i); }, 1ULL << 40, callCount),
+		   measureNanosecondsPerCall([](uint64_t i) { return integer_sqrt(i); }, 1ULL << 40, callCount));
+
+	// NOTE: Work sizes are usually smooth numbers, so the interesting case is multiples of big powers of two.
+	printf("%-48s %12.2f %12.2f\n", "calcSmallestBoundingBox, 1024 * [1, 2^16)",
+		   measureNanosecondsPerCall([](uint64_t i) { return linear_calcSmallestBoundingBox(i * 1024).first; }, 1, 1 << 16),
+		   measureNanosecondsPerCall([](uint64_t i) { return calcSmallestBoundingBox(i * 1024).first; }, 1, 1 << 16));
+
+	printf("%-48s %12.2f %12.2f\n", "calcSmallestBoundingBox, [2^24, 2^24 + 2^16)",
+		   measureNanosecondsPerCall([](uint64_t i) { return linear_calcSmallestBoundingBox(i).first; }, 1 << 24, 1 << 16),
+		   measureNanosecondsPerCall([](uint64_t i) { return calcSmallestBoundingBox(i).first; }, 1 << 24, 1 << 16));
+
+	return 0;
+}
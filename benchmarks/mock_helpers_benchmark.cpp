@@ -0,0 +1,234 @@
+// Benchmarks and stress tests for the helpers of cl_bindings_and_helpers.h that talk to OpenCL: getAllOpenCLDevices(),
+// initOpenCLVarsForBestDevice() and setupComputeKernelFromString(). They run against the mock OpenCL library (see mock_icd), which
+// goes through initOpenCLBindings() like a real OpenCL.dll would, so the numbers are the host-side cost of the helpers without driver noise.
+// Output is CSV on stdout. The benchmarks print the same columns as helpers_benchmark:
+// benchmark,parameter,iterations,min_ns_per_op,median_ns_per_op
+// The stress tests inject failures into every OpenCL function the helpers use, at several failure periods, and print
+// stress,failing_function,failure_period,helper_failures,leaked_objects
+// Exits with 1 if anything leaked or a check failed, so it can double as a test.
+// Usage: mock_helpers_benchmark [path\to\mock_opencl.dll] [benchmark name filter]. The path defaults to ..\mock_icd\mock_opencl.dll.
+// Build the mock with build_mock_opencl.bat first, then build this with build_benchmarks.bat, or for example:
+// cl /O2 /std:c++20 /EHsc /I ..\include /I ..\mock_icd mock_helpers_benchmark.cpp ..\src\cl_bindings_and_helpers.cpp
+
+#include "cl_bindings_and_helpers.h"
+#include "mock_opencl.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <string>
+
+#define BENCHMARK_REPETITIONS 9
+
+// Every benchmark folds its results into this, so that the optimizer can't throw the work away.
+static volatile uint64_t benchmarkSink;
+
+static const char* benchmarkFilter = nullptr;
+
+static mockOpenCLSetConfig_func mockOpenCLSetConfig;
+static mockOpenCLGetLiveObjectCount_func mockOpenCLGetLiveObjectCount;
+
+static bool checksFailed = false;
+
+// Runs func() callsPerRepetition times per repetition and prints the min and the median time per call.
+template <typename func_t>
+static void runBenchmark(const char* name, const std::string& parameter, size_t callsPerRepetition, func_t func) {
+	if (benchmarkFilter && !std::strstr(name, benchmarkFilter)) { return; }
+
+	uint64_t sink = 0;
+	for (size_t i = 0; i < callsPerRepetition / 8 + 1; i++) { sink += func(); }		// NOTE: Warm-up, for the caches and the branch predictor.
+
+	double timesPerOp[BENCHMARK_REPETITIONS];
+	for (size_t repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < callsPerRepetition; i++) { sink += func(); }
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		timesPerOp[repetition] = std::chrono::duration<double, std::nano>(end - start).count() / (double)callsPerRepetition;
+	}
+	benchmarkSink = benchmarkSink + sink;
+
+	std::sort(timesPerOp, timesPerOp + BENCHMARK_REPETITIONS);
+	std::printf("%s,%s,%zu,%.3f,%.3f\n", name, parameter.c_str(), callsPerRepetition, timesPerOp[0], timesPerOp[BENCHMARK_REPETITIONS / 2]);
+	std::fflush(stdout);
+}
+
+static void check(bool condition, const char* what) {
+	if (condition) { return; }
+	std::fprintf(stderr, "check failed: %s\n", what);
+	checksFailed = true;
+}
+
+// NOTE: A few kernels in front of the one that gets created, so that the build has something to chew on.
+static std::string generateKernelSource(size_t kernelCount) {
+	std::string source;
+	for (size_t i = 0; i < kernelCount; i++) {
+		source += "__kernel void kernel" + std::to_string(i) + "(__global float* output, __global const float* input, uint count) {\n"
+				  "\tsize_t index = get_global_id(0);\n"
+				  "\tif (index < count) { output[index] = input[index] * " + std::to_string(i + 1) + ".0f; }\n"
+				  "}\n";
+	}
+	return source;
+}
+
+static void benchmarkHelpers() {
+	struct TopologyCase {
+		const char* parameter;
+		cl_uint platformCount;
+		cl_uint devicesPerPlatform;
+	};
+	const TopologyCase topologies[] = { { "1x1", 1, 1 }, { "4x4", 4, 4 }, { "16x8", 16, 8 } };
+
+	for (const TopologyCase& topology : topologies) {
+		MockOpenCLConfig config;
+		config.platform_count = topology.platformCount;
+		config.devices_per_platform = topology.devicesPerPlatform;
+		mockOpenCLSetConfig(&config);
+
+		runBenchmark("getAllOpenCLDevices", topology.parameter, 2000, []() {
+			cl_int err;
+			OpenCLDeviceCollection collection = getAllOpenCLDevices(err, VersionIdentifier(1, 2));
+			return (uint64_t)err + collection.devices_length;
+		});
+
+		runBenchmark("initOpenCLVarsForBestDevice", topology.parameter, 2000, []() {
+			cl_platform_id platform;
+			cl_device_id device;
+			OpenCLContext context;
+			OpenCLCommandQueue commandQueue;
+			cl_int err = initOpenCLVarsForBestDevice(VersionIdentifier(1, 2), platform, device, context, commandQueue);
+			return (uint64_t)err + (uintptr_t)device;
+		});
+	}
+
+	MockOpenCLConfig config;
+	mockOpenCLSetConfig(&config);
+	cl_platform_id platform;
+	cl_device_id device;
+	OpenCLContext context;
+	OpenCLCommandQueue commandQueue;
+	cl_int err = initOpenCLVarsForBestDevice(VersionIdentifier(1, 2), platform, device, context, commandQueue);
+	check(err == CL_SUCCESS, "initOpenCLVarsForBestDevice() for the kernel benchmarks");
+	if (err != CL_SUCCESS) { return; }
+
+	const size_t kernelCounts[] = { 1, 64, 1024 };
+	for (size_t kernelCount : kernelCounts) {
+		std::string source = generateKernelSource(kernelCount);
+		std::string kernelName = "kernel" + std::to_string(kernelCount - 1);
+		cl_context rawContext = context;
+		runBenchmark("setupComputeKernelFromString", std::to_string(kernelCount) + "_kernels", kernelCount > 64 ? 200 : 5000, [&]() {
+			OpenCLProgram program;
+			OpenCLKernel kernel;
+			size_t kernelWorkGroupSize = 0;
+			std::string buildLog;
+			cl_int err = setupComputeKernelFromString(rawContext, device, source.c_str(), kernelName.c_str(), program, kernel, kernelWorkGroupSize, buildLog);
+			return (uint64_t)err + kernelWorkGroupSize;
+		});
+	}
+}
+
+// Runs every helper once against the current configuration. Returns how many of them failed.
+static uint64_t runHelpersOnce() {
+	uint64_t failures = 0;
+
+	{
+		cl_int err;
+		OpenCLDeviceCollection collection = getAllOpenCLDevices(err, VersionIdentifier(1, 2));
+		if (err != CL_SUCCESS) { failures++; }
+	}
+
+	cl_platform_id platform;
+	cl_device_id device;
+	OpenCLContext context;
+	OpenCLCommandQueue commandQueue;
+	cl_int err = initOpenCLVarsForBestDevice(VersionIdentifier(1, 2), platform, device, context, commandQueue);
+	if (err != CL_SUCCESS) { return failures + 2; }		// NOTE: The kernel setup needs a context, so it counts as failed too.
+
+	std::string source = generateKernelSource(4);
+	OpenCLProgram program;
+	OpenCLKernel kernel;
+	size_t kernelWorkGroupSize;
+	std::string buildLog;
+	err = setupComputeKernelFromString(context, device, source.c_str(), "kernel3", program, kernel, kernelWorkGroupSize, buildLog);
+	if (err != CL_SUCCESS) { failures++; }
+	return failures;
+}
+
+static void stressTestHelpers() {
+	// NOTE: Every function that one of the three helpers calls, see the lists above their declarations. Except for the clRelease* functions,
+	// because a release that fails doesn't release anything, so those would show up as leaks that aren't the helpers' fault.
+	const char* const functions[] = {
+		"clGetPlatformIDs", "clGetPlatformInfo", "clGetDeviceIDs", "clGetDeviceInfo", "clCreateContext", "clCreateCommandQueue",
+		"clRetainContext", "clCreateProgramWithSource", "clBuildProgram", "clGetProgramBuildInfo", "clCreateKernel", "clGetKernelWorkGroupInfo"
+	};
+	const uint64_t failurePeriods[] = { 1, 2, 3, 7 };
+
+	for (const char* function : functions) {
+		for (uint64_t failurePeriod : failurePeriods) {
+			MockOpenCLConfig config;
+			config.platform_count = 3;
+			config.devices_per_platform = 3;
+			config.failing_function = function;
+			config.failure_period = failurePeriod;
+			mockOpenCLSetConfig(&config);
+
+			uint64_t failures = 0;
+			for (size_t i = 0; i < 16; i++) { failures += runHelpersOnce(); }
+
+			// NOTE: Whether a helper gets through an injected failure depends on the function (some failures only skip a platform or a
+			// device), but no matter what, everything the helpers created has to be released again by now.
+			size_t leakedObjects = mockOpenCLGetLiveObjectCount();
+			std::printf("stress,%s,%llu,%llu,%zu\n", function, (unsigned long long)failurePeriod, (unsigned long long)failures, leakedObjects);
+			std::fflush(stdout);
+			check(leakedObjects == 0, "no objects leaked under error injection");
+			// NOTE: Otherwise the next test would count this test's leaks too.
+			if (leakedObjects) { return; }
+		}
+	}
+
+	// NOTE: Platforms below the minimum version have to be skipped, even if they come first.
+	const char* const platformVersions[] = { "OpenCL 1.1 Mock Platform", "OpenCL 3.0 Mock Platform" };
+	MockOpenCLConfig config;
+	config.platform_count = 2;
+	config.platform_versions = platformVersions;
+	mockOpenCLSetConfig(&config);
+	cl_platform_id platform;
+	cl_device_id device;
+	OpenCLContext context;
+	OpenCLCommandQueue commandQueue;
+	cl_int err = initOpenCLVarsForBestDevice(VersionIdentifier(1, 2), platform, device, context, commandQueue);
+	check(err == CL_SUCCESS, "initOpenCLVarsForBestDevice() with a platform below the minimum version");
+	if (err == CL_SUCCESS) {
+		char version[64] = { };
+		clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(version) - 1, version, nullptr);
+		check(std::strcmp(version, platformVersions[1]) == 0, "initOpenCLVarsForBestDevice() skips platforms below the minimum version");
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* mockPath = argc > 1 ? argv[1] : "..\\mock_icd\\mock_opencl.dll";
+	if (argc > 2) { benchmarkFilter = argv[2]; }
+
+	cl_int err = initOpenCLBindings(mockPath);
+	if (err != CL_SUCCESS) { std::fprintf(stderr, "initOpenCLBindings(\"%s\") failed with %d\n", mockPath, err); return 1; }
+
+	// NOTE: Loading the same path again just gives back the module that initOpenCLBindings() loaded (with one more reference).
+	HMODULE mockModule = LoadLibraryA(mockPath);
+	mockOpenCLSetConfig = (mockOpenCLSetConfig_func)GetProcAddress(mockModule, "mockOpenCLSetConfig");
+	mockOpenCLGetLiveObjectCount = (mockOpenCLGetLiveObjectCount_func)GetProcAddress(mockModule, "mockOpenCLGetLiveObjectCount");
+	if (!mockOpenCLSetConfig || !mockOpenCLGetLiveObjectCount) { std::fprintf(stderr, "%s isn't the mock OpenCL library\n", mockPath); return 1; }
+
+	std::printf("benchmark,parameter,iterations,min_ns_per_op,median_ns_per_op\n");
+	benchmarkHelpers();
+
+	std::printf("stress,failing_function,failure_period,helper_failures,leaked_objects\n");
+	stressTestHelpers();
+
+	FreeLibrary(mockModule);
+	freeOpenCLLib();
+	return checksFailed ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+
+#include <cstdint>			// for fixed-width types
+#include <map>				// for std::map
+
+// NOTE: The kernelWorkGroupSize that setupComputeKernelFromString() gives back is just CL_KERNEL_WORK_GROUP_SIZE rounded down to the preferred
+// multiple, which is a decent guess and nothing more. The autotuner times a set of candidate local sizes with the arguments that are currently
+// set on the kernel and picks the fastest one. Results go into a WorkGroupTuningDatabase, which can be saved to and loaded from a file,
+// so that later runs don't have to measure again.
+// NOTE: Results are keyed by a hash of the program source, build options and kernel name, a hash of the device name and driver version and
+// the size class of the global size (each dimension rounded up to the next power of two, see calcWorkSizeClass()), since the best local size
+// depends on all of those. The build options are in there so that variants of one source (see cl_kernel_variants.h) get tuned separately.
+// NOTE: Timing is done on the host around clFinish, so it works on every implementation (including CPU ones) and doesn't need a profiling queue.
+
+// Base two logarithm of the size, rounded up. Shared with the kernel variant selector, so that both group global sizes the same way.
+constexpr cl_uint calcWorkSizeClass(size_t size) noexcept {
+	cl_uint sizeClass = 0;
+	while (sizeClass < sizeof(size_t) * 8 && ((size_t)1 << sizeClass) < size) { sizeClass++; }
+	return sizeClass;
+}
+
+struct WorkGroupTuningKey {
+	uint64_t kernel_hash;
+	uint64_t device_hash;
+	cl_uint dimensions;
+	cl_uint size_class[3];		// NOTE: Base two logarithm of each global size, rounded up.
+
+	bool operator<(const WorkGroupTuningKey& right) const noexcept;
+};
+
+struct WorkGroupTuningResult {
+	NDRange local_size;			// NOTE: 0 dimensions means the implementation's own choice was fastest.
+	uint64_t time;				// NOTE: Fastest measured launch in nanoseconds (host-side, including launch overhead).
+};
+
+class WorkGroupTuningDatabase {
+	std::map<WorkGroupTuningKey, WorkGroupTuningResult> entries;
+
+public:
+	// Adds the entries from the file to the database. Entries that are already in the database get overwritten.
+	// Returns CL_EXT_FILE_OPEN_FAILED if the file doesn't exist, which you can safely ignore on the first run.
+	cl_int load(const char* path) noexcept;
+
+	// Writes every entry to the file, replacing whatever was there before.
+	cl_int save(const char* path) const noexcept;
+
+	bool lookup(const WorkGroupTuningKey& key, WorkGroupTuningResult& result) const noexcept;
+
+	void store(const WorkGroupTuningKey& key, const WorkGroupTuningResult& result) noexcept;
+
+	size_t get_entry_count() const noexcept { return entries.size(); }
+
+	void clear() noexcept { entries.clear(); }
+};
+
+// NOTE: Uses clGetKernelInfo, clGetProgramInfo, clGetProgramBuildInfo and clGetDeviceInfo.
+cl_int getWorkGroupTuningKey(cl_kernel kernel, cl_device_id device, const NDRange& globalSize, WorkGroupTuningKey& key) noexcept;
+
+// Finds the fastest local size for launching the kernel with the given global size and the arguments that are currently set.
+// If the database has a result for this kernel, device and global size class that evenly divides the global size, that result gets
+// used without measuring anything. Otherwise every candidate gets launched once to warm up and then repetitions times, the fastest
+// launch of each candidate counts, and the winner gets stored in the database.
+// NOTE: Candidates are every combination of powers of two (per dimension) that evenly divides the global size, respects
+// CL_DEVICE_MAX_WORK_ITEM_SIZES and fits into CL_KERNEL_WORK_GROUP_SIZE, plus the implementation's own choice.
+// Candidates that the implementation refuses to launch get skipped.
+// NOTE: The kernel actually runs, so make sure it's fine to run it (repetitions + 1) times per candidate with the current arguments.
+cl_int tuneWorkGroupSize(cl_command_queue queue, cl_kernel kernel, cl_device_id device, const NDRange& globalSize, NDRange& bestLocalSize,
+						 WorkGroupTuningDatabase* database = nullptr, cl_uint repetitions = 5) noexcept;
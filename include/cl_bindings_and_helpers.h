@@ -11,6 +11,12 @@
 
 #include <utility>			// for std::pair
 
+#include <type_traits>		// for std::is_trivially_copyable and friends
+
+#include <cstring>			// for std::memcpy
+
+#include <cstddef>			// for std::max_align_t
+
 // NOTE: These almost definitely only work in Windows, so if you ever want to port this to another system, these definitely need to change.
 #define CL_API_CALL _stdcall		// Calling covention for the OpenCL API calls.
 #define CL_CALLBACK _stdcall		// Calling convention for the OpenCL callback functions.
@@ -128,6 +134,16 @@
 #define CL_EXT_CREATE_KERNEL_FAILED			13
 #define CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED	14
 
+#define CL_EXT_EVENT_GRAPH_CYCLE_DETECTED		15
+#define CL_EXT_EVENT_GRAPH_INVALID_NODE			16
+#define CL_EXT_EVENT_POOL_EXHAUSTED			17
+#define CL_EXT_KERNEL_ARG_COUNT_MISMATCH		18
+#define CL_EXT_KERNEL_WRONG_THREAD			19
+#define CL_EXT_COMMAND_RECORDING_FINALIZED		20
+#define CL_EXT_COMMAND_RECORDING_INVALID_COMMAND	21
+#define CL_EXT_KERNEL_INCLUDE_CYCLE			22
+#define CL_EXT_FUNCTION_UNAVAILABLE			23		// NOTE: An optional entry point that the loaded OpenCL.dll doesn't export (see initOpenCLBindings()).
+
 /* cl_bool */
 #define CL_FALSE                                    0
 #define CL_TRUE                                     1
@@ -316,6 +332,19 @@
 #define CL_MEM_KERNEL_READ_AND_WRITE                (1 << 12)
 // end introduction
 
+/* cl_map_flags - bitfield */
+#define CL_MAP_READ                                 (1 << 0)
+#define CL_MAP_WRITE                                (1 << 1)
+// introduced in version 1.2
+#define CL_MAP_WRITE_INVALIDATE_REGION              (1 << 2)
+// end introduction
+
+// introduced in version 1.2
+/* cl_mem_migration_flags - bitfield */
+#define CL_MIGRATE_MEM_OBJECT_HOST                  (1 << 0)
+#define CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED     (1 << 1)
+// end introduction
+
 /* cl_channel_order */
 #define CL_R                                        0x10B0											// Order of the channels when creating an image.
 #define CL_A                                        0x10B1
@@ -368,6 +397,23 @@
 #define CL_UNORM_INT_101010_2                       0x10E0
 // end introduction
 
+/* cl_command_queue_properties - bitfield */
+#define CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE      (1 << 0)
+#define CL_QUEUE_PROFILING_ENABLE                   (1 << 1)
+
+/* cl_program_info */
+#define CL_PROGRAM_REFERENCE_COUNT                  0x1160
+#define CL_PROGRAM_CONTEXT                          0x1161
+#define CL_PROGRAM_NUM_DEVICES                      0x1162
+#define CL_PROGRAM_DEVICES                          0x1163
+#define CL_PROGRAM_SOURCE                           0x1164
+#define CL_PROGRAM_BINARY_SIZES                     0x1165
+#define CL_PROGRAM_BINARIES                         0x1166
+// introduced in version 1.2
+#define CL_PROGRAM_NUM_KERNELS                      0x1167
+#define CL_PROGRAM_KERNEL_NAMES                     0x1168
+// end introduction
+
 /* cl_program_build_info */
 #define CL_PROGRAM_BUILD_STATUS                     0x1181
 #define CL_PROGRAM_BUILD_OPTIONS                    0x1182
@@ -389,6 +435,69 @@
 #define CL_KERNEL_GLOBAL_WORK_SIZE						0x11B5
 // end introduction
 
+/* cl_event_info */
+#define CL_EVENT_COMMAND_QUEUE                      0x11D0
+#define CL_EVENT_COMMAND_TYPE                       0x11D1
+#define CL_EVENT_REFERENCE_COUNT                    0x11D2
+#define CL_EVENT_COMMAND_EXECUTION_STATUS           0x11D3
+// introduced in version 1.1
+#define CL_EVENT_CONTEXT                            0x11D4
+// end introduction
+
+/* cl_image_info */
+#define CL_IMAGE_FORMAT                             0x1110
+#define CL_IMAGE_ELEMENT_SIZE                       0x1111
+#define CL_IMAGE_ROW_PITCH                          0x1112
+#define CL_IMAGE_SLICE_PITCH                        0x1113
+#define CL_IMAGE_WIDTH                              0x1114
+#define CL_IMAGE_HEIGHT                             0x1115
+#define CL_IMAGE_DEPTH                              0x1116
+
+/* cl_kernel_info */
+#define CL_KERNEL_FUNCTION_NAME                     0x1190
+#define CL_KERNEL_NUM_ARGS                          0x1191
+#define CL_KERNEL_REFERENCE_COUNT                   0x1192
+#define CL_KERNEL_CONTEXT                           0x1193
+#define CL_KERNEL_PROGRAM                           0x1194
+// introduced in version 1.2
+#define CL_KERNEL_ATTRIBUTES                        0x1195
+// end introduction
+
+/* command execution status */
+#define CL_COMPLETE                                 0x0
+#define CL_RUNNING                                  0x1
+#define CL_SUBMITTED                                0x2
+#define CL_QUEUED                                   0x3
+
+/* cl_profiling_info */
+#define CL_PROFILING_COMMAND_QUEUED                 0x1280
+#define CL_PROFILING_COMMAND_SUBMIT                 0x1281
+#define CL_PROFILING_COMMAND_START                  0x1282
+#define CL_PROFILING_COMMAND_END                    0x1283
+// introduced in version 2.0
+#define CL_PROFILING_COMMAND_COMPLETE               0x1284
+// end introduction
+
+// introduced in version 3.0
+#define CL_NAME_VERSION_MAX_NAME_SIZE               64
+#define CL_VERSION_MAJOR_BITS                       10
+#define CL_VERSION_MINOR_BITS                       10
+#define CL_VERSION_PATCH_BITS                       12
+#define CL_MAKE_VERSION(major, minor, patch) \
+	((((major) & 0x3FF) << (CL_VERSION_MINOR_BITS + CL_VERSION_PATCH_BITS)) | (((minor) & 0x3FF) << CL_VERSION_PATCH_BITS) | ((patch) & 0xFFF))
+// end introduction
+
+/* cl_khr_command_buffer */
+// NOTE: The extension is still provisional and its entry points changed signatures between versions, so only use the function typedefs
+// below with an implementation that reports version 0.9.5 or newer in CL_DEVICE_EXTENSIONS_WITH_VERSION (see cl_command_recording.h).
+#define CL_EXT_KHR_COMMAND_BUFFER_NAME              "cl_khr_command_buffer"
+#define CL_EXT_KHR_COMMAND_BUFFER_MIN_VERSION       CL_MAKE_VERSION(0, 9, 5)
+#define CL_INVALID_COMMAND_BUFFER_KHR               -1138
+#define CL_INVALID_SYNC_POINT_WAIT_LIST_KHR         -1139
+#define CL_INCOMPATIBLE_COMMAND_QUEUE_KHR           -1140
+#define CL_COMMAND_BUFFER_FLAGS_KHR                 0x1293
+#define CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR      (1 << 0)
+
 // Simple type definitions for basic fixed-width, OpenCL compatible types.
 typedef int32_t cl_int;
 typedef uint32_t cl_uint;
@@ -416,15 +525,20 @@ typedef cl_bitfield cl_command_queue_properties;
 
 // Programs
 typedef struct _cl_program* cl_program;
+typedef cl_uint cl_program_info;
 typedef cl_uint cl_program_build_info;
 
 // Kernels
 typedef struct _cl_kernel* cl_kernel;
+typedef cl_uint cl_kernel_info;
 typedef cl_uint cl_kernel_work_group_info;
 
 // Memory
 typedef struct _cl_mem* cl_mem;
 typedef cl_bitfield cl_mem_flags;
+typedef cl_bitfield cl_map_flags;
+typedef cl_bitfield cl_mem_migration_flags;
+typedef cl_uint cl_image_info;
 
 // Image format
 typedef cl_uint             cl_channel_order;
@@ -432,6 +546,24 @@ typedef cl_uint             cl_channel_type;
 
 // Events
 typedef struct _cl_event* cl_event;
+typedef cl_uint cl_event_info;
+typedef cl_uint cl_profiling_info;
+
+// introduced in version 3.0
+typedef cl_uint cl_version;
+
+struct cl_name_version {
+	cl_version version;
+	char name[CL_NAME_VERSION_MAX_NAME_SIZE];
+};
+// end introduction
+
+// cl_khr_command_buffer
+typedef struct _cl_command_buffer_khr* cl_command_buffer_khr;
+typedef struct _cl_mutable_command_khr* cl_mutable_command_khr;
+typedef cl_uint cl_sync_point_khr;
+typedef cl_ulong cl_command_buffer_properties_khr;
+typedef cl_ulong cl_command_properties_khr;
 
 // Image format struct
 struct cl_image_format {
@@ -501,6 +633,17 @@ typedef cl_program (CL_API_CALL* clCreateProgramWithSource_func)(cl_context cont
 // Creates an OpenCL program with the specified source.
 inline clCreateProgramWithSource_func clCreateProgramWithSource;
 
+typedef cl_program (CL_API_CALL* clCreateProgramWithBinary_func)(cl_context context, 
+																 cl_uint num_devices, 
+																 const cl_device_id* device_list, 
+																 const size_t* lengths, 
+																 const unsigned char** binaries, 
+																 cl_int* binary_status, 
+																 cl_int* errcode_ret);
+// Creates an OpenCL program from binaries that were previously queried with CL_PROGRAM_BINARIES (one per device). The program still has to
+// be built with clBuildProgram, which is cheap for device binaries. Implementations reject binaries from other devices or driver versions.
+inline clCreateProgramWithBinary_func clCreateProgramWithBinary;
+
 typedef cl_int (CL_API_CALL* clBuildProgram_func)(cl_program program, 
 												  cl_uint num_devices, 
 												  const cl_device_id* device_list, 
@@ -510,6 +653,14 @@ typedef cl_int (CL_API_CALL* clBuildProgram_func)(cl_program program,
 // Builds an OpenCL program which was created with clCreateProgramWithSource.
 inline clBuildProgram_func clBuildProgram;
 
+typedef cl_int (CL_API_CALL* clGetProgramInfo_func)(cl_program program, 
+													cl_program_info param_name, 
+													size_t param_value_size, 
+													void* param_value, 
+													size_t* param_value_size_ret);
+// Gets program info, like the source code that the program was created with or the devices it's associated with.
+inline clGetProgramInfo_func clGetProgramInfo;
+
 typedef cl_int (CL_API_CALL* clGetProgramBuildInfo_func)(cl_program program, 
 														 cl_device_id device, 
 														 cl_program_build_info param_name, 
@@ -544,6 +695,14 @@ typedef cl_mem (CL_API_CALL* clCreateImage2D_func)(cl_context context,
 // Creates a 2D image. This is essentially the same thing as a normal buffer, except you can access it in 2D and it contains various image channels (RGBA and such).
 inline clCreateImage2D_func clCreateImage2D;
 
+typedef cl_int (CL_API_CALL* clGetImageInfo_func)(cl_mem image, 
+												  cl_image_info param_name, 
+												  size_t param_value_size, 
+												  void* param_value, 
+												  size_t* param_value_size_ret);
+// Gets image info, like the dimensions or the size of one pixel.
+inline clGetImageInfo_func clGetImageInfo;
+
 typedef cl_int (CL_API_CALL* clSetKernelArg_func)(cl_kernel kernel, 
 												  cl_uint arg_index, 
 												  size_t arg_size, 
@@ -551,6 +710,14 @@ typedef cl_int (CL_API_CALL* clSetKernelArg_func)(cl_kernel kernel,
 // Sets kernel arguments.
 inline clSetKernelArg_func clSetKernelArg;
 
+typedef cl_int (CL_API_CALL* clGetKernelInfo_func)(cl_kernel kernel, 
+												   cl_kernel_info param_name, 
+												   size_t param_value_size, 
+												   void* param_value, 
+												   size_t* param_value_size_ret);
+// Gets kernel info, like the function name or the amount of args that the kernel takes.
+inline clGetKernelInfo_func clGetKernelInfo;
+
 typedef cl_int (CL_API_CALL* clGetKernelWorkGroupInfo_func)(cl_kernel kernel, 
 															cl_device_id device, 
 															cl_kernel_work_group_info param_name, 
@@ -632,56 +799,300 @@ typedef cl_int (CL_API_CALL* clEnqueueReadImage_func)(cl_command_queue command_q
 // Enqueues an image read on the command queue. You can set the blocking_read flag in order to wait for this function to finish without using clFinish.
 inline clEnqueueReadImage_func clEnqueueReadImage;
 
+typedef cl_int (CL_API_CALL* clEnqueueCopyBuffer_func)(cl_command_queue command_queue, 
+														cl_mem src_buffer, 
+														cl_mem dst_buffer, 
+														size_t src_offset, 
+														size_t dst_offset, 
+														size_t size, 
+														cl_uint num_events_in_wait_list, 
+														const cl_event* event_wait_list, 
+														cl_event* event);
+// Enqueues a device-side copy from one buffer to another. Doesn't touch host memory at all.
+inline clEnqueueCopyBuffer_func clEnqueueCopyBuffer;
+
+typedef void* (CL_API_CALL* clEnqueueMapBuffer_func)(cl_command_queue command_queue, 
+													 cl_mem buffer, 
+													 cl_bool blocking_map, 
+													 cl_map_flags map_flags, 
+													 size_t offset, 
+													 size_t size, 
+													 cl_uint num_events_in_wait_list, 
+													 const cl_event* event_wait_list, 
+													 cl_event* event, 
+													 cl_int* errcode_ret);
+// Maps a region of a buffer into host memory and returns the host pointer. With CL_MEM_ALLOC_HOST_PTR buffers, that's usually pinned memory,
+// which the implementation can DMA from and to directly.
+inline clEnqueueMapBuffer_func clEnqueueMapBuffer;
+
+typedef cl_int (CL_API_CALL* clEnqueueUnmapMemObject_func)(cl_command_queue command_queue, 
+														   cl_mem memobj, 
+														   void* mapped_ptr, 
+														   cl_uint num_events_in_wait_list, 
+														   const cl_event* event_wait_list, 
+														   cl_event* event);
+// Unmaps a region that was mapped with clEnqueueMapBuffer().
+inline clEnqueueUnmapMemObject_func clEnqueueUnmapMemObject;
+
+// introduced in version 1.2
+typedef cl_int (CL_API_CALL* clEnqueueMigrateMemObjects_func)(cl_command_queue command_queue, 
+															  cl_uint num_mem_objects, 
+															  const cl_mem* mem_objects, 
+															  cl_mem_migration_flags flags, 
+															  cl_uint num_events_in_wait_list, 
+															  const cl_event* event_wait_list, 
+															  cl_event* event);
+// Moves memory objects to the device of the queue (or to the host with CL_MIGRATE_MEM_OBJECT_HOST), ahead of the commands that use them.
+// Only works within one context, since that's where memory objects live.
+// NOTE: OpenCL 1.2, optional (nullptr with older libraries).
+inline clEnqueueMigrateMemObjects_func clEnqueueMigrateMemObjects;
+// end introduction
+
+// introduced in version 1.2
+typedef cl_int (CL_API_CALL* clEnqueueMarkerWithWaitList_func)(cl_command_queue command_queue, 
+															   cl_uint num_events_in_wait_list, 
+															   const cl_event* event_wait_list, 
+															   cl_event* event);
+// Enqueues a marker, which completes once every event in the wait list has completed (or every previous command in the queue if the wait list is empty).
+// NOTE: OpenCL 1.2, optional (nullptr with older libraries).
+inline clEnqueueMarkerWithWaitList_func clEnqueueMarkerWithWaitList;
+// end introduction
+
+typedef cl_int (CL_API_CALL* clWaitForEvents_func)(cl_uint num_events, 
+												   const cl_event* event_list);
+// Blocks the host thread until every event in the list has completed.
+inline clWaitForEvents_func clWaitForEvents;
+
+typedef cl_int (CL_API_CALL* clGetEventInfo_func)(cl_event event, 
+												  cl_event_info param_name, 
+												  size_t param_value_size, 
+												  void* param_value, 
+												  size_t* param_value_size_ret);
+// Gets event info for a specific event. Mostly useful for polling the execution status without blocking.
+inline clGetEventInfo_func clGetEventInfo;
+
+// introduced in version 1.1
+typedef cl_event (CL_API_CALL* clCreateUserEvent_func)(cl_context context, 
+													   cl_int* errcode_ret);
+// Creates an event whose status is controlled by the host instead of the device. Useful for making device commands wait on host work.
+// NOTE: OpenCL 1.1, optional (nullptr with older libraries).
+inline clCreateUserEvent_func clCreateUserEvent;
+
+typedef cl_int (CL_API_CALL* clSetUserEventStatus_func)(cl_event event, 
+														cl_int execution_status);
+// Sets the status of a user event. Can only be done once per user event.
+// NOTE: OpenCL 1.1, optional (nullptr with older libraries).
+inline clSetUserEventStatus_func clSetUserEventStatus;
+
+typedef cl_int (CL_API_CALL* clSetEventCallback_func)(cl_event event, 
+													  cl_int command_exec_callback_type, 
+													  void (CL_CALLBACK* pfn_notify)(cl_event event, cl_int event_command_status, void* user_data), 
+													  void* user_data);
+// Registers a callback which the implementation calls (from some thread of its own) once the event reaches the specified status.
+// NOTE: OpenCL 1.1, optional (nullptr with older libraries).
+inline clSetEventCallback_func clSetEventCallback;
+// end introduction
+
+typedef cl_int (CL_API_CALL* clGetEventProfilingInfo_func)(cl_event event, 
+														   cl_profiling_info param_name, 
+														   size_t param_value_size, 
+														   void* param_value, 
+														   size_t* param_value_size_ret);
+// Gets the device timestamps (in nanoseconds) of a command. Only works if the command queue was created with CL_QUEUE_PROFILING_ENABLE.
+inline clGetEventProfilingInfo_func clGetEventProfilingInfo;
+
+typedef cl_int (CL_API_CALL* clRetainEvent_func)(cl_event event);
+// Increments an event's reference count.
+inline clRetainEvent_func clRetainEvent;
+
+typedef cl_int (CL_API_CALL* clReleaseEvent_func)(cl_event event);
+// Decrements an event's reference count.
+inline clReleaseEvent_func clReleaseEvent;
+
 // TODO: Think about noexcepting these function ptrs.
 // You can't really because you can't cast non-noexcept to noexcept function ptrs.
 // TODO: Find a way around that for efficiency.
 
+typedef cl_int (CL_API_CALL* clRetainMemObject_func)(cl_mem memobj);
+// Increments a memory object's reference count.
+inline clRetainMemObject_func clRetainMemObject;
+
 typedef cl_int (CL_API_CALL* clReleaseMemObject_func)(cl_mem memobj);
 // Decrements a memory object's reference count.
 inline clReleaseMemObject_func clReleaseMemObject;
 
+typedef cl_int (CL_API_CALL* clRetainKernel_func)(cl_kernel kernel);
+// Increments a kernel's reference count.
+inline clRetainKernel_func clRetainKernel;
+
 typedef cl_int (CL_API_CALL* clReleaseKernel_func)(cl_kernel kernel);
 // Decrements a kernel's reference count.
 inline clReleaseKernel_func clReleaseKernel;
 
+typedef cl_int (CL_API_CALL* clRetainProgram_func)(cl_program program);
+// Increments a program's reference count.
+inline clRetainProgram_func clRetainProgram;
+
 typedef cl_int (CL_API_CALL* clReleaseProgram_func)(cl_program program);
 // Decrements a program's reference count.
 inline clReleaseProgram_func clReleaseProgram;
 
+typedef cl_int (CL_API_CALL* clRetainCommandQueue_func)(cl_command_queue command_queue);
+// Increments a command queue's reference count.
+inline clRetainCommandQueue_func clRetainCommandQueue;
+
 typedef cl_int (CL_API_CALL* clReleaseCommandQueue_func)(cl_command_queue command_queue);
 // Decrements a command queue's reference count.
 inline clReleaseCommandQueue_func clReleaseCommandQueue;
 
+typedef cl_int (CL_API_CALL* clRetainContext_func)(cl_context context);
+// Increments a context's reference count.
+inline clRetainContext_func clRetainContext;
+
 typedef cl_int (CL_API_CALL* clReleaseContext_func)(cl_context context);
 // Decrements a context's reference count.
 inline clReleaseContext_func clReleaseContext;
 
+// introduced in version 1.2
+typedef void* (CL_API_CALL* clGetExtensionFunctionAddressForPlatform_func)(cl_platform_id platform, 
+																		   const char* func_name);
+// Gets the address of an extension function of a platform, or nullptr if the platform doesn't have it.
+// NOTE: OpenCL 1.2, optional (nullptr with older libraries).
+inline clGetExtensionFunctionAddressForPlatform_func clGetExtensionFunctionAddressForPlatform;
+// end introduction
+
+// NOTE: Extension functions aren't bound by initOpenCLBindings(), since they belong to a platform, not to the DLL.
+// Get them with clGetExtensionFunctionAddressForPlatform() and keep them next to whatever they belong to.
+
+// cl_khr_command_buffer (0.9.5 and newer)
+typedef cl_command_buffer_khr (CL_API_CALL* clCreateCommandBufferKHR_func)(cl_uint num_queues, 
+																		   const cl_command_queue* queues, 
+																		   const cl_command_buffer_properties_khr* properties, 
+																		   cl_int* errcode_ret);
+
+typedef cl_int (CL_API_CALL* clFinalizeCommandBufferKHR_func)(cl_command_buffer_khr command_buffer);
+
+typedef cl_int (CL_API_CALL* clReleaseCommandBufferKHR_func)(cl_command_buffer_khr command_buffer);
+
+typedef cl_int (CL_API_CALL* clEnqueueCommandBufferKHR_func)(cl_uint num_queues, 
+															 cl_command_queue* queues, 
+															 cl_command_buffer_khr command_buffer, 
+															 cl_uint num_events_in_wait_list, 
+															 const cl_event* event_wait_list, 
+															 cl_event* event);
+
+typedef cl_int (CL_API_CALL* clCommandNDRangeKernelKHR_func)(cl_command_buffer_khr command_buffer, 
+															 cl_command_queue command_queue, 
+															 const cl_command_properties_khr* properties, 
+															 cl_kernel kernel, 
+															 cl_uint work_dim, 
+															 const size_t* global_work_offset, 
+															 const size_t* global_work_size, 
+															 const size_t* local_work_size, 
+															 cl_uint num_sync_points_in_wait_list, 
+															 const cl_sync_point_khr* sync_point_wait_list, 
+															 cl_sync_point_khr* sync_point, 
+															 cl_mutable_command_khr* mutable_handle);
+
+typedef cl_int (CL_API_CALL* clCommandCopyBufferKHR_func)(cl_command_buffer_khr command_buffer, 
+														  cl_command_queue command_queue, 
+														  const cl_command_properties_khr* properties, 
+														  cl_mem src_buffer, 
+														  cl_mem dst_buffer, 
+														  size_t src_offset, 
+														  size_t dst_offset, 
+														  size_t size, 
+														  cl_uint num_sync_points_in_wait_list, 
+														  const cl_sync_point_khr* sync_point_wait_list, 
+														  cl_sync_point_khr* sync_point, 
+														  cl_mutable_command_khr* mutable_handle);
+
+// Number of bits needed to represent the input, so the position of the highest set bit plus one (0 for an input of 0).
+// NOTE: Halving search over the shift amount, so it's log2(bit count) steps instead of one step per bit.
+template <typename uint_t>
+constexpr unsigned int integer_bit_length(uint_t input) noexcept {
+	static_assert(std::is_unsigned<uint_t>{}, "integer_bit_length failed: input must be of unsigned integral type");
+	unsigned int result = 0;
+	for (unsigned int shift = sizeof(uint_t) * 4; shift != 0; shift /= 2) {
+		if (input >> shift) { input >>= shift; result += shift; }
+	}
+	return result + (input != 0);
+}
+
+// Floor of the square root, exact for every input.
+// NOTE: Newton's method, seeded with the power of two right above the root (which we get from the bit length). Starting above the root means
+// the iteration decreases monotonically until it hits the floor of the root, so there's no need for a correction step, and from that seed it
+// only takes a handful of iterations even for 64-bit inputs. The old bisection needed one iteration per bit and overflowed for big inputs.
 template <typename uint_t>
-constexpr uint_t integer_sqrt(uint_t input) {			// TODO: Is this the most efficient algorithm. Has to be good since it could run at runtime as well.
+constexpr uint_t integer_sqrt(uint_t input) noexcept {
 	static_assert(std::is_unsigned<uint_t>{}, "integer_sqrt failed: input must be of unsigned integral type");
-	uint_t spanStartIndex = 0;
-	uint_t spanLengthMinusOne = input;
+	if (input < 2) { return input; }
+	uint_t estimate = (uint_t)((uint_t)1 << ((integer_bit_length(input) + 1) / 2));
 	while (true) {
-		spanLengthMinusOne /= 2;
-		if (spanLengthMinusOne == 0) { return spanStartIndex; }
-		uint_t half = spanStartIndex + spanLengthMinusOne;
-		uint_t squareHalf = half * half;
-		if (squareHalf > input) { spanLengthMinusOne--; continue; }
-		if (squareHalf < input) { spanStartIndex = half; continue; }
-		return half;
+		uint_t nextEstimate = (uint_t)((estimate + input / estimate) / 2);
+		if (nextEstimate >= estimate) { return estimate; }
+		estimate = nextEstimate;
 	}
 }
 
+// Finds the factor pair of area that is closest to a square, as (smaller factor, bigger factor).
+// NOTE: Instead of trial-dividing every number from the root downwards, we factorize area (trial division only has to go up to the root of
+// whatever is left, which is quick for the smooth numbers that work sizes usually are) and then walk through every divisor that the prime factors
+// can make, keeping the biggest one that's still at most the root.
 template <typename uint_t>
-constexpr std::pair<uint_t, uint_t> calcSmallestBoundingBox(uint_t area) {
+constexpr std::pair<uint_t, uint_t> calcSmallestBoundingBox(uint_t area) noexcept {
 	static_assert(std::is_unsigned<uint_t>{}, "calcSmallestBoundingBox failed: area must be of unsigned integral type");
-	uint_t cielRoot = integer_sqrt(area);
-	for (uint_t i = cielRoot; i >= 2; i--) {
-		if (area % i == 0) {
-			return std::make_pair(i, area / i);
+	if (area < 4) { return std::make_pair((uint_t)1, area); }
+	uint_t root = integer_sqrt(area);
+
+	// NOTE: The product of the first 16 primes is bigger than 2^64, so no supported area can have more distinct prime factors than that.
+	uint_t primes[16] { };
+	uint_t primePowers[16] { };			// NOTE: primes[i] to the power of its full exponent.
+	unsigned int exponents[16] { };
+	unsigned int primeCount = 0;
+
+	uint_t remainder = area;
+	for (uint_t divisor = 2; divisor <= remainder / divisor; divisor += (divisor == 2 ? 1 : 2)) {
+		if (remainder % divisor != 0) { continue; }
+		primes[primeCount] = divisor;
+		primePowers[primeCount] = 1;
+		do {
+			remainder /= divisor;
+			primePowers[primeCount] *= divisor;
+			exponents[primeCount]++;
+		} while (remainder % divisor == 0);
+		primeCount++;
+	}
+	if (remainder > 1) {
+		primes[primeCount] = remainder;
+		primePowers[primeCount] = remainder;
+		exponents[primeCount] = 1;
+		primeCount++;
+	}
+
+	// NOTE: Walks through every divisor like an odometer: the digits are the exponents of the prime factors.
+	unsigned int currentExponents[16] { };
+	uint_t divisor = 1;
+	uint_t bestDivisor = 1;
+	while (true) {
+		unsigned int digit = 0;
+		for (; digit < primeCount; digit++) {
+			if (currentExponents[digit] < exponents[digit]) {
+				currentExponents[digit]++;
+				divisor *= primes[digit];
+				break;
+			}
+			divisor /= primePowers[digit];
+			currentExponents[digit] = 0;
+		}
+		if (digit == primeCount) { break; }
+		if (divisor <= root && divisor > bestDivisor) {
+			bestDivisor = divisor;
+			if (bestDivisor == root) { break; }
 		}
 	}
-	return std::make_pair(1, area);
+
+	return std::make_pair(bestDivisor, (uint_t)(area / bestDivisor));
 }
 
 // Stores version information in numerical form.
@@ -702,6 +1113,116 @@ struct VersionIdentifier {
 	}
 };
 
+// NOTE: Move-only owner of one reference to an OpenCL object. Moving hands the reference over without touching the reference count,
+// and the destructor releases it, so error paths don't have to release anything by hand and a wrapper is exactly as big as the raw handle.
+// NOTE: Copying is deleted on purpose. If you really want a second owner, use share(), which retains, so that every retain is visible in the code.
+// NOTE: Converts implicitly to the raw handle, so wrappers can be passed straight into the OpenCL functions. Use get_address() for clSetKernelArg().
+template <typename handle_t>
+struct OpenCLHandleTraits;
+
+template <>
+struct OpenCLHandleTraits<cl_mem> {
+	static cl_int retain(cl_mem handle) noexcept { return clRetainMemObject(handle); }
+	static cl_int release(cl_mem handle) noexcept { return clReleaseMemObject(handle); }
+};
+
+template <>
+struct OpenCLHandleTraits<cl_kernel> {
+	static cl_int retain(cl_kernel handle) noexcept { return clRetainKernel(handle); }
+	static cl_int release(cl_kernel handle) noexcept { return clReleaseKernel(handle); }
+};
+
+template <>
+struct OpenCLHandleTraits<cl_program> {
+	static cl_int retain(cl_program handle) noexcept { return clRetainProgram(handle); }
+	static cl_int release(cl_program handle) noexcept { return clReleaseProgram(handle); }
+};
+
+template <>
+struct OpenCLHandleTraits<cl_command_queue> {
+	static cl_int retain(cl_command_queue handle) noexcept { return clRetainCommandQueue(handle); }
+	static cl_int release(cl_command_queue handle) noexcept { return clReleaseCommandQueue(handle); }
+};
+
+template <>
+struct OpenCLHandleTraits<cl_context> {
+	static cl_int retain(cl_context handle) noexcept { return clRetainContext(handle); }
+	static cl_int release(cl_context handle) noexcept { return clReleaseContext(handle); }
+};
+
+template <>
+struct OpenCLHandleTraits<cl_event> {
+	static cl_int retain(cl_event handle) noexcept { return clRetainEvent(handle); }
+	static cl_int release(cl_event handle) noexcept { return clReleaseEvent(handle); }
+};
+
+template <typename handle_t>
+class OpenCLHandle {
+	handle_t handle = nullptr;
+
+public:
+	constexpr OpenCLHandle() noexcept = default;
+
+	// Takes over the reference that the caller owns (for example the one that a clCreate* function returned), without retaining.
+	constexpr explicit OpenCLHandle(handle_t handle) noexcept : handle(handle) { }
+
+	OpenCLHandle(const OpenCLHandle& other) = delete;
+	OpenCLHandle& operator=(const OpenCLHandle& right) = delete;
+
+	constexpr OpenCLHandle(OpenCLHandle&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+
+	OpenCLHandle& operator=(OpenCLHandle&& other) noexcept {
+		if (this == &other) { return *this; }
+		reset();
+		handle = other.handle;
+		other.handle = nullptr;
+		return *this;
+	}
+
+	// Retains a handle that the caller doesn't own (for example one that belongs to an OpenCLDeviceCollection) and owns the new reference.
+	static OpenCLHandle retain(cl_int& err, handle_t handle) noexcept {
+		if (!handle) { err = CL_SUCCESS; return OpenCLHandle(); }
+		err = OpenCLHandleTraits<handle_t>::retain(handle);
+		if (err != CL_SUCCESS) { return OpenCLHandle(); }
+		return OpenCLHandle(handle);
+	}
+
+	// Second owner of the same object. Sharing an empty wrapper gives you another empty wrapper.
+	OpenCLHandle share(cl_int& err) const noexcept { return retain(err, handle); }
+
+	constexpr handle_t get() const noexcept { return handle; }
+	constexpr operator handle_t() const noexcept { return handle; }
+	constexpr const handle_t* get_address() const noexcept { return &handle; }
+
+	// Gives up ownership without releasing. The caller has to release the returned handle.
+	constexpr handle_t detach() noexcept {
+		handle_t result = handle;
+		handle = nullptr;
+		return result;
+	}
+
+	// Releases the current object (if any) and takes over the reference to the new one.
+	void reset(handle_t newHandle = nullptr) noexcept {
+		if (handle) { OpenCLHandleTraits<handle_t>::release(handle); }				// NOTE: Errors aren't handled here because there's nothing sensible to do about them.
+		handle = newHandle;
+	}
+
+	constexpr void swap(OpenCLHandle& other) noexcept {
+		handle_t temp_handle = handle;
+		handle = other.handle;
+		other.handle = temp_handle;
+	}
+
+	~OpenCLHandle() noexcept { reset(); }
+};
+
+typedef OpenCLHandle<cl_mem> OpenCLMemObject;
+typedef OpenCLHandle<cl_kernel> OpenCLKernel;
+typedef OpenCLHandle<cl_program> OpenCLProgram;
+typedef OpenCLHandle<cl_command_queue> OpenCLCommandQueue;
+typedef OpenCLHandle<cl_context> OpenCLContext;
+typedef OpenCLHandle<cl_event> OpenCLEvent;
+
 class OpenCLDeviceIndexCollection;
 
 enum class OpenCLDeviceCollection_state : uint8_t {
@@ -724,7 +1245,7 @@ public:
 		devices = new (std::nothrow) cl_device_id[devices_length];
 		if (!devices) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
 
-		contexts = new (std::nothrow) cl_context[contexts_length];
+		contexts = new (std::nothrow) cl_context[contexts_length]();		// NOTE: Value-initialized, so that the destructor knows which contexts exist if the collection gets destroyed half-filled.
 		if (!contexts) {
 			delete[] devices;
 			devices = nullptr;
@@ -826,110 +1347,260 @@ public:
 		return contexts[getContextIndexForDeviceIndex(deviceIndex)];
 	}
 
+	// NOTE: The collection owns its contexts and releases them here. If you want to keep using one of them after the collection is gone,
+	// retain it first (see OpenCLContext::retain()).
 	constexpr ~OpenCLDeviceCollection() noexcept {
+		if (contexts) {
+			for (size_t i = 0; i < contexts_length; i++) {
+				if (contexts[i]) { clReleaseContext(contexts[i]); }
+			}
+		}
 		delete[] contextEndIndices;		// NOTE: Doesn't do anything if the pointers are nullptr, don't worry.
 		delete[] contexts;
 		delete[] devices;
 	}
 };
 
-template <typename element_t>
+// NOTE: Growable array that reports allocation failures through error codes instead of exceptions.
+// The first inline_capacity elements live inside the object itself, so the common case of a handful of elements never touches the heap.
+// Past that, the capacity doubles on every growth, so pushing n elements costs O(n) copies in total instead of the O(n^2) of fixed-size steps.
+// NOTE: Trivially copyable element types get moved around with memcpy and realloc (the trivially-relocatable fast path), everything else
+// gets move-constructed into the new storage and destroyed in the old one, so non-trivial types are fine too.
+template <typename element_t, size_t inline_capacity = 16>
 class custom_vector {
+	static_assert(alignof(element_t) <= alignof(std::max_align_t), "custom_vector failed: over-aligned element types aren't supported, since the heap storage comes from malloc");
+
+	static constexpr bool is_trivially_relocatable = std::is_trivially_copyable<element_t>::value;
+
+	// NOTE: At least one element, since arrays of size 0 aren't allowed.
+	alignas(element_t) unsigned char inline_storage[(inline_capacity ? inline_capacity : 1) * sizeof(element_t)];
+
+	element_t* get_inline_data() noexcept { return (element_t*)inline_storage; }
+	bool is_inline() const noexcept { return data == (const element_t*)inline_storage; }
+
+	// Moves the elements from source to destination (which don't overlap) and ends the lifetimes of the ones in source.
+	static void relocate(element_t* destination, element_t* source, size_t count) noexcept {
+		if constexpr (is_trivially_relocatable) {
+			if (count) { std::memcpy((void*)destination, (const void*)source, count * sizeof(element_t)); }
+		} else {
+			for (size_t i = 0; i < count; i++) {
+				new (destination + i) element_t(std::move(source[i]));
+				source[i].~element_t();
+			}
+		}
+	}
+
+	static void destroy(element_t* elements, size_t count) noexcept {
+		if constexpr (!std::is_trivially_destructible<element_t>::value) {
+			for (size_t i = 0; i < count; i++) { elements[i].~element_t(); }
+		}
+	}
+
+	// Moves the elements into heap storage of exactly new_capacity elements. new_capacity has to be at least length.
+	cl_int reallocate(size_t new_capacity) noexcept {
+		if (new_capacity > (size_t)-1 / sizeof(element_t)) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+
+		if constexpr (is_trivially_relocatable) {
+			if (!is_inline()) {
+				element_t* new_data = (element_t*)realloc(data, new_capacity * sizeof(element_t));
+				if (!new_data) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+				data = new_data;
+				capacity = new_capacity;
+				return CL_SUCCESS;
+			}
+		}
+
+		element_t* new_data = (element_t*)malloc(new_capacity * sizeof(element_t));
+		if (!new_data) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+		relocate(new_data, data, length);
+		if (!is_inline()) { free(data); }
+		data = new_data;
+		capacity = new_capacity;
+		return CL_SUCCESS;
+	}
+
+	cl_int grow_to_fit(size_t required_capacity) noexcept {
+		if (required_capacity <= capacity) { return CL_SUCCESS; }
+		size_t new_capacity = capacity * 2;
+		if (new_capacity < required_capacity || new_capacity < capacity) { new_capacity = required_capacity; }
+		return reallocate(new_capacity);
+	}
+
+	void become_empty_inline() noexcept {
+		data = get_inline_data();
+		capacity = inline_capacity;
+		length = 0;
+	}
+
 public:
 	element_t* data;
 	size_t capacity;
 	size_t length = 0;
 
-	custom_vector(cl_int& err) noexcept : capacity(128) {
-		data = (element_t*)malloc(capacity * sizeof(element_t));
-		if (!data) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
+	custom_vector() noexcept : data(get_inline_data()), capacity(inline_capacity) { }
 
-		err = CL_SUCCESS;
+	// NOTE: Construction can't fail anymore since the vector starts out in its inline storage, but plenty of code still passes an error code.
+	custom_vector(cl_int& err) noexcept : custom_vector() { err = CL_SUCCESS; }
+
+	custom_vector(const custom_vector& other) = delete;
+	custom_vector& operator=(const custom_vector& right) = delete;
+
+	custom_vector(custom_vector&& other) noexcept : custom_vector() {
+		if (other.is_inline()) {
+			relocate(data, other.data, other.length);
+			length = other.length;
+		} else {
+			data = other.data;
+			capacity = other.capacity;
+			length = other.length;
+		}
+		other.become_empty_inline();
+	}
+
+	custom_vector& operator=(custom_vector&& right) noexcept {
+		if (this == &right) { return *this; }
+		clear();
+		if (!is_inline()) { free(data); }
+		become_empty_inline();
+
+		if (right.is_inline()) {
+			relocate(data, right.data, right.length);
+			length = right.length;
+		} else {
+			data = right.data;
+			capacity = right.capacity;
+			length = right.length;
+		}
+		right.become_empty_inline();
+		return *this;
+	}
+
+	element_t& operator[](size_t index) noexcept { return data[index]; }
+	const element_t& operator[](size_t index) const noexcept { return data[index]; }
+
+	element_t* begin() noexcept { return data; }
+	element_t* end() noexcept { return data + length; }
+	const element_t* begin() const noexcept { return data; }
+	const element_t* end() const noexcept { return data + length; }
+
+	// Makes sure there's room for at least new_capacity elements. Never shrinks.
+	cl_int reserve(size_t new_capacity) noexcept {
+		if (new_capacity <= capacity) { return CL_SUCCESS; }
+		return reallocate(new_capacity);
 	}
 
+	// New elements get value-initialized (so zeroed for arithmetic types). Shrinking destroys the excess elements but keeps the storage,
+	// use shrink_to_fit() for giving it back.
 	cl_int resize(size_t new_length) noexcept {
-		/*
-		* If new_length is smaller than capacity, this function will essentially set length to new_length and then do a shrink_to_fit.
-		* If new_length is the same as capacity, we still call realloc because I assume that the cost isn't high when calling it with
-		* values that are lower than or equal to the existing allocation's size, since then it doesn't have to move the allocation in memory.
-		* Basically I don't want to waste processing time with an if statement that checks whether new_length == capacity, because why should I? I shouldn't.
-		* We would be avoiding the realloc in that case, but we've just covered that it would be super fast anyway, so the reward doesn't outweigh the cost.
-		*/
-
-		element_t* new_data = (element_t*)realloc(data, new_length * sizeof(element_t));
-		if (!new_data) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+		if (new_length < length) {
+			destroy(data + new_length, length - new_length);
+			length = new_length;
+			return CL_SUCCESS;
+		}
 
-		data = new_data;
+		cl_int err = grow_to_fit(new_length);
+		if (err != CL_SUCCESS) { return err; }
+		for (size_t i = length; i < new_length; i++) { new (data + i) element_t(); }
 		length = new_length;
-		capacity = length;
-
 		return CL_SUCCESS;
 	}
 
-	cl_int increase_space(size_t addition) noexcept {
-		size_t new_capacity = capacity + addition;
-		element_t* new_data = (element_t*)realloc(data, new_capacity * sizeof(element_t));
-		if (!new_data) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
-
-		data = new_data;
-		capacity = new_capacity;
+	cl_int push_back(const element_t& element) noexcept {
+		if (length == capacity) {
+			// NOTE: element could be one of our own elements, which the growth would move out from under us, so copy it first.
+			element_t copy(element);
+			cl_int err = grow_to_fit(length + 1);
+			if (err != CL_SUCCESS) { return err; }
+			new (data + length) element_t(std::move(copy));
+			length++;
+			return CL_SUCCESS;
+		}
 
+		new (data + length) element_t(element);
+		length++;
 		return CL_SUCCESS;
 	}
 
-	cl_int increase_space() noexcept { return increase_space(128); }
-
-	constexpr cl_int push_back(const element_t& element) noexcept {
+	cl_int push_back(element_t&& element) noexcept {
 		if (length == capacity) {
-			cl_int err = increase_space();
+			element_t moved(std::move(element));
+			cl_int err = grow_to_fit(length + 1);
 			if (err != CL_SUCCESS) { return err; }
+			new (data + length) element_t(std::move(moved));
+			length++;
+			return CL_SUCCESS;
 		}
 
-		data[length++] = element;
-
+		new (data + length) element_t(std::move(element));
+		length++;
 		return CL_SUCCESS;
 	}
 
-	constexpr cl_int push_empty_back(size_t addition_length) noexcept {
+	// Appends addition_length default-initialized elements, so for trivial types they're left uninitialized, ready to be filled in.
+	cl_int push_empty_back(size_t addition_length) noexcept {
 		size_t new_length = length + addition_length;
+		if (new_length < length) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
 
-		if (new_length <= capacity) { length = new_length; return CL_SUCCESS; }
-
-		size_t difference = new_length - capacity;
-		size_t aligned_difference = 128 - ((difference - 1) % 128 + 1) + difference;
-		// TODO: Replace other, weirder aligning code somewhere in the codebase with this version, this one looks nice.
-
-		cl_int err = increase_space(aligned_difference);
+		cl_int err = grow_to_fit(new_length);
 		if (err != CL_SUCCESS) { return err; }
-
+		if constexpr (!std::is_trivially_default_constructible<element_t>::value) {
+			for (size_t i = length; i < new_length; i++) { new (data + i) element_t; }
+		}
 		length = new_length;
-
 		return CL_SUCCESS;
 	}
 
-	cl_int shrink_to_fit() noexcept {
-		element_t* new_data = (element_t*)realloc(data, length * sizeof(element_t));
-		if (!new_data) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+	void pop_back() noexcept {
+		length--;
+		data[length].~element_t();
+	}
 
-		data = new_data;
-		capacity = length;
+	void clear() noexcept {
+		destroy(data, length);
+		length = 0;
+	}
 
-		return CL_SUCCESS;
+	// Gives back the unused storage, moving the elements back into the inline storage if they fit.
+	cl_int shrink_to_fit() noexcept {
+		if (is_inline() || length == capacity) { return CL_SUCCESS; }
+
+		if (length <= inline_capacity) {
+			element_t* heap_data = data;
+			relocate(get_inline_data(), heap_data, length);
+			free(heap_data);
+			data = get_inline_data();
+			capacity = inline_capacity;
+			return CL_SUCCESS;
+		}
+
+		return reallocate(length);
 	}
 
+	// Hands the elements over to the caller, who becomes responsible for destroying them and for releasing the memory with free().
+	// The vector is empty afterwards. Elements on the heap get handed over as is (with capacity - length unused elements at the end),
+	// elements in the inline storage get moved to a heap allocation of exactly length elements first. Returns nullptr if the vector is empty.
 	element_t* steal_data(cl_int& err) noexcept {
-		err = shrink_to_fit();
-		if (err != CL_SUCCESS) { return nullptr; }
+		if (length == 0) {
+			if (!is_inline()) { free(data); }
+			become_empty_inline();
+			err = CL_SUCCESS;
+			return nullptr;
+		}
 
-		element_t* temp_data = data;
-		data = nullptr;
+		if (is_inline()) {
+			err = reallocate(length);
+			if (err != CL_SUCCESS) { return nullptr; }
+		}
 
+		element_t* stolen_data = data;
+		become_empty_inline();
 		err = CL_SUCCESS;
-		return temp_data;
+		return stolen_data;
 	}
 
 	~custom_vector() noexcept {
-		free(data);					// NOTE: Doesn't do anything if data is nullptr.
+		destroy(data, length);
+		if (!is_inline()) { free(data); }
 	}
 };
 
@@ -960,22 +1631,23 @@ public:
 
 	constexpr OpenCLDeviceIndexCollection() noexcept = default;
 
-	constexpr OpenCLDeviceIndexCollection(cl_int& err, const OpenCLDeviceCollection* data) noexcept : 
+	// NOTE: indices comes from malloc instead of new[], so that removeInvalidDevices() can adopt the storage of a custom_vector without copying it.
+	OpenCLDeviceIndexCollection(cl_int& err, const OpenCLDeviceCollection* data) noexcept : 
 		data(data), length(data->devices_length)
 	{
-		indices = new (std::nothrow) size_t[length];
-		if (!indices) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
+		indices = (size_t*)malloc(length * sizeof(size_t));
+		if (!indices && length) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
 
 		for (size_t i = 0; i < length; i++) { indices[i] = i; }
 
 		err = CL_SUCCESS;
 	}
 
-	constexpr OpenCLDeviceIndexCollection(cl_int& err, const OpenCLDeviceIndexCollection& right) noexcept : 
+	OpenCLDeviceIndexCollection(cl_int& err, const OpenCLDeviceIndexCollection& right) noexcept : 
 		data(right.data), length(right.length)
 	{
-		indices = new (std::nothrow) size_t[length];
-		if (!indices) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
+		indices = (size_t*)malloc(length * sizeof(size_t));
+		if (!indices && length) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
 
 		std::copy(right.indices, right.indices + length, indices);
 
@@ -1013,7 +1685,7 @@ public:
 	constexpr const size_t& operator[](size_t index) const noexcept { return indices[index]; }
 
 	template <typename comparator_functor_t>
-	constexpr OpenCLDeviceIndexCollection sort(cl_int& err, comparator_functor_t comparator) const noexcept {
+	OpenCLDeviceIndexCollection sort(cl_int& err, comparator_functor_t comparator) const noexcept {
 		OpenCLDeviceIndexCollection result(err, *this);
 		if (err != CL_SUCCESS) { return result; }
 
@@ -1023,7 +1695,7 @@ public:
 		return result;
 	}
 
-	constexpr OpenCLDeviceIndexCollection sort_by_increasing_max_work_group_size(cl_int& err) const noexcept {
+	OpenCLDeviceIndexCollection sort_by_increasing_max_work_group_size(cl_int& err) const noexcept {
 		// NOTE: You can't capture member variables with &data or data, I assume since using them from the lambda body is weird.
 		// Like how would you refer to them from the lambda body? this->data? Doesn't work since you haven't captured this.
 		// Simply data? That's weird since only things inside of classes can refer to the member variables like that.
@@ -1054,21 +1726,24 @@ public:
 
 		custom_vector<size_t> new_indices;
 		for (size_t i = 0; i < length; i++) {
-			if (checker(indices[i])) { new_indices.push_back(indices[i]); }
+			if (checker(indices[i])) {
+				err = new_indices.push_back(indices[i]);
+				if (err != CL_SUCCESS) { result.length = 0; return result; }
+			}
 		}
 
 		result.data = data;
-		result.length = new_indices.length;				// NOTE: It's important that this is above the next line.
-		result.indices = new_indices.steal_data();		// NOTE: Since after this line the state of new_indices is pretty undefined.
+		result.length = new_indices.length;					// NOTE: It's important that this is above the next line.
+		result.indices = new_indices.steal_data(err);		// NOTE: Since after this line new_indices is empty.
+		if (err != CL_SUCCESS) { result.length = 0; }
 
-		err = CL_SUCCESS;
 		return result;
 	}
 
-	constexpr OpenCLDeviceIndexCollection reverse(cl_int& err) const noexcept {
+	OpenCLDeviceIndexCollection reverse(cl_int& err) const noexcept {
 		OpenCLDeviceIndexCollection result;
-		result.indices = new (std::nothrow) size_t[length];
-		if (!result.indices) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return result; }
+		result.indices = (size_t*)malloc(length * sizeof(size_t));
+		if (!result.indices && length) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return result; }
 		result.length = length;
 		result.data = data;
 
@@ -1080,8 +1755,8 @@ public:
 		return result;
 	}
 
-	constexpr ~OpenCLDeviceIndexCollection() noexcept {
-		delete[] indices;		// NOTE: Don't worry, doesn't do anything if it's nullptr.
+	~OpenCLDeviceIndexCollection() noexcept {
+		free(indices);			// NOTE: Don't worry, doesn't do anything if it's nullptr.
 	}
 };
 
@@ -1091,6 +1766,9 @@ inline OpenCLDeviceIndexCollection OpenCLDeviceCollection::createDeviceIndexColl
 
 bool loadOpenCLLib() noexcept;
 
+// Same as above, but loads the OpenCL implementation from the specified path instead of the system's OpenCL.dll (for example the mock library in mock_icd).
+bool loadOpenCLLib(const char* libraryPath) noexcept;
+
 // Bind a specific DLL function to it's corresponding function pointer. Splitting these up into separate functions is useful in case the user wants to bind these in a lazy fashion.
 bool bind_clGetPlatformIDs() noexcept;
 bool bind_clGetPlatformInfo() noexcept;
@@ -1100,28 +1778,111 @@ bool bind_clCreateContext() noexcept;
 bool bind_clGetContextInfo() noexcept;
 bool bind_clCreateCommandQueue() noexcept;
 bool bind_clCreateProgramWithSource() noexcept;
+bool bind_clCreateProgramWithBinary() noexcept;
 bool bind_clBuildProgram() noexcept;
+bool bind_clGetProgramInfo() noexcept;
 bool bind_clGetProgramBuildInfo() noexcept;
 bool bind_clCreateKernel() noexcept;
 bool bind_clCreateBuffer() noexcept;
 bool bind_clCreateImage2D() noexcept;
+bool bind_clGetImageInfo() noexcept;
 bool bind_clSetKernelArg() noexcept;
+bool bind_clGetKernelInfo() noexcept;
 bool bind_clGetKernelWorkGroupInfo() noexcept;
 bool bind_clEnqueueNDRangeKernel() noexcept;
+bool bind_clFlush() noexcept;
 bool bind_clFinish() noexcept;
 bool bind_clEnqueueWriteBuffer() noexcept;
 bool bind_clEnqueueReadBuffer() noexcept;
 bool bind_clEnqueueWriteImage() noexcept;
 bool bind_clEnqueueReadImage() noexcept;
+bool bind_clEnqueueCopyBuffer() noexcept;
+bool bind_clEnqueueMapBuffer() noexcept;
+bool bind_clEnqueueUnmapMemObject() noexcept;
+bool bind_clEnqueueMigrateMemObjects() noexcept;
+bool bind_clEnqueueMarkerWithWaitList() noexcept;
+bool bind_clWaitForEvents() noexcept;
+bool bind_clGetEventInfo() noexcept;
+bool bind_clCreateUserEvent() noexcept;
+bool bind_clSetUserEventStatus() noexcept;
+bool bind_clSetEventCallback() noexcept;
+bool bind_clGetEventProfilingInfo() noexcept;
+bool bind_clRetainEvent() noexcept;
+bool bind_clReleaseEvent() noexcept;
+bool bind_clRetainMemObject() noexcept;
 bool bind_clReleaseMemObject() noexcept;
+bool bind_clRetainKernel() noexcept;
 bool bind_clReleaseKernel() noexcept;
+bool bind_clRetainProgram() noexcept;
 bool bind_clReleaseProgram() noexcept;
+bool bind_clRetainCommandQueue() noexcept;
 bool bind_clReleaseCommandQueue() noexcept;
+bool bind_clRetainContext() noexcept;
 bool bind_clReleaseContext() noexcept;
+bool bind_clGetExtensionFunctionAddressForPlatform() noexcept;
+
+// X-macro that expands X(function) for every function pointer that initOpenCLBindings() binds.
+// Used by the modules that interpose on the function pointers (see cl_tracing.h and cl_instrumentation.h), so keep it up-to-date when adding bindings.
+#define CL_EXT_FOR_EACH_BOUND_FUNCTION(X) \
+	X(clGetPlatformIDs) \
+	X(clGetPlatformInfo) \
+	X(clGetDeviceIDs) \
+	X(clGetDeviceInfo) \
+	X(clCreateContext) \
+	X(clGetContextInfo) \
+	X(clCreateCommandQueue) \
+	X(clCreateProgramWithSource) \
+	X(clCreateProgramWithBinary) \
+	X(clBuildProgram) \
+	X(clGetProgramInfo) \
+	X(clGetProgramBuildInfo) \
+	X(clCreateKernel) \
+	X(clCreateBuffer) \
+	X(clCreateImage2D) \
+	X(clGetImageInfo) \
+	X(clSetKernelArg) \
+	X(clGetKernelInfo) \
+	X(clGetKernelWorkGroupInfo) \
+	X(clEnqueueNDRangeKernel) \
+	X(clFlush) \
+	X(clFinish) \
+	X(clEnqueueWriteBuffer) \
+	X(clEnqueueReadBuffer) \
+	X(clEnqueueWriteImage) \
+	X(clEnqueueReadImage) \
+	X(clEnqueueCopyBuffer) \
+	X(clEnqueueMapBuffer) \
+	X(clEnqueueUnmapMemObject) \
+	X(clEnqueueMigrateMemObjects) \
+	X(clEnqueueMarkerWithWaitList) \
+	X(clWaitForEvents) \
+	X(clGetEventInfo) \
+	X(clCreateUserEvent) \
+	X(clSetUserEventStatus) \
+	X(clSetEventCallback) \
+	X(clGetEventProfilingInfo) \
+	X(clRetainEvent) \
+	X(clReleaseEvent) \
+	X(clRetainMemObject) \
+	X(clReleaseMemObject) \
+	X(clRetainKernel) \
+	X(clReleaseKernel) \
+	X(clRetainProgram) \
+	X(clReleaseProgram) \
+	X(clRetainCommandQueue) \
+	X(clReleaseCommandQueue) \
+	X(clRetainContext) \
+	X(clReleaseContext) \
+	X(clGetExtensionFunctionAddressForPlatform)
 
 // Simple helper function which initializes the dynamic linkage to the OpenCL DLL and initializes the bindings to all of the various functions.
+// NOTE: The OpenCL 1.1 and 1.2 functions that only the optional modules need (user events, event callbacks, markers, migration, extension
+// lookup) don't make this fail if they're missing, they just stay nullptr. The modules that need them return CL_EXT_FUNCTION_UNAVAILABLE then.
 cl_int initOpenCLBindings() noexcept;
 
+// Same as above, but with the OpenCL implementation at the specified path.
+cl_int initOpenCLBindings(const char* libraryPath) noexcept;
+
 bool freeOpenCLLib() noexcept;
 
 VersionIdentifier convertOpenCLVersionStringToVersionIdentifier(const char* string) noexcept;
@@ -1139,8 +1900,17 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 // clGetDeviceInfo
 // clCreateContext
 // clCreateCommandQueue
+// clRetainContext
 // clReleaseContext
-cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, cl_context& context, cl_command_queue& commandQueue) noexcept;
+// clReleaseCommandQueue
+// NOTE: Pass CL_QUEUE_PROFILING_ENABLE as the command queue properties if you want to be able to time the commands that you enqueue (see cl_profiling.h).
+// NOTE: The contexts of the devices that didn't get picked are released before this returns, the caller owns the returned context and queue.
+cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, OpenCLContext& context, OpenCLCommandQueue& commandQueue,
+								   cl_command_queue_properties commandQueueProperties = 0) noexcept;
+
+// Same as above, but with raw handles, which the caller has to release.
+cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, cl_context& context, cl_command_queue& commandQueue,
+								   cl_command_queue_properties commandQueueProperties = 0) noexcept;
 
 // Helper function to quickly set up a compute kernel.
 // NOTE: In case you want to only bind the functions that this function uses, it uses:
@@ -1151,6 +1921,17 @@ cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumPlatformVersi
 // clCreateKernel
 // clGetKernelWorkGroupInfo
 // clReleaseKernel
+// NOTE: program and kernel only get replaced on success. On failure, they keep whatever they had.
+// NOTE: buildOptions get passed to clBuildProgram() as they are (-D defines, -cl-fast-relaxed-math, ...). nullptr means no options.
 // TODO: Annotate these two functions properly.
-cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog) noexcept;
-cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog) noexcept;
+cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
+cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
+
+// The two halves of setupComputeKernelFromString(), for when one program gets built once and its kernels get created later (or several times).
+// program and kernel only get replaced on success, same as above.
+cl_int buildProgramFromString(cl_context context, cl_device_id device, const char* sourceCodeString, OpenCLProgram& program, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
+cl_int setupComputeKernelFromProgram(cl_device_id device, cl_program program, const char* kernelName, OpenCLKernel& kernel, size_t& kernelWorkGroupSize) noexcept;
+
+// Same as above, but with raw handles, which the caller has to release.
+cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
+cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
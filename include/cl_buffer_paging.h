@@ -0,0 +1,136 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: The buffer pager manages buffers for data sets that don't fit into device memory all at once. Every managed buffer has a home in
+// host memory and the device copy is a cache: buffers get paged in when something needs them on the device and the least recently used
+// ones get evicted (written back to host memory if a kernel could have changed them) whenever the device-side budget would be exceeded.
+// NOTE: Buffers that kernels use get paged in by enqueueNDRangeKernel(), which also sets them as kernel arguments, since the cl_mem of
+// a buffer changes every time it gets evicted and paged in again. Bind them with setKernelArg() once, the pager sets them before every launch.
+// For anything else (copies, your own enqueues), use makeResident() and get_device_buffer().
+// NOTE: The host copies live in pinned memory (mapped CL_MEM_ALLOC_HOST_PTR buffers) by default, which the implementation can transfer from
+// and to without staging. If pinned memory runs out, the pager falls back to normal host memory for the remaining buffers.
+// NOTE: Everything goes through the one queue that you pass in, which has to be in-order, since page-ins, kernels and page-outs depend on
+// that order. Transfers don't block, except for read() and write(), which hand you the data right away.
+// NOTE: The budget is per pager, so use one pager per context. If several pagers (or buffers outside of the pager) share a device, split the
+// budget between them. If the device runs out of memory before the budget is reached anyway (other processes, fragmentation),
+// the pager evicts more and lowers its budget to what actually fit.
+// NOTE: Not thread-safe.
+
+struct BufferPagingConfig {
+	// Device memory the pager may use for resident buffers, in bytes. 0 means budget_percentage percent of CL_DEVICE_GLOBAL_MEM_SIZE.
+	uint64_t device_budget = 0;
+
+	// NOTE: The rest is left for the implementation, private and local memory of the kernels and buffers outside of the pager.
+	uint32_t budget_percentage = 75;
+
+	bool pinned_host_memory = true;
+};
+
+class BufferPager {
+	struct PagedBuffer {
+		size_t size = 0;
+		cl_mem_flags flags = 0;
+		bool live = false;				// NOTE: Released slots get reused by the next createBuffer().
+
+		OpenCLMemObject deviceBuffer;	// NOTE: nullptr while the buffer is evicted.
+		OpenCLMemObject pinnedBuffer;	// NOTE: The buffer that hostData is mapped from, nullptr if hostData comes from malloc.
+		void* hostData = nullptr;
+		OpenCLEvent lastHostTransfer;	// NOTE: The last enqueued transfer that reads or writes hostData.
+
+		bool hostValid = true;			// NOTE: Whether hostData is up-to-date. Only ever false while the buffer is resident.
+		bool hasContents = false;		// NOTE: Buffers that nobody wrote to yet don't need to be transferred when they get paged in.
+		uint64_t lastUse = 0;
+		uint32_t pinCount = 0;			// NOTE: Pinned buffers don't get evicted, so that the buffers of one launch don't evict each other.
+	};
+
+	struct KernelBinding {
+		cl_kernel kernel;
+		cl_uint argIndex;
+		size_t bufferIndex;
+		cl_mem appliedBuffer;			// NOTE: What the kernel argument was last set to, so that unchanged arguments don't get set again.
+	};
+
+	cl_context context = nullptr;
+	cl_command_queue queue = nullptr;
+	BufferPagingConfig config;
+	uint64_t budget = 0;
+	uint64_t maxAllocationSize = 0;
+	uint64_t residentBytes = 0;
+	uint64_t useClock = 0;
+	bool pinnedHostMemoryFailed = false;	// NOTE: Once a pinned allocation fails, the rest of the buffers go straight to malloc.
+
+	custom_vector<PagedBuffer, 8> buffers;
+	custom_vector<size_t> freeSlots;
+	custom_vector<KernelBinding, 8> bindings;
+
+	bool isValidBuffer(size_t bufferIndex) const noexcept { return bufferIndex < buffers.length && buffers[bufferIndex].live; }
+	cl_int allocateHostData(PagedBuffer& buffer) noexcept;
+	void freeHostData(PagedBuffer& buffer) noexcept;
+	cl_int waitForHostTransfer(PagedBuffer& buffer) noexcept;
+	cl_int evict(size_t bufferIndex) noexcept;
+	cl_int evictLeastRecentlyUsed() noexcept;
+	cl_int pageIn(PagedBuffer& buffer) noexcept;
+	cl_int makeResidentPinned(const size_t* bufferIndices, size_t count) noexcept;
+
+public:
+	// Statistics since construction.
+	uint64_t page_in_count = 0;
+	uint64_t page_out_count = 0;			// NOTE: Only evictions that had to write the buffer back to host memory.
+	uint64_t eviction_count = 0;
+	uint64_t bytes_paged_in = 0;
+	uint64_t bytes_paged_out = 0;
+
+	BufferPager() noexcept = default;
+
+	// NOTE: Uses CL_DEVICE_GLOBAL_MEM_SIZE and CL_DEVICE_MAX_MEM_ALLOC_SIZE of the device, which should be the device of the queue.
+	BufferPager(cl_int& err, cl_context context, cl_device_id device, cl_command_queue queue, const BufferPagingConfig& config = BufferPagingConfig()) noexcept;
+
+	BufferPager& operator=(const BufferPager& right) = delete;
+
+	BufferPager(BufferPager&& other) noexcept = default;
+
+	// Creates a managed buffer. flags are the access flags of the device buffer (CL_MEM_READ_WRITE, CL_MEM_READ_ONLY or CL_MEM_WRITE_ONLY),
+	// initialData (nullptr for none) gets copied into the host copy. Nothing gets allocated on the device until the buffer is needed there.
+	// NOTE: Kernels can't change CL_MEM_READ_ONLY buffers, so those never have to be written back when they get evicted.
+	cl_int createBuffer(size_t size, cl_mem_flags flags, const void* initialData, size_t& bufferIndex) noexcept;
+
+	// Releases the device and the host copy. Waits for transfers that still use the host copy. Also removes the kernel bindings of the buffer.
+	cl_int releaseBuffer(size_t bufferIndex) noexcept;
+
+	// Binds a managed buffer to a kernel argument, see enqueueNDRangeKernel().
+	cl_int setKernelArg(cl_kernel kernel, cl_uint argIndex, size_t bufferIndex) noexcept;
+
+	// Pages in every managed buffer bound to the kernel (evicting others if necessary), sets them as arguments and enqueues the kernel.
+	// Returns CL_MEM_OBJECT_ALLOCATION_FAILURE if the buffers of the kernel don't fit into the budget together.
+	// NOTE: The bound buffers count as changed by the kernel afterwards, unless they're CL_MEM_READ_ONLY.
+	cl_int enqueueNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize,
+								cl_uint numEventsInWaitList = 0, const cl_event* eventWaitList = nullptr, cl_event* event = nullptr) noexcept;
+
+	// Pages the buffers in together (none of them evicts another). Their device buffers (see get_device_buffer()) stay valid until the next
+	// call that can page something in. Like with enqueueNDRangeKernel(), the buffers count as changed on the device afterwards.
+	cl_int makeResident(const size_t* bufferIndices, size_t count) noexcept;
+
+	// The device buffer of a resident buffer, nullptr if it's evicted.
+	cl_mem get_device_buffer(size_t bufferIndex) const noexcept;
+
+	// Prefetch hint: pages the buffer in now, so that the transfer overlaps with whatever is in the queue before the kernel that needs it.
+	// Apart from counting as a use, does nothing if the buffer is already resident.
+	cl_int prefetch(size_t bufferIndex) noexcept;
+
+	// Eviction hint: the buffer won't be needed for a while, so it becomes the first candidate for eviction. With evictNow, it gets evicted
+	// right away, which frees the device memory early and gets the write-back going.
+	cl_int adviseEvict(size_t bufferIndex, bool evictNow = false) noexcept;
+
+	// Blocking host access to a buffer, wherever it currently lives.
+	cl_int read(size_t bufferIndex, size_t offset, size_t size, void* destination) noexcept;
+	cl_int write(size_t bufferIndex, size_t offset, size_t size, const void* source) noexcept;
+
+	bool is_resident(size_t bufferIndex) const noexcept { return isValidBuffer(bufferIndex) && buffers[bufferIndex].deviceBuffer; }
+	uint64_t get_resident_bytes() const noexcept { return residentBytes; }
+	uint64_t get_budget() const noexcept { return budget; }
+
+	~BufferPager() noexcept;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: A command recording captures a fixed sequence of kernel launches and buffer copies once and replays the whole sequence with a
+// single call. If the device reports cl_khr_command_buffer (0.9.5 or newer), finalize() turns the sequence into a command buffer and
+// a replay is one clEnqueueCommandBufferKHR() call. Otherwise (or if creating the command buffer fails), the recording replays itself:
+// everything is resolved up front, so a replay is just the enqueue calls, plus clSetKernelArg() for the arguments that actually differ
+// from what the kernel already has.
+// NOTE: Kernel arguments get recorded per command with recordKernelArg(), so the same cl_kernel can show up several times with different
+// arguments. Arguments you set on the cl_kernel yourself before recording are fine as long as that kernel only shows up once and you don't touch
+// it between replays. If you do touch a recorded kernel outside of the recording, call invalidate_kernel_args() before the next replay.
+// NOTE: Commands run in the order they were recorded, so the queue has to be in-order. The wait list of replay() applies to the
+// first command and the event belongs to the last one.
+// NOTE: patchKernelArg() changes an argument between replays. The emulated path applies it with a single clSetKernelArg(), the native
+// path has to record the command buffer again on the next replay (there's no mutable-dispatch support here), so keep patches rare with native recordings.
+// NOTE: Native command buffers get requested with CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, so that back-to-back replays can be pending
+// at the same time. Implementations that refuse it get a plain command buffer, and then a replay blocks until the previous one is done,
+// since enqueueing a pending command buffer again is an error there.
+// NOTE: The recording doesn't own the queue, the kernels or the buffers. It isn't thread-safe.
+
+struct CommandBufferKHRFunctions {
+	clCreateCommandBufferKHR_func clCreateCommandBufferKHR = nullptr;
+	clFinalizeCommandBufferKHR_func clFinalizeCommandBufferKHR = nullptr;
+	clReleaseCommandBufferKHR_func clReleaseCommandBufferKHR = nullptr;
+	clEnqueueCommandBufferKHR_func clEnqueueCommandBufferKHR = nullptr;
+	clCommandNDRangeKernelKHR_func clCommandNDRangeKernelKHR = nullptr;
+	clCommandCopyBufferKHR_func clCommandCopyBufferKHR = nullptr;
+};
+
+// Checks whether the device supports a usable version of cl_khr_command_buffer and fetches the functions if it does.
+// NOTE: Needs CL_DEVICE_EXTENSIONS_WITH_VERSION, so devices below OpenCL 3.0 always report false.
+// NOTE: Additionally uses clGetExtensionFunctionAddressForPlatform, and reports false if the library doesn't have it (below OpenCL 1.2).
+bool loadCommandBufferKHRFunctions(cl_int& err, cl_device_id device, CommandBufferKHRFunctions& functions) noexcept;
+
+enum class RecordedCommand_type : uint8_t {
+	NDRANGE_KERNEL,
+	COPY_BUFFER
+};
+
+class CommandRecording {
+	struct Command {
+		RecordedCommand_type type;
+		cl_kernel kernel;
+		cl_uint workDim;
+		size_t globalWorkSize[3];
+		size_t localWorkSize[3];
+		bool hasLocalWorkSize;
+		size_t kernelState;				// NOTE: Index into kernelStates.
+		size_t firstArg;				// NOTE: Index into args, the arguments of a command form a linked list. SIZE_MAX if there are none.
+		cl_mem srcBuffer;
+		cl_mem dstBuffer;
+		size_t srcOffset;
+		size_t dstOffset;
+		size_t size;
+	};
+
+	struct Arg {
+		size_t next;
+		cl_uint index;
+		size_t size;
+		size_t valueOffset;				// NOTE: Into argValues. SIZE_MAX for __local arguments, which only have a size.
+	};
+
+	// NOTE: Which command's arguments every kernel currently has, so that replays only set what differs.
+	struct KernelState {
+		cl_kernel kernel;
+		size_t appliedCommand;
+	};
+
+	cl_command_queue queue = nullptr;
+	CommandBufferKHRFunctions functions;
+	bool nativeSupported = false;
+	cl_command_buffer_khr commandBuffer = nullptr;
+	bool commandBufferStale = false;			// NOTE: Set by patchKernelArg(), the command buffer gets recorded again on the next replay.
+	bool simultaneousUse = false;				// NOTE: Whether the implementation took CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR.
+	OpenCLEvent lastReplay;						// NOTE: Last native replay, only kept without simultaneous use.
+	bool finalized = false;
+
+	custom_vector<Command, 4> commands;
+	custom_vector<Arg, 8> args;
+	custom_vector<unsigned char, 64> argValues;
+	custom_vector<KernelState, 4> kernelStates;
+
+	size_t findArg(size_t command, cl_uint index) const noexcept;
+	bool isSameArgValue(const Arg& left, const Arg& right) const noexcept;
+	cl_int storeArg(size_t command, cl_uint index, size_t size, const void* value, size_t& argIndex) noexcept;
+	cl_int setArg(cl_kernel kernel, const Arg& arg) noexcept;
+	cl_int applyArgs(size_t command) noexcept;
+	cl_int buildCommandBuffer() noexcept;
+	void releaseCommandBuffer() noexcept;
+
+public:
+	CommandRecording() noexcept = default;
+
+	// Pass false as allowNative to always use the emulated path (useful for comparing the two).
+	CommandRecording(cl_int& err, cl_device_id device, cl_command_queue queue, bool allowNative = true) noexcept;
+
+	CommandRecording& operator=(const CommandRecording& right) = delete;
+
+	CommandRecording(CommandRecording&& other) noexcept;
+
+	// Records a kernel launch. commandIndex is what you pass to recordKernelArg() and patchKernelArg(). Pass nullptr as the local size to
+	// let the implementation choose.
+	cl_int recordNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize, size_t& commandIndex) noexcept;
+
+	// Records an argument of a recorded kernel launch. Pass nullptr as the value for __local arguments.
+	cl_int recordKernelArg(size_t commandIndex, cl_uint argIndex, size_t size, const void* value) noexcept;
+
+	template <typename value_t>
+	cl_int recordKernelArg(size_t commandIndex, cl_uint argIndex, const value_t& value) noexcept { return recordKernelArg(commandIndex, argIndex, sizeof(value_t), &value); }
+
+	cl_int recordCopyBuffer(cl_mem srcBuffer, cl_mem dstBuffer, size_t srcOffset, size_t dstOffset, size_t size) noexcept;
+
+	// Ends the recording. Returns CL_EXT_COMMAND_RECORDING_FINALIZED if you try to record something afterwards.
+	cl_int finalize() noexcept;
+
+	// NOTE: An empty recording is just a marker (if there's a wait list or an event), which returns CL_EXT_FUNCTION_UNAVAILABLE below OpenCL 1.2.
+	cl_int replay(cl_uint numEventsInWaitList = 0, const cl_event* eventWaitList = nullptr, cl_event* event = nullptr) noexcept;
+
+	// Changes an argument that was recorded with recordKernelArg() (or adds one). Works before and after finalize().
+	cl_int patchKernelArg(size_t commandIndex, cl_uint argIndex, size_t size, const void* value) noexcept;
+
+	template <typename value_t>
+	cl_int patchKernelArg(size_t commandIndex, cl_uint argIndex, const value_t& value) noexcept { return patchKernelArg(commandIndex, argIndex, sizeof(value_t), &value); }
+
+	// Forgets which arguments the kernels have, so that the next replay sets every recorded argument again.
+	void invalidate_kernel_args() noexcept;
+
+	// Whether replays go through a cl_khr_command_buffer command buffer. Only meaningful after finalize().
+	bool is_native() const noexcept { return commandBuffer; }
+
+	size_t get_command_count() const noexcept { return commands.length; }
+
+	~CommandRecording() noexcept;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <future>			// for std::future and std::promise
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>		// for std::coroutine_handle
+#define CL_EXT_COROUTINES_AVAILABLE
+#endif
+
+// NOTE: Everything in here is built on clSetEventCallback, so nothing ever blocks a host thread. The event callbacks run on some thread
+// that belongs to the OpenCL implementation though, and the spec forbids calling blocking OpenCL functions (clFinish, clWaitForEvents,
+// blocking reads and writes) from there. Keep that in mind for whatever code runs as a result of the callback.
+// NOTE: None of these take ownership of the event you give them, you still have to release it yourself (after the wait has finished).
+// NOTE: clSetEventCallback is OpenCL 1.1. With older libraries, getEventFuture() fails and co_await gives back CL_EXT_FUNCTION_UNAVAILABLE.
+
+// Returns a future which becomes ready once the event completes. The value is CL_SUCCESS if the command completed successfully
+// and the (negative) error code of the command if it was terminated.
+// NOTE: Works on any C++ version, for when you can't use the coroutine version below.
+std::future<cl_int> getEventFuture(cl_int& err, cl_event event) noexcept;
+
+#ifdef CL_EXT_COROUTINES_AVAILABLE
+
+// NOTE: Gets called with the address of the coroutine that should be resumed. Use this to move the resumption off of the OpenCL callback thread,
+// for example by pushing std::coroutine_handle<>::from_address(coroutineAddress) into the work queue of your own thread pool.
+typedef void (*EventResumeExecutor)(void* coroutineAddress, void* executorData);
+
+class EventAwaiter {
+	cl_event event;
+	EventResumeExecutor executor;
+	void* executorData;
+	std::coroutine_handle<> handle;
+	cl_int status = CL_SUCCESS;
+
+	static void CL_CALLBACK callback(cl_event, cl_int event_command_status, void* user_data) noexcept {
+		EventAwaiter& awaiter = *(EventAwaiter*)user_data;
+		awaiter.status = event_command_status < 0 ? event_command_status : CL_SUCCESS;
+		// NOTE: Copying these out is important, since resuming can destroy the coroutine frame that the awaiter lives in.
+		std::coroutine_handle<> handle = awaiter.handle;
+		EventResumeExecutor executor = awaiter.executor;
+		if (executor) { executor(handle.address(), awaiter.executorData); return; }
+		handle.resume();
+	}
+
+public:
+	constexpr EventAwaiter(cl_event event, EventResumeExecutor executor, void* executorData) noexcept : event(event), executor(executor), executorData(executorData) { }
+
+	bool await_ready() noexcept {
+		if (!clSetEventCallback) { status = CL_EXT_FUNCTION_UNAVAILABLE; return true; }
+		// NOTE: Cheap check that saves us from registering a callback (and the thread hop) if the command is already done.
+		cl_int executionStatus;
+		cl_int err = clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &executionStatus, nullptr);
+		if (err != CL_SUCCESS) { status = err; return true; }
+		if (executionStatus <= CL_COMPLETE) { status = executionStatus < 0 ? executionStatus : CL_SUCCESS; return true; }
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle) noexcept {
+		this->handle = handle;
+		// NOTE: The callback can run (and resume the coroutine) before clSetEventCallback even returns, so we can't touch any members
+		// after this call if it succeeded.
+		cl_int err = clSetEventCallback(event, CL_COMPLETE, callback, this);
+		if (err != CL_SUCCESS) { status = err; return false; }
+		return true;
+	}
+
+	constexpr cl_int await_resume() const noexcept { return status; }
+};
+
+// Lets you do "cl_int status = co_await awaitEvent(event);". status follows the same rules as the value of getEventFuture().
+// NOTE: Without an executor, the coroutine gets resumed directly on the OpenCL callback thread.
+constexpr EventAwaiter awaitEvent(cl_event event, EventResumeExecutor executor = nullptr, void* executorData = nullptr) noexcept {
+	return EventAwaiter(event, executor, executorData);
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+#include <vector>			// for std::vector
+
+// NOTE: The event graph lets you describe a bunch of device commands (and host callbacks) together with the buffers they touch,
+// and then works out the event wait lists for you. Independent branches get spread across the queues you give it, so they can overlap,
+// where-as dependent commands wait on exactly the events they need to and nothing more. Once compiled, the graph can be executed as many
+// times as you want without redoing any of the dependency work.
+// NOTE: Every queue and buffer that you give to a graph must belong to the context you construct it with, because user events and
+// cross-queue wait lists don't work across contexts.
+
+enum class EventGraphNode_type : uint8_t {
+	KERNEL,
+	COPY_BUFFER,
+	WRITE_BUFFER,
+	READ_BUFFER,
+	HOST_CALLBACK
+};
+
+enum class EventGraphBufferAccess : uint8_t {
+	READ,
+	WRITE,
+	READ_WRITE
+};
+
+struct EventGraphBufferDependency {
+	cl_mem buffer;
+	EventGraphBufferAccess access;
+};
+
+// NOTE: Host callbacks get called from whatever thread the OpenCL implementation uses for event callbacks, so don't call blocking OpenCL
+// functions (clFinish, clWaitForEvents, blocking reads and writes) from inside of them. That's forbidden by the spec.
+typedef void (*EventGraphHostCallback)(void* userData);
+
+class EventGraph {
+public:
+	typedef size_t node_id;
+
+private:
+	struct KernelArg {
+		cl_uint index;
+		size_t size;
+		size_t offset;				// NOTE: Offset into argBytes, or -1 if the arg is a local memory arg (value is nullptr).
+	};
+
+	struct Node {
+		EventGraphNode_type type;
+
+		cl_kernel kernel;
+		cl_uint work_dim;
+		size_t global_work_size[3];
+		size_t local_work_size[3];
+		bool has_local_work_size;
+		std::vector<KernelArg> args;
+		std::vector<unsigned char> argBytes;
+
+		cl_mem src_buffer;
+		cl_mem dst_buffer;
+		size_t src_offset;
+		size_t dst_offset;
+		size_t size;
+		void* host_ptr;
+
+		EventGraphHostCallback callback;
+		void* callbackUserData;
+
+		std::vector<EventGraphBufferDependency> bufferDependencies;
+		std::vector<node_id> explicitPredecessors;
+
+		// NOTE: Everything below this line is filled in by compile().
+		std::vector<node_id> predecessors;
+		std::vector<node_id> waitPredecessors;			// NOTE: Subset of predecessors whose events we actually have to wait on (different queue or host node).
+		size_t queueIndex;
+		bool needsEvent;
+		bool isSink;
+
+		cl_event event;
+	};
+
+	cl_context context;
+	std::vector<cl_command_queue> queues;
+	std::vector<bool> unflushedQueues;		// NOTE: Queues that got commands since their last flush, during execute().
+	std::vector<Node> nodes;
+
+	std::vector<node_id> executionOrder;
+	std::vector<cl_event> waitListScratch;
+	std::vector<cl_event> pendingEventScratch;
+
+	bool compiled = false;
+	bool inFlight = false;
+
+	node_id addNode(cl_int& err, EventGraphNode_type type, const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept;
+
+	cl_int flushWaitPredecessors(const Node& node) noexcept;
+	cl_int enqueueNode(Node& node) noexcept;
+
+	static void CL_CALLBACK hostCallbackTrampoline(cl_event event, cl_int event_command_status, void* user_data) noexcept;
+
+	void releaseEvents() noexcept;
+
+public:
+	EventGraph(cl_int& err, cl_context context, const cl_command_queue* queues, size_t queues_length) noexcept;
+
+	EventGraph(const EventGraph& other) = delete;
+	EventGraph& operator=(const EventGraph& right) = delete;
+	// NOTE: Copying and moving are deleted on purpose, since the host callback trampolines hold pointers into this object.
+
+	// NOTE: The global and local work size arrays are copied, so you don't have to keep them alive. local_work_size can be nullptr.
+	// The buffer dependencies describe which buffers the kernel reads and writes, which is what the edges of the graph get derived from.
+	node_id addKernel(cl_int& err, cl_kernel kernel, cl_uint work_dim, const size_t* global_work_size, const size_t* local_work_size,
+					  const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept;
+
+	// NOTE: Kernel objects are stateful, so you can't just set the args once and use the same kernel in multiple nodes.
+	// That's why the graph records the args per node and sets them right before it enqueues the node. arg_value can be nullptr for local memory args.
+	cl_int setKernelArg(node_id node, cl_uint arg_index, size_t arg_size, const void* arg_value) noexcept;
+
+	// NOTE: The dependencies of the copy nodes are derived from their arguments, so you don't have to declare them.
+	node_id addCopyBuffer(cl_int& err, cl_mem src_buffer, cl_mem dst_buffer, size_t src_offset, size_t dst_offset, size_t size) noexcept;
+	node_id addWriteBuffer(cl_int& err, cl_mem buffer, size_t offset, size_t size, const void* ptr) noexcept;
+	node_id addReadBuffer(cl_int& err, cl_mem buffer, size_t offset, size_t size, void* ptr) noexcept;
+
+	// NOTE: Returns CL_EXT_FUNCTION_UNAVAILABLE through err if the OpenCL library is older than 1.2 (see initOpenCLBindings()).
+	node_id addHostCallback(cl_int& err, EventGraphHostCallback callback, void* userData, const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept;
+
+	// Adds an edge that can't be expressed through buffer dependencies (for example two host callbacks that share host state).
+	cl_int addDependency(node_id before, node_id after) noexcept;
+
+	// Derives all the edges, sorts the nodes topologically, assigns queues and works out which events need to exist.
+	// NOTE: execute() calls this implicitly if the graph changed since the last compile, so you only need to call it if you want to
+	// control when the work happens.
+	cl_int compile() noexcept;
+
+	// Enqueues the whole graph without blocking. If the previous execution hasn't been waited on yet, this waits on it first.
+	// Every queue that got commands is flushed by the time this returns, so the graph makes progress (and host callbacks fire) without wait().
+	// NOTE: The queues have to be in-order queues, since commands on the same queue rely on the queue order instead of events.
+	cl_int execute() noexcept;
+
+	// Blocks until every sink of the graph (every node that nothing else depends on) has completed.
+	cl_int wait() noexcept;
+
+	size_t get_node_count() const noexcept { return nodes.size(); }
+
+	~EventGraph() noexcept;
+};
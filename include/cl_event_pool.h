@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: The event pool is meant for high-rate submission paths, where every enqueue produces an event that eventually has to be
+// waited on and released. All the bookkeeping lives in arrays that get allocated once in the constructor, so acquiring and recycling
+// slots never touches the heap. Enqueue functions write their event straight into the slot (see get_event_ptr()).
+// NOTE: clWaitForEvents only accepts events from a single context, so use one pool per context.
+// NOTE: The pool isn't thread-safe. Use one per submission thread, which is what you want for performance anyway.
+
+// Gets called once the event of a slot has completed (or was terminated, in which case status is the negative error code).
+// The event is already released by the time this is called and the slot is free again.
+typedef void (*EventPoolCompletionCallback)(size_t slot, cl_int status, void* userData);
+
+class EventPool {
+	struct Slot {
+		cl_event event;
+		EventPoolCompletionCallback callback;
+		void* userData;
+		size_t activeIndex;
+	};
+
+	Slot* slots = nullptr;
+	size_t* freeSlots = nullptr;			// NOTE: Used as a stack.
+	size_t freeSlots_length = 0;
+	size_t* activeSlots = nullptr;			// NOTE: Dense list of the slots that are in use, so that sweeps don't have to skip over free slots.
+	size_t activeSlots_length = 0;
+	cl_event* waitScratch = nullptr;
+
+	void retireActiveSlot(size_t activeIndex, cl_int status) noexcept;
+
+public:
+	size_t capacity = 0;
+
+	constexpr EventPool() noexcept = default;
+
+	EventPool(cl_int& err, size_t capacity) noexcept;
+
+	EventPool& operator=(const EventPool& right) = delete;
+
+	EventPool(EventPool&& other) noexcept;
+
+	// Hands out a free slot. Returns CL_EXT_EVENT_POOL_EXHAUSTED if there isn't one, in which case you should poll() or waitAll() first.
+	cl_int acquire(size_t& slot, EventPoolCompletionCallback callback = nullptr, void* userData = nullptr) noexcept;
+
+	// Pass this as the event out-param of whatever enqueue function you're calling.
+	cl_event* get_event_ptr(size_t slot) noexcept { return &slots[slot].event; }
+
+	// Gives back a slot whose enqueue failed. If an event did get written into the slot, it gets released.
+	void cancel(size_t slot) noexcept;
+
+	// Checks the status of every outstanding event in one sweep and retires all of the completed ones.
+	// completedCount gets set to the number of slots that were retired.
+	cl_int poll(size_t& completedCount) noexcept;
+
+	// Waits on every outstanding event with a single clWaitForEvents call and then retires all of them.
+	cl_int waitAll() noexcept;
+
+	size_t get_outstanding_count() const noexcept { return activeSlots_length; }
+	size_t get_free_count() const noexcept { return freeSlots_length; }
+
+	~EventPool() noexcept;
+};
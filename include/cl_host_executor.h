@@ -0,0 +1,194 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+
+#include <cstdint>			// for fixed-width types
+#include <atomic>			// for std::atomic
+#include <condition_variable>	// for std::condition_variable
+#include <functional>		// for std::function
+#include <mutex>			// for std::mutex
+#include <thread>			// for std::thread
+#include <tuple>			// for std::tuple and std::apply
+#include <utility>			// for std::forward
+#include <vector>			// for std::vector
+
+// NOTE: The host executor runs C++ callables over the same global/local ND-range model that OpenCL kernels use, on a thread pool.
+// It's the fallback for machines without a usable OpenCL platform (see isHostFallbackError()), and it lets kernel-launch code run on
+// test machines without GPUs. HostKernel<args_t...> mirrors Kernel<args_t...> (see cl_kernel_launcher.h): setArgs(), enqueueNDRange()
+// and enqueue() take the same NDRange sizes, just with a HostExecutor instead of a command queue.
+// NOTE: Work groups get distributed over the threads, and every work group runs start to finish on one thread. Barriers are done through
+// loop splitting: a HostKernel is a list of phases, and every phase runs for every work item of the group before the next phase starts,
+// which is exactly what a work-group barrier between the phases would do. That means values that have to survive a barrier can't live in
+// local variables of a phase, put them into the local memory arena instead (indexed by get_local_linear_id()).
+// NOTE: Within a phase, work items run in order with dimension 0 innermost, and the callable gets inlined into that loop, so simple
+// phases vectorize. For full control, use addGroupPhase(), which gets the whole work group and does its own loop.
+
+struct HostWorkGroup {
+	cl_uint dimensions;
+	size_t global_size[3];
+	size_t local_size[3];
+	size_t num_groups[3];
+	size_t group_id[3];
+	unsigned char* local_memory;		// NOTE: 64-byte aligned, uninitialized, and only valid while the group runs.
+	size_t local_memory_size;
+
+	template <typename element_t>
+	element_t* get_local_memory(size_t byteOffset = 0) const noexcept { return (element_t*)(local_memory + byteOffset); }
+
+	size_t get_local_linear_size() const noexcept { return local_size[0] * local_size[1] * local_size[2]; }
+};
+
+struct HostWorkItem {
+	const HostWorkGroup* group;
+	size_t local_id[3];
+	size_t global_id[3];
+
+	size_t get_global_id(cl_uint dimension) const noexcept { return global_id[dimension]; }
+	size_t get_local_id(cl_uint dimension) const noexcept { return local_id[dimension]; }
+	size_t get_group_id(cl_uint dimension) const noexcept { return group->group_id[dimension]; }
+	size_t get_global_size(cl_uint dimension) const noexcept { return group->global_size[dimension]; }
+	size_t get_local_size(cl_uint dimension) const noexcept { return group->local_size[dimension]; }
+	size_t get_num_groups(cl_uint dimension) const noexcept { return group->num_groups[dimension]; }
+	size_t get_local_linear_id() const noexcept { return (local_id[2] * group->local_size[1] + local_id[1]) * group->local_size[0] + local_id[0]; }
+};
+
+// Runs func(const HostWorkItem&) for every work item of the group, dimension 0 innermost.
+template <typename func_t>
+inline void forEachHostWorkItem(const HostWorkGroup& group, func_t&& func) {
+	HostWorkItem item;
+	item.group = &group;
+	size_t groupOrigin[3] = { group.group_id[0] * group.local_size[0], group.group_id[1] * group.local_size[1], group.group_id[2] * group.local_size[2] };
+	for (size_t z = 0; z < group.local_size[2]; z++) {
+		item.local_id[2] = z;
+		item.global_id[2] = groupOrigin[2] + z;
+		for (size_t y = 0; y < group.local_size[1]; y++) {
+			item.local_id[1] = y;
+			item.global_id[1] = groupOrigin[1] + y;
+			for (size_t x = 0; x < group.local_size[0]; x++) {
+				item.local_id[0] = x;
+				item.global_id[0] = groupOrigin[0] + x;
+				func(item);
+			}
+		}
+	}
+}
+
+// Gets called once per work group, from whatever pool thread the group landed on.
+typedef void (*HostWorkGroupFunction)(HostWorkGroup& group, void* userData);
+
+class HostExecutor {
+	struct Worker {
+		std::thread thread;
+		unsigned char* localMemory = nullptr;
+		size_t localMemoryCapacity = 0;
+	};
+
+	Worker* workers = nullptr;
+	size_t workers_length = 0;			// NOTE: Index 0 is the calling thread, which works along instead of waiting.
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobDone;
+	uint64_t jobGeneration = 0;
+	size_t busyWorkerCount = 0;
+	bool shuttingDown = false;
+
+	HostWorkGroupFunction jobFunction;
+	void* jobUserData;
+	HostWorkGroup jobTemplate;
+	size_t jobGroupCount;
+	std::atomic<size_t> nextGroup { 0 };
+
+	void workerLoop(size_t workerIndex) noexcept;
+	void workOnJob(size_t workerIndex) noexcept;
+	cl_int reserveLocalMemory(size_t size) noexcept;
+
+public:
+	HostExecutor() noexcept = default;
+
+	// threadCount of 0 means one thread per hardware thread. The calling thread counts as one of them.
+	HostExecutor(cl_int& err, size_t threadCount = 0) noexcept;
+
+	HostExecutor& operator=(const HostExecutor& right) = delete;
+
+	// Runs function for every work group of the range and returns once all of them are done.
+	// localSize of NDRange() picks a local size on its own. Otherwise, it has to evenly divide the global size
+	// (CL_INVALID_WORK_GROUP_SIZE if it doesn't), same as in OpenCL 1.x.
+	// NOTE: Only one launch can run at a time, the executor isn't meant to be launched on from several threads at once.
+	cl_int execute(const NDRange& globalSize, const NDRange& localSize, size_t localMemorySize, HostWorkGroupFunction function, void* userData) noexcept;
+
+	size_t get_thread_count() const noexcept { return workers_length; }
+
+	~HostExecutor() noexcept;
+};
+
+// Errors after which falling back to the host executor makes sense, because there's no usable OpenCL implementation on the machine.
+constexpr bool isHostFallbackError(cl_int err) noexcept {
+	switch (err) {
+	case CL_EXT_DLL_LOAD_FAILURE:
+	case CL_EXT_DLL_FUNC_BIND_FAILURE:
+	case CL_EXT_NO_PLATFORMS_FOUND:
+	case CL_EXT_NO_DEVICES_FOUND_ON_PLATFORM:
+	case CL_EXT_NO_DEVICES_FOUND:
+		return true;
+	default: return false;
+	}
+}
+
+template <typename... args_t>
+class HostKernel {
+	typedef std::function<void(const HostWorkGroup&, const std::tuple<args_t...>&)> phase_t;
+
+	std::vector<phase_t> phases;
+	std::tuple<args_t...> argValues;
+
+	static void runGroup(HostWorkGroup& group, void* userData) noexcept {
+		HostKernel* kernel = (HostKernel*)userData;
+		for (const phase_t& phase : kernel->phases) { phase(group, kernel->argValues); }
+	}
+
+public:
+	size_t local_memory_size = 0;		// NOTE: Bytes of local memory per work group, the equivalent of __local buffers.
+
+	HostKernel() noexcept = default;
+
+	// Adds a phase that runs func(const HostWorkItem&, args...) for every work item. Consecutive phases are separated by a work-group barrier.
+	template <typename func_t>
+	HostKernel& addPhase(func_t func) {
+		phases.push_back([func](const HostWorkGroup& group, const std::tuple<args_t...>& args) {
+			std::apply([&](const args_t&... unpackedArgs) {
+				forEachHostWorkItem(group, [&](const HostWorkItem& item) { func(item, unpackedArgs...); });
+			}, args);
+		});
+		return *this;
+	}
+
+	// Adds a phase that runs func(const HostWorkGroup&, args...) once per work group and loops over the work items itself.
+	template <typename func_t>
+	HostKernel& addGroupPhase(func_t func) {
+		phases.push_back([func](const HostWorkGroup& group, const std::tuple<args_t...>& args) {
+			std::apply([&](const args_t&... unpackedArgs) { func(group, unpackedArgs...); }, args);
+		});
+		return *this;
+	}
+
+	template <typename... call_args_t>
+	cl_int setArgs(call_args_t&&... args) noexcept {
+		static_assert(sizeof...(call_args_t) == sizeof...(args_t), "HostKernel::setArgs failed: argument count doesn't match the declared kernel signature");
+		argValues = std::tuple<args_t...>(std::forward<call_args_t>(args)...);
+		return CL_SUCCESS;
+	}
+
+	cl_int enqueueNDRange(HostExecutor& executor, const NDRange& globalSize, const NDRange& localSize = NDRange()) noexcept {
+		return executor.execute(globalSize, localSize, local_memory_size, runGroup, this);
+	}
+
+	// NOTE: Unlike with Kernel<args_t...>, this blocks until the kernel is done, since there's no queue to wait on afterwards.
+	template <typename... call_args_t>
+	cl_int enqueue(HostExecutor& executor, const NDRange& globalSize, const NDRange& localSize, call_args_t&&... args) noexcept {
+		cl_int err = setArgs(std::forward<call_args_t>(args)...);
+		if (err != CL_SUCCESS) { return err; }
+		return enqueueNDRange(executor, globalSize, localSize);
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_profiling.h"
+
+#include <cstdint>			// for fixed-width types
+#include <vector>			// for std::vector
+#include <utility>			// for std::pair
+
+// NOTE: The instrumentation layer routes every bound function pointer (see CL_EXT_FOR_EACH_BOUND_FUNCTION) through a generated wrapper
+// that counts the calls, counts the errors per error code, adds up the bytes moved by the read/write/copy functions and records the
+// host-side latency of every call into a histogram. Everything is kept in relaxed atomics, so it's safe to use from any amount of threads.
+// NOTE: When disabled, the wrappers aren't installed at all, so there is zero overhead.
+
+struct OpenCLFunctionStats {
+	const char* name;
+	uint64_t call_count;
+	uint64_t error_count;							// NOTE: Calls that returned (or reported through errcode_ret) anything other than CL_SUCCESS.
+	std::vector<std::pair<cl_int, uint64_t>> errors_by_code;
+	uint64_t bytes_transferred;						// NOTE: Only counted for the buffer and image read/write/copy functions.
+	LatencyHistogram latency;						// NOTE: Host-side nanoseconds, from entering the wrapper to the original function returning.
+};
+
+// Installs the wrappers. Same rules as enableOpenCLTracing(): call it after binding, while no other thread is calling OpenCL functions,
+// and disable interposing modules in the reverse order of enabling them.
+cl_int enableOpenCLInstrumentation() noexcept;
+
+void disableOpenCLInstrumentation() noexcept;
+
+bool isOpenCLInstrumentationEnabled() noexcept;
+
+// Returns the statistics of every function that has been called at least once since the last reset.
+std::vector<OpenCLFunctionStats> getOpenCLInstrumentationStats() noexcept;
+
+// NOTE: Calls that are in progress while this runs can end up half in the old and half in the new statistics, which doesn't matter in practice.
+void resetOpenCLInstrumentationStats() noexcept;
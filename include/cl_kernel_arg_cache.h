@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+#include <thread>			// for std::thread::id
+
+// NOTE: Kernel argument state lives inside of the cl_kernel object and stays there between launches, so re-setting arguments that
+// haven't changed is pure overhead (and on some drivers, clSetKernelArg is surprisingly expensive). KernelArgCache keeps a shadow copy
+// of the bytes of every argument and only calls clSetKernelArg for arguments whose bytes actually changed.
+// For typed kernels, Kernel<args_t...> (see cl_kernel_launcher.h) does the same thing on its own.
+// NOTE: THREAD-CONFINEMENT: The shadow copy is only correct as long as every argument change goes through the cache, and a cl_kernel
+// can't be safely shared between threads anyway (the argument state is shared, so two threads would overwrite each other's arguments).
+// So the cache belongs to one thread: the first thread that calls set() owns it, and calls from any other thread fail
+// with CL_EXT_KERNEL_WRONG_THREAD. Use bind_to_current_thread() to hand the cache over to another thread on purpose.
+// If you change arguments behind the cache's back (by calling clSetKernelArg directly), call invalidate().
+
+// Arguments bigger than this are always set, without being shadowed. Every OpenCL C type fits (double16/long16 are 128 bytes).
+#define KERNEL_ARG_CACHE_MAX_SHADOWED_SIZE 128
+
+class KernelArgCache {
+	struct ShadowedArg {
+		size_t size;
+		bool isSet;
+		bool isLocal;
+		alignas(16) unsigned char bytes[KERNEL_ARG_CACHE_MAX_SHADOWED_SIZE];
+	};
+
+	ShadowedArg* args = nullptr;
+	std::thread::id owner;
+
+public:
+	cl_kernel kernel = nullptr;
+	cl_uint arg_count = 0;
+
+	// Number of clSetKernelArg calls that were actually made and that were skipped, for checking how much the cache is saving.
+	uint64_t set_count = 0;
+	uint64_t skip_count = 0;
+
+	KernelArgCache() noexcept = default;
+
+	// Queries the argument count of the kernel. The cache doesn't take ownership of the kernel.
+	KernelArgCache(cl_int& err, cl_kernel kernel) noexcept;
+
+	KernelArgCache& operator=(const KernelArgCache& right) = delete;
+
+	KernelArgCache(KernelArgCache&& other) noexcept;
+
+	// Same as clSetKernelArg, but skips the call if the argument already has exactly these bytes.
+	// Passing nullptr as value declares a __local argument of the given size, just like with clSetKernelArg.
+	cl_int set(cl_uint index, size_t size, const void* value) noexcept;
+
+	template <typename arg_t>
+	cl_int set(cl_uint index, const arg_t& value) noexcept { return set(index, sizeof(arg_t), &value); }
+
+	// Forgets every shadowed argument, so that the next set() of every argument goes through to clSetKernelArg.
+	void invalidate() noexcept;
+
+	// Makes the calling thread the owner of the cache.
+	void bind_to_current_thread() noexcept { owner = std::this_thread::get_id(); }
+
+	~KernelArgCache() noexcept;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+#include <cstring>			// for std::memcmp
+#include <bitset>			// for std::bitset
+#include <thread>			// for std::thread::id
+#include <string>			// for std::string
+#include <tuple>			// for std::tuple
+#include <type_traits>		// for type traits
+#include <utility>			// for std::index_sequence and std::forward
+
+// NOTE: Kernel<args_t...> wraps a kernel together with its declared signature, so that all of the arguments can be set and the kernel
+// enqueued with one call. The argument count and the argument types are checked at compile time against the declared signature,
+// and the argument values live in a std::tuple inside of the wrapper, so the storage is sized once, at compile time.
+// The only thing that can't be checked at compile time is whether the declared signature matches the kernel source, so
+// setupComputeKernelFromString() at least compares the argument counts (see CL_EXT_KERNEL_ARG_COUNT_MISMATCH).
+// NOTE: The stored argument values double as a shadow copy of the argument state inside of the cl_kernel, so arguments whose bytes
+// haven't changed since the last launch don't get set again. This has the same thread-confinement rules as KernelArgCache
+// (see cl_kernel_arg_cache.h): the first thread that sets arguments owns the wrapper, other threads get CL_EXT_KERNEL_WRONG_THREAD.
+// NOTE: This module is header-only, there is no source file to compile.
+
+// Declares a __local kernel argument. Only the size gets passed to the kernel, the implementation allocates the memory.
+struct LocalMemory {
+	size_t size;
+
+	constexpr LocalMemory() noexcept : size(0) { }
+	constexpr LocalMemory(size_t size) noexcept : size(size) { }
+};
+
+// Global or local work size with 1 to 3 dimensions. The default one (0 dimensions) means "let the implementation choose" when used as a local size.
+// NOTE: The constructors are explicit so that they don't get mixed up with kernel arguments when calling Kernel::enqueue().
+struct NDRange {
+	cl_uint dimensions;
+	size_t sizes[3];
+
+	constexpr NDRange() noexcept : dimensions(0), sizes { 0, 0, 0 } { }
+	constexpr explicit NDRange(size_t x) noexcept : dimensions(1), sizes { x, 1, 1 } { }
+	constexpr explicit NDRange(size_t x, size_t y) noexcept : dimensions(2), sizes { x, y, 1 } { }
+	constexpr explicit NDRange(size_t x, size_t y, size_t z) noexcept : dimensions(3), sizes { x, y, z } { }
+
+	constexpr const size_t* get_sizes_ptr() const noexcept { return dimensions ? sizes : nullptr; }
+};
+
+// Checks whether a type can be declared as a kernel argument. The only pointer that's allowed is cl_mem (a handle, so a pointer to an
+// opaque struct), every other pointer is almost certainly a mistake, since host pointers mean nothing to the kernel.
+// NOTE: The bindings don't cover samplers, so cl_sampler arguments aren't a thing here.
+template <typename arg_t>
+struct is_valid_kernel_arg {
+	static constexpr bool value = std::is_trivially_copyable<arg_t>::value &&
+								  (!std::is_pointer<arg_t>::value || std::is_same<arg_t, cl_mem>::value) &&
+								  !std::is_reference<arg_t>::value &&
+								  sizeof(arg_t) <= 128;		// NOTE: Largest OpenCL C type is double16/long16.
+};
+
+template <typename arg_t>
+struct KernelArgSetter {
+	static cl_int set(cl_kernel kernel, cl_uint index, const arg_t& value) noexcept { return clSetKernelArg(kernel, index, sizeof(arg_t), &value); }
+	static bool equals(const arg_t& left, const arg_t& right) noexcept { return std::memcmp(&left, &right, sizeof(arg_t)) == 0; }
+};
+
+template <>
+struct KernelArgSetter<LocalMemory> {
+	static cl_int set(cl_kernel kernel, cl_uint index, const LocalMemory& value) noexcept { return clSetKernelArg(kernel, index, value.size, nullptr); }
+	static bool equals(const LocalMemory& left, const LocalMemory& right) noexcept { return left.size == right.size; }
+};
+
+template <typename... args_t>
+class Kernel {
+	static_assert((is_valid_kernel_arg<args_t>::value && ...), "Kernel failed: every declared kernel argument has to be trivially copyable, at most 128 bytes big and not a host pointer");
+
+	std::tuple<args_t...> argValues;
+	std::bitset<sizeof...(args_t)> argIsSet;
+	std::thread::id owner;
+
+	template <size_t index, typename call_arg_t>
+	cl_int setArg(call_arg_t&& value) noexcept {
+		typedef typename std::tuple_element<index, std::tuple<args_t...>>::type declared_arg_t;
+		static_assert(std::is_convertible<call_arg_t, declared_arg_t>::value, "Kernel::setArgs failed: argument isn't convertible to the declared kernel argument type");
+		declared_arg_t newValue = std::forward<call_arg_t>(value);
+		declared_arg_t& storedValue = std::get<index>(argValues);
+		if (argIsSet[index] && KernelArgSetter<declared_arg_t>::equals(storedValue, newValue)) { skip_count++; return CL_SUCCESS; }
+
+		cl_int err = KernelArgSetter<declared_arg_t>::set(kernel, index, newValue);
+		set_count++;
+		if (err != CL_SUCCESS) { argIsSet[index] = false; return err; }
+		storedValue = newValue;
+		argIsSet[index] = true;
+		return CL_SUCCESS;
+	}
+
+	template <size_t... indices, typename... call_args_t>
+	cl_int setArgsImpl(std::index_sequence<indices...>, call_args_t&&... args) noexcept {
+		cl_int err = CL_SUCCESS;
+		// NOTE: Stops at the first failure, the fold evaluates left to right.
+		((err == CL_SUCCESS ? (err = setArg<indices>(std::forward<call_args_t>(args))) : err), ...);
+		return err;
+	}
+
+public:
+	static constexpr size_t arg_count = sizeof...(args_t);
+
+	OpenCLProgram program;
+	OpenCLKernel kernel;
+	size_t kernelWorkGroupSize = 0;
+
+	// Number of clSetKernelArg calls that were actually made and that were skipped because the argument didn't change.
+	uint64_t set_count = 0;
+	uint64_t skip_count = 0;
+
+	Kernel() noexcept = default;
+
+	Kernel& operator=(const Kernel& right) = delete;
+
+	Kernel(Kernel&& other) noexcept : argValues(other.argValues), argIsSet(other.argIsSet), owner(other.owner), program(std::move(other.program)), kernel(std::move(other.kernel)),
+									  kernelWorkGroupSize(other.kernelWorkGroupSize), set_count(other.set_count), skip_count(other.skip_count) { }
+
+	Kernel& operator=(Kernel&& other) noexcept {
+		if (this == &other) { return *this; }
+		release();
+		argValues = other.argValues;
+		argIsSet = other.argIsSet;
+		owner = other.owner;
+		program = std::move(other.program);
+		kernel = std::move(other.kernel);
+		kernelWorkGroupSize = other.kernelWorkGroupSize;
+		set_count = other.set_count;
+		skip_count = other.skip_count;
+		return *this;
+	}
+
+	// Sets every kernel argument whose value changed since it was last set. Doesn't compile if the count doesn't match or if an argument
+	// isn't convertible to its declared type.
+	template <typename... call_args_t>
+	cl_int setArgs(call_args_t&&... args) noexcept {
+		static_assert(sizeof...(call_args_t) == sizeof...(args_t), "Kernel::setArgs failed: argument count doesn't match the declared kernel signature");
+		std::thread::id currentThread = std::this_thread::get_id();
+		if (owner == std::thread::id()) { owner = currentThread; }
+		else if (owner != currentThread) { return CL_EXT_KERNEL_WRONG_THREAD; }
+		return setArgsImpl(std::index_sequence_for<args_t...>{}, std::forward<call_args_t>(args)...);
+	}
+
+	// Enqueues the kernel with whatever arguments are currently set.
+	cl_int enqueueNDRange(cl_command_queue queue, const NDRange& globalSize, const NDRange& localSize = NDRange(),
+						  cl_uint numEventsInWaitList = 0, const cl_event* eventWaitList = nullptr, cl_event* event = nullptr) noexcept {
+		return clEnqueueNDRangeKernel(queue, kernel, globalSize.dimensions, nullptr, globalSize.sizes, localSize.get_sizes_ptr(), numEventsInWaitList, eventWaitList, event);
+	}
+
+	// Sets every kernel argument and enqueues the kernel. Pass NDRange() as the local size to let the implementation choose.
+	// NOTE: If you need wait lists or events, use setArgs() and enqueueNDRange() separately.
+	template <typename... call_args_t>
+	cl_int enqueue(cl_command_queue queue, const NDRange& globalSize, const NDRange& localSize, call_args_t&&... args) noexcept {
+		cl_int err = setArgs(std::forward<call_args_t>(args)...);
+		if (err != CL_SUCCESS) { return err; }
+		return enqueueNDRange(queue, globalSize, localSize);
+	}
+
+	template <size_t index>
+	const typename std::tuple_element<index, std::tuple<args_t...>>::type& get_arg() const noexcept { return std::get<index>(argValues); }
+
+	// Call this if you changed arguments of the cl_kernel directly, so that the next setArgs() sets every argument again.
+	void invalidate_args() noexcept { argIsSet.reset(); }
+
+	// Makes the calling thread the owner of the wrapper.
+	void bind_to_current_thread() noexcept { owner = std::this_thread::get_id(); }
+
+	void release() noexcept {
+		argIsSet.reset();
+		kernel.reset();
+		program.reset();
+	}
+
+	// NOTE: No destructor needed, the handles release themselves (the kernel first, since it's declared after the program).
+};
+
+// Typed version of setupComputeKernelFromString(). On top of the normal setup, compares the argument count of the kernel with the declared
+// signature and returns CL_EXT_KERNEL_ARG_COUNT_MISMATCH if they differ (in which case nothing is left allocated).
+// NOTE: Additionally uses clGetKernelInfo.
+template <typename... args_t>
+cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, Kernel<args_t...>& kernel, std::string& buildLog, const char* buildOptions = nullptr) noexcept {
+	kernel.release();
+
+	cl_int err = setupComputeKernelFromString(context, device, sourceCodeString, kernelName, kernel.program, kernel.kernel, kernel.kernelWorkGroupSize, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+
+	cl_uint argCount;
+	err = clGetKernelInfo(kernel.kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &argCount, nullptr);
+	if (err != CL_SUCCESS) { kernel.release(); return err; }
+	if (argCount != sizeof...(args_t)) { kernel.release(); return CL_EXT_KERNEL_ARG_COUNT_MISMATCH; }
+
+	return CL_SUCCESS;
+}
+
+template <typename... args_t>
+cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, Kernel<args_t...>& kernel, std::string& buildLog, const char* buildOptions = nullptr) noexcept {
+	kernel.release();
+
+	cl_int err = setupComputeKernelFromFile(context, device, sourceCodeFile, kernelName, kernel.program, kernel.kernel, kernel.kernelWorkGroupSize, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+
+	cl_uint argCount;
+	err = clGetKernelInfo(kernel.kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &argCount, nullptr);
+	if (err != CL_SUCCESS) { kernel.release(); return err; }
+	if (argCount != sizeof...(args_t)) { kernel.release(); return CL_EXT_KERNEL_ARG_COUNT_MISMATCH; }
+
+	return CL_SUCCESS;
+}
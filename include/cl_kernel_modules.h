@@ -0,0 +1,155 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+
+#include <cstdint>			// for fixed-width types
+#include <string>			// for std::string
+#include <vector>			// for std::vector
+#include <map>				// for std::map
+#include <filesystem>		// for std::filesystem::file_time_type
+
+// NOTE: setupComputeKernelFromFile() hands one file to the compiler and leaves #include to the implementation, which means every
+// implementation resolves them a little differently and nobody on the host side knows what a program actually depends on.
+// The module loader resolves #include directives itself and hands the compiler one flattened source. Along the way it keeps the dependency
+// graph of every file it has seen, with a content hash per file, and a cache of built programs keyed by root file, context, device and
+// build options. A program only gets rebuilt if the hash over its transitive sources changed since it was built, otherwise the cached
+// program gets reused and only the kernel gets created.
+// NOTE: #include "file" is looked up relative to the including file first and then in the include directories, #include <file> only in
+// the include directories, in the order they were added. Files with #pragma once get included once per program.
+// NOTE: Includes get resolved whether or not they're inside an #if that turns out to be false (the loader doesn't evaluate the preprocessor),
+// so conditionally included files have to exist. Includes with a macro instead of a file name are left for the compiler.
+// NOTE: The flattened source has #line directives, so line numbers in build logs point at the original files.
+// NOTE: Files are only read again if their size or write time changed, and a changed file whose content hash stays the same (touched,
+// checked out again) doesn't cause a rebuild. Every setup call looks at the files again, so edits show up without any manual invalidation.
+// NOTE: The in-memory cache is for processes that set up kernels more than once (hot reloading, several contexts or devices, kernels that
+// get recreated). Programs stay cached there until forget_programs() or clear().
+// NOTE: With a binary cache directory, built programs also get written to disk (CL_PROGRAM_BINARIES), so that the next process skips the
+// compiler too. Binary files are keyed by the transitive source hash, the device name, the driver version and the build options, so a
+// source edit, a different GPU or a driver update each end up with a file of their own. The implementation gets the final say: a binary
+// that it rejects (or a file that's truncated or doesn't match its key) falls back to a build from source, which then overwrites the file.
+// Writing binaries is best effort, failures only mean that the next process builds from source again. Old files never get deleted.
+// NOTE: Not thread-safe.
+
+class KernelModuleLoader {
+	struct IncludeDirective {
+		size_t line_begin;				// NOTE: Offsets of the directive line in the content, so that flattening can cut it out.
+		size_t line_end;
+		size_t line_number;				// NOTE: 1-based.
+		bool is_pragma_once;
+		bool quoted;					// NOTE: #include "name" instead of #include <name>.
+		std::string name;				// NOTE: As written. Gets resolved on every walk, since include directories and files can come and go.
+	};
+
+	struct SourceFile {
+		std::string content;
+		uint64_t content_hash = 0;
+		std::filesystem::file_time_type write_time;
+		uintmax_t size = 0;
+		bool pragma_once = false;
+		std::vector<IncludeDirective> directives;
+		uint64_t checked_generation = 0;	// NOTE: Files get checked for changes once per setup call.
+	};
+
+	struct ProgramKey {
+		std::string root_path;
+		cl_context context;
+		cl_device_id device;
+		std::string build_options;
+
+		bool operator<(const ProgramKey& right) const noexcept;
+	};
+
+	struct CachedProgram {
+		OpenCLProgram program;
+		uint64_t source_hash;
+	};
+
+	std::vector<std::string> includeDirectories;
+	std::string binaryCacheDirectory;
+	std::map<std::string, SourceFile> files;
+	std::map<ProgramKey, CachedProgram> programs;
+	uint64_t generation = 0;
+
+	static void parseDirectives(const std::string& content, std::vector<IncludeDirective>& directives, bool& pragmaOnce);
+	cl_int resolveInclude(const std::string& includingFile, const std::string& name, bool quoted, std::string& path) const noexcept;
+	cl_int refreshFile(const std::string& path, std::string& log) noexcept;
+	cl_int walk(const std::string& path, std::vector<std::string>& stack, std::vector<std::string>& included, uint64_t& hash,
+				std::string* source, std::string& log) noexcept;
+	cl_int walkRoot(const char* rootFile, std::string& rootPath, uint64_t& hash, std::string* source, std::vector<std::string>* dependencies,
+					std::string& log) noexcept;
+	cl_int getBinaryKey(cl_device_id device, uint64_t sourceHash, const char* buildOptions, uint64_t& key) const noexcept;
+	std::string getBinaryPath(uint64_t key) const;
+	bool loadBinary(cl_context context, cl_device_id device, uint64_t key, const char* buildOptions, OpenCLProgram& program) noexcept;
+	void saveBinary(cl_device_id device, cl_program program, uint64_t key) noexcept;
+
+public:
+	// Statistics since construction.
+	uint64_t build_count = 0;
+	uint64_t reuse_count = 0;
+	uint64_t file_read_count = 0;
+	uint64_t binary_load_count = 0;
+	uint64_t binary_reject_count = 0;		// NOTE: Binary files that were there but couldn't be used.
+	uint64_t binary_save_count = 0;
+
+	KernelModuleLoader() noexcept = default;
+
+	KernelModuleLoader& operator=(const KernelModuleLoader& right) = delete;
+
+	KernelModuleLoader(KernelModuleLoader&& other) noexcept = default;
+
+	cl_int addIncludeDirectory(const char* directory) noexcept;
+
+	// Turns on the binary cache (see above). The directory gets created if it doesn't exist. nullptr turns the binary cache off again.
+	cl_int setBinaryCacheDirectory(const char* directory) noexcept;
+
+	// Gives back the program for the root file, built from the flattened source with the build options, and reuses the cached one if none
+	// of its sources changed. If it isn't cached in memory, the binary cache gets tried before the compiler.
+	// program gets its own reference, releasing it doesn't affect the cache.
+	// NOTE: Unresolvable includes return CL_EXT_FILE_OPEN_FAILED and include cycles CL_EXT_KERNEL_INCLUDE_CYCLE, in both cases with
+	// an explanation in buildLog. Build failures are the same as in setupComputeKernelFromString().
+	cl_int getProgram(cl_context context, cl_device_id device, const char* rootFile, OpenCLProgram& program, std::string& buildLog,
+					  const char* buildOptions = nullptr) noexcept;
+
+	// Same as setupComputeKernelFromFile(), but with the include resolution and the program cache of the loader.
+	cl_int setupComputeKernel(cl_context context, cl_device_id device, const char* rootFile, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel,
+							  size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions = nullptr) noexcept;
+
+	// Typed version, which also checks the argument count like the typed setupComputeKernelFromFile().
+	template <typename... args_t>
+	cl_int setupComputeKernel(cl_context context, cl_device_id device, const char* rootFile, const char* kernelName, Kernel<args_t...>& kernel,
+							  std::string& buildLog, const char* buildOptions = nullptr) noexcept {
+		kernel.release();
+
+		cl_int err = setupComputeKernel(context, device, rootFile, kernelName, kernel.program, kernel.kernel, kernel.kernelWorkGroupSize, buildLog, buildOptions);
+		if (err != CL_SUCCESS) { return err; }
+
+		cl_uint argCount;
+		err = clGetKernelInfo(kernel.kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &argCount, nullptr);
+		if (err != CL_SUCCESS) { kernel.release(); return err; }
+		if (argCount != sizeof...(args_t)) { kernel.release(); return CL_EXT_KERNEL_ARG_COUNT_MISMATCH; }
+
+		return CL_SUCCESS;
+	}
+
+	// The flattened source that the compiler gets for the root file. Useful for debugging include problems.
+	cl_int preprocess(const char* rootFile, std::string& source, std::string& log) noexcept;
+
+	// Every file that the root file depends on (itself included), in the order they get included.
+	cl_int getDependencies(const char* rootFile, std::vector<std::string>& dependencies, std::string& log) noexcept;
+
+	// Hash over the content of every file that the root file depends on. The cached programs get rebuilt whenever it changes.
+	cl_int getSourceHash(const char* rootFile, uint64_t& hash, std::string& log) noexcept;
+
+	size_t get_cached_program_count() const noexcept { return programs.size(); }
+
+	// Releases the cached programs (programs and kernels that you still hold stay valid). Do this before releasing a context that programs
+	// were cached for, otherwise the cache keeps the context alive.
+	void forget_programs() noexcept { programs.clear(); }
+
+	// Also forgets the files, so that everything gets read again.
+	void clear() noexcept {
+		programs.clear();
+		files.clear();
+	}
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+
+#include <cstdint>			// for fixed-width types
+#include <string>			// for std::string
+#include <vector>			// for std::vector
+#include <map>				// for std::map
+#include <chrono>			// for std::chrono::steady_clock
+
+// NOTE: One logical kernel, several compiled specializations of it. Every variant is the same kernel built with different build options
+// (-D tile sizes, vector widths, -cl-fast-relaxed-math, ...), and KernelVariants picks one per launch, based on the global size.
+// NOTE: Nobody knows the crossover points up front (they depend on the device, the driver and the problem), so they get learned by timing:
+// the first samples_per_variant launches of every applicable variant in a size class are measured, after that the variant with the
+// fastest measured launch in that size class wins every launch. Size classes come from the autotuner's calcWorkSizeClass(), so each
+// dimension of the global size rounded up to the next power of two.
+// NOTE: Measured launches are synchronous (clFinish before and after, timed on the host), everything else is just an enqueue.
+// Exploration is over after (variant count * samples_per_variant) launches per size class, so it's only a handful of launches.
+// NOTE: Variants are built for one device, so the learned timings are per device too. Use one KernelVariants per device.
+// NOTE: Not thread-safe.
+
+// The non-template half of KernelVariants, which does the bookkeeping. Usable on its own if you launch the variants yourself.
+class KernelVariantSelector {
+	struct Variant {
+		std::string build_options;
+		NDRange local_size;				// NOTE: 0 dimensions means the implementation chooses.
+		NDRange global_multiple;		// NOTE: 0 dimensions means any global size works.
+	};
+
+	struct ShapeKey {
+		cl_uint dimensions;
+		cl_uint size_class[3];
+
+		bool operator<(const ShapeKey& right) const noexcept;
+	};
+
+	struct VariantTiming {
+		uint64_t best_time = (uint64_t)-1;
+		cl_uint sample_count = 0;
+	};
+
+	std::vector<Variant> variants;
+	std::map<ShapeKey, std::vector<VariantTiming>> timings;
+
+	static ShapeKey getShapeKey(const NDRange& globalSize) noexcept;
+	bool isApplicable(const Variant& variant, const NDRange& globalSize) const noexcept;
+
+public:
+	// Measured launches per variant and size class before the selector trusts its timings.
+	cl_uint samples_per_variant = 3;
+
+	// Registers a variant and gives back its index. The variant can only run global sizes that evenly divide into both its local size and
+	// its global multiple (for example the tile size it was built with). The dimensions have to match too, unless they're 0.
+	cl_int addVariant(const char* buildOptions, const NDRange& localSize, const NDRange& globalMultiple, size_t& variant) noexcept;
+
+	// Picks the variant for a launch. measure is true if the launch is part of the exploration, in which case pass its time to record().
+	// Returns CL_INVALID_GLOBAL_WORK_SIZE if none of the variants can run the global size.
+	cl_int select(const NDRange& globalSize, size_t& variant, bool& measure) const noexcept;
+
+	// Adds a measured launch (in nanoseconds) to the timings of the size class of globalSize.
+	void record(const NDRange& globalSize, size_t variant, uint64_t time) noexcept;
+
+	// Fastest measured launch of the variant in the size class of globalSize, (uint64_t)-1 if it wasn't measured yet.
+	uint64_t get_best_time(const NDRange& globalSize, size_t variant) const noexcept;
+
+	size_t get_variant_count() const noexcept { return variants.size(); }
+	const char* get_build_options(size_t variant) const noexcept { return variants[variant].build_options.c_str(); }
+	const NDRange& get_local_size(size_t variant) const noexcept { return variants[variant].local_size; }
+
+	// Forgets the timings, so that every size class gets explored again. The variants stay.
+	void reset_timings() noexcept { timings.clear(); }
+
+	void clear() noexcept {
+		variants.clear();
+		timings.clear();
+	}
+};
+
+template <typename... args_t>
+class KernelVariants {
+	custom_vector<Kernel<args_t...>, 4> kernels;
+	KernelVariantSelector selector;
+
+public:
+	// Build log of the last variant that failed to build.
+	std::string build_log;
+
+	// How often each variant was launched, measured launches included.
+	custom_vector<uint64_t, 4> launch_counts;
+
+	KernelVariants() noexcept = default;
+
+	KernelVariants& operator=(const KernelVariants& right) = delete;
+
+	KernelVariants(KernelVariants&& other) noexcept = default;
+	KernelVariants& operator=(KernelVariants&& other) noexcept = default;
+
+	// Builds the kernel with the build options (see setupComputeKernelFromString()) and adds it as a variant. See
+	// KernelVariantSelector::addVariant() for localSize and globalMultiple. On failure, nothing gets added.
+	cl_int addVariant(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, const char* buildOptions,
+					  size_t& variant, const NDRange& localSize = NDRange(), const NDRange& globalMultiple = NDRange()) noexcept {
+		// NOTE: Make room first, so that nothing can fail after the selector knows about the variant.
+		cl_int err = kernels.reserve(kernels.length + 1);
+		if (err != CL_SUCCESS) { return err; }
+		err = launch_counts.reserve(launch_counts.length + 1);
+		if (err != CL_SUCCESS) { return err; }
+
+		Kernel<args_t...> kernel;
+		err = setupComputeKernelFromString(context, device, sourceCodeString, kernelName, kernel, build_log, buildOptions);
+		if (err != CL_SUCCESS) { return err; }
+
+		err = selector.addVariant(buildOptions, localSize, globalMultiple, variant);
+		if (err != CL_SUCCESS) { return err; }
+		kernels.push_back(std::move(kernel));
+		launch_counts.push_back(0);
+		return CL_SUCCESS;
+	}
+
+	// Picks a variant for the global size (see KernelVariantSelector::select()), sets the arguments on it and enqueues it with its local size.
+	// NOTE: Launches that get measured finish before this returns.
+	template <typename... call_args_t>
+	cl_int enqueue(cl_command_queue queue, const NDRange& globalSize, call_args_t&&... args) noexcept {
+		size_t variant;
+		bool measure;
+		cl_int err = selector.select(globalSize, variant, measure);
+		if (err != CL_SUCCESS) { return err; }
+
+		Kernel<args_t...>& kernel = kernels[variant];
+		err = kernel.setArgs(std::forward<call_args_t>(args)...);
+		if (err != CL_SUCCESS) { return err; }
+
+		if (!measure) {
+			err = kernel.enqueueNDRange(queue, globalSize, selector.get_local_size(variant));
+			if (err == CL_SUCCESS) { launch_counts[variant]++; }
+			return err;
+		}
+
+		// NOTE: Drain the queue first, otherwise whatever was enqueued before ends up in the measurement.
+		err = clFinish(queue);
+		if (err != CL_SUCCESS) { return err; }
+		auto start = std::chrono::steady_clock::now();
+		err = kernel.enqueueNDRange(queue, globalSize, selector.get_local_size(variant));
+		if (err != CL_SUCCESS) { return err; }
+		err = clFinish(queue);
+		if (err != CL_SUCCESS) { return err; }
+		auto end = std::chrono::steady_clock::now();
+
+		selector.record(globalSize, variant, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		launch_counts[variant]++;
+		return CL_SUCCESS;
+	}
+
+	Kernel<args_t...>& get_kernel(size_t variant) noexcept { return kernels[variant]; }
+	KernelVariantSelector& get_selector() noexcept { return selector; }
+	size_t get_variant_count() const noexcept { return kernels.length; }
+};
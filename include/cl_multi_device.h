@@ -0,0 +1,133 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+#include "cl_work_stealing.h"
+
+#include <cstdint>			// for fixed-width types
+#include <string>			// for std::string
+#include <vector>			// for std::vector
+#include <atomic>			// for std::atomic
+
+// NOTE: The multi-device executor runs one data-parallel kernel across every selected device of an OpenCLDeviceCollection at the same time.
+// The range gets split along its last dimension (so rows for 2D ranges), proportionally to each device's throughput, and every device gets
+// its own queue, kernel object and buffers. Partitioned buffers get scattered to the devices slice by slice and gathered back the same way,
+// broadcast buffers get copied to every device whole.
+// NOTE: Throughput starts out as an estimate (compute units times clock frequency), which is rough, especially across device types.
+// After every run, the actual kernel time of every device (from profiling info) gets blended into the estimate, so the split converges
+// on the real ratio after a couple of runs. Use calibrate() to get there before the runs that matter.
+// NOTE: Every device only sees its own slice, starting at index 0. If the kernel needs to know where its slice starts in the whole range,
+// use setPartitionOffsetArg(), which passes the start of the slice (in the split dimension) as a ulong.
+// NOTE: The static split of run() breaks down when the devices differ wildly or when their load changes between runs, since the whole run
+// waits for the slowest device. runDynamic() cuts the range into chunks instead: every device works through its own share chunk by chunk
+// and steals chunks from the back of the other devices' shares once it runs out, with its chunk size adapted to its observed latency.
+// NOTE: The executor doesn't own the contexts, so the OpenCLDeviceCollection has to outlive it.
+
+enum class MultiDeviceBuffer_mode : uint8_t {
+	BROADCAST_INPUT,				// Whole buffer gets copied to every device before every run.
+	PARTITIONED_INPUT,				// Every device gets its slice before the run.
+	PARTITIONED_OUTPUT,				// Every device's slice gets read back after the run.
+	PARTITIONED_INPUT_OUTPUT
+};
+
+class MultiDeviceExecutor {
+	enum class Arg_type : uint8_t {
+		UNSET,
+		BUFFER,
+		SCALAR,
+		PARTITION_OFFSET
+	};
+
+	struct Arg {
+		Arg_type type = Arg_type::UNSET;
+		MultiDeviceBuffer_mode mode;
+		void* hostData;
+		size_t size;				// NOTE: Bytes per index of the split dimension for partitioned buffers, the whole size otherwise.
+		std::vector<unsigned char> scalarValue;
+	};
+
+	struct DeviceBuffer {
+		OpenCLMemObject buffer;
+		size_t capacity = 0;
+	};
+
+	struct Device {
+		cl_device_id device;
+		cl_context context;
+		OpenCLCommandQueue queue;
+		OpenCLKernel kernel;
+		double throughput;			// NOTE: Indices of the split dimension per nanosecond, once measured.
+		bool measuredOnce = false;
+		size_t start;
+		size_t count;
+		cl_event kernelEvent = nullptr;
+		std::vector<DeviceBuffer> buffers;
+		double chunkThroughput = 0;	// NOTE: Indices per nanosecond including transfers, as seen from the host. Used for sizing chunks in runDynamic().
+	};
+
+	std::vector<Device> devices;
+	std::vector<OpenCLProgram> programs;
+	std::vector<Arg> args;
+	size_t partitionGranularity = 1;
+
+	void partition(size_t totalCount) noexcept;
+	cl_int prepareDevice(Device& device, const NDRange& range, const NDRange& localSize, bool uploadBroadcastBuffers) noexcept;
+	void recordKernelTime(Device& device) noexcept;
+	void fillInUnmeasuredThroughputs() noexcept;
+	cl_int workOnChunks(size_t deviceIndex, WorkStealingRange* ranges, const NDRange& range, const NDRange& localSize, std::atomic<bool>& failed) noexcept;
+	void release() noexcept;
+
+public:
+	// Blend factor for new throughput measurements. 1 means only the last run counts, 0 means the estimate never changes.
+	double throughput_smoothing = 0.5;
+
+	// How long runDynamic() aims for one chunk to take (upload, kernel and readback), in nanoseconds. Smaller chunks balance better
+	// but pay the per-chunk overhead more often.
+	uint64_t target_chunk_latency = 2000000;
+
+	MultiDeviceExecutor() noexcept = default;
+
+	// Builds the kernel once per context and creates a queue and a kernel object for every selected device.
+	// If a build fails, buildLog gets the build log of the first selected device of that context.
+	MultiDeviceExecutor(cl_int& err, const OpenCLDeviceCollection& collection, const OpenCLDeviceIndexCollection& selectedDevices,
+						const char* sourceCodeString, const char* kernelName, std::string& buildLog) noexcept;
+
+	MultiDeviceExecutor& operator=(const MultiDeviceExecutor& right) = delete;
+
+	MultiDeviceExecutor(MultiDeviceExecutor&& other) noexcept;
+
+	// Host memory has to stay valid (and, for inputs, unchanged) until run() returns.
+	cl_int setBufferArg(cl_uint argIndex, MultiDeviceBuffer_mode mode, void* hostData, size_t size) noexcept;
+
+	// Same value on every device.
+	cl_int setScalarArg(cl_uint argIndex, size_t size, const void* value) noexcept;
+
+	template <typename value_t>
+	cl_int setScalarArg(cl_uint argIndex, const value_t& value) noexcept { return setScalarArg(argIndex, sizeof(value_t), &value); }
+
+	cl_int setPartitionOffsetArg(cl_uint argIndex) noexcept;
+
+	// Slices (except for the last one) are multiples of this, so that they work with fixed local sizes. Defaults to 1.
+	void set_partition_granularity(size_t granularity) noexcept { partitionGranularity = granularity ? granularity : 1; }
+
+	// Scatters, runs the kernel over the range on every device and gathers. Blocks until everything is done.
+	// NOTE: localSize is used on every device as is, so the split dimension of it has to divide the partition granularity.
+	cl_int run(const NDRange& range, const NDRange& localSize = NDRange()) noexcept;
+
+	// Same as run(), but with dynamic work stealing between the devices (see above). Uses one host thread per device.
+	// NOTE: Chunks are multiples of the partition granularity (except for the very last one), so the same local size rules apply as for run().
+	// NOTE: The split dimension is limited to 2^32 times the partition granularity.
+	cl_int runDynamic(const NDRange& range, const NDRange& localSize = NDRange()) noexcept;
+
+	// Runs the range repetitions times, so that the throughput measurements settle.
+	cl_int calibrate(const NDRange& range, cl_uint repetitions = 3) noexcept;
+
+	size_t get_device_count() const noexcept { return devices.size(); }
+	cl_device_id get_device(size_t index) const noexcept { return devices[index].device; }
+	cl_command_queue get_queue(size_t index) const noexcept { return devices[index].queue; }
+
+	// Share of the range that a device got in the last run (or would get, before the first run), between 0 and 1.
+	double get_share(size_t index) const noexcept;
+
+	~MultiDeviceExecutor() noexcept;
+};
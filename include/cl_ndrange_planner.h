@@ -0,0 +1,34 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_kernel_launcher.h"
+
+// NOTE: The planner turns a problem shape (the amount of work items you actually need, in 1 to 3 dimensions) into a global and local size
+// that the device can launch. The work-group size gets factored into the dimensions with calcSmallestBoundingBox(), so that work groups
+// are as square (or cubic) as possible, with the bigger factor going to dimension 0, since that's the one that's contiguous in memory
+// for the usual row-major layouts. Per-dimension limits (CL_DEVICE_MAX_WORK_ITEM_SIZES) and the problem shape itself are respected
+// by moving factors between dimensions, and the global size gets padded up to a multiple of the local size.
+// NOTE: Padding means that some work items are out of bounds, so kernels need a guard. Pass the bounds to the kernel and start it with:
+// if (get_global_id(0) >= bound_x || get_global_id(1) >= bound_y) { return; }
+// NOTE: Guarded work items still count for barriers, so if the kernel uses barriers, don't return early, skip the work instead.
+
+struct NDRangeLimits {
+	size_t max_work_group_size;			// NOTE: Use the kernel's CL_KERNEL_WORK_GROUP_SIZE here, not the device's maximum.
+	size_t max_work_item_sizes[3];
+	size_t preferred_work_group_size_multiple;
+};
+
+struct NDRangePlan {
+	NDRange global_size;
+	NDRange local_size;
+	size_t bounds[3];					// NOTE: The problem shape. Work items with get_global_id(d) >= bounds[d] are padding.
+	bool is_padded;
+};
+
+// Gathers the limits for launching the kernel on the device.
+// NOTE: Uses clGetKernelWorkGroupInfo and clGetDeviceInfo.
+cl_int getNDRangeLimits(cl_kernel kernel, cl_device_id device, NDRangeLimits& limits) noexcept;
+
+// Plans the launch of a problem with the given shape. Returns CL_INVALID_WORK_DIMENSION if the shape doesn't have 1 to 3 dimensions
+// and CL_INVALID_GLOBAL_WORK_SIZE if one of its sizes is 0.
+cl_int planNDRange(const NDRange& problemShape, const NDRangeLimits& limits, NDRangePlan& plan) noexcept;
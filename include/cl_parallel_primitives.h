@@ -0,0 +1,225 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+#include <string>			// for std::string
+#include <limits>			// for std::numeric_limits
+#include <algorithm>		// for std::min and std::max
+#include <vector>			// for std::vector
+
+// NOTE: Built-in data-parallel primitives: reduce, inclusive and exclusive scan, segmented inclusive scan, histogram and radix sort.
+// The kernel sources are embedded, and every (element type, operation) combination gets its own program, built the first time it's used
+// (with setupComputeKernelFromString()), so only what you actually use gets compiled.
+// NOTE: Work-group sizes come from the kernels themselves (the smallest CL_KERNEL_WORK_GROUP_SIZE of a program, rounded down to a power of two,
+// see get_work_group_size()), and the local memory gets sized to match, so nothing is hardcoded for a specific device.
+// NOTE: Everything gets enqueued on the queue you pass in and nothing blocks, so the results are ready once the queue gets there.
+// The queue has to be in-order, since the passes of one primitive depend on each other.
+// NOTE: Scratch buffers (one set per scan level, plus the radix sort ping-pong buffers) are kept around and only grow, so repeated calls
+// with similar sizes don't allocate. Use release_scratch() to give the memory back.
+// NOTE: Float reductions and scans combine the elements in a different order than a sequential loop, so compare them against the
+// host reference (see the bottom of this file) with a tolerance.
+// NOTE: Not thread-safe. Use one instance per queue.
+
+enum class PrimitiveType : uint8_t {
+	INT,
+	UINT,
+	FLOAT
+};
+
+enum class PrimitiveOperation : uint8_t {
+	SUM,
+	MIN,
+	MAX
+};
+
+class ParallelPrimitives {
+	struct ScanPrograms {
+		OpenCLProgram program;
+		OpenCLKernel reduce;
+		OpenCLKernel scanTiles;
+		OpenCLKernel addTileOffsets;
+		OpenCLKernel segmentedScanTiles;
+		OpenCLKernel addSegmentedTileOffsets;
+		size_t workGroupSize = 0;
+	};
+
+	struct UintPrograms {
+		OpenCLProgram program;
+		OpenCLKernel fill;
+		OpenCLKernel histogramLocal;
+		OpenCLKernel histogramGlobal;
+		OpenCLKernel radixCount;
+		OpenCLKernel radixScatter;
+		size_t workGroupSize = 0;
+	};
+
+	struct ScratchBuffer {
+		OpenCLMemObject buffer;
+		size_t capacity = 0;
+	};
+
+	// NOTE: One per level of the scan hierarchy. The tile totals of level n are the input of level n + 1, which scans them in place,
+	// so that they turn into the offsets of the tiles of level n. The flags are only used by the segmented scan.
+	struct ScanLevel {
+		ScratchBuffer totals;
+		ScratchBuffer totalFlags;
+		ScratchBuffer outputFlags;			// NOTE: Per element: whether a segment starts anywhere between the start of the tile and the element.
+	};
+
+	cl_context context = nullptr;
+	cl_device_id device = nullptr;
+	cl_command_queue queue = nullptr;
+	cl_ulong localMemorySize = 0;
+	cl_uint computeUnits = 0;
+
+	ScanPrograms scanPrograms[3][3];			// NOTE: [type][operation]
+	UintPrograms uintPrograms;
+	std::vector<ScanLevel> scanLevels;
+	ScratchBuffer reducePartials;
+	ScratchBuffer radixKeys;
+	ScratchBuffer radixValues;
+	ScratchBuffer radixDigitCounts;
+
+	cl_int ensureScratch(ScratchBuffer& scratch, size_t size) noexcept;
+	cl_int getScanPrograms(PrimitiveType type, PrimitiveOperation operation, ScanPrograms*& programs) noexcept;
+	cl_int getUintPrograms(UintPrograms*& programs) noexcept;
+	cl_int scanLevel(ScanPrograms& programs, size_t elementSize, size_t level, cl_mem input, cl_mem flags, cl_mem output, size_t count, bool exclusive) noexcept;
+	cl_int fillUint(cl_mem buffer, size_t count, cl_uint value) noexcept;
+
+public:
+	// Build log of the last program that failed to build.
+	std::string build_log;
+
+	ParallelPrimitives() noexcept = default;
+
+	ParallelPrimitives(cl_int& err, cl_context context, cl_device_id device, cl_command_queue queue) noexcept;
+
+	ParallelPrimitives& operator=(const ParallelPrimitives& right) = delete;
+
+	ParallelPrimitives(ParallelPrimitives&& other) noexcept = default;
+
+	// Combines all count elements of input into result[0]. An empty input gives the identity of the operation.
+	cl_int reduce(PrimitiveType type, PrimitiveOperation operation, cl_mem input, size_t count, cl_mem result) noexcept;
+
+	// output[i] = input[0] op ... op input[i]. Input and output can be the same buffer.
+	cl_int inclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem output, size_t count) noexcept;
+
+	// output[i] = input[0] op ... op input[i - 1], and the identity for output[0]. Input and output can be the same buffer.
+	cl_int exclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem output, size_t count) noexcept;
+
+	// Inclusive scan that starts over wherever flags (a cl_uint buffer) is non-zero, so every flagged element starts a new segment.
+	// Input and output can be the same buffer.
+	cl_int segmentedInclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem flags, cl_mem output, size_t count) noexcept;
+
+	// Counts the cl_uint keys into binCount cl_uint bins (which get zeroed first). Keys >= binCount are ignored.
+	// NOTE: Counts into local memory per work group if the bins fit, straight into global memory with atomics otherwise.
+	cl_int histogram(cl_mem keys, size_t count, cl_mem bins, cl_uint binCount) noexcept;
+
+	// Stable ascending sort of cl_uint keys, in place. If values isn't nullptr, it's a cl_uint buffer that gets permuted along with the keys
+	// (use indices as the values to sort anything else). Only the lowest keyBits bits get looked at, so pass fewer bits if the keys are small.
+	// NOTE: LSD radix sort with 4-bit digits, so ceil(keyBits / 4) passes. If keyBits isn't a multiple of 4, the last pass masks its digit
+	// down to the bits that are left.
+	cl_int radixSort(cl_mem keys, cl_mem values, size_t count, cl_uint keyBits = 32) noexcept;
+
+	// Work-group size that the scan kernels of that combination run with. Builds the program if it isn't built yet.
+	cl_int get_work_group_size(PrimitiveType type, PrimitiveOperation operation, size_t& workGroupSize) noexcept;
+
+	void release_scratch() noexcept;
+};
+
+// Host reference implementations, for validating the device results.
+
+template <typename value_t>
+constexpr value_t getPrimitiveIdentity(PrimitiveOperation operation) noexcept {
+	switch (operation) {
+	case PrimitiveOperation::MIN:
+		if constexpr (std::numeric_limits<value_t>::has_infinity) { return std::numeric_limits<value_t>::infinity(); }
+		else { return std::numeric_limits<value_t>::max(); }
+	case PrimitiveOperation::MAX:
+		if constexpr (std::numeric_limits<value_t>::has_infinity) { return -std::numeric_limits<value_t>::infinity(); }
+		else { return std::numeric_limits<value_t>::lowest(); }
+	default: return 0;
+	}
+}
+
+template <typename value_t>
+constexpr value_t applyPrimitiveOperation(PrimitiveOperation operation, const value_t& left, const value_t& right) noexcept {
+	switch (operation) {
+	case PrimitiveOperation::MIN: return std::min(left, right);
+	case PrimitiveOperation::MAX: return std::max(left, right);
+	default: return left + right;
+	}
+}
+
+template <typename value_t>
+value_t hostReduce(PrimitiveOperation operation, const value_t* input, size_t count) noexcept {
+	value_t result = getPrimitiveIdentity<value_t>(operation);
+	for (size_t i = 0; i < count; i++) { result = applyPrimitiveOperation(operation, result, input[i]); }
+	return result;
+}
+
+template <typename value_t>
+void hostInclusiveScan(PrimitiveOperation operation, const value_t* input, value_t* output, size_t count) noexcept {
+	value_t accumulator = getPrimitiveIdentity<value_t>(operation);
+	for (size_t i = 0; i < count; i++) {
+		accumulator = applyPrimitiveOperation(operation, accumulator, input[i]);
+		output[i] = accumulator;
+	}
+}
+
+template <typename value_t>
+void hostExclusiveScan(PrimitiveOperation operation, const value_t* input, value_t* output, size_t count) noexcept {
+	value_t accumulator = getPrimitiveIdentity<value_t>(operation);
+	for (size_t i = 0; i < count; i++) {
+		value_t element = input[i];				// NOTE: Read before writing, so that input and output can be the same array.
+		output[i] = accumulator;
+		accumulator = applyPrimitiveOperation(operation, accumulator, element);
+	}
+}
+
+template <typename value_t>
+void hostSegmentedInclusiveScan(PrimitiveOperation operation, const value_t* input, const cl_uint* flags, value_t* output, size_t count) noexcept {
+	value_t accumulator = getPrimitiveIdentity<value_t>(operation);
+	for (size_t i = 0; i < count; i++) {
+		accumulator = flags[i] ? input[i] : applyPrimitiveOperation(operation, accumulator, input[i]);
+		output[i] = accumulator;
+	}
+}
+
+inline void hostHistogram(const cl_uint* keys, size_t count, cl_uint* bins, cl_uint binCount) noexcept {
+	for (cl_uint i = 0; i < binCount; i++) { bins[i] = 0; }
+	for (size_t i = 0; i < count; i++) {
+		if (keys[i] < binCount) { bins[keys[i]]++; }
+	}
+}
+
+// Stable sort by the lowest keyBits bits, values (if not nullptr) get permuted along with the keys. Same result as radixSort().
+inline cl_int hostRadixSort(cl_uint* keys, cl_uint* values, size_t count, cl_uint keyBits = 32) noexcept {
+	cl_uint mask = keyBits >= 32 ? 0xFFFFFFFF : ((cl_uint)1 << keyBits) - 1;
+	size_t* order = new (std::nothrow) size_t[count];
+	cl_uint* keysCopy = new (std::nothrow) cl_uint[count];
+	cl_uint* valuesCopy = values ? new (std::nothrow) cl_uint[count] : nullptr;
+	if (!order || !keysCopy || (values && !valuesCopy)) {
+		delete[] order;
+		delete[] keysCopy;
+		delete[] valuesCopy;
+		return CL_EXT_INSUFFICIENT_HOST_MEM;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		order[i] = i;
+		keysCopy[i] = keys[i];
+		if (values) { valuesCopy[i] = values[i]; }
+	}
+	std::stable_sort(order, order + count, [keys, mask](size_t left, size_t right) { return (keys[left] & mask) < (keys[right] & mask); });
+	for (size_t i = 0; i < count; i++) {
+		keys[i] = keysCopy[order[i]];
+		if (values) { values[i] = valuesCopy[order[i]]; }
+	}
+
+	delete[] order;
+	delete[] keysCopy;
+	delete[] valuesCopy;
+	return CL_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: Moves buffer contents from one device to another without the usual read-to-host-then-write round trip through pageable memory.
+// NOTE: If both devices share a context (getAllOpenCLDevices() puts every device of a platform into one context), the copy is a plain
+// clEnqueueCopyBuffer() on the destination queue and migration is clEnqueueMigrateMemObjects(). The implementation then picks whatever
+// path it has between the devices (peer-to-peer over the bus, or its own staging), and nothing blocks. The destination queue waits for
+// everything that was enqueued on the source queue before the call, through a marker.
+// NOTE: Across contexts (different platforms, or devices that were set up separately), a memory object can't be used by the other side,
+// so the data goes through host memory after all, but through pinned staging buffers and in chunks: the read of chunk n + 1 from the source
+// device overlaps with the write of chunk n to the destination device. Events can't cross contexts either, so the host drives that
+// pipeline, which means staged copies block until the data has arrived.
+// NOTE: OpenCL has no standard peer-to-peer extension (the vendor ones need special allocations on both ends), so there's no third path.
+// NOTE: Same-context copies between two queues and migration need OpenCL 1.2 (markers, clEnqueueMigrateMemObjects()) and return
+// CL_EXT_FUNCTION_UNAVAILABLE with older libraries. Staged copies work with OpenCL 1.0.
+// NOTE: Both queues have to be in-order. Not thread-safe.
+
+struct PeerMigrationConfig {
+	// Bytes per staged chunk. Bigger chunks mean fewer, more efficient transfers, smaller ones more overlap between the two devices.
+	size_t chunk_size = (size_t)4 << 20;
+
+	// Staging buffers in flight. Two is enough for the read of one chunk to overlap with the write of the previous one, and it's also the
+	// minimum, fewer return CL_INVALID_VALUE from the constructor.
+	cl_uint staging_buffer_count = 2;
+
+	bool pinned_staging = true;
+};
+
+class PeerBufferMigrator {
+	struct StagingBuffer {
+		OpenCLMemObject pinnedBuffer;	// NOTE: The buffer that hostData is mapped from, nullptr if hostData comes from malloc.
+		void* hostData = nullptr;
+		OpenCLEvent read;				// NOTE: Read from the source device into hostData.
+		OpenCLEvent write;				// NOTE: Write from hostData to the destination device.
+	};
+
+	cl_context sourceContext = nullptr;
+	cl_command_queue sourceQueue = nullptr;
+	cl_context destinationContext = nullptr;
+	cl_command_queue destinationQueue = nullptr;
+	PeerMigrationConfig config;
+
+	custom_vector<StagingBuffer, 4> stagingBuffers;
+	size_t stagingCapacity = 0;
+
+	cl_int enqueueSourceMarker(OpenCLEvent& marker) noexcept;
+	cl_int ensureStaging(size_t size) noexcept;
+	void releaseStaging() noexcept;
+	void drainStaging() noexcept;
+
+public:
+	// Statistics since construction.
+	uint64_t direct_copy_count = 0;			// NOTE: Copies within one context.
+	uint64_t migration_count = 0;
+	uint64_t staged_copy_count = 0;
+	uint64_t bytes_staged = 0;
+
+	PeerBufferMigrator() noexcept = default;
+
+	// NOTE: The queues have to belong to the contexts. Nothing gets allocated until the first staged copy.
+	PeerBufferMigrator(cl_int& err, cl_context sourceContext, cl_command_queue sourceQueue, cl_context destinationContext, cl_command_queue destinationQueue,
+					   const PeerMigrationConfig& config = PeerMigrationConfig()) noexcept;
+
+	PeerBufferMigrator& operator=(const PeerBufferMigrator& right) = delete;
+
+	PeerBufferMigrator(PeerBufferMigrator&& other) noexcept = default;
+
+	bool is_same_context() const noexcept { return sourceContext == destinationContext; }
+
+	// Copies size bytes from the source buffer (in the source context) to the destination buffer (in the destination context).
+	// Within one context, nothing blocks and event (if not nullptr) gives back the copy. Across contexts, this returns once the data has
+	// arrived, and event stays untouched.
+	// NOTE: Don't enqueue writes to the source buffer on the source queue until the copy is done, the copy only waits for what came before it.
+	cl_int copy(cl_mem sourceBuffer, size_t sourceOffset, cl_mem destinationBuffer, size_t destinationOffset, size_t size, cl_event* event = nullptr) noexcept;
+
+	// Migrates the buffer to the destination device, so that commands on the destination queue don't have to wait for it to move.
+	// With contentUndefined, only the allocation moves (for buffers that are about to be overwritten anyway).
+	// Returns CL_INVALID_CONTEXT across contexts, since a buffer can't leave its context. Use copy() into a buffer of the other context instead.
+	cl_int migrate(cl_mem buffer, bool contentUndefined = false, cl_event* event = nullptr) noexcept;
+
+	// Gives the staging buffers back. They get allocated again by the next staged copy.
+	void release_staging() noexcept { releaseStaging(); }
+
+	~PeerBufferMigrator() noexcept;
+};
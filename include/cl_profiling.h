@@ -0,0 +1,157 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+#include <string>			// for std::string
+#include <vector>			// for std::vector
+#include <unordered_map>	// for std::unordered_map
+#include <mutex>			// for std::mutex
+#include <atomic>			// for std::atomic
+
+// NOTE: Profiling only works on command queues that were created with CL_QUEUE_PROFILING_ENABLE (see the commandQueueProperties
+// parameter of initOpenCLVarsForBestDevice()). On other queues, clGetEventProfilingInfo returns CL_PROFILING_INFO_NOT_AVAILABLE.
+
+// Log-linear histogram of nanosecond durations. Every power of two is split into 16 sub-buckets, so the relative error of any
+// percentile is at most 1/16, which is plenty for spotting regressions. Recording is a couple of shifts and an increment.
+class LatencyHistogram {
+public:
+	static constexpr size_t sub_bucket_bits = 4;
+	static constexpr size_t sub_bucket_count = 1 << sub_bucket_bits;
+	static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+	uint64_t counts[bucket_count] = { };
+	uint64_t total_count = 0;
+	uint64_t sum = 0;
+	uint64_t max_value = 0;
+
+	static constexpr size_t get_bucket_index(uint64_t value) noexcept {
+		if (value < sub_bucket_count) { return (size_t)value; }
+		size_t highestBit = 63;
+		while (!(value >> highestBit)) { highestBit--; }
+		size_t shift = highestBit - sub_bucket_bits;
+		return (shift + 1) * sub_bucket_count + (size_t)((value >> shift) & (sub_bucket_count - 1));
+	}
+
+	// Returns the smallest value that lands in the given bucket.
+	static constexpr uint64_t get_bucket_lower_bound(size_t index) noexcept {
+		if (index < sub_bucket_count) { return index; }
+		size_t shift = index / sub_bucket_count - 1;
+		return (uint64_t)(sub_bucket_count + index % sub_bucket_count) << shift;
+	}
+
+	constexpr void record(uint64_t value) noexcept {
+		counts[get_bucket_index(value)]++;
+		total_count++;
+		sum += value;
+		if (value > max_value) { max_value = value; }
+	}
+
+	// NOTE: percentile goes from 0 to 100. Returns the lower bound of the bucket that contains the percentile.
+	constexpr uint64_t get_percentile(double percentile) const noexcept {
+		if (total_count == 0) { return 0; }
+		uint64_t targetCount = (uint64_t)(percentile / 100 * total_count);
+		if (targetCount >= total_count) { targetCount = total_count - 1; }
+		uint64_t accumulatedCount = 0;
+		for (size_t i = 0; i < bucket_count; i++) {
+			accumulatedCount += counts[i];
+			if (accumulatedCount > targetCount) { return get_bucket_lower_bound(i); }
+		}
+		return max_value;
+	}
+
+	constexpr void merge(const LatencyHistogram& other) noexcept {
+		for (size_t i = 0; i < bucket_count; i++) { counts[i] += other.counts[i]; }
+		total_count += other.total_count;
+		sum += other.sum;
+		if (other.max_value > max_value) { max_value = other.max_value; }
+	}
+
+	constexpr void reset() noexcept { *this = LatencyHistogram(); }
+};
+
+// The raw device timestamps of one command, in nanoseconds of the device's profiling clock.
+struct ProfiledCommand {
+	const char* name;
+	cl_command_queue queue;
+	cl_ulong queued;
+	cl_ulong submit;
+	cl_ulong start;
+	cl_ulong end;
+};
+
+// Gets called for every command that the profiler collects, in case you want the raw timestamps as well as the statistics.
+// NOTE: Runs on the OpenCL callback thread, so keep it short and don't call blocking OpenCL functions in there.
+typedef void (*ProfiledCommandSink)(const ProfiledCommand& command, void* userData);
+
+struct KernelProfileSummary {
+	std::string name;
+	uint64_t count;
+	uint64_t total_device_time;			// NOTE: Sum of (end - start) over all commands.
+	uint64_t device_time_p50;
+	uint64_t device_time_p99;
+	uint64_t device_time_max;
+	uint64_t total_queue_latency;		// NOTE: Sum of (start - queued) over all commands. This is the time that the command spent waiting before it ran.
+	uint64_t queue_latency_p50;
+	uint64_t queue_latency_p99;
+	uint64_t failed_count;				// NOTE: Commands that were terminated or whose timestamps weren't available.
+};
+
+// Collects device timestamps for every command that you register with it and aggregates them per kernel name.
+// NOTE: Collection happens in event callbacks, so registering a command never blocks and you don't have to poll anything.
+// Event callbacks are OpenCL 1.1, with older libraries registering returns CL_EXT_FUNCTION_UNAVAILABLE.
+// NOTE: Thread-safe, you can register commands from as many threads as you want.
+class KernelProfiler {
+	struct Entry {
+		KernelProfiler* profiler;
+		std::string name;
+		LatencyHistogram deviceTime;
+		LatencyHistogram queueLatency;
+		uint64_t failed_count = 0;
+	};
+
+	std::mutex mutex;
+	// NOTE: Nodes of unordered_map are pointer-stable, which is important because the pending callbacks hold pointers to entries.
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<cl_kernel, Entry*> kernelEntryCache;
+	std::atomic<size_t> pendingCount { 0 };
+
+	ProfiledCommandSink sink = nullptr;
+	void* sinkUserData = nullptr;
+
+	Entry* getEntry(const char* name) noexcept;
+
+	static void CL_CALLBACK collectCallback(cl_event event, cl_int event_command_status, void* user_data) noexcept;
+
+	cl_int recordIntoEntry(cl_event event, Entry* entry) noexcept;
+
+public:
+	KernelProfiler() noexcept = default;
+
+	KernelProfiler& operator=(const KernelProfiler& right) = delete;
+	// NOTE: No moving either, pending callbacks point into this object.
+
+	// Registers the command behind the event under the given name (the name gets copied). The event doesn't get consumed,
+	// you still have to release your reference to it like you normally would.
+	cl_int record(cl_event event, const char* name) noexcept;
+
+	// Same as record(), but uses the function name of the kernel as the name. The name gets looked up once per kernel and cached.
+	// NOTE: The cache is keyed on the cl_kernel handle, so call forgetKernel() before releasing a kernel if you're going to create more later.
+	cl_int recordKernel(cl_event event, cl_kernel kernel) noexcept;
+
+	void forgetKernel(cl_kernel kernel) noexcept;
+
+	void set_sink(ProfiledCommandSink sink, void* userData) noexcept;
+
+	std::vector<KernelProfileSummary> summarize() noexcept;
+
+	// Zeroes all the statistics. Commands that are still pending get counted into the fresh statistics once they complete.
+	void reset() noexcept;
+
+	// Spins until every pending callback has run. Mostly useful before reading the summary at the end of a benchmark.
+	void waitForPendingCallbacks() const noexcept;
+
+	size_t get_pending_count() const noexcept { return pendingCount.load(std::memory_order_acquire); }
+
+	~KernelProfiler() noexcept { waitForPendingCallbacks(); }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: Commands sit in the host-side queue of the implementation until something flushes them to the device. Never flushing
+// means the device only starts once you clFinish() (or do something blocking), and flushing after every enqueue means a kernel-mode
+// transition per command, which dominates when the kernels are small. The submission batcher sits in between: you tell it about
+// every command you enqueue (or let it enqueue kernels for you) and it flushes once one of the policies below says so.
+// NOTE: Idle detection works with a marker that gets enqueued right before every flush. Once the marker is complete, everything that
+// was flushed before it is done and the device is starving, so the waiting commands get flushed right away. Markers are cheap,
+// they ride along in the same flush and never touch the device.
+// NOTE: Markers need OpenCL 1.2. With older libraries, the device counts as busy after the first flush, so idle flushes never happen
+// and adaptive batching only ever grows the limit (up to max_batch_commands). The batch limit and the time limit work the same either way.
+// NOTE: With adaptive batching, the batch size limit halves whenever the device ran dry before the limit was reached and doubles whenever
+// the limit was reached while the device was still busy, so it settles on batches that are about as big as the device can chew through
+// between two flushes.
+// NOTE: The policies only get checked when you enqueue something or call poll(). If you stop enqueueing for a while, call poll()
+// (or flush()) so that the time limit can do its thing.
+// NOTE: The batcher isn't thread-safe and doesn't own the queue. Use one per queue and submission thread.
+
+struct SubmissionPolicy {
+	// Flush once this many commands are waiting. With adaptive batching, this is the upper limit of the batch size.
+	uint32_t max_batch_commands = 32;
+
+	// Lower limit of the batch size with adaptive batching.
+	uint32_t min_batch_commands = 1;
+
+	// Flush once the estimated work of the waiting commands adds up to this. The unit is whatever you pass as the work estimate
+	// (enqueueNDRangeKernel() uses the global work-item count). 0 turns it off.
+	uint64_t max_batch_work = 0;
+
+	// Flush once the oldest waiting command has waited this long, in nanoseconds. 0 turns it off.
+	uint64_t max_batch_delay = 100000;
+
+	// Flush right away once the device has finished everything that was flushed so far.
+	bool flush_when_idle = true;
+
+	bool adaptive = true;
+};
+
+class SubmissionBatcher {
+	cl_command_queue queue = nullptr;
+	OpenCLEvent lastFlushMarker;
+	bool deviceKnownIdle = true;			// NOTE: Once the marker is complete, it stays complete, so there's no need to ask again until the next flush.
+
+	uint32_t pendingCommands = 0;
+	uint64_t pendingWork = 0;
+	uint64_t firstPendingTime = 0;
+	uint32_t batchLimit = 0;
+
+	bool isDeviceIdle(cl_int& err) noexcept;
+	cl_int flushPending() noexcept;
+
+public:
+	SubmissionPolicy policy;
+
+	// Statistics since construction.
+	uint64_t command_count = 0;
+	uint64_t flush_count = 0;
+	uint64_t idle_flush_count = 0;			// NOTE: Flushes that happened because the device ran dry.
+
+	SubmissionBatcher() noexcept = default;
+
+	SubmissionBatcher(cl_command_queue queue, const SubmissionPolicy& policy = SubmissionPolicy()) noexcept;
+
+	SubmissionBatcher& operator=(const SubmissionBatcher& right) = delete;
+
+	SubmissionBatcher(SubmissionBatcher&& other) noexcept = default;
+
+	// Tells the batcher that you enqueued a command on the queue yourself. Flushes if a policy says so.
+	cl_int recordEnqueue(uint64_t estimatedWork = 1) noexcept;
+
+	// Enqueues the kernel and records it, with the global work-item count as the work estimate.
+	cl_int enqueueNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize,
+								cl_uint numEventsInWaitList = 0, const cl_event* eventWaitList = nullptr, cl_event* event = nullptr) noexcept;
+
+	// Checks the time limit and the idle policy without enqueueing anything.
+	cl_int poll() noexcept;
+
+	// Flushes whatever is waiting, regardless of the policies.
+	cl_int flush() noexcept;
+
+	// Flushes and waits until the queue is empty.
+	cl_int finish() noexcept;
+
+	// Call this after doing something that flushes the queue implicitly (blocking transfers, clFinish(), clWaitForEvents() on one of the
+	// waiting commands), so that the batcher doesn't flush again for nothing.
+	void mark_flushed() noexcept;
+
+	cl_command_queue get_queue() const noexcept { return queue; }
+	uint32_t get_pending_command_count() const noexcept { return pendingCommands; }
+	uint32_t get_batch_limit() const noexcept { return batchLimit; }
+};
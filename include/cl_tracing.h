@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+#include "cl_profiling.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: The tracer puts every call that goes through the OpenCL function pointers (host-side duration), every device command that
+// a KernelProfiler collects (device timestamps, converted to the host clock) and whatever host regions you mark yourself into one timeline,
+// which can be dumped as a Chrome JSON trace (open it in chrome://tracing or https://ui.perfetto.dev).
+// NOTE: Recording is lock-free: every thread writes into its own ring buffer, and once the buffer is full, the oldest events get overwritten.
+// The only lock is taken once per thread, the first time that thread records something.
+
+// Swaps every bound function pointer (see CL_EXT_FOR_EACH_BOUND_FUNCTION) for a wrapper that times the call and then calls the original.
+// eventsPerThread gets rounded up to a power of two and only applies to threads that haven't recorded anything yet.
+// NOTE: Call this after the bindings are initialized and while no other thread is calling OpenCL functions, since it overwrites the pointers.
+// NOTE: If something else swaps the function pointers too, disable them in the reverse order of enabling them.
+cl_int enableOpenCLTracing(size_t eventsPerThread = 65536) noexcept;
+
+// Puts the original function pointers back. Recorded events stay around until clearTrace().
+void disableOpenCLTracing() noexcept;
+
+bool isOpenCLTracingEnabled() noexcept;
+
+// Nanoseconds on the host clock that the tracer uses.
+uint64_t getTraceTimestamp() noexcept;
+
+// Records an arbitrary host region. name has to stay alive until the trace is dumped (string literals are ideal).
+void traceHostRegion(const char* name, uint64_t start, uint64_t duration) noexcept;
+
+// Marks the lifetime of the scope as a host region.
+class TraceScope {
+	const char* name;
+	uint64_t start;
+
+public:
+	TraceScope(const char* name) noexcept : name(name), start(getTraceTimestamp()) { }
+
+	TraceScope& operator=(const TraceScope& right) = delete;
+
+	~TraceScope() noexcept { traceHostRegion(name, start, getTraceTimestamp() - start); }
+};
+
+// Plug this into KernelProfiler::set_sink() to get the device commands into the trace: profiler.set_sink(traceProfiledCommandSink, nullptr).
+// NOTE: Device clocks and the host clock have nothing to do with each other. By default, the offset between them is estimated per queue
+// from the time that the completion callbacks arrive (which is always a bit after the command ends), and the smallest estimate wins.
+// That's usually accurate to within the callback latency. For something better, use calibrateTraceDeviceClock().
+void traceProfiledCommandSink(const ProfiledCommand& command, void* userData) noexcept;
+
+// Measures the offset between the device clock of the queue and the host clock by timestamping a marker right as it gets enqueued.
+// NOTE: Blocks until the marker completes and only works on queues created with CL_QUEUE_PROFILING_ENABLE. Markers need OpenCL 1.2,
+// with older libraries this returns CL_EXT_FUNCTION_UNAVAILABLE and the callback-based estimate stays in use.
+cl_int calibrateTraceDeviceClock(cl_command_queue queue) noexcept;
+
+// Writes everything that's in the ring buffers into a Chrome JSON trace file.
+// NOTE: Safe to call while other threads are recording, but events that are being overwritten while the dump runs get skipped.
+cl_int dumpChromeTrace(const char* path) noexcept;
+
+// Empties all ring buffers. Only call this while nobody is recording.
+void clearTrace() noexcept;
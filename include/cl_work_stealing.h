@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>			// for fixed-width types
+#include <atomic>			// for std::atomic
+
+// NOTE: Lock-free range of work items that one worker takes chunks from the front of, while other workers can steal chunks from the back.
+// Both ends live in one 64-bit atomic (begin in the low half, end in the high half), so taking and stealing are single compare-exchanges
+// and never see a torn range. That limits ranges to 2^32 items, which is plenty when the items are blocks of work items.
+// NOTE: MultiDeviceExecutor::runDynamic() (see cl_multi_device.h) uses one of these per device, but it works for any kind of worker.
+
+class WorkStealingRange {
+	std::atomic<uint64_t> bounds { 0 };
+
+	static constexpr uint64_t pack(uint32_t begin, uint32_t end) noexcept { return (uint64_t)begin | ((uint64_t)end << 32); }
+	static constexpr uint32_t unpack_begin(uint64_t packed) noexcept { return (uint32_t)packed; }
+	static constexpr uint32_t unpack_end(uint64_t packed) noexcept { return (uint32_t)(packed >> 32); }
+
+public:
+	WorkStealingRange() noexcept = default;
+
+	WorkStealingRange& operator=(const WorkStealingRange& right) = delete;
+
+	// NOTE: Not thread-safe with respect to take() and steal(), only reset while nobody is working on the range.
+	void reset(uint32_t begin, uint32_t end) noexcept { bounds.store(pack(begin, end), std::memory_order_relaxed); }
+
+	// Takes up to maxCount items from the front. Returns false once the range is empty.
+	bool take(uint32_t maxCount, uint32_t& begin, uint32_t& count) noexcept {
+		uint64_t current = bounds.load(std::memory_order_acquire);
+		while (true) {
+			uint32_t currentBegin = unpack_begin(current);
+			uint32_t currentEnd = unpack_end(current);
+			if (currentBegin >= currentEnd) { return false; }
+			uint32_t takenCount = currentEnd - currentBegin < maxCount ? currentEnd - currentBegin : maxCount;
+			if (bounds.compare_exchange_weak(current, pack(currentBegin + takenCount, currentEnd), std::memory_order_acq_rel, std::memory_order_acquire)) {
+				begin = currentBegin;
+				count = takenCount;
+				return true;
+			}
+		}
+	}
+
+	// Takes up to maxCount items from the back. Returns false once the range is empty.
+	bool steal(uint32_t maxCount, uint32_t& begin, uint32_t& count) noexcept {
+		uint64_t current = bounds.load(std::memory_order_acquire);
+		while (true) {
+			uint32_t currentBegin = unpack_begin(current);
+			uint32_t currentEnd = unpack_end(current);
+			if (currentBegin >= currentEnd) { return false; }
+			uint32_t takenCount = currentEnd - currentBegin < maxCount ? currentEnd - currentBegin : maxCount;
+			if (bounds.compare_exchange_weak(current, pack(currentBegin, currentEnd - takenCount), std::memory_order_acq_rel, std::memory_order_acquire)) {
+				begin = currentEnd - takenCount;
+				count = takenCount;
+				return true;
+			}
+		}
+	}
+
+	uint32_t get_remaining() const noexcept {
+		uint64_t current = bounds.load(std::memory_order_acquire);
+		return unpack_end(current) > unpack_begin(current) ? unpack_end(current) - unpack_begin(current) : 0;
+	}
+};
@@ -0,0 +1 @@
+cl /nologo /O2 /std:c++20 /EHsc /LD /I ..\include mock_opencl.cpp /link /DEF:mock_opencl.def /OUT:mock_opencl.dll
@@ -0,0 +1,1338 @@
+#include "mock_opencl.h"
+
+#include <cstdint>						// For fixed-width types.
+
+#include <new>							// For std::nothrow.
+
+#include <cstring>						// For std::memcpy and std::strcmp.
+
+#include <string>						// For std::string.
+
+#include <vector>						// For std::vector.
+
+#include <memory>						// For std::unique_ptr.
+
+#include <unordered_map>				// For std::unordered_map.
+
+#include <mutex>						// For std::mutex.
+
+#include <atomic>						// For std::atomic.
+
+#include <thread>						// For std::this_thread::yield.
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+// NOTE: The exported functions are called mock_clWhatever and get exported as clWhatever through mock_opencl.def,
+// since the real names are already taken by the function pointers in cl_bindings_and_helpers.h.
+#define MOCK_EXPORT extern "C"
+
+// NOTE: These aren't in cl_bindings_and_helpers.h because the library itself never needs them.
+#define MOCK_CL_BUILD_SUCCESS 0
+#define MOCK_CL_BUILD_NONE -1
+#define MOCK_CL_BUILD_ERROR -2
+#define MOCK_CL_COMMAND_NDRANGE_KERNEL 0x11F0
+#define MOCK_CL_COMMAND_READ_BUFFER 0x11F3
+#define MOCK_CL_COMMAND_WRITE_BUFFER 0x11F4
+#define MOCK_CL_COMMAND_COPY_BUFFER 0x11F5
+#define MOCK_CL_COMMAND_READ_IMAGE 0x11F6
+#define MOCK_CL_COMMAND_WRITE_IMAGE 0x11F7
+#define MOCK_CL_COMMAND_MAP_BUFFER 0x11FB
+#define MOCK_CL_COMMAND_UNMAP_MEM_OBJECT 0x11FD
+#define MOCK_CL_COMMAND_MARKER 0x11FE
+#define MOCK_CL_COMMAND_MIGRATE_MEM_OBJECTS 0x1206
+#define MOCK_CL_COMMAND_USER 0x1204
+
+#define MOCK_DEFAULT_PLATFORM_VERSION "OpenCL 3.0 Mock Platform"
+#define MOCK_DEVICE_VERSION "OpenCL 3.0 Mock Device"
+#define MOCK_DRIVER_VERSION "1.0"
+
+enum Mock_function_index : uint32_t {
+#define MOCK_X(function) MOCK_FUNCTION_##function,
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(MOCK_X)
+#undef MOCK_X
+	MOCK_FUNCTION_COUNT
+};
+
+static const char* const functionNames[MOCK_FUNCTION_COUNT] = {
+#define MOCK_X(function) #function,
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(MOCK_X)
+#undef MOCK_X
+};
+
+enum class Object_type : uint8_t {
+	CONTEXT,
+	QUEUE,
+	PROGRAM,
+	KERNEL,
+	MEM,
+	EVENT
+};
+
+struct _cl_platform_id {
+	std::string version;
+	std::vector<cl_device_id> devices;
+};
+
+struct _cl_device_id {
+	cl_platform_id platform;
+	std::string name;
+	MockOpenCLConfig config;		// NOTE: Only the device properties get used, the strings in here aren't valid.
+};
+
+struct _cl_context {
+	cl_uint refCount = 1;
+	std::vector<cl_device_id> devices;
+	std::vector<cl_context_properties> properties;
+};
+
+struct _cl_command_queue {
+	cl_uint refCount = 1;
+	cl_context context;
+	cl_device_id device;
+	cl_command_queue_properties properties;
+	uint64_t busyUntil = 0;			// NOTE: End of the last command on the simulated device timeline.
+};
+
+struct KernelDeclaration {
+	std::string name;
+	cl_uint argCount;
+};
+
+struct _cl_program {
+	cl_uint refCount = 1;
+	cl_context context;
+	std::string source;
+	cl_int buildStatus = MOCK_CL_BUILD_NONE;
+	std::string buildOptions;
+	std::string buildLog;
+	std::vector<KernelDeclaration> kernels;
+	bool fromBinary = false;			// NOTE: CL_PROGRAM_SOURCE is empty for those, like on real implementations.
+};
+
+struct _cl_kernel {
+	cl_uint refCount = 1;
+	cl_program program;
+	std::string name;
+	std::vector<bool> argIsSet;
+};
+
+// NOTE: Bytes of all live buffers that live "on the device", so that allocations beyond global_memory_size fail like on a real device.
+static cl_ulong allocatedDeviceBytes = 0;
+
+struct _cl_mem {
+	cl_uint refCount = 1;
+	cl_context context;
+	std::vector<unsigned char> data;
+	bool isImage = false;
+	cl_image_format format;
+	size_t elementSize;
+	size_t width;
+	size_t height;
+	size_t rowPitch;
+	size_t mapCount = 0;
+	cl_ulong deviceBytes = 0;
+
+	~_cl_mem() { allocatedDeviceBytes -= deviceBytes; }
+};
+
+struct EventCallback {
+	cl_int status;
+	void (CL_CALLBACK* function)(cl_event event, cl_int event_command_status, void* user_data);
+	void* userData;
+};
+
+struct _cl_event {
+	cl_uint refCount = 1;
+	cl_context context;
+	cl_command_queue queue;			// NOTE: nullptr for user events.
+	cl_uint commandType;
+	cl_int userStatus = CL_SUBMITTED;
+	uint64_t queued;
+	uint64_t submit;
+	uint64_t start;
+	uint64_t end;
+	std::vector<EventCallback> callbacks;
+};
+
+static std::mutex mockMutex;
+static MockOpenCLConfig config;
+static Mock_function_index failingFunction = MOCK_FUNCTION_COUNT;
+static std::atomic<uint64_t> callCounts[MOCK_FUNCTION_COUNT];
+
+// NOTE: Platforms and devices from older configurations stay alive (see mockOpenCLSetConfig()), only the current ones get enumerated.
+static std::vector<std::unique_ptr<_cl_platform_id>> allPlatforms;
+static std::vector<std::unique_ptr<_cl_device_id>> allDevices;
+static std::vector<cl_platform_id> currentPlatforms;
+static bool platformsInitialized = false;
+
+// NOTE: Every live object, so that dangling handles get reported as invalid instead of crashing, which is what the stress tests want to find.
+static std::unordered_map<const void*, Object_type> liveObjects;
+
+static uint64_t now() noexcept {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// NOTE: Spins instead of sleeping, since sleeps are way too coarse for the microsecond latencies this is meant to simulate.
+static void spinUntil(uint64_t deadline) noexcept {
+	while (now() < deadline) { std::this_thread::yield(); }
+}
+
+// NOTE: Running out of memory leaves fewer platforms or devices than configured, which clGetPlatformIDs() and clGetDeviceIDs() then report.
+static void initPlatforms() noexcept {
+	currentPlatforms.clear();
+	for (cl_uint i = 0; i < config.platform_count; i++) {
+		std::unique_ptr<_cl_platform_id> platform(new (std::nothrow) _cl_platform_id());
+		if (!platform) { break; }
+		platform->version = config.platform_versions && config.platform_versions[i] ? config.platform_versions[i] : MOCK_DEFAULT_PLATFORM_VERSION;
+		for (cl_uint j = 0; j < config.devices_per_platform; j++) {
+			std::unique_ptr<_cl_device_id> device(new (std::nothrow) _cl_device_id());
+			if (!device) { break; }
+			device->platform = platform.get();
+			device->name = "Mock Device " + std::to_string(i) + "." + std::to_string(j);
+			device->config = config;
+			device->config.platform_versions = nullptr;
+			device->config.failing_function = nullptr;
+			platform->devices.push_back(device.get());
+			allDevices.push_back(std::move(device));
+		}
+		currentPlatforms.push_back(platform.get());
+		allPlatforms.push_back(std::move(platform));
+	}
+	platformsInitialized = true;
+}
+
+// Counts the call and spins the call latency. Returns false if the call should fail with the injected error instead.
+static bool enterFunction(Mock_function_index function, cl_int& injectedError) noexcept {
+	uint64_t callNumber = callCounts[function].fetch_add(1, std::memory_order_relaxed) + 1;
+	uint64_t callLatency;
+	bool fail;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		callLatency = config.call_latency;
+		fail = function == failingFunction && callNumber % config.failure_period == 0;
+		injectedError = config.injected_error;
+	}
+	if (callLatency) { spinUntil(now() + callLatency); }
+	return !fail;
+}
+
+#define MOCK_ENTRY(function) { cl_int injectedError; if (!enterFunction(MOCK_FUNCTION_##function, injectedError)) { return injectedError; } }
+#define MOCK_ENTRY_RETURNING_HANDLE(function) { \
+	cl_int injectedError; \
+	if (!enterFunction(MOCK_FUNCTION_##function, injectedError)) { if (errcode_ret) { *errcode_ret = injectedError; } return nullptr; } \
+}
+
+static void setErrcode(cl_int* errcode_ret, cl_int err) noexcept { if (errcode_ret) { *errcode_ret = err; } }
+
+template <typename object_t>
+static bool isLive(object_t object, Object_type type) noexcept {
+	auto it = liveObjects.find(object);
+	return it != liveObjects.end() && it->second == type;
+}
+
+static bool isValidDevice(cl_device_id device) noexcept {
+	for (const std::unique_ptr<_cl_device_id>& candidate : allDevices) {
+		if (candidate.get() == device) { return true; }
+	}
+	return false;
+}
+
+// Standard info query behavior: writes the value if there's a buffer (which has to be big enough) and reports the size if asked.
+static cl_int returnInfo(const void* value, size_t size, size_t param_value_size, void* param_value, size_t* param_value_size_ret) noexcept {
+	if (param_value) {
+		if (param_value_size < size) { return CL_INVALID_VALUE; }
+		std::memcpy(param_value, value, size);
+	}
+	if (param_value_size_ret) { *param_value_size_ret = size; }
+	return CL_SUCCESS;
+}
+
+template <typename value_t>
+static cl_int returnInfoValue(const value_t& value, size_t param_value_size, void* param_value, size_t* param_value_size_ret) noexcept {
+	return returnInfo(&value, sizeof(value_t), param_value_size, param_value, param_value_size_ret);
+}
+
+static cl_int returnInfoString(const std::string& value, size_t param_value_size, void* param_value, size_t* param_value_size_ret) noexcept {
+	return returnInfo(value.c_str(), value.length() + 1, param_value_size, param_value, param_value_size_ret);
+}
+
+static cl_int getEventStatus(cl_event event, uint64_t time) noexcept {
+	if (!event->queue) { return event->userStatus; }
+	if (time >= event->end) { return CL_COMPLETE; }
+	if (time >= event->start) { return CL_RUNNING; }
+	if (time >= event->submit) { return CL_SUBMITTED; }
+	return CL_QUEUED;
+}
+
+static bool isAnyDeviceType(cl_device_type type, cl_device_type requested) noexcept {
+	return requested == CL_DEVICE_TYPE_ALL || (type & requested);
+}
+
+// Puts a command of the given duration on the queue's timeline. Returns the end of the command through end.
+static cl_int enqueueCommand(cl_command_queue queue, cl_uint num_events_in_wait_list, const cl_event* event_wait_list, uint64_t duration,
+							 cl_uint commandType, cl_event* event, uint64_t& end) noexcept {
+	if ((num_events_in_wait_list == 0) != (event_wait_list == nullptr)) { return CL_INVALID_EVENT_WAIT_LIST; }
+	uint64_t currentTime = now();
+	uint64_t start = currentTime > queue->busyUntil ? currentTime : queue->busyUntil;
+	for (cl_uint i = 0; i < num_events_in_wait_list; i++) {
+		cl_event waitEvent = event_wait_list[i];
+		if (!isLive(waitEvent, Object_type::EVENT)) { return CL_INVALID_EVENT_WAIT_LIST; }
+		if (waitEvent->queue && waitEvent->end > start) { start = waitEvent->end; }
+	}
+	end = start + duration;
+	queue->busyUntil = end;
+
+	if (event) {
+		cl_event result = new (std::nothrow) _cl_event();
+		if (!result) { return CL_OUT_OF_HOST_MEMORY; }
+		result->context = queue->context;
+		result->queue = queue;
+		result->commandType = commandType;
+		result->queued = currentTime;
+		result->submit = currentTime;
+		result->start = start;
+		result->end = end;
+		liveObjects[result] = Object_type::EVENT;
+		*event = result;
+	}
+	return CL_SUCCESS;
+}
+
+static uint64_t calcTransferDuration(size_t size) noexcept {
+	return config.transfer_bandwidth > 0 ? (uint64_t)(size / config.transfer_bandwidth) : 0;
+}
+
+static bool isWhitespace(char character) noexcept {
+	return character == ' ' || character == '\t' || character == '\n' || character == '\r';
+}
+
+static bool isIdentifierCharacter(char character) noexcept {
+	return (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') || (character >= '0' && character <= '9') || character == '_';
+}
+
+// Finds every "kernel void name(params)" and "__kernel void name(params)" in the source. Good enough for the kernels the tests use,
+// it doesn't know about comments or the preprocessor.
+static void scanKernelDeclarations(const std::string& source, std::vector<KernelDeclaration>& kernels) noexcept {
+	kernels.clear();
+	size_t position = 0;
+	while ((position = source.find("kernel", position)) != std::string::npos) {
+		size_t tokenEnd = position + sizeof("kernel") - 1;
+		bool isToken = (position == 0 || !isIdentifierCharacter(source[position - 1]) || (position >= 2 && source.compare(position - 2, 2, "__") == 0 &&
+						(position == 2 || !isIdentifierCharacter(source[position - 3])))) && tokenEnd < source.length() && !isIdentifierCharacter(source[tokenEnd]);
+		position = tokenEnd;
+		if (!isToken) { continue; }
+
+		size_t cursor = tokenEnd;
+		while (cursor < source.length() && isWhitespace(source[cursor])) { cursor++; }
+		if (source.compare(cursor, sizeof("void") - 1, "void") != 0) { continue; }
+		cursor += sizeof("void") - 1;
+		while (cursor < source.length() && isWhitespace(source[cursor])) { cursor++; }
+		size_t nameStart = cursor;
+		while (cursor < source.length() && isIdentifierCharacter(source[cursor])) { cursor++; }
+		if (cursor == nameStart) { continue; }
+		KernelDeclaration kernel;
+		kernel.name = source.substr(nameStart, cursor - nameStart);
+		while (cursor < source.length() && isWhitespace(source[cursor])) { cursor++; }
+		if (cursor >= source.length() || source[cursor] != '(') { continue; }
+
+		size_t depth = 1;
+		cl_uint commaCount = 0;
+		bool hasParameterText = false;
+		std::string firstWord;
+		for (cursor++; cursor < source.length() && depth; cursor++) {
+			char character = source[cursor];
+			if (character == '(') { depth++; }
+			else if (character == ')') { depth--; if (!depth) { break; } }
+			else if (character == ',' && depth == 1) { commaCount++; }
+			if (!isWhitespace(character)) {
+				hasParameterText = true;
+				if (commaCount == 0 && isIdentifierCharacter(character)) { firstWord += character; }
+			}
+		}
+		kernel.argCount = !hasParameterText || (commaCount == 0 && firstWord == "void") ? 0 : commaCount + 1;
+		kernels.push_back(kernel);
+		position = cursor;
+	}
+}
+
+static size_t calcImageElementSize(const cl_image_format& format) noexcept {
+	switch (format.image_channel_data_type) {
+	case CL_UNORM_SHORT_565:
+	case CL_UNORM_SHORT_555:
+		return 2;
+	case CL_UNORM_INT_101010:
+	case CL_UNORM_INT_101010_2:
+		return 4;
+	}
+
+	size_t channelSize;
+	switch (format.image_channel_data_type) {
+	case CL_SNORM_INT8: case CL_UNORM_INT8: case CL_SIGNED_INT8: case CL_UNSIGNED_INT8: channelSize = 1; break;
+	case CL_SNORM_INT16: case CL_UNORM_INT16: case CL_SIGNED_INT16: case CL_UNSIGNED_INT16: case CL_HALF_FLOAT: channelSize = 2; break;
+	case CL_UNORM_INT24: channelSize = 3; break;
+	case CL_SIGNED_INT32: case CL_UNSIGNED_INT32: case CL_FLOAT: channelSize = 4; break;
+	default: return 0;
+	}
+
+	size_t channelCount;
+	switch (format.image_channel_order) {
+	case CL_R: case CL_A: case CL_Rx: case CL_INTENSITY: case CL_LUMINANCE: case CL_DEPTH: channelCount = 1; break;
+	case CL_RG: case CL_RA: case CL_RGx: case CL_DEPTH_STENCIL: channelCount = 2; break;
+	case CL_RGB: case CL_RGBx: case CL_sRGB: case CL_sRGBx: channelCount = 3; break;
+	case CL_RGBA: case CL_BGRA: case CL_ARGB: case CL_ABGR: case CL_sRGBA: case CL_sBGRA: channelCount = 4; break;
+	default: return 0;
+	}
+
+	return channelSize * channelCount;
+}
+
+// NOTE: Takes the callbacks separately, so that they can be moved out of the event and run without holding mockMutex.
+static void fireEventCallbacks(cl_event event, cl_int status, const std::vector<EventCallback>& callbacks) noexcept {
+	for (const EventCallback& callback : callbacks) {
+		if (status <= callback.status) { callback.function(event, status, callback.userData); }
+	}
+}
+
+// Platforms and devices.
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetPlatformIDs(cl_uint num_entries, cl_platform_id* platforms, cl_uint* num_platforms) {
+	MOCK_ENTRY(clGetPlatformIDs);
+	if ((num_entries == 0 && platforms) || (!platforms && !num_platforms)) { return CL_INVALID_VALUE; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!platformsInitialized) { initPlatforms(); }
+	if (num_platforms) { *num_platforms = (cl_uint)currentPlatforms.size(); }
+	if (platforms) {
+		for (cl_uint i = 0; i < num_entries && i < currentPlatforms.size(); i++) { platforms[i] = currentPlatforms[i]; }
+	}
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetPlatformInfo(cl_platform_id platform, cl_platform_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetPlatformInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	bool isValidPlatform = false;
+	for (const std::unique_ptr<_cl_platform_id>& candidate : allPlatforms) {
+		if (candidate.get() == platform) { isValidPlatform = true; break; }
+	}
+	if (!isValidPlatform) { return CL_INVALID_PLATFORM; }
+
+	switch (param_name) {
+	case CL_PLATFORM_PROFILE: return returnInfoString("FULL_PROFILE", param_value_size, param_value, param_value_size_ret);
+	case CL_PLATFORM_VERSION: return returnInfoString(platform->version, param_value_size, param_value, param_value_size_ret);
+	case CL_PLATFORM_NAME: return returnInfoString("Mock OpenCL Platform", param_value_size, param_value, param_value_size_ret);
+	case CL_PLATFORM_VENDOR: return returnInfoString("Mock", param_value_size, param_value, param_value_size_ret);
+	case CL_PLATFORM_EXTENSIONS: return returnInfoString("", param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetDeviceIDs(cl_platform_id platform, cl_device_type device_type, cl_uint num_entries, cl_device_id* devices, cl_uint* num_devices) {
+	MOCK_ENTRY(clGetDeviceIDs);
+	if ((num_entries == 0 && devices) || (!devices && !num_devices)) { return CL_INVALID_VALUE; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	bool isValidPlatform = false;
+	for (const std::unique_ptr<_cl_platform_id>& candidate : allPlatforms) {
+		if (candidate.get() == platform) { isValidPlatform = true; break; }
+	}
+	if (!isValidPlatform) { return CL_INVALID_PLATFORM; }
+
+	cl_uint count = 0;
+	for (cl_device_id device : platform->devices) {
+		if (!isAnyDeviceType(device->config.device_type, device_type)) { continue; }
+		if (devices && count < num_entries) { devices[count] = device; }
+		count++;
+	}
+	if (num_devices) { *num_devices = count; }
+	return count ? CL_SUCCESS : CL_DEVICE_NOT_FOUND;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetDeviceInfo(cl_device_id device, cl_device_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetDeviceInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isValidDevice(device)) { return CL_INVALID_DEVICE; }
+	const MockOpenCLConfig& properties = device->config;
+
+	switch (param_name) {
+	case CL_DEVICE_TYPE: return returnInfoValue(properties.device_type, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_NAME: return returnInfoString(device->name, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_VENDOR: return returnInfoString("Mock", param_value_size, param_value, param_value_size_ret);
+	case CL_DRIVER_VERSION: return returnInfoString(MOCK_DRIVER_VERSION, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_VERSION: return returnInfoString(MOCK_DEVICE_VERSION, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_EXTENSIONS: return returnInfoString("", param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_EXTENSIONS_WITH_VERSION: return returnInfo(nullptr, 0, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_PLATFORM: return returnInfoValue(device->platform, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_COMPUTE_UNITS: return returnInfoValue(properties.compute_units, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_CLOCK_FREQUENCY: return returnInfoValue(properties.clock_frequency, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_WORK_GROUP_SIZE: return returnInfoValue(properties.max_work_group_size, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS: return returnInfoValue((cl_uint)3, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_WORK_ITEM_SIZES:
+		{
+			size_t maxWorkItemSizes[3] = { properties.max_work_group_size, properties.max_work_group_size, properties.max_work_group_size < 64 ? properties.max_work_group_size : 64 };
+			return returnInfo(maxWorkItemSizes, sizeof(maxWorkItemSizes), param_value_size, param_value, param_value_size_ret);
+		}
+	case CL_DEVICE_GLOBAL_MEM_SIZE: return returnInfoValue(properties.global_memory_size, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_MAX_MEM_ALLOC_SIZE: return returnInfoValue(properties.global_memory_size / 4, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_LOCAL_MEM_SIZE: return returnInfoValue((cl_ulong)32768, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_AVAILABLE: return returnInfoValue((cl_bool)1, param_value_size, param_value, param_value_size_ret);
+	case CL_DEVICE_PROFILING_TIMER_RESOLUTION: return returnInfoValue((size_t)1, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+// Contexts and queues.
+
+MOCK_EXPORT cl_context CL_API_CALL mock_clCreateContext(const cl_context_properties* properties, cl_uint num_devices, const cl_device_id* devices,
+														void (CL_CALLBACK* pfn_notify)(const char* errinfo, const void* private_info, size_t cb, void* user_data),
+														void* user_data, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateContext);
+	if (num_devices == 0 || !devices || (!pfn_notify && user_data)) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	for (cl_uint i = 0; i < num_devices; i++) {
+		if (!isValidDevice(devices[i])) { setErrcode(errcode_ret, CL_INVALID_DEVICE); return nullptr; }
+	}
+
+	cl_context context = new (std::nothrow) _cl_context();
+	if (!context) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	context->devices.assign(devices, devices + num_devices);
+	if (properties) {
+		// NOTE: Properties are name/value pairs terminated by a 0.
+		size_t length = 0;
+		while (properties[length]) { length += 2; }
+		context->properties.assign(properties, properties + length + 1);
+	}
+	liveObjects[context] = Object_type::CONTEXT;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return context;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetContextInfo(cl_context context, cl_context_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetContextInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { return CL_INVALID_CONTEXT; }
+
+	switch (param_name) {
+	case CL_CONTEXT_REFERENCE_COUNT: return returnInfoValue(context->refCount, param_value_size, param_value, param_value_size_ret);
+	case CL_CONTEXT_NUM_DEVICES: return returnInfoValue((cl_uint)context->devices.size(), param_value_size, param_value, param_value_size_ret);
+	case CL_CONTEXT_DEVICES:
+		return returnInfo(context->devices.data(), context->devices.size() * sizeof(cl_device_id), param_value_size, param_value, param_value_size_ret);
+	case CL_CONTEXT_PROPERTIES:
+		return returnInfo(context->properties.data(), context->properties.size() * sizeof(cl_context_properties), param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_command_queue CL_API_CALL mock_clCreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateCommandQueue);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+	bool isContextDevice = false;
+	for (cl_device_id contextDevice : context->devices) {
+		if (contextDevice == device) { isContextDevice = true; break; }
+	}
+	if (!isContextDevice) { setErrcode(errcode_ret, CL_INVALID_DEVICE); return nullptr; }
+	if (properties & ~(cl_command_queue_properties)(CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE)) {
+		setErrcode(errcode_ret, CL_INVALID_VALUE);
+		return nullptr;
+	}
+
+	cl_command_queue queue = new (std::nothrow) _cl_command_queue();
+	if (!queue) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	queue->context = context;
+	queue->device = device;
+	queue->properties = properties;
+	liveObjects[queue] = Object_type::QUEUE;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return queue;
+}
+
+// Programs and kernels.
+
+MOCK_EXPORT cl_program CL_API_CALL mock_clCreateProgramWithSource(cl_context context, cl_uint count, const char* const* strings, const size_t* lengths, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateProgramWithSource);
+	if (count == 0 || !strings) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+
+	cl_program program = new (std::nothrow) _cl_program();
+	if (!program) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	program->context = context;
+	for (cl_uint i = 0; i < count; i++) {
+		if (!strings[i]) { delete program; setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+		if (lengths && lengths[i]) { program->source.append(strings[i], lengths[i]); }
+		else { program->source.append(strings[i]); }
+	}
+	liveObjects[program] = Object_type::PROGRAM;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return program;
+}
+
+// NOTE: Mock binaries are the source behind a prefix that names the device, so binaries only load on the device they came from,
+// like on a real implementation.
+static std::string getMockBinaryPrefix(cl_device_id device) { return "MOCKBIN " + std::to_string((uintptr_t)device) + "\n"; }
+
+MOCK_EXPORT cl_program CL_API_CALL mock_clCreateProgramWithBinary(cl_context context, cl_uint num_devices, const cl_device_id* device_list, const size_t* lengths,
+																  const unsigned char** binaries, cl_int* binary_status, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateProgramWithBinary);
+	if (num_devices == 0 || !device_list || !lengths || !binaries) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+
+	std::string source;
+	for (cl_uint i = 0; i < num_devices; i++) {
+		bool isContextDevice = false;
+		for (cl_device_id contextDevice : context->devices) {
+			if (contextDevice == device_list[i]) { isContextDevice = true; break; }
+		}
+		if (!isContextDevice) { setErrcode(errcode_ret, CL_INVALID_DEVICE); return nullptr; }
+		if (!binaries[i] || lengths[i] == 0) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+
+		std::string binary((const char*)binaries[i], lengths[i]);
+		std::string prefix = getMockBinaryPrefix(device_list[i]);
+		bool valid = binary.compare(0, prefix.size(), prefix) == 0;
+		if (binary_status) { binary_status[i] = valid ? CL_SUCCESS : CL_INVALID_BINARY; }
+		if (!valid) { setErrcode(errcode_ret, CL_INVALID_BINARY); return nullptr; }
+		source = binary.substr(prefix.size());
+	}
+
+	cl_program program = new (std::nothrow) _cl_program();
+	if (!program) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	program->context = context;
+	program->source = source;
+	program->fromBinary = true;
+	liveObjects[program] = Object_type::PROGRAM;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return program;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id* device_list, const char* options,
+												   void (CL_CALLBACK* pfn_notify)(cl_program program, void* user_data), void* user_data) {
+	MOCK_ENTRY(clBuildProgram);
+	if ((num_devices == 0) != (device_list == nullptr) || (!pfn_notify && user_data)) { return CL_INVALID_VALUE; }
+	uint64_t buildLatency;
+	cl_int err;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(program, Object_type::PROGRAM)) { return CL_INVALID_PROGRAM; }
+		for (cl_uint i = 0; i < num_devices; i++) {
+			bool isContextDevice = false;
+			for (cl_device_id contextDevice : program->context->devices) {
+				if (contextDevice == device_list[i]) { isContextDevice = true; break; }
+			}
+			if (!isContextDevice) { return CL_INVALID_DEVICE; }
+		}
+
+		buildLatency = config.build_latency;
+		program->buildOptions = options ? options : "";
+		size_t errorDirective = program->source.find("#error");
+		if (errorDirective != std::string::npos) {
+			size_t lineEnd = program->source.find('\n', errorDirective);
+			program->buildLog = "mock build failed: " + program->source.substr(errorDirective, lineEnd == std::string::npos ? std::string::npos : lineEnd - errorDirective);
+			program->buildStatus = MOCK_CL_BUILD_ERROR;
+			program->kernels.clear();
+			err = CL_BUILD_PROGRAM_FAILURE;
+		} else {
+			program->buildLog.clear();
+			program->buildStatus = MOCK_CL_BUILD_SUCCESS;
+			scanKernelDeclarations(program->source, program->kernels);
+			err = CL_SUCCESS;
+		}
+	}
+
+	if (buildLatency) { spinUntil(now() + buildLatency); }
+	if (pfn_notify) { pfn_notify(program, user_data); }
+	return err;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetProgramInfo(cl_program program, cl_program_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetProgramInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(program, Object_type::PROGRAM)) { return CL_INVALID_PROGRAM; }
+
+	switch (param_name) {
+	case CL_PROGRAM_REFERENCE_COUNT: return returnInfoValue(program->refCount, param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_CONTEXT: return returnInfoValue(program->context, param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_NUM_DEVICES: return returnInfoValue((cl_uint)program->context->devices.size(), param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_DEVICES:
+		return returnInfo(program->context->devices.data(), program->context->devices.size() * sizeof(cl_device_id), param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_SOURCE: return returnInfoString(program->fromBinary ? std::string() : program->source, param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_BINARY_SIZES:
+		{
+			std::vector<size_t> sizes;
+			for (cl_device_id device : program->context->devices) {
+				sizes.push_back(program->buildStatus == MOCK_CL_BUILD_SUCCESS ? getMockBinaryPrefix(device).size() + program->source.size() : 0);
+			}
+			return returnInfo(sizes.data(), sizes.size() * sizeof(size_t), param_value_size, param_value, param_value_size_ret);
+		}
+	case CL_PROGRAM_BINARIES:
+		{
+			// NOTE: param_value is an array of pointers, one per device, nullptr entries get skipped.
+			size_t size = program->context->devices.size() * sizeof(unsigned char*);
+			if (param_value_size_ret) { *param_value_size_ret = size; }
+			if (!param_value) { return CL_SUCCESS; }
+			if (param_value_size < size) { return CL_INVALID_VALUE; }
+			unsigned char** binaries = (unsigned char**)param_value;
+			for (size_t i = 0; i < program->context->devices.size(); i++) {
+				if (!binaries[i] || program->buildStatus != MOCK_CL_BUILD_SUCCESS) { continue; }
+				std::string binary = getMockBinaryPrefix(program->context->devices[i]) + program->source;
+				std::memcpy(binaries[i], binary.data(), binary.size());
+			}
+			return CL_SUCCESS;
+		}
+	case CL_PROGRAM_NUM_KERNELS:
+		if (program->buildStatus != MOCK_CL_BUILD_SUCCESS) { return CL_INVALID_PROGRAM_EXECUTABLE; }
+		return returnInfoValue(program->kernels.size(), param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_KERNEL_NAMES:
+		{
+			if (program->buildStatus != MOCK_CL_BUILD_SUCCESS) { return CL_INVALID_PROGRAM_EXECUTABLE; }
+			std::string kernelNames;
+			for (const KernelDeclaration& kernel : program->kernels) {
+				if (!kernelNames.empty()) { kernelNames += ';'; }
+				kernelNames += kernel.name;
+			}
+			return returnInfoString(kernelNames, param_value_size, param_value, param_value_size_ret);
+		}
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info param_name,
+														  size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetProgramBuildInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(program, Object_type::PROGRAM)) { return CL_INVALID_PROGRAM; }
+	if (!isValidDevice(device)) { return CL_INVALID_DEVICE; }
+
+	switch (param_name) {
+	case CL_PROGRAM_BUILD_STATUS: return returnInfoValue(program->buildStatus, param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_BUILD_OPTIONS: return returnInfoString(program->buildOptions, param_value_size, param_value, param_value_size_ret);
+	case CL_PROGRAM_BUILD_LOG: return returnInfoString(program->buildLog, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_kernel CL_API_CALL mock_clCreateKernel(cl_program program, const char* kernel_name, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateKernel);
+	if (!kernel_name) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(program, Object_type::PROGRAM)) { setErrcode(errcode_ret, CL_INVALID_PROGRAM); return nullptr; }
+	if (program->buildStatus != MOCK_CL_BUILD_SUCCESS) { setErrcode(errcode_ret, CL_INVALID_PROGRAM_EXECUTABLE); return nullptr; }
+
+	for (const KernelDeclaration& declaration : program->kernels) {
+		if (declaration.name != kernel_name) { continue; }
+		cl_kernel kernel = new (std::nothrow) _cl_kernel();
+		if (!kernel) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+		kernel->program = program;
+		kernel->name = declaration.name;
+		kernel->argIsSet.assign(declaration.argCount, false);
+		liveObjects[kernel] = Object_type::KERNEL;
+		setErrcode(errcode_ret, CL_SUCCESS);
+		return kernel;
+	}
+	setErrcode(errcode_ret, CL_INVALID_KERNEL_NAME);
+	return nullptr;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void* arg_value) {
+	MOCK_ENTRY(clSetKernelArg);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(kernel, Object_type::KERNEL)) { return CL_INVALID_KERNEL; }
+	if (arg_index >= kernel->argIsSet.size()) { return CL_INVALID_ARG_INDEX; }
+	// NOTE: A null value with a size is how local memory arguments get set, so only a zero size is actually wrong.
+	if (arg_size == 0) { return CL_INVALID_ARG_SIZE; }
+	(void)arg_value;
+	kernel->argIsSet[arg_index] = true;
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetKernelInfo(cl_kernel kernel, cl_kernel_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetKernelInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(kernel, Object_type::KERNEL)) { return CL_INVALID_KERNEL; }
+
+	switch (param_name) {
+	case CL_KERNEL_FUNCTION_NAME: return returnInfoString(kernel->name, param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_NUM_ARGS: return returnInfoValue((cl_uint)kernel->argIsSet.size(), param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_REFERENCE_COUNT: return returnInfoValue(kernel->refCount, param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_CONTEXT: return returnInfoValue(kernel->program->context, param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_PROGRAM: return returnInfoValue(kernel->program, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device, cl_kernel_work_group_info param_name,
+															 size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetKernelWorkGroupInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(kernel, Object_type::KERNEL)) { return CL_INVALID_KERNEL; }
+	if (!isValidDevice(device)) { return CL_INVALID_DEVICE; }
+
+	switch (param_name) {
+	case CL_KERNEL_WORK_GROUP_SIZE: return returnInfoValue(device->config.max_work_group_size, param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE:
+		return returnInfoValue(device->config.preferred_work_group_size_multiple, param_value_size, param_value, param_value_size_ret);
+	case CL_KERNEL_COMPILE_WORK_GROUP_SIZE:
+		{
+			size_t compileWorkGroupSize[3] = { 0, 0, 0 };
+			return returnInfo(compileWorkGroupSize, sizeof(compileWorkGroupSize), param_value_size, param_value, param_value_size_ret);
+		}
+	case CL_KERNEL_LOCAL_MEM_SIZE:
+	case CL_KERNEL_PRIVATE_MEM_SIZE:
+		return returnInfoValue((cl_ulong)0, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+// Memory objects.
+
+MOCK_EXPORT cl_mem CL_API_CALL mock_clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void* host_ptr, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateBuffer);
+	if (size == 0) { setErrcode(errcode_ret, CL_INVALID_BUFFER_SIZE); return nullptr; }
+	if (((flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0) != (host_ptr != nullptr)) { setErrcode(errcode_ret, CL_INVALID_HOST_PTR); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+	if (size > config.global_memory_size) { setErrcode(errcode_ret, CL_INVALID_BUFFER_SIZE); return nullptr; }
+
+	// NOTE: CL_MEM_ALLOC_HOST_PTR buffers live in host memory, so they don't count.
+	bool onDevice = !(flags & CL_MEM_ALLOC_HOST_PTR);
+	if (onDevice && allocatedDeviceBytes + size > config.global_memory_size) { setErrcode(errcode_ret, CL_MEM_OBJECT_ALLOCATION_FAILURE); return nullptr; }
+
+	cl_mem buffer = new (std::nothrow) _cl_mem();
+	if (!buffer) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	buffer->context = context;
+	buffer->data.resize(size);
+	if (onDevice) {
+		buffer->deviceBytes = size;
+		allocatedDeviceBytes += size;
+	}
+	if (host_ptr) { std::memcpy(buffer->data.data(), host_ptr, size); }
+	liveObjects[buffer] = Object_type::MEM;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return buffer;
+}
+
+MOCK_EXPORT cl_mem CL_API_CALL mock_clCreateImage2D(cl_context context, cl_mem_flags flags, const cl_image_format* image_format, size_t image_width,
+													size_t image_height, size_t image_row_pitch, void* host_ptr, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateImage2D);
+	if (!image_format) { setErrcode(errcode_ret, CL_INVALID_IMAGE_FORMAT_DESCRIPTOR); return nullptr; }
+	size_t elementSize = calcImageElementSize(*image_format);
+	if (elementSize == 0) { setErrcode(errcode_ret, CL_INVALID_IMAGE_FORMAT_DESCRIPTOR); return nullptr; }
+	if (image_width == 0 || image_height == 0) { setErrcode(errcode_ret, CL_INVALID_IMAGE_SIZE); return nullptr; }
+	if (((flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0) != (host_ptr != nullptr)) { setErrcode(errcode_ret, CL_INVALID_HOST_PTR); return nullptr; }
+	size_t rowPitch = image_width * elementSize;
+	if (host_ptr && image_row_pitch) {
+		if (image_row_pitch < rowPitch) { setErrcode(errcode_ret, CL_INVALID_IMAGE_SIZE); return nullptr; }
+	} else if (image_row_pitch) { setErrcode(errcode_ret, CL_INVALID_IMAGE_SIZE); return nullptr; }
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+
+	cl_mem image = new (std::nothrow) _cl_mem();
+	if (!image) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	image->context = context;
+	image->isImage = true;
+	image->format = *image_format;
+	image->elementSize = elementSize;
+	image->width = image_width;
+	image->height = image_height;
+	image->rowPitch = rowPitch;
+	image->data.resize(rowPitch * image_height);
+	if (host_ptr) {
+		size_t hostRowPitch = image_row_pitch ? image_row_pitch : rowPitch;
+		for (size_t y = 0; y < image_height; y++) { std::memcpy(image->data.data() + y * rowPitch, (unsigned char*)host_ptr + y * hostRowPitch, rowPitch); }
+	}
+	liveObjects[image] = Object_type::MEM;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return image;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetImageInfo(cl_mem image, cl_image_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetImageInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(image, Object_type::MEM) || !image->isImage) { return CL_INVALID_MEM_OBJECT; }
+
+	switch (param_name) {
+	case CL_IMAGE_FORMAT: return returnInfoValue(image->format, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_ELEMENT_SIZE: return returnInfoValue(image->elementSize, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_ROW_PITCH: return returnInfoValue(image->rowPitch, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_SLICE_PITCH: return returnInfoValue((size_t)0, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_WIDTH: return returnInfoValue(image->width, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_HEIGHT: return returnInfoValue(image->height, param_value_size, param_value, param_value_size_ret);
+	case CL_IMAGE_DEPTH: return returnInfoValue((size_t)0, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+// Commands.
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueNDRangeKernel(cl_command_queue command_queue, cl_kernel kernel, cl_uint work_dim, const size_t* global_work_offset,
+														   const size_t* global_work_size, const size_t* local_work_size, cl_uint num_events_in_wait_list,
+														   const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueNDRangeKernel);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	if (!isLive(kernel, Object_type::KERNEL)) { return CL_INVALID_KERNEL; }
+	if (kernel->program->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+	for (bool isSet : kernel->argIsSet) {
+		if (!isSet) { return CL_INVALID_KERNEL_ARGS; }
+	}
+	if (work_dim < 1 || work_dim > 3) { return CL_INVALID_WORK_DIMENSION; }
+	if (!global_work_size) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+	size_t workGroupSize = 1;
+	for (cl_uint i = 0; i < work_dim; i++) {
+		if (global_work_size[i] == 0) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+		if (!local_work_size) { continue; }
+		if (local_work_size[i] == 0 || global_work_size[i] % local_work_size[i] != 0) { return CL_INVALID_WORK_GROUP_SIZE; }
+		workGroupSize *= local_work_size[i];
+	}
+	if (workGroupSize > command_queue->device->config.max_work_group_size) { return CL_INVALID_WORK_GROUP_SIZE; }
+	(void)global_work_offset;
+
+	uint64_t end;
+	return enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, config.kernel_latency, MOCK_CL_COMMAND_NDRANGE_KERNEL, event, end);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clFlush(cl_command_queue command_queue) {
+	MOCK_ENTRY(clFlush);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clFinish(cl_command_queue command_queue) {
+	MOCK_ENTRY(clFinish);
+	uint64_t busyUntil;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+		busyUntil = command_queue->busyUntil;
+	}
+	spinUntil(busyUntil);
+	return CL_SUCCESS;
+}
+
+// Shared by the buffer reads and writes, which only differ in the direction of the copy.
+static cl_int enqueueBufferTransfer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size, void* hostPointer, bool isRead,
+									cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) noexcept {
+	uint64_t end;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+		if (!isLive(buffer, Object_type::MEM) || buffer->isImage) { return CL_INVALID_MEM_OBJECT; }
+		if (buffer->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+		if (!hostPointer || size == 0 || offset + size > buffer->data.size() || offset + size < offset) { return CL_INVALID_VALUE; }
+		cl_int err = enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, calcTransferDuration(size),
+									isRead ? MOCK_CL_COMMAND_READ_BUFFER : MOCK_CL_COMMAND_WRITE_BUFFER, event, end);
+		if (err != CL_SUCCESS) { return err; }
+		// NOTE: Kernels don't change anything, so copying right away gives the same result as copying when the command runs.
+		if (isRead) { std::memcpy(hostPointer, buffer->data.data() + offset, size); }
+		else { std::memcpy(buffer->data.data() + offset, hostPointer, size); }
+	}
+	if (blocking) { spinUntil(end); }
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write, size_t offset, size_t size, const void* ptr,
+														 cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueWriteBuffer);
+	return enqueueBufferTransfer(command_queue, buffer, blocking_write, offset, size, (void*)ptr, false, num_events_in_wait_list, event_wait_list, event);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueReadBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_read, size_t offset, size_t size, void* ptr,
+														cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueReadBuffer);
+	return enqueueBufferTransfer(command_queue, buffer, blocking_read, offset, size, ptr, true, num_events_in_wait_list, event_wait_list, event);
+}
+
+// Same thing for images, row by row.
+static cl_int enqueueImageTransfer(cl_command_queue command_queue, cl_mem image, cl_bool blocking, const size_t origin[3], const size_t region[3], size_t hostRowPitch,
+								   void* hostPointer, bool isRead, cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) noexcept {
+	uint64_t end;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+		if (!isLive(image, Object_type::MEM) || !image->isImage) { return CL_INVALID_MEM_OBJECT; }
+		if (image->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+		if (!hostPointer || !origin || !region) { return CL_INVALID_VALUE; }
+		if (origin[2] != 0 || region[2] != 1 || region[0] == 0 || region[1] == 0 ||
+			origin[0] + region[0] > image->width || origin[1] + region[1] > image->height) { return CL_INVALID_VALUE; }
+		size_t rowSize = region[0] * image->elementSize;
+		if (hostRowPitch == 0) { hostRowPitch = rowSize; }
+		else if (hostRowPitch < rowSize) { return CL_INVALID_VALUE; }
+
+		cl_int err = enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, calcTransferDuration(rowSize * region[1]),
+									isRead ? MOCK_CL_COMMAND_READ_IMAGE : MOCK_CL_COMMAND_WRITE_IMAGE, event, end);
+		if (err != CL_SUCCESS) { return err; }
+		for (size_t y = 0; y < region[1]; y++) {
+			unsigned char* imageRow = image->data.data() + (origin[1] + y) * image->rowPitch + origin[0] * image->elementSize;
+			unsigned char* hostRow = (unsigned char*)hostPointer + y * hostRowPitch;
+			if (isRead) { std::memcpy(hostRow, imageRow, rowSize); }
+			else { std::memcpy(imageRow, hostRow, rowSize); }
+		}
+	}
+	if (blocking) { spinUntil(end); }
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueWriteImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_write, const size_t origin[3], const size_t region[3],
+														size_t input_row_pitch, size_t input_slice_pitch, const void* ptr,
+														cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueWriteImage);
+	(void)input_slice_pitch;
+	return enqueueImageTransfer(command_queue, image, blocking_write, origin, region, input_row_pitch, (void*)ptr, false, num_events_in_wait_list, event_wait_list, event);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueReadImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_read, const size_t origin[3], const size_t region[3],
+													   size_t row_pitch, size_t slice_pitch, void* ptr,
+													   cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueReadImage);
+	(void)slice_pitch;
+	return enqueueImageTransfer(command_queue, image, blocking_read, origin, region, row_pitch, ptr, true, num_events_in_wait_list, event_wait_list, event);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueCopyBuffer(cl_command_queue command_queue, cl_mem src_buffer, cl_mem dst_buffer, size_t src_offset, size_t dst_offset, size_t size,
+														cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueCopyBuffer);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	if (!isLive(src_buffer, Object_type::MEM) || src_buffer->isImage || !isLive(dst_buffer, Object_type::MEM) || dst_buffer->isImage) { return CL_INVALID_MEM_OBJECT; }
+	if (src_buffer->context != command_queue->context || dst_buffer->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+	if (size == 0 || src_offset + size > src_buffer->data.size() || dst_offset + size > dst_buffer->data.size()) { return CL_INVALID_VALUE; }
+	if (src_buffer == dst_buffer && src_offset < dst_offset + size && dst_offset < src_offset + size) { return CL_MEM_COPY_OVERLAP; }
+
+	uint64_t end;
+	cl_int err = enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, calcTransferDuration(size), MOCK_CL_COMMAND_COPY_BUFFER, event, end);
+	if (err != CL_SUCCESS) { return err; }
+	std::memcpy(dst_buffer->data.data() + dst_offset, src_buffer->data.data() + src_offset, size);
+	return CL_SUCCESS;
+}
+
+// NOTE: The mock keeps buffers in host memory anyway, so mapping just hands out a pointer into the buffer.
+MOCK_EXPORT void* CL_API_CALL mock_clEnqueueMapBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_map, cl_map_flags map_flags, size_t offset, size_t size,
+													  cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clEnqueueMapBuffer);
+	(void)map_flags;
+	uint64_t end;
+	void* mappedPointer;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(command_queue, Object_type::QUEUE)) { setErrcode(errcode_ret, CL_INVALID_COMMAND_QUEUE); return nullptr; }
+		if (!isLive(buffer, Object_type::MEM) || buffer->isImage) { setErrcode(errcode_ret, CL_INVALID_MEM_OBJECT); return nullptr; }
+		if (buffer->context != command_queue->context) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+		if (size == 0 || offset + size > buffer->data.size() || offset + size < offset) { setErrcode(errcode_ret, CL_INVALID_VALUE); return nullptr; }
+		cl_int err = enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, 0, MOCK_CL_COMMAND_MAP_BUFFER, event, end);
+		if (err != CL_SUCCESS) { setErrcode(errcode_ret, err); return nullptr; }
+		buffer->mapCount++;
+		mappedPointer = buffer->data.data() + offset;
+	}
+	if (blocking_map) { spinUntil(end); }
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return mappedPointer;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueUnmapMemObject(cl_command_queue command_queue, cl_mem memobj, void* mapped_ptr,
+															cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueUnmapMemObject);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	if (!isLive(memobj, Object_type::MEM)) { return CL_INVALID_MEM_OBJECT; }
+	if (memobj->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+	unsigned char* pointer = (unsigned char*)mapped_ptr;
+	if (!memobj->mapCount || pointer < memobj->data.data() || pointer >= memobj->data.data() + memobj->data.size()) { return CL_INVALID_VALUE; }
+
+	uint64_t end;
+	cl_int err = enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, 0, MOCK_CL_COMMAND_UNMAP_MEM_OBJECT, event, end);
+	if (err != CL_SUCCESS) { return err; }
+	memobj->mapCount--;
+	return CL_SUCCESS;
+}
+
+// NOTE: Every device of the mock shares the same host memory, so migrating only takes up device time, as long as a transfer of the contents would.
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueMigrateMemObjects(cl_command_queue command_queue, cl_uint num_mem_objects, const cl_mem* mem_objects, cl_mem_migration_flags flags,
+															   cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueMigrateMemObjects);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	if (num_mem_objects == 0 || !mem_objects) { return CL_INVALID_VALUE; }
+	if (flags & ~(cl_mem_migration_flags)(CL_MIGRATE_MEM_OBJECT_HOST | CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED)) { return CL_INVALID_VALUE; }
+	size_t totalSize = 0;
+	for (cl_uint i = 0; i < num_mem_objects; i++) {
+		if (!isLive(mem_objects[i], Object_type::MEM)) { return CL_INVALID_MEM_OBJECT; }
+		if (mem_objects[i]->context != command_queue->context) { return CL_INVALID_CONTEXT; }
+		totalSize += mem_objects[i]->data.size();
+	}
+
+	uint64_t duration = (flags & CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED) ? 0 : calcTransferDuration(totalSize);
+	uint64_t end;
+	return enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, duration, MOCK_CL_COMMAND_MIGRATE_MEM_OBJECTS, event, end);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clEnqueueMarkerWithWaitList(cl_command_queue command_queue, cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event) {
+	MOCK_ENTRY(clEnqueueMarkerWithWaitList);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(command_queue, Object_type::QUEUE)) { return CL_INVALID_COMMAND_QUEUE; }
+	uint64_t end;
+	return enqueueCommand(command_queue, num_events_in_wait_list, event_wait_list, 0, MOCK_CL_COMMAND_MARKER, event, end);
+}
+
+// Events.
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clWaitForEvents(cl_uint num_events, const cl_event* event_list) {
+	MOCK_ENTRY(clWaitForEvents);
+	if (num_events == 0 || !event_list) { return CL_INVALID_VALUE; }
+	uint64_t latestEnd = 0;
+	std::vector<cl_event> userEvents;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		for (cl_uint i = 0; i < num_events; i++) {
+			if (!isLive(event_list[i], Object_type::EVENT)) { return CL_INVALID_EVENT; }
+			if (event_list[i]->context != event_list[0]->context) { return CL_INVALID_CONTEXT; }
+			if (event_list[i]->queue) { latestEnd = event_list[i]->end > latestEnd ? event_list[i]->end : latestEnd; }
+			else { userEvents.push_back(event_list[i]); }
+		}
+	}
+
+	spinUntil(latestEnd);
+	// NOTE: User events only complete when the host says so, so keep polling them (under the lock, since another thread is going to set them).
+	for (cl_event userEvent : userEvents) {
+		while (true) {
+			cl_int status;
+			{
+				std::lock_guard<std::mutex> lock(mockMutex);
+				status = userEvent->userStatus;
+			}
+			if (status < 0) { return CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST; }
+			if (status == CL_COMPLETE) { break; }
+			std::this_thread::yield();
+		}
+	}
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetEventInfo(cl_event event, cl_event_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetEventInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(event, Object_type::EVENT)) { return CL_INVALID_EVENT; }
+
+	switch (param_name) {
+	case CL_EVENT_COMMAND_QUEUE: return returnInfoValue(event->queue, param_value_size, param_value, param_value_size_ret);
+	case CL_EVENT_CONTEXT: return returnInfoValue(event->context, param_value_size, param_value, param_value_size_ret);
+	case CL_EVENT_COMMAND_TYPE: return returnInfoValue(event->commandType, param_value_size, param_value, param_value_size_ret);
+	case CL_EVENT_REFERENCE_COUNT: return returnInfoValue(event->refCount, param_value_size, param_value, param_value_size_ret);
+	case CL_EVENT_COMMAND_EXECUTION_STATUS: return returnInfoValue(getEventStatus(event, now()), param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+MOCK_EXPORT cl_event CL_API_CALL mock_clCreateUserEvent(cl_context context, cl_int* errcode_ret) {
+	MOCK_ENTRY_RETURNING_HANDLE(clCreateUserEvent);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(context, Object_type::CONTEXT)) { setErrcode(errcode_ret, CL_INVALID_CONTEXT); return nullptr; }
+
+	cl_event event = new (std::nothrow) _cl_event();
+	if (!event) { setErrcode(errcode_ret, CL_OUT_OF_HOST_MEMORY); return nullptr; }
+	event->context = context;
+	event->queue = nullptr;
+	event->commandType = MOCK_CL_COMMAND_USER;
+	event->queued = event->submit = event->start = event->end = 0;
+	liveObjects[event] = Object_type::EVENT;
+	setErrcode(errcode_ret, CL_SUCCESS);
+	return event;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clSetUserEventStatus(cl_event event, cl_int execution_status) {
+	MOCK_ENTRY(clSetUserEventStatus);
+	if (execution_status > 0) { return CL_INVALID_VALUE; }
+	std::vector<EventCallback> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(event, Object_type::EVENT) || event->queue) { return CL_INVALID_EVENT; }
+		if (event->userStatus <= 0) { return CL_INVALID_OPERATION; }
+		event->userStatus = execution_status;
+		callbacks.swap(event->callbacks);
+	}
+
+	// NOTE: Outside of the lock, since callbacks are allowed to call back into OpenCL. The status is CL_COMPLETE or an error, which fires
+	// every callback.
+	fireEventCallbacks(event, execution_status, callbacks);
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clSetEventCallback(cl_event event, cl_int command_exec_callback_type,
+													   void (CL_CALLBACK* pfn_notify)(cl_event event, cl_int event_command_status, void* user_data), void* user_data) {
+	MOCK_ENTRY(clSetEventCallback);
+	if (!pfn_notify || (command_exec_callback_type != CL_COMPLETE && command_exec_callback_type != CL_RUNNING && command_exec_callback_type != CL_SUBMITTED)) {
+		return CL_INVALID_VALUE;
+	}
+
+	uint64_t deadline;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		if (!isLive(event, Object_type::EVENT)) { return CL_INVALID_EVENT; }
+		if (!event->queue) {
+			if (event->userStatus > command_exec_callback_type) {
+				event->callbacks.push_back({ command_exec_callback_type, pfn_notify, user_data });
+				return CL_SUCCESS;
+			}
+			deadline = 0;
+		} else {
+			switch (command_exec_callback_type) {
+			case CL_SUBMITTED: deadline = event->submit; break;
+			case CL_RUNNING: deadline = event->start; break;
+			default: deadline = event->end; break;
+			}
+		}
+	}
+
+	spinUntil(deadline);
+	cl_int status;
+	{
+		std::lock_guard<std::mutex> lock(mockMutex);
+		status = getEventStatus(event, now());
+	}
+	pfn_notify(event, status < command_exec_callback_type ? status : command_exec_callback_type, user_data);
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clGetEventProfilingInfo(cl_event event, cl_profiling_info param_name, size_t param_value_size, void* param_value, size_t* param_value_size_ret) {
+	MOCK_ENTRY(clGetEventProfilingInfo);
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(event, Object_type::EVENT)) { return CL_INVALID_EVENT; }
+	if (!event->queue || !(event->queue->properties & CL_QUEUE_PROFILING_ENABLE) || getEventStatus(event, now()) != CL_COMPLETE) {
+		return CL_PROFILING_INFO_NOT_AVAILABLE;
+	}
+
+	switch (param_name) {
+	case CL_PROFILING_COMMAND_QUEUED: return returnInfoValue((cl_ulong)event->queued, param_value_size, param_value, param_value_size_ret);
+	case CL_PROFILING_COMMAND_SUBMIT: return returnInfoValue((cl_ulong)event->submit, param_value_size, param_value, param_value_size_ret);
+	case CL_PROFILING_COMMAND_START: return returnInfoValue((cl_ulong)event->start, param_value_size, param_value, param_value_size_ret);
+	case CL_PROFILING_COMMAND_END:
+	case CL_PROFILING_COMMAND_COMPLETE:
+		return returnInfoValue((cl_ulong)event->end, param_value_size, param_value, param_value_size_ret);
+	default: return CL_INVALID_VALUE;
+	}
+}
+
+// Reference counting.
+
+template <typename object_t>
+static cl_int releaseObject(object_t object, Object_type type, cl_int invalidError) noexcept {
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(object, type)) { return invalidError; }
+	if (--object->refCount == 0) {
+		liveObjects.erase(object);
+		delete object;
+	}
+	return CL_SUCCESS;
+}
+
+template <typename object_t>
+static cl_int retainObject(object_t object, Object_type type, cl_int invalidError) noexcept {
+	std::lock_guard<std::mutex> lock(mockMutex);
+	if (!isLive(object, type)) { return invalidError; }
+	object->refCount++;
+	return CL_SUCCESS;
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainEvent(cl_event event) {
+	MOCK_ENTRY(clRetainEvent);
+	return retainObject(event, Object_type::EVENT, CL_INVALID_EVENT);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseEvent(cl_event event) {
+	MOCK_ENTRY(clReleaseEvent);
+	return releaseObject(event, Object_type::EVENT, CL_INVALID_EVENT);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainMemObject(cl_mem memobj) {
+	MOCK_ENTRY(clRetainMemObject);
+	return retainObject(memobj, Object_type::MEM, CL_INVALID_MEM_OBJECT);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseMemObject(cl_mem memobj) {
+	MOCK_ENTRY(clReleaseMemObject);
+	return releaseObject(memobj, Object_type::MEM, CL_INVALID_MEM_OBJECT);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainKernel(cl_kernel kernel) {
+	MOCK_ENTRY(clRetainKernel);
+	return retainObject(kernel, Object_type::KERNEL, CL_INVALID_KERNEL);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseKernel(cl_kernel kernel) {
+	MOCK_ENTRY(clReleaseKernel);
+	return releaseObject(kernel, Object_type::KERNEL, CL_INVALID_KERNEL);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainProgram(cl_program program) {
+	MOCK_ENTRY(clRetainProgram);
+	return retainObject(program, Object_type::PROGRAM, CL_INVALID_PROGRAM);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseProgram(cl_program program) {
+	MOCK_ENTRY(clReleaseProgram);
+	return releaseObject(program, Object_type::PROGRAM, CL_INVALID_PROGRAM);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainCommandQueue(cl_command_queue command_queue) {
+	MOCK_ENTRY(clRetainCommandQueue);
+	return retainObject(command_queue, Object_type::QUEUE, CL_INVALID_COMMAND_QUEUE);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseCommandQueue(cl_command_queue command_queue) {
+	MOCK_ENTRY(clReleaseCommandQueue);
+	return releaseObject(command_queue, Object_type::QUEUE, CL_INVALID_COMMAND_QUEUE);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clRetainContext(cl_context context) {
+	MOCK_ENTRY(clRetainContext);
+	return retainObject(context, Object_type::CONTEXT, CL_INVALID_CONTEXT);
+}
+
+MOCK_EXPORT cl_int CL_API_CALL mock_clReleaseContext(cl_context context) {
+	MOCK_ENTRY(clReleaseContext);
+	return releaseObject(context, Object_type::CONTEXT, CL_INVALID_CONTEXT);
+}
+
+// NOTE: The mock doesn't have any extensions.
+MOCK_EXPORT void* CL_API_CALL mock_clGetExtensionFunctionAddressForPlatform(cl_platform_id platform, const char* func_name) {
+	cl_int injectedError;
+	if (!enterFunction(MOCK_FUNCTION_clGetExtensionFunctionAddressForPlatform, injectedError)) { return nullptr; }
+	(void)platform;
+	(void)func_name;
+	return nullptr;
+}
+
+// Mock control functions (see mock_opencl.h).
+
+MOCK_EXPORT void mockOpenCLSetConfig(const MockOpenCLConfig* newConfig) {
+	std::lock_guard<std::mutex> lock(mockMutex);
+	config = newConfig ? *newConfig : MockOpenCLConfig();
+	if (config.failure_period == 0) { config.failure_period = 1; }
+
+	failingFunction = MOCK_FUNCTION_COUNT;
+	if (config.failing_function) {
+		for (uint32_t i = 0; i < MOCK_FUNCTION_COUNT; i++) {
+			if (std::strcmp(functionNames[i], config.failing_function) == 0) { failingFunction = (Mock_function_index)i; break; }
+		}
+	}
+	// NOTE: The strings are the caller's, and they don't have to outlive this call. The platform versions get copied below, the failing
+	// function already got resolved.
+	initPlatforms();
+	config.platform_versions = nullptr;
+	config.failing_function = nullptr;
+}
+
+MOCK_EXPORT uint64_t mockOpenCLGetCallCount(const char* functionName) {
+	for (uint32_t i = 0; i < MOCK_FUNCTION_COUNT; i++) {
+		if (std::strcmp(functionNames[i], functionName) == 0) { return callCounts[i].load(std::memory_order_relaxed); }
+	}
+	return 0;
+}
+
+MOCK_EXPORT void mockOpenCLResetCallCounts() {
+	for (uint32_t i = 0; i < MOCK_FUNCTION_COUNT; i++) { callCounts[i].store(0, std::memory_order_relaxed); }
+}
+
+MOCK_EXPORT size_t mockOpenCLGetLiveObjectCount() {
+	std::lock_guard<std::mutex> lock(mockMutex);
+	return liveObjects.size();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cl_bindings_and_helpers.h"
+
+#include <cstdint>			// for fixed-width types
+
+// NOTE: The mock OpenCL library is a fake OpenCL.dll that implements every function that initOpenCLBindings() binds, without any device behind it.
+// It's for measuring the host-side cost of this library's helpers without driver noise, and for stress-testing them on machines without a GPU.
+// Load it with initOpenCLBindings("path\\to\\mock_opencl.dll") and configure it through the functions below, which you get with GetProcAddress()
+// on a handle to the same DLL (LoadLibraryA() on the same path again just gives you the already loaded module).
+// NOTE: Nothing actually runs. Buffers and images are real host memory, so writes, copies and reads move real bytes, but kernels only take
+// up simulated device time. Every queue has a simulated device timeline: commands start once the queue and their wait lists are done,
+// take their configured latency, and events report their status and profiling timestamps according to that timeline, so the host sees the
+// same asynchronous behavior as with a real device. Waiting (clFinish(), clWaitForEvents(), blocking transfers) spins until the timeline catches up.
+// NOTE: Kernels get found by scanning the program source for "kernel void name(...)" (or __kernel), and their argument count is the
+// number of top-level commas in the parameter list plus one. A program whose source contains "#error" fails to build, with a build log.
+// NOTE: Differences from a real implementation, on purpose:
+//  - Wait lists that contain user events that aren't complete yet are treated as if those events were complete.
+//  - Event callbacks on commands run on the thread that registers them, as soon as the simulated timeline reaches the requested status
+//    (so clSetEventCallback() can block for as long as the command has left). Callbacks on user events run inside clSetUserEventStatus().
+//  - Objects don't keep their parents alive, releasing a context with live queues in it is fine as far as the mock is concerned.
+//  - Buffers (except CL_MEM_ALLOC_HOST_PTR ones) count against global_memory_size right when they're created, where real implementations
+//    often only allocate on first use. Going over fails clCreateBuffer() with CL_MEM_OBJECT_ALLOCATION_FAILURE.
+
+// Default-constructed, this is one GPU on one OpenCL 3.0 platform, with no latencies and no error injection.
+struct MockOpenCLConfig {
+	cl_uint platform_count = 1;
+	cl_uint devices_per_platform = 1;
+	const char* const* platform_versions = nullptr;		// NOTE: One per platform. nullptr means "OpenCL 3.0 Mock Platform" for every platform.
+	cl_device_type device_type = CL_DEVICE_TYPE_GPU;
+	cl_uint compute_units = 16;
+	cl_uint clock_frequency = 1000;						// NOTE: In MHz.
+	size_t max_work_group_size = 256;
+	size_t preferred_work_group_size_multiple = 32;
+	cl_ulong global_memory_size = (cl_ulong)4 << 30;
+
+	// Simulated latencies in nanoseconds. call_latency gets spun on the calling thread at the start of every call, the rest
+	// is device time on the queue's timeline (except for build_latency, which clBuildProgram() spins, like a real compiler would take).
+	uint64_t call_latency = 0;
+	uint64_t build_latency = 0;
+	uint64_t kernel_latency = 0;
+	double transfer_bandwidth = 0;						// NOTE: In bytes per nanosecond (so GB/s). 0 means transfers take no device time.
+
+	// Error injection. Every failure_period-th call to the function with that name (so every call for 1) returns injected_error
+	// instead of doing anything. Functions that return handles return nullptr and report the error through errcode_ret.
+	const char* failing_function = nullptr;
+	cl_int injected_error = CL_OUT_OF_RESOURCES;
+	uint64_t failure_period = 1;
+};
+
+// Replaces the configuration. NOTE: Platform and device handles from before stay valid, but they don't belong to the new configuration,
+// so configure before enumerating.
+typedef void (*mockOpenCLSetConfig_func)(const MockOpenCLConfig* config);
+
+// Number of calls to the function with that name since loading or since the last reset, including calls that failed.
+typedef uint64_t (*mockOpenCLGetCallCount_func)(const char* functionName);
+typedef void (*mockOpenCLResetCallCounts_func)();
+
+// Number of contexts, queues, programs, kernels, memory objects and events that haven't been released yet. Useful for finding leaks in stress tests.
+typedef size_t (*mockOpenCLGetLiveObjectCount_func)();
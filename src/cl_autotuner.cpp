@@ -0,0 +1,235 @@
+#include "cl_autotuner.h"
+
+#include "cl_ndrange_planner.h"
+
+#include <new>							// For std::nothrow.
+
+#include <cstdint>						// For fixed-width types.
+
+#include <cinttypes>					// For PRIx64 and friends.
+
+#include <cstdio>						// For snprintf and sscanf.
+
+#include <fstream>						// For std::ifstream and std::ofstream.
+
+#include <string>						// For std::string and std::getline.
+
+#include <vector>						// For std::vector.
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hashBytes(uint64_t hash, const char* bytes, size_t length) noexcept {
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+bool WorkGroupTuningKey::operator<(const WorkGroupTuningKey& right) const noexcept {
+	if (kernel_hash != right.kernel_hash) { return kernel_hash < right.kernel_hash; }
+	if (device_hash != right.device_hash) { return device_hash < right.device_hash; }
+	if (dimensions != right.dimensions) { return dimensions < right.dimensions; }
+	for (cl_uint i = 0; i < 3; i++) {
+		if (size_class[i] != right.size_class[i]) { return size_class[i] < right.size_class[i]; }
+	}
+	return false;
+}
+
+cl_int WorkGroupTuningDatabase::load(const char* path) noexcept {
+	std::ifstream file(path);
+	if (!file.is_open()) { return CL_EXT_FILE_OPEN_FAILED; }
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') { continue; }
+
+		WorkGroupTuningKey key;
+		WorkGroupTuningResult result;
+		cl_uint localDimensions;
+		size_t localSizes[3];
+		// NOTE: Lines that don't parse get skipped instead of failing the whole load, a hand-edited file shouldn't cost us every other result.
+		if (sscanf(line.c_str(), "%" SCNx64 " %" SCNx64 " %u %u %u %u %u %zu %zu %zu %" SCNu64,
+				   &key.kernel_hash, &key.device_hash, &key.dimensions, &key.size_class[0], &key.size_class[1], &key.size_class[2],
+				   &localDimensions, &localSizes[0], &localSizes[1], &localSizes[2], &result.time) != 11) { continue; }
+		if (key.dimensions < 1 || key.dimensions > 3 || localDimensions > key.dimensions) { continue; }
+
+		switch (localDimensions) {
+		case 0: result.local_size = NDRange(); break;
+		case 1: result.local_size = NDRange(localSizes[0]); break;
+		case 2: result.local_size = NDRange(localSizes[0], localSizes[1]); break;
+		case 3: result.local_size = NDRange(localSizes[0], localSizes[1], localSizes[2]); break;
+		}
+		entries[key] = result;
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int WorkGroupTuningDatabase::save(const char* path) const noexcept {
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) { return CL_EXT_FILE_OPEN_FAILED; }
+
+	file << "# kernel_hash device_hash dimensions size_class_x size_class_y size_class_z local_dimensions local_x local_y local_z time_ns\n";
+	char lineBuffer[256];
+	for (const auto& entry : entries) {
+		const WorkGroupTuningKey& key = entry.first;
+		const WorkGroupTuningResult& result = entry.second;
+		snprintf(lineBuffer, sizeof(lineBuffer), "%016" PRIx64 " %016" PRIx64 " %u %u %u %u %u %zu %zu %zu %" PRIu64 "\n",
+				 key.kernel_hash, key.device_hash, key.dimensions, key.size_class[0], key.size_class[1], key.size_class[2],
+				 result.local_size.dimensions, result.local_size.sizes[0], result.local_size.sizes[1], result.local_size.sizes[2], result.time);
+		file << lineBuffer;
+	}
+
+	if (!file.good()) { return CL_EXT_FILE_OPEN_FAILED; }
+	return CL_SUCCESS;
+}
+
+bool WorkGroupTuningDatabase::lookup(const WorkGroupTuningKey& key, WorkGroupTuningResult& result) const noexcept {
+	auto entry = entries.find(key);
+	if (entry == entries.end()) { return false; }
+	result = entry->second;
+	return true;
+}
+
+void WorkGroupTuningDatabase::store(const WorkGroupTuningKey& key, const WorkGroupTuningResult& result) noexcept { entries[key] = result; }
+
+// Feeds a string info value into the hash. The terminating null character gets hashed too, so that "ab" + "c" and "a" + "bc" hash differently.
+template <typename object_t, typename info_t, typename func_t>
+static cl_int hashInfoString(uint64_t& hash, func_t getInfo, object_t object, info_t paramName) noexcept {
+	size_t size;
+	cl_int err = getInfo(object, paramName, 0, nullptr, &size);
+	if (err != CL_SUCCESS) { return err; }
+	char* buffer = new (std::nothrow) char[size];
+	if (!buffer) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+	err = getInfo(object, paramName, size, buffer, nullptr);
+	if (err == CL_SUCCESS) { hash = hashBytes(hash, buffer, size); }
+	delete[] buffer;
+	return err;
+}
+
+cl_int getWorkGroupTuningKey(cl_kernel kernel, cl_device_id device, const NDRange& globalSize, WorkGroupTuningKey& key) noexcept {
+	if (globalSize.dimensions < 1 || globalSize.dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+
+	cl_program program;
+	cl_int err = clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(cl_program), &program, nullptr);
+	if (err != CL_SUCCESS) { return err; }
+
+	key.kernel_hash = FNV_OFFSET_BASIS;
+	// NOTE: Programs that weren't created from source report an empty string here, in which case the kernel name is all we have.
+	err = hashInfoString(key.kernel_hash, clGetProgramInfo, program, (cl_program_info)CL_PROGRAM_SOURCE);
+	if (err != CL_SUCCESS) { return err; }
+	err = hashInfoString(key.kernel_hash, clGetKernelInfo, kernel, (cl_kernel_info)CL_KERNEL_FUNCTION_NAME);
+	if (err != CL_SUCCESS) { return err; }
+	// NOTE: The same source built with different options (-D tile sizes, vector widths, fast math) is a different kernel as far as
+	// the best local size is concerned.
+	auto getBuildInfo = [device](cl_program program, cl_program_build_info paramName, size_t paramValueSize, void* paramValue, size_t* paramValueSizeRet) {
+		return clGetProgramBuildInfo(program, device, paramName, paramValueSize, paramValue, paramValueSizeRet);
+	};
+	err = hashInfoString(key.kernel_hash, getBuildInfo, program, (cl_program_build_info)CL_PROGRAM_BUILD_OPTIONS);
+	if (err != CL_SUCCESS) { return err; }
+
+	key.device_hash = FNV_OFFSET_BASIS;
+	err = hashInfoString(key.device_hash, clGetDeviceInfo, device, (cl_device_info)CL_DEVICE_NAME);
+	if (err != CL_SUCCESS) { return err; }
+	err = hashInfoString(key.device_hash, clGetDeviceInfo, device, (cl_device_info)CL_DRIVER_VERSION);
+	if (err != CL_SUCCESS) { return err; }
+
+	key.dimensions = globalSize.dimensions;
+	for (cl_uint i = 0; i < 3; i++) { key.size_class[i] = i < globalSize.dimensions ? calcWorkSizeClass(globalSize.sizes[i]) : 0; }
+
+	return CL_SUCCESS;
+}
+
+static bool localSizeDivides(const NDRange& localSize, const NDRange& globalSize) noexcept {
+	if (localSize.dimensions == 0) { return true; }
+	if (localSize.dimensions != globalSize.dimensions) { return false; }
+	for (cl_uint i = 0; i < localSize.dimensions; i++) {
+		if (localSize.sizes[i] == 0 || globalSize.sizes[i] % localSize.sizes[i] != 0) { return false; }
+	}
+	return true;
+}
+
+// Sets bestTime to the fastest launch in nanoseconds, or to UINT64_MAX if the implementation refused the local size.
+static cl_int timeLocalSize(cl_command_queue queue, cl_kernel kernel, const NDRange& globalSize, const NDRange& localSize, cl_uint repetitions, uint64_t& bestTime) noexcept {
+	bestTime = UINT64_MAX;
+
+	cl_int err = clEnqueueNDRangeKernel(queue, kernel, globalSize.dimensions, nullptr, globalSize.sizes, localSize.get_sizes_ptr(), 0, nullptr, nullptr);
+	switch (err) {
+	case CL_SUCCESS: break;
+	// NOTE: These mean that this specific local size doesn't work for this kernel, which isn't an error as far as tuning is concerned.
+	case CL_INVALID_WORK_GROUP_SIZE: case CL_INVALID_WORK_ITEM_SIZE: case CL_OUT_OF_RESOURCES: return CL_SUCCESS;
+	default: return err;
+	}
+	err = clFinish(queue);
+	if (err != CL_SUCCESS) { return err; }
+
+	for (cl_uint i = 0; i < repetitions; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		err = clEnqueueNDRangeKernel(queue, kernel, globalSize.dimensions, nullptr, globalSize.sizes, localSize.get_sizes_ptr(), 0, nullptr, nullptr);
+		if (err != CL_SUCCESS) { return err; }
+		err = clFinish(queue);
+		if (err != CL_SUCCESS) { return err; }
+		uint64_t time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (time < bestTime) { bestTime = time; }
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int tuneWorkGroupSize(cl_command_queue queue, cl_kernel kernel, cl_device_id device, const NDRange& globalSize, NDRange& bestLocalSize,
+						 WorkGroupTuningDatabase* database, cl_uint repetitions) noexcept {
+	if (repetitions == 0) { return CL_INVALID_VALUE; }
+
+	WorkGroupTuningKey key;
+	cl_int err = getWorkGroupTuningKey(kernel, device, globalSize, key);
+	if (err != CL_SUCCESS) { return err; }
+
+	WorkGroupTuningResult result;
+	if (database && database->lookup(key, result) && localSizeDivides(result.local_size, globalSize)) {
+		bestLocalSize = result.local_size;
+		return CL_SUCCESS;
+	}
+
+	NDRangeLimits ndRangeLimits;
+	err = getNDRangeLimits(kernel, device, ndRangeLimits);
+	if (err != CL_SUCCESS) { return err; }
+	size_t kernelWorkGroupSize = ndRangeLimits.max_work_group_size;
+	const size_t* maxWorkItemSizes = ndRangeLimits.max_work_item_sizes;
+
+	// NOTE: The implementation's own choice goes first, so that it wins ties.
+	std::vector<NDRange> candidates;
+	candidates.push_back(NDRange());
+	size_t limits[3] = { 1, 1, 1 };
+	for (cl_uint i = 0; i < globalSize.dimensions; i++) { limits[i] = maxWorkItemSizes[i] < globalSize.sizes[i] ? maxWorkItemSizes[i] : globalSize.sizes[i]; }
+	for (size_t x = 1; x <= limits[0] && x <= kernelWorkGroupSize; x *= 2) {
+		if (globalSize.sizes[0] % x != 0) { continue; }
+		for (size_t y = 1; y <= limits[1] && x * y <= kernelWorkGroupSize; y *= 2) {
+			if (globalSize.dimensions > 1 && globalSize.sizes[1] % y != 0) { continue; }
+			for (size_t z = 1; z <= limits[2] && x * y * z <= kernelWorkGroupSize; z *= 2) {
+				if (globalSize.dimensions > 2 && globalSize.sizes[2] % z != 0) { continue; }
+				switch (globalSize.dimensions) {
+				case 1: candidates.push_back(NDRange(x)); break;
+				case 2: candidates.push_back(NDRange(x, y)); break;
+				case 3: candidates.push_back(NDRange(x, y, z)); break;
+				}
+			}
+		}
+	}
+
+	result.local_size = NDRange();
+	result.time = UINT64_MAX;
+	for (const NDRange& candidate : candidates) {
+		uint64_t time;
+		err = timeLocalSize(queue, kernel, globalSize, candidate, repetitions, time);
+		if (err != CL_SUCCESS) { return err; }
+		if (time < result.time) { result.local_size = candidate; result.time = time; }
+	}
+
+	bestLocalSize = result.local_size;
+	if (database && result.time != UINT64_MAX) { database->store(key, result); }
+	return CL_SUCCESS;
+}
@@ -17,7 +17,9 @@
 
 HMODULE DLLHandle;
 
-bool loadOpenCLLib() noexcept { return DLLHandle = LoadLibraryA("OpenCL.dll"); }
+bool loadOpenCLLib(const char* libraryPath) noexcept { return DLLHandle = LoadLibraryA(libraryPath); }
+
+bool loadOpenCLLib() noexcept { return loadOpenCLLib("OpenCL.dll"); }
 
 bool bind_clGetPlatformIDs() noexcept { return clGetPlatformIDs = (clGetPlatformIDs_func)GetProcAddress(DLLHandle, "clGetPlatformIDs"); }
 bool bind_clGetPlatformInfo() noexcept { return clGetPlatformInfo = (clGetPlatformInfo_func)GetProcAddress(DLLHandle, "clGetPlatformInfo"); }
@@ -27,12 +29,16 @@ bool bind_clCreateContext() noexcept { return clCreateContext = (clCreateContext
 bool bind_clGetContextInfo() noexcept { return clGetContextInfo = (clGetContextInfo_func)GetProcAddress(DLLHandle, "clGetContextInfo"); }
 bool bind_clCreateCommandQueue() noexcept { return clCreateCommandQueue = (clCreateCommandQueue_func)GetProcAddress(DLLHandle, "clCreateCommandQueue"); }
 bool bind_clCreateProgramWithSource() noexcept { return clCreateProgramWithSource = (clCreateProgramWithSource_func)GetProcAddress(DLLHandle, "clCreateProgramWithSource"); }
+bool bind_clCreateProgramWithBinary() noexcept { return clCreateProgramWithBinary = (clCreateProgramWithBinary_func)GetProcAddress(DLLHandle, "clCreateProgramWithBinary"); }
 bool bind_clBuildProgram() noexcept { return clBuildProgram = (clBuildProgram_func)GetProcAddress(DLLHandle, "clBuildProgram"); }
+bool bind_clGetProgramInfo() noexcept { return clGetProgramInfo = (clGetProgramInfo_func)GetProcAddress(DLLHandle, "clGetProgramInfo"); }
 bool bind_clGetProgramBuildInfo() noexcept { return clGetProgramBuildInfo = (clGetProgramBuildInfo_func)GetProcAddress(DLLHandle, "clGetProgramBuildInfo"); }
 bool bind_clCreateKernel() noexcept { return clCreateKernel = (clCreateKernel_func)GetProcAddress(DLLHandle, "clCreateKernel"); }
 bool bind_clCreateBuffer() noexcept { return clCreateBuffer = (clCreateBuffer_func)GetProcAddress(DLLHandle, "clCreateBuffer"); }
 bool bind_clCreateImage2D() noexcept { return clCreateImage2D = (clCreateImage2D_func)GetProcAddress(DLLHandle, "clCreateImage2D"); }
+bool bind_clGetImageInfo() noexcept { return clGetImageInfo = (clGetImageInfo_func)GetProcAddress(DLLHandle, "clGetImageInfo"); }
 bool bind_clSetKernelArg() noexcept { return clSetKernelArg = (clSetKernelArg_func)GetProcAddress(DLLHandle, "clSetKernelArg"); }
+bool bind_clGetKernelInfo() noexcept { return clGetKernelInfo = (clGetKernelInfo_func)GetProcAddress(DLLHandle, "clGetKernelInfo"); }
 bool bind_clGetKernelWorkGroupInfo() noexcept { return clGetKernelWorkGroupInfo = (clGetKernelWorkGroupInfo_func)GetProcAddress(DLLHandle, "clGetKernelWorkGroupInfo"); }
 bool bind_clEnqueueNDRangeKernel() noexcept { return clEnqueueNDRangeKernel = (clEnqueueNDRangeKernel_func)GetProcAddress(DLLHandle, "clEnqueueNDRangeKernel"); }
 bool bind_clFlush() noexcept { return clFlush = (clFlush_func)GetProcAddress(DLLHandle, "clFlush"); }
@@ -41,16 +47,35 @@ bool bind_clEnqueueWriteBuffer() noexcept { return clEnqueueWriteBuffer = (clEnq
 bool bind_clEnqueueReadBuffer() noexcept { return clEnqueueReadBuffer = (clEnqueueReadBuffer_func)GetProcAddress(DLLHandle, "clEnqueueReadBuffer"); }
 bool bind_clEnqueueWriteImage() noexcept { return clEnqueueWriteImage = (clEnqueueWriteImage_func)GetProcAddress(DLLHandle, "clEnqueueWriteImage"); }
 bool bind_clEnqueueReadImage() noexcept { return clEnqueueReadImage = (clEnqueueReadImage_func)GetProcAddress(DLLHandle, "clEnqueueReadImage"); }
+bool bind_clEnqueueCopyBuffer() noexcept { return clEnqueueCopyBuffer = (clEnqueueCopyBuffer_func)GetProcAddress(DLLHandle, "clEnqueueCopyBuffer"); }
+bool bind_clEnqueueMapBuffer() noexcept { return clEnqueueMapBuffer = (clEnqueueMapBuffer_func)GetProcAddress(DLLHandle, "clEnqueueMapBuffer"); }
+bool bind_clEnqueueUnmapMemObject() noexcept { return clEnqueueUnmapMemObject = (clEnqueueUnmapMemObject_func)GetProcAddress(DLLHandle, "clEnqueueUnmapMemObject"); }
+bool bind_clEnqueueMigrateMemObjects() noexcept { return clEnqueueMigrateMemObjects = (clEnqueueMigrateMemObjects_func)GetProcAddress(DLLHandle, "clEnqueueMigrateMemObjects"); }
+bool bind_clEnqueueMarkerWithWaitList() noexcept { return clEnqueueMarkerWithWaitList = (clEnqueueMarkerWithWaitList_func)GetProcAddress(DLLHandle, "clEnqueueMarkerWithWaitList"); }
+bool bind_clWaitForEvents() noexcept { return clWaitForEvents = (clWaitForEvents_func)GetProcAddress(DLLHandle, "clWaitForEvents"); }
+bool bind_clGetEventInfo() noexcept { return clGetEventInfo = (clGetEventInfo_func)GetProcAddress(DLLHandle, "clGetEventInfo"); }
+bool bind_clCreateUserEvent() noexcept { return clCreateUserEvent = (clCreateUserEvent_func)GetProcAddress(DLLHandle, "clCreateUserEvent"); }
+bool bind_clSetUserEventStatus() noexcept { return clSetUserEventStatus = (clSetUserEventStatus_func)GetProcAddress(DLLHandle, "clSetUserEventStatus"); }
+bool bind_clSetEventCallback() noexcept { return clSetEventCallback = (clSetEventCallback_func)GetProcAddress(DLLHandle, "clSetEventCallback"); }
+bool bind_clGetEventProfilingInfo() noexcept { return clGetEventProfilingInfo = (clGetEventProfilingInfo_func)GetProcAddress(DLLHandle, "clGetEventProfilingInfo"); }
+bool bind_clRetainEvent() noexcept { return clRetainEvent = (clRetainEvent_func)GetProcAddress(DLLHandle, "clRetainEvent"); }
+bool bind_clReleaseEvent() noexcept { return clReleaseEvent = (clReleaseEvent_func)GetProcAddress(DLLHandle, "clReleaseEvent"); }
+bool bind_clRetainMemObject() noexcept { return clRetainMemObject = (clRetainMemObject_func)GetProcAddress(DLLHandle, "clRetainMemObject"); }
 bool bind_clReleaseMemObject() noexcept { return clReleaseMemObject = (clReleaseMemObject_func)GetProcAddress(DLLHandle, "clReleaseMemObject"); }
+bool bind_clRetainKernel() noexcept { return clRetainKernel = (clRetainKernel_func)GetProcAddress(DLLHandle, "clRetainKernel"); }
 bool bind_clReleaseKernel() noexcept { return clReleaseKernel = (clReleaseKernel_func)GetProcAddress(DLLHandle, "clReleaseKernel"); }
+bool bind_clRetainProgram() noexcept { return clRetainProgram = (clRetainProgram_func)GetProcAddress(DLLHandle, "clRetainProgram"); }
 bool bind_clReleaseProgram() noexcept { return clReleaseProgram = (clReleaseProgram_func)GetProcAddress(DLLHandle, "clReleaseProgram"); }
+bool bind_clRetainCommandQueue() noexcept { return clRetainCommandQueue = (clRetainCommandQueue_func)GetProcAddress(DLLHandle, "clRetainCommandQueue"); }
 bool bind_clReleaseCommandQueue() noexcept { return clReleaseCommandQueue = (clReleaseCommandQueue_func)GetProcAddress(DLLHandle, "clReleaseCommandQueue"); }
+bool bind_clRetainContext() noexcept { return clRetainContext = (clRetainContext_func)GetProcAddress(DLLHandle, "clRetainContext"); }
 bool bind_clReleaseContext() noexcept { return clReleaseContext = (clReleaseContext_func)GetProcAddress(DLLHandle, "clReleaseContext"); }
+bool bind_clGetExtensionFunctionAddressForPlatform() noexcept { return clGetExtensionFunctionAddressForPlatform = (clGetExtensionFunctionAddressForPlatform_func)GetProcAddress(DLLHandle, "clGetExtensionFunctionAddressForPlatform"); }
 
 #define CHECK_FUNC_VALIDITY(func) if (!(func)) { FreeLibrary(DLLHandle); return CL_EXT_DLL_FUNC_BIND_FAILURE; }
 
-cl_int initOpenCLBindings() noexcept {
-	if (!loadOpenCLLib()) { return CL_EXT_DLL_LOAD_FAILURE; }
+cl_int initOpenCLBindings(const char* libraryPath) noexcept {
+	if (!loadOpenCLLib(libraryPath)) { return CL_EXT_DLL_LOAD_FAILURE; }
 
 	CHECK_FUNC_VALIDITY(bind_clGetPlatformIDs());										// Go through all the functions and bind them one by one.
 	CHECK_FUNC_VALIDITY(bind_clGetPlatformInfo());										// As soon as a bind fails, try to free the library and subsequently return failure for the whole init function.
@@ -60,12 +85,16 @@ cl_int initOpenCLBindings() noexcept {
 	CHECK_FUNC_VALIDITY(bind_clGetContextInfo());
 	CHECK_FUNC_VALIDITY(bind_clCreateCommandQueue());
 	CHECK_FUNC_VALIDITY(bind_clCreateProgramWithSource());
+	CHECK_FUNC_VALIDITY(bind_clCreateProgramWithBinary());
 	CHECK_FUNC_VALIDITY(bind_clBuildProgram());
+	CHECK_FUNC_VALIDITY(bind_clGetProgramInfo());
 	CHECK_FUNC_VALIDITY(bind_clGetProgramBuildInfo());
 	CHECK_FUNC_VALIDITY(bind_clCreateKernel());
 	CHECK_FUNC_VALIDITY(bind_clCreateBuffer());
 	CHECK_FUNC_VALIDITY(bind_clCreateImage2D());
+	CHECK_FUNC_VALIDITY(bind_clGetImageInfo());
 	CHECK_FUNC_VALIDITY(bind_clSetKernelArg());
+	CHECK_FUNC_VALIDITY(bind_clGetKernelInfo());
 	CHECK_FUNC_VALIDITY(bind_clGetKernelWorkGroupInfo());
 	CHECK_FUNC_VALIDITY(bind_clEnqueueNDRangeKernel());
 	CHECK_FUNC_VALIDITY(bind_clFlush());
@@ -74,15 +103,39 @@ cl_int initOpenCLBindings() noexcept {
 	CHECK_FUNC_VALIDITY(bind_clEnqueueReadBuffer());
 	CHECK_FUNC_VALIDITY(bind_clEnqueueWriteImage());
 	CHECK_FUNC_VALIDITY(bind_clEnqueueReadImage());
+	CHECK_FUNC_VALIDITY(bind_clEnqueueCopyBuffer());
+	CHECK_FUNC_VALIDITY(bind_clEnqueueMapBuffer());
+	CHECK_FUNC_VALIDITY(bind_clEnqueueUnmapMemObject());
+	CHECK_FUNC_VALIDITY(bind_clWaitForEvents());
+	CHECK_FUNC_VALIDITY(bind_clGetEventInfo());
+	CHECK_FUNC_VALIDITY(bind_clGetEventProfilingInfo());
+	CHECK_FUNC_VALIDITY(bind_clRetainEvent());
+	CHECK_FUNC_VALIDITY(bind_clReleaseEvent());
+	CHECK_FUNC_VALIDITY(bind_clRetainMemObject());
 	CHECK_FUNC_VALIDITY(bind_clReleaseMemObject());
+	CHECK_FUNC_VALIDITY(bind_clRetainKernel());
 	CHECK_FUNC_VALIDITY(bind_clReleaseKernel());
+	CHECK_FUNC_VALIDITY(bind_clRetainProgram());
 	CHECK_FUNC_VALIDITY(bind_clReleaseProgram());
+	CHECK_FUNC_VALIDITY(bind_clRetainCommandQueue());
 	CHECK_FUNC_VALIDITY(bind_clReleaseCommandQueue());
+	CHECK_FUNC_VALIDITY(bind_clRetainContext());
 	CHECK_FUNC_VALIDITY(bind_clReleaseContext());
 
+	// NOTE: OpenCL 1.1 and 1.2 functions. Missing ones stay nullptr instead of failing the whole init, so that 1.0 and 1.1 libraries
+	// still work for everything that doesn't need them.
+	bind_clEnqueueMigrateMemObjects();
+	bind_clEnqueueMarkerWithWaitList();
+	bind_clCreateUserEvent();
+	bind_clSetUserEventStatus();
+	bind_clSetEventCallback();
+	bind_clGetExtensionFunctionAddressForPlatform();
+
 	return CL_SUCCESS;
 }
 
+cl_int initOpenCLBindings() noexcept { return initOpenCLBindings("OpenCL.dll"); }
+
 bool freeOpenCLLib() noexcept { return FreeLibrary(DLLHandle); }
 
 constexpr bool is_character_whitespace(char character) noexcept {
@@ -215,16 +268,11 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 		return OpenCLDeviceCollection();
 	}
 
-	// NOTE: I don't know if these heap allocations are worse than avoiding vectors by sorting through platform versions once for counting
-	// and then once again for filling (see the way you've been doing it for compile-time algorithms for more clarity).
-	// The second option would make the code more complex, which isn't worth the potential performance boost because this code doesn't need to be fast
-	// at all.
-	// We could also make a custom vector that stack allocates for small amounts and then switches to heap for bigger amounts,
-	// but that complexity also isn't worth it.
-	// IN CONCLUSION: I'm keeping it like this because the code complexity is the simplest.
+	// NOTE: custom_vector keeps the first handful of elements inline, and systems rarely have more than a handful of platforms,
+	// so these usually don't touch the heap at all.
 	// NOTE: If you're wondering why we don't use vectors for everything in this function, see below.
-	std::vector<cl_uint> validPlatforms;
-	std::vector<cl_uint> validPlatformDeviceCounts;
+	custom_vector<cl_uint> validPlatforms;
+	custom_vector<cl_uint> validPlatformDeviceCounts;
 	size_t totalDeviceCount = 0;
 
 	for (size_t i = 0; i < platformCount; i++) {
@@ -255,7 +303,11 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 		delete[] versionString;
 
 		if (platform_version >= minimumPlatformVersion) {
-			validPlatforms.push_back(i);
+			err = validPlatforms.push_back(i);
+			if (err != CL_SUCCESS) {
+				delete[] platforms;
+				return OpenCLDeviceCollection();
+			}
 
 			cl_uint deviceCount;
 			err = clGetDeviceIDs(currentPlatform, CL_DEVICE_TYPE_ALL, 0, nullptr, &deviceCount);
@@ -284,7 +336,11 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 				return OpenCLDeviceCollection();
 			}
 
-			validPlatformDeviceCounts.push_back(deviceCount);
+			err = validPlatformDeviceCounts.push_back(deviceCount);
+			if (err != CL_SUCCESS) {
+				delete[] platforms;
+				return OpenCLDeviceCollection();
+			}
 			totalDeviceCount += deviceCount;
 
 			continue;
@@ -294,18 +350,18 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 	/*
 	* 
 	* NOTE: We go through everything, get the counts, then construct the OpenCLDeviceCollection, go through everything again
-	* and get the data. The reason we do this is because std::vector isn't able to lose control of it's data.
-	* We could create our own std::vector (would be easy in this case since we barely use any of the functionality) and add
-	* the functionality that we want, but this is easier and simpler. Honestly, not using vectors for most of the stuff might even be
-	* faster because we avoid heap allocations, but I don't know.
-	* The important thing is that this version makes the code less complex (because no vector implementation), which is worth the possible performance loss
-	* because this code isn't performance critical at all.
+	* and get the data. custom_vector could hand over its data now (see steal_data()), but the devices have to be queried per platform
+	* with the final counts anyway, so the collection gets allocated at its final size up front and the devices get written into it directly.
 	* 
 	*/
 
-	size_t validPlatformsCount = validPlatforms.size();
+	size_t validPlatformsCount = validPlatforms.length;
 
 	OpenCLDeviceCollection result(err, validPlatformsCount, totalDeviceCount);
+	if (err != CL_SUCCESS) {
+		delete[] platforms;
+		return OpenCLDeviceCollection();
+	}
 
 	size_t lastContextEndIndex = 0;
 	for (size_t i = 0; i < validPlatformsCount; i++) {
@@ -326,12 +382,14 @@ OpenCLDeviceCollection getAllOpenCLDevices(cl_int& err, const VersionIdentifier&
 		result.contextEndIndices[i] = lastContextEndIndex;
 	}
 
+	delete[] platforms;
 	return result;
 
 	// TODO: Fix visual studio formatting so that it doesn't put asterisk on the type and lets me align it to the var name in for loops and such.
 }
 
-cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, cl_context& context, cl_command_queue& commandQueue) noexcept {
+cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, OpenCLContext& context, OpenCLCommandQueue& commandQueue,
+								   cl_command_queue_properties commandQueueProperties) noexcept {
 	cl_int err;
 
 	OpenCLDeviceCollection devices = getAllOpenCLDevices(err, minimumTargetPlatformVersion);
@@ -343,10 +401,13 @@ cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatfor
 	OpenCLDeviceIndexCollection sortedDeviceIndices = deviceIndices.sort_by_increasing_max_work_group_size(err);
 	if (err != CL_SUCCESS) { return err; }
 
-	bestDevice = devices[sortedDeviceIndices[sortedDeviceIndices.length - 1]];
-	context = devices.getContextForDeviceIndex(sortedDeviceIndices[sortedDeviceIndices.length - 1]);
+	cl_device_id newBestDevice = devices[sortedDeviceIndices[sortedDeviceIndices.length - 1]];
 
-	commandQueue = clCreateCommandQueue(context, bestDevice, 0, &err);
+	// NOTE: The collection releases all of its contexts when it goes out of scope, so the one we keep needs its own reference.
+	OpenCLContext newContext = OpenCLContext::retain(err, devices.getContextForDeviceIndex(sortedDeviceIndices[sortedDeviceIndices.length - 1]));
+	if (err != CL_SUCCESS) { return err; }
+
+	OpenCLCommandQueue newCommandQueue(clCreateCommandQueue(newContext, newBestDevice, commandQueueProperties, &err));
 	if (err != CL_SUCCESS) { return err; }
 
 	/*
@@ -405,9 +466,14 @@ cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatfor
 	// NOTE: The above code only returns the platform if you explicitly specified the platform in clCreateContext(),
 	// which we did not and will not. Instead, let's do it like this:
 
-	err = clGetDeviceInfo(bestDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &bestPlatform, nullptr);
+	cl_platform_id newBestPlatform;
+	err = clGetDeviceInfo(newBestDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &newBestPlatform, nullptr);
 	if (err != CL_SUCCESS) { return err; }
 
+	bestPlatform = newBestPlatform;
+	bestDevice = newBestDevice;
+	context = std::move(newContext);
+	commandQueue = std::move(newCommandQueue);
 	return CL_SUCCESS;
 
 	// NOTE: The rest of this function is just an old implementation that I'm keeping around for reference.
@@ -482,6 +548,17 @@ cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatfor
 	return CL_SUCCESS;*/
 }
 
+cl_int initOpenCLVarsForBestDevice(const VersionIdentifier& minimumTargetPlatformVersion, cl_platform_id& bestPlatform, cl_device_id& bestDevice, cl_context& context, cl_command_queue& commandQueue,
+								   cl_command_queue_properties commandQueueProperties) noexcept {
+	OpenCLContext newContext;
+	OpenCLCommandQueue newCommandQueue;
+	cl_int err = initOpenCLVarsForBestDevice(minimumTargetPlatformVersion, bestPlatform, bestDevice, newContext, newCommandQueue, commandQueueProperties);
+	if (err != CL_SUCCESS) { return err; }
+	context = newContext.detach();
+	commandQueue = newCommandQueue.detach();
+	return CL_SUCCESS;
+}
+
 char* readFromSourceFile(const char* sourceFile, cl_int& errorCode) noexcept {
 	std::ifstream kernelSourceFile(sourceFile, std::ios::beg);
 	if (!kernelSourceFile.is_open()) { errorCode = CL_EXT_FILE_OPEN_FAILED; return nullptr; }
@@ -500,12 +577,13 @@ char* readFromSourceFile(const char* sourceFile, cl_int& errorCode) noexcept {
 	return kernelSource;																																	// Returning a raw heap-initialized char array is potentially dangerous. The caller must delete the array.
 }
 
-cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog) noexcept {
+cl_int buildProgramFromString(cl_context context, cl_device_id device, const char* sourceCodeString, OpenCLProgram& program, std::string& buildLog, const char* buildOptions) noexcept {
 	cl_int err;
-	program = clCreateProgramWithSource(context, 1, (const char* const*)&sourceCodeString, nullptr, &err);
-	if (!program) { return CL_EXT_CREATE_PROGRAM_FAILED; }
+	// NOTE: Everything goes into locals first and only gets moved into the out-params at the end, so every early return releases whatever got created so far.
+	OpenCLProgram newProgram(clCreateProgramWithSource(context, 1, (const char* const*)&sourceCodeString, nullptr, &err));
+	if (!newProgram) { return CL_EXT_CREATE_PROGRAM_FAILED; }
 
-	switch (clBuildProgram(program, 0, nullptr, nullptr, nullptr, nullptr)) {
+	switch (clBuildProgram(newProgram, 0, nullptr, buildOptions, nullptr, nullptr)) {
 	case CL_SUCCESS: break;
 	case CL_BUILD_PROGRAM_FAILURE:
 		{
@@ -531,54 +609,87 @@ cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, con
 			// and forcing "class instance;" is simply to enforce the invokation of the default constructor whether goto is hit or not,
 			// since that is simpler than the alternative.
 
-			err = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &buildLogSize);
-			if (err != CL_SUCCESS) { clReleaseProgram(program); return err; }
+			err = clGetProgramBuildInfo(newProgram, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &buildLogSize);
+			if (err != CL_SUCCESS) { return err; }
 			char* buildLogBuffer = new (std::nothrow) char[buildLogSize];
-			if (!buildLogBuffer) { clReleaseProgram(program); return CL_EXT_INSUFFICIENT_HOST_MEM; }
-			err = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, buildLogSize, buildLogBuffer, nullptr);
+			if (!buildLogBuffer) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+			err = clGetProgramBuildInfo(newProgram, device, CL_PROGRAM_BUILD_LOG, buildLogSize, buildLogBuffer, nullptr);
 			if (err != CL_SUCCESS) {
 				delete[] buildLogBuffer;
-				clReleaseProgram(program);
 				return CL_EXT_GET_BUILD_LOG_FAILED;
 			}
-			clReleaseProgram(program);
-			buildLog = std::string(buildLogBuffer, buildLogSize - 1);																							// Give back to user as an std::string to avoid headaches with dangling pointers. WE DON'T DELETE buildLogBuffer here because it's now under the care of buildLog std::string.
+			buildLog = std::string(buildLogBuffer, buildLogSize - 1);																							// Give back to user as an std::string to avoid headaches with dangling pointers.
+			delete[] buildLogBuffer;																															// NOTE: std::string copies, so the buffer is still ours to delete.
 			return CL_EXT_BUILD_FAILED_WITH_BUILD_LOG;
 		}
 	default:
-		clReleaseProgram(program);
 		return CL_EXT_BUILD_FAILED_WITHOUT_BUILD_LOG;
 	}
 
-	kernel = clCreateKernel(program, kernelName, &err);
-	if (!kernel) { clReleaseProgram(program); return CL_EXT_CREATE_KERNEL_FAILED; }
+	program = std::move(newProgram);
+	return CL_SUCCESS;
+}
 
-	err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelWorkGroupSize, nullptr);
-	if (err != CL_SUCCESS) {
-		clReleaseKernel(kernel);
-		clReleaseProgram(program);
-		return CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED;
-	}
+cl_int setupComputeKernelFromProgram(cl_device_id device, cl_program program, const char* kernelName, OpenCLKernel& kernel, size_t& kernelWorkGroupSize) noexcept {
+	cl_int err;
+	OpenCLKernel newKernel(clCreateKernel(program, kernelName, &err));
+	if (!newKernel) { return CL_EXT_CREATE_KERNEL_FAILED; }
+
+	size_t newKernelWorkGroupSize;
+	err = clGetKernelWorkGroupInfo(newKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &newKernelWorkGroupSize, nullptr);
+	if (err != CL_SUCCESS) { return CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED; }
 
 	size_t kernelPreferredWorkGroupSizeMultiple;																										// The kernels preferred work group size multiple, which should go evenly into whatever size we end up picking for the kernel work group.
-	err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &kernelPreferredWorkGroupSizeMultiple, nullptr);
-	if (err != CL_SUCCESS) {
-		clReleaseKernel(kernel);
-		clReleaseProgram(program);
-		return CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED;
-	}
+	err = clGetKernelWorkGroupInfo(newKernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &kernelPreferredWorkGroupSizeMultiple, nullptr);
+	if (err != CL_SUCCESS) { return CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED; }
 
 	// Compute optimal work group size for kernel based on the raw kernel maximum and kernel preferred work group size multiple.
-	if (kernelWorkGroupSize > kernelPreferredWorkGroupSizeMultiple) { kernelWorkGroupSize -= kernelWorkGroupSize % kernelPreferredWorkGroupSizeMultiple; }
+	if (newKernelWorkGroupSize > kernelPreferredWorkGroupSizeMultiple) { newKernelWorkGroupSize -= newKernelWorkGroupSize % kernelPreferredWorkGroupSizeMultiple; }
 
+	kernelWorkGroupSize = newKernelWorkGroupSize;
+	kernel = std::move(newKernel);
 	return CL_SUCCESS;
 }
 
-cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog) noexcept {
+cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions) noexcept {
+	OpenCLProgram newProgram;
+	cl_int err = buildProgramFromString(context, device, sourceCodeString, newProgram, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+
+	OpenCLKernel newKernel;
+	err = setupComputeKernelFromProgram(device, newProgram, kernelName, newKernel, kernelWorkGroupSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	program = std::move(newProgram);
+	kernel = std::move(newKernel);
+	return CL_SUCCESS;
+}
+
+cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions) noexcept {
 	cl_int err;
 	const char* sourceCodeString = readFromSourceFile(sourceCodeFile, err);
 	if (!sourceCodeString) { return err; }
-	err = setupComputeKernelFromString(context, device, sourceCodeString, kernelName, program, kernel, kernelWorkGroupSize, buildLog);
+	err = setupComputeKernelFromString(context, device, sourceCodeString, kernelName, program, kernel, kernelWorkGroupSize, buildLog, buildOptions);
 	delete[] sourceCodeString;
 	return err;
 }
+
+cl_int setupComputeKernelFromString(cl_context context, cl_device_id device, const char* sourceCodeString, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions) noexcept {
+	OpenCLProgram newProgram;
+	OpenCLKernel newKernel;
+	cl_int err = setupComputeKernelFromString(context, device, sourceCodeString, kernelName, newProgram, newKernel, kernelWorkGroupSize, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+	program = newProgram.detach();
+	kernel = newKernel.detach();
+	return CL_SUCCESS;
+}
+
+cl_int setupComputeKernelFromFile(cl_context context, cl_device_id device, const char* sourceCodeFile, const char* kernelName, cl_program& program, cl_kernel& kernel, size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions) noexcept {
+	OpenCLProgram newProgram;
+	OpenCLKernel newKernel;
+	cl_int err = setupComputeKernelFromFile(context, device, sourceCodeFile, kernelName, newProgram, newKernel, kernelWorkGroupSize, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+	program = newProgram.detach();
+	kernel = newKernel.detach();
+	return CL_SUCCESS;
+}
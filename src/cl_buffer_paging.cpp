@@ -0,0 +1,331 @@
+#include "cl_buffer_paging.h"
+
+#include <cstdlib>						// For malloc and free.
+#include <cstring>						// For std::memcpy.
+#include <utility>						// For std::move.
+
+#define BUFFER_PAGING_ACCESS_FLAGS (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY)
+
+BufferPager::BufferPager(cl_int& err, cl_context context, cl_device_id device, cl_command_queue queue, const BufferPagingConfig& config) noexcept
+	: context(context), queue(queue), config(config) {
+	cl_ulong globalMemorySize;
+	err = clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemorySize, nullptr);
+	if (err != CL_SUCCESS) { return; }
+	cl_ulong deviceMaxAllocationSize;
+	err = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &deviceMaxAllocationSize, nullptr);
+	if (err != CL_SUCCESS) { return; }
+
+	budget = config.device_budget ? config.device_budget : globalMemorySize / 100 * config.budget_percentage;
+	maxAllocationSize = deviceMaxAllocationSize;
+}
+
+cl_int BufferPager::allocateHostData(PagedBuffer& buffer) noexcept {
+	if (config.pinned_host_memory && !pinnedHostMemoryFailed) {
+		cl_int err;
+		OpenCLMemObject pinnedBuffer(clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, buffer.size, nullptr, &err));
+		if (pinnedBuffer) {
+			void* mapped = clEnqueueMapBuffer(queue, pinnedBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, buffer.size, 0, nullptr, nullptr, &err);
+			if (err == CL_SUCCESS) {
+				buffer.pinnedBuffer = std::move(pinnedBuffer);
+				buffer.hostData = mapped;
+				return CL_SUCCESS;
+			}
+		}
+		pinnedHostMemoryFailed = true;
+	}
+
+	buffer.hostData = malloc(buffer.size);
+	if (!buffer.hostData) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+	return CL_SUCCESS;
+}
+
+void BufferPager::freeHostData(PagedBuffer& buffer) noexcept {
+	if (!buffer.hostData) { return; }
+
+	if (buffer.pinnedBuffer) {
+		// NOTE: The unmap lands behind every transfer that still uses the memory, so there's no need to wait.
+		clEnqueueUnmapMemObject(queue, buffer.pinnedBuffer, buffer.hostData, 0, nullptr, nullptr);
+		buffer.pinnedBuffer.reset();
+	} else {
+		waitForHostTransfer(buffer);
+		free(buffer.hostData);
+	}
+	buffer.hostData = nullptr;
+	buffer.lastHostTransfer.reset();
+}
+
+cl_int BufferPager::waitForHostTransfer(PagedBuffer& buffer) noexcept {
+	if (!buffer.lastHostTransfer) { return CL_SUCCESS; }
+	cl_event transfer = buffer.lastHostTransfer;
+	cl_int err = clWaitForEvents(1, &transfer);
+	if (err != CL_SUCCESS) { return err; }
+	buffer.lastHostTransfer.reset();
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::evict(size_t bufferIndex) noexcept {
+	PagedBuffer& buffer = buffers[bufferIndex];
+
+	if (!buffer.hostValid) {
+		cl_event transfer;
+		cl_int err = clEnqueueReadBuffer(queue, buffer.deviceBuffer, CL_FALSE, 0, buffer.size, buffer.hostData, 0, nullptr, &transfer);
+		if (err != CL_SUCCESS) { return err; }
+		buffer.lastHostTransfer.reset(transfer);
+		buffer.hostValid = true;
+		page_out_count++;
+		bytes_paged_out += buffer.size;
+	}
+
+	// NOTE: The implementation keeps the memory object alive until the read-back is done, so it can go right away.
+	buffer.deviceBuffer.reset();
+	residentBytes -= buffer.size;
+	eviction_count++;
+
+	for (KernelBinding& binding : bindings) {
+		if (binding.bufferIndex == bufferIndex) { binding.appliedBuffer = nullptr; }
+	}
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::evictLeastRecentlyUsed() noexcept {
+	size_t victim = SIZE_MAX;
+	for (size_t i = 0; i < buffers.length; i++) {
+		const PagedBuffer& buffer = buffers[i];
+		if (!buffer.live || !buffer.deviceBuffer || buffer.pinCount) { continue; }
+		if (victim == SIZE_MAX || buffer.lastUse < buffers[victim].lastUse) { victim = i; }
+	}
+	if (victim == SIZE_MAX) { return CL_MEM_OBJECT_ALLOCATION_FAILURE; }
+	return evict(victim);
+}
+
+cl_int BufferPager::pageIn(PagedBuffer& buffer) noexcept {
+	while (true) {
+		while (residentBytes + buffer.size > budget) {
+			cl_int err = evictLeastRecentlyUsed();
+			if (err != CL_SUCCESS) { return err; }
+		}
+
+		cl_int err;
+		OpenCLMemObject deviceBuffer(clCreateBuffer(context, buffer.flags, buffer.size, nullptr, &err));
+		if (deviceBuffer && buffer.hasContents) {
+			cl_event transfer;
+			err = clEnqueueWriteBuffer(queue, deviceBuffer, CL_FALSE, 0, buffer.size, buffer.hostData, 0, nullptr, &transfer);
+			if (err == CL_SUCCESS) { buffer.lastHostTransfer.reset(transfer); }
+		}
+
+		if (err == CL_SUCCESS) {
+			buffer.deviceBuffer = std::move(deviceBuffer);
+			residentBytes += buffer.size;
+			page_in_count++;
+			if (buffer.hasContents) { bytes_paged_in += buffer.size; }
+			return CL_SUCCESS;
+		}
+
+		// NOTE: The device ran out before the budget did (other processes, buffers outside of the pager, fragmentation), so what's resident
+		// right now is what actually fits. Lower the budget to that and evict until this buffer fits too.
+		if ((err != CL_MEM_OBJECT_ALLOCATION_FAILURE && err != CL_OUT_OF_RESOURCES) || !residentBytes) { return err; }
+		budget = residentBytes > buffer.size ? residentBytes : buffer.size;
+	}
+}
+
+cl_int BufferPager::makeResidentPinned(const size_t* bufferIndices, size_t count) noexcept {
+	uint64_t now = ++useClock;
+	for (size_t i = 0; i < count; i++) {
+		PagedBuffer& buffer = buffers[bufferIndices[i]];
+		buffer.pinCount++;
+		buffer.lastUse = now;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		PagedBuffer& buffer = buffers[bufferIndices[i]];
+		if (buffer.deviceBuffer) { continue; }
+		cl_int err = pageIn(buffer);
+		if (err != CL_SUCCESS) { return err; }
+	}
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::createBuffer(size_t size, cl_mem_flags flags, const void* initialData, size_t& bufferIndex) noexcept {
+	if (flags & ~(cl_mem_flags)BUFFER_PAGING_ACCESS_FLAGS) { return CL_INVALID_VALUE; }
+	if (!size || size > maxAllocationSize || size > budget) { return CL_INVALID_BUFFER_SIZE; }
+
+	// NOTE: Reserving up front, so that the host memory never has to be given back because the slot couldn't be stored.
+	cl_int err;
+	if (!freeSlots.length) {
+		err = buffers.reserve(buffers.length + 1);
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	PagedBuffer newBuffer;
+	newBuffer.size = size;
+	newBuffer.flags = flags ? flags : CL_MEM_READ_WRITE;
+	err = allocateHostData(newBuffer);
+	if (err != CL_SUCCESS) { return err; }
+	if (initialData) {
+		std::memcpy(newBuffer.hostData, initialData, size);
+		newBuffer.hasContents = true;
+	}
+	newBuffer.live = true;
+
+	if (freeSlots.length) {
+		bufferIndex = freeSlots[freeSlots.length - 1];
+		freeSlots.pop_back();
+		buffers[bufferIndex] = std::move(newBuffer);
+		return CL_SUCCESS;
+	}
+
+	buffers.push_back(std::move(newBuffer));
+	bufferIndex = buffers.length - 1;
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::releaseBuffer(size_t bufferIndex) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+	// NOTE: Same here, so that there's no way to fail after the buffer is gone.
+	cl_int err = freeSlots.reserve(freeSlots.length + 1);
+	if (err != CL_SUCCESS) { return err; }
+
+	for (size_t i = 0; i < bindings.length; ) {
+		if (bindings[i].bufferIndex == bufferIndex) {
+			bindings[i] = bindings[bindings.length - 1];
+			bindings.pop_back();
+		} else { i++; }
+	}
+
+	PagedBuffer& buffer = buffers[bufferIndex];
+	if (buffer.deviceBuffer) { residentBytes -= buffer.size; }
+	freeHostData(buffer);
+	buffer = PagedBuffer();
+	freeSlots.push_back(bufferIndex);
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::setKernelArg(cl_kernel kernel, cl_uint argIndex, size_t bufferIndex) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+
+	for (KernelBinding& binding : bindings) {
+		if (binding.kernel == kernel && binding.argIndex == argIndex) {
+			if (binding.bufferIndex != bufferIndex) {
+				binding.bufferIndex = bufferIndex;
+				binding.appliedBuffer = nullptr;
+			}
+			return CL_SUCCESS;
+		}
+	}
+
+	return bindings.push_back({ kernel, argIndex, bufferIndex, nullptr });
+}
+
+cl_int BufferPager::enqueueNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize,
+										 cl_uint numEventsInWaitList, const cl_event* eventWaitList, cl_event* event) noexcept {
+	custom_vector<size_t> kernelBuffers;
+	for (const KernelBinding& binding : bindings) {
+		if (binding.kernel != kernel) { continue; }
+		cl_int err = kernelBuffers.push_back(binding.bufferIndex);
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	cl_int err = makeResidentPinned(kernelBuffers.data, kernelBuffers.length);
+	if (err == CL_SUCCESS) {
+		for (KernelBinding& binding : bindings) {
+			if (binding.kernel != kernel) { continue; }
+			cl_mem deviceBuffer = buffers[binding.bufferIndex].deviceBuffer;
+			if (binding.appliedBuffer == deviceBuffer) { continue; }
+			err = clSetKernelArg(kernel, binding.argIndex, sizeof(cl_mem), &deviceBuffer);
+			if (err != CL_SUCCESS) { break; }
+			binding.appliedBuffer = deviceBuffer;
+		}
+	}
+	if (err == CL_SUCCESS) { err = clEnqueueNDRangeKernel(queue, kernel, workDim, nullptr, globalWorkSize, localWorkSize, numEventsInWaitList, eventWaitList, event); }
+
+	for (size_t bufferIndex : kernelBuffers) {
+		PagedBuffer& buffer = buffers[bufferIndex];
+		buffer.pinCount--;
+		if (err == CL_SUCCESS && !(buffer.flags & CL_MEM_READ_ONLY)) {
+			buffer.hostValid = false;
+			buffer.hasContents = true;
+		}
+	}
+	return err;
+}
+
+cl_int BufferPager::makeResident(const size_t* bufferIndices, size_t count) noexcept {
+	for (size_t i = 0; i < count; i++) {
+		if (!isValidBuffer(bufferIndices[i])) { return CL_INVALID_MEM_OBJECT; }
+	}
+
+	cl_int err = makeResidentPinned(bufferIndices, count);
+	for (size_t i = 0; i < count; i++) {
+		PagedBuffer& buffer = buffers[bufferIndices[i]];
+		buffer.pinCount--;
+		if (err == CL_SUCCESS && !(buffer.flags & CL_MEM_READ_ONLY)) {
+			buffer.hostValid = false;
+			buffer.hasContents = true;
+		}
+	}
+	return err;
+}
+
+cl_mem BufferPager::get_device_buffer(size_t bufferIndex) const noexcept {
+	if (!isValidBuffer(bufferIndex)) { return nullptr; }
+	return buffers[bufferIndex].deviceBuffer;
+}
+
+cl_int BufferPager::prefetch(size_t bufferIndex) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+	cl_int err = makeResidentPinned(&bufferIndex, 1);
+	buffers[bufferIndex].pinCount--;
+	return err;
+}
+
+cl_int BufferPager::adviseEvict(size_t bufferIndex, bool evictNow) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+	PagedBuffer& buffer = buffers[bufferIndex];
+	buffer.lastUse = 0;
+	if (evictNow && buffer.deviceBuffer && !buffer.pinCount) { return evict(bufferIndex); }
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::read(size_t bufferIndex, size_t offset, size_t size, void* destination) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+	PagedBuffer& buffer = buffers[bufferIndex];
+	if (!destination || offset > buffer.size || size > buffer.size - offset) { return CL_INVALID_VALUE; }
+	if (!size) { return CL_SUCCESS; }
+
+	// NOTE: If the device has the newer data, read straight from there instead of paging the whole buffer out.
+	if (!buffer.hostValid) { return clEnqueueReadBuffer(queue, buffer.deviceBuffer, CL_TRUE, offset, size, destination, 0, nullptr, nullptr); }
+
+	cl_int err = waitForHostTransfer(buffer);
+	if (err != CL_SUCCESS) { return err; }
+	std::memcpy(destination, (const unsigned char*)buffer.hostData + offset, size);
+	return CL_SUCCESS;
+}
+
+cl_int BufferPager::write(size_t bufferIndex, size_t offset, size_t size, const void* source) noexcept {
+	if (!isValidBuffer(bufferIndex)) { return CL_INVALID_MEM_OBJECT; }
+	PagedBuffer& buffer = buffers[bufferIndex];
+	if (!source || offset > buffer.size || size > buffer.size - offset) { return CL_INVALID_VALUE; }
+	if (!size) { return CL_SUCCESS; }
+
+	cl_int err;
+	if (buffer.deviceBuffer) {
+		err = clEnqueueWriteBuffer(queue, buffer.deviceBuffer, CL_TRUE, offset, size, source, 0, nullptr, nullptr);
+		if (err != CL_SUCCESS) { return err; }
+		buffer.hasContents = true;
+		// NOTE: The device has the newer data anyway, the host copy gets it on eviction.
+		if (!buffer.hostValid) { return CL_SUCCESS; }
+	}
+
+	// NOTE: Updating the host copy as well keeps it valid, so that buffers that only the host writes never need a write-back.
+	err = waitForHostTransfer(buffer);
+	if (err != CL_SUCCESS) { return err; }
+	std::memcpy((unsigned char*)buffer.hostData + offset, source, size);
+	buffer.hasContents = true;
+	return CL_SUCCESS;
+}
+
+BufferPager::~BufferPager() noexcept {
+	for (PagedBuffer& buffer : buffers) {
+		if (buffer.live) { freeHostData(buffer); }
+	}
+}
@@ -0,0 +1,343 @@
+#include "cl_command_recording.h"
+
+#include <new>							// For std::nothrow.
+
+#include <cstring>						// For std::memcpy, std::memcmp and std::strncmp.
+
+bool loadCommandBufferKHRFunctions(cl_int& err, cl_device_id device, CommandBufferKHRFunctions& functions) noexcept {
+	functions = CommandBufferKHRFunctions();
+	err = CL_SUCCESS;
+	// NOTE: Libraries below OpenCL 1.2 can't look extension functions up, which just means the recording gets emulated.
+	if (!clGetExtensionFunctionAddressForPlatform) { return false; }
+
+	// NOTE: Devices below OpenCL 3.0 don't know the query, which just means there's no (versioned) extension, not that something went wrong.
+	size_t extensionsSize;
+	if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS_WITH_VERSION, 0, nullptr, &extensionsSize) != CL_SUCCESS) { return false; }
+	size_t extensionCount = extensionsSize / sizeof(cl_name_version);
+	if (!extensionCount) { return false; }
+
+	cl_name_version* extensions = new (std::nothrow) cl_name_version[extensionCount];
+	if (!extensions) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return false; }
+	err = clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS_WITH_VERSION, extensionCount * sizeof(cl_name_version), extensions, nullptr);
+	if (err != CL_SUCCESS) { delete[] extensions; return false; }
+
+	bool usableVersion = false;
+	for (size_t i = 0; i < extensionCount; i++) {
+		if (std::strncmp(extensions[i].name, CL_EXT_KHR_COMMAND_BUFFER_NAME, CL_NAME_VERSION_MAX_NAME_SIZE) == 0) {
+			// NOTE: Only 0.9.x from 0.9.5 on, since that's the ABI that the typedefs describe. Anything newer might have changed them again.
+			usableVersion = extensions[i].version >= CL_EXT_KHR_COMMAND_BUFFER_MIN_VERSION && extensions[i].version < CL_MAKE_VERSION(0, 10, 0);
+			break;
+		}
+	}
+	delete[] extensions;
+	if (!usableVersion) { return false; }
+
+	cl_platform_id platform;
+	err = clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, nullptr);
+	if (err != CL_SUCCESS) { return false; }
+
+	functions.clCreateCommandBufferKHR = (clCreateCommandBufferKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+	functions.clFinalizeCommandBufferKHR = (clFinalizeCommandBufferKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+	functions.clReleaseCommandBufferKHR = (clReleaseCommandBufferKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+	functions.clEnqueueCommandBufferKHR = (clEnqueueCommandBufferKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+	functions.clCommandNDRangeKernelKHR = (clCommandNDRangeKernelKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+	functions.clCommandCopyBufferKHR = (clCommandCopyBufferKHR_func)clGetExtensionFunctionAddressForPlatform(platform, "clCommandCopyBufferKHR");
+	if (!functions.clCreateCommandBufferKHR || !functions.clFinalizeCommandBufferKHR || !functions.clReleaseCommandBufferKHR ||
+		!functions.clEnqueueCommandBufferKHR || !functions.clCommandNDRangeKernelKHR || !functions.clCommandCopyBufferKHR) {
+		functions = CommandBufferKHRFunctions();
+		return false;
+	}
+
+	return true;
+}
+
+CommandRecording::CommandRecording(cl_int& err, cl_device_id device, cl_command_queue queue, bool allowNative) noexcept : queue(queue) {
+	if (allowNative) {
+		nativeSupported = loadCommandBufferKHRFunctions(err, device, functions);
+		if (err != CL_SUCCESS) { return; }
+	}
+	err = CL_SUCCESS;
+}
+
+CommandRecording::CommandRecording(CommandRecording&& other) noexcept :
+	queue(other.queue), functions(other.functions), nativeSupported(other.nativeSupported), commandBuffer(other.commandBuffer),
+	commandBufferStale(other.commandBufferStale), simultaneousUse(other.simultaneousUse), lastReplay(std::move(other.lastReplay)),
+	finalized(other.finalized), commands(std::move(other.commands)), args(std::move(other.args)),
+	argValues(std::move(other.argValues)), kernelStates(std::move(other.kernelStates))
+{
+	other.commandBuffer = nullptr;
+	other.commandBufferStale = false;
+}
+
+size_t CommandRecording::findArg(size_t command, cl_uint index) const noexcept {
+	for (size_t arg = commands[command].firstArg; arg != SIZE_MAX; arg = args[arg].next) {
+		if (args[arg].index == index) { return arg; }
+	}
+	return SIZE_MAX;
+}
+
+bool CommandRecording::isSameArgValue(const Arg& left, const Arg& right) const noexcept {
+	if (left.size != right.size) { return false; }
+	if (left.valueOffset == SIZE_MAX || right.valueOffset == SIZE_MAX) { return left.valueOffset == right.valueOffset; }
+	return std::memcmp(&argValues[left.valueOffset], &argValues[right.valueOffset], left.size) == 0;
+}
+
+cl_int CommandRecording::storeArg(size_t command, cl_uint index, size_t size, const void* value, size_t& argIndex) noexcept {
+	cl_int err;
+	argIndex = findArg(command, index);
+	if (argIndex == SIZE_MAX) {
+		Arg newArg;
+		newArg.next = commands[command].firstArg;
+		newArg.index = index;
+		newArg.size = 0;
+		newArg.valueOffset = SIZE_MAX;
+		err = args.push_back(newArg);
+		if (err != CL_SUCCESS) { return err; }
+		argIndex = args.length - 1;
+		commands[command].firstArg = argIndex;
+	}
+
+	Arg& arg = args[argIndex];
+	if (!value) {
+		arg.size = size;
+		arg.valueOffset = SIZE_MAX;
+		return CL_SUCCESS;
+	}
+
+	// NOTE: Patches with the same size overwrite the old value in place, everything else gets appended (the old bytes just stay unused).
+	if (arg.valueOffset == SIZE_MAX || arg.size != size) {
+		size_t valueOffset = argValues.length;
+		err = argValues.resize(valueOffset + size);
+		if (err != CL_SUCCESS) { return err; }
+		arg.valueOffset = valueOffset;
+		arg.size = size;
+	}
+	std::memcpy(&argValues[arg.valueOffset], value, size);
+	return CL_SUCCESS;
+}
+
+cl_int CommandRecording::setArg(cl_kernel kernel, const Arg& arg) noexcept {
+	return clSetKernelArg(kernel, arg.index, arg.size, arg.valueOffset == SIZE_MAX ? nullptr : &argValues[arg.valueOffset]);
+}
+
+cl_int CommandRecording::applyArgs(size_t command) noexcept {
+	const Command& currentCommand = commands[command];
+	KernelState& state = kernelStates[currentCommand.kernelState];
+	if (state.appliedCommand == command) { return CL_SUCCESS; }
+
+	for (size_t arg = currentCommand.firstArg; arg != SIZE_MAX; arg = args[arg].next) {
+		if (state.appliedCommand != SIZE_MAX) {
+			size_t previousArg = findArg(state.appliedCommand, args[arg].index);
+			if (previousArg != SIZE_MAX && isSameArgValue(args[previousArg], args[arg])) { continue; }
+		}
+		cl_int err = setArg(currentCommand.kernel, args[arg]);
+		if (err != CL_SUCCESS) { state.appliedCommand = SIZE_MAX; return err; }
+	}
+
+	state.appliedCommand = command;
+	return CL_SUCCESS;
+}
+
+cl_int CommandRecording::recordNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize, size_t& commandIndex) noexcept {
+	if (finalized) { return CL_EXT_COMMAND_RECORDING_FINALIZED; }
+	if (workDim < 1 || workDim > 3) { return CL_INVALID_WORK_DIMENSION; }
+	if (!globalWorkSize) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+
+	size_t kernelState = 0;
+	while (kernelState < kernelStates.length && kernelStates[kernelState].kernel != kernel) { kernelState++; }
+	if (kernelState == kernelStates.length) {
+		KernelState newState;
+		newState.kernel = kernel;
+		newState.appliedCommand = SIZE_MAX;
+		cl_int err = kernelStates.push_back(newState);
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	Command command = { };
+	command.type = RecordedCommand_type::NDRANGE_KERNEL;
+	command.kernel = kernel;
+	command.workDim = workDim;
+	for (cl_uint i = 0; i < workDim; i++) {
+		command.globalWorkSize[i] = globalWorkSize[i];
+		command.localWorkSize[i] = localWorkSize ? localWorkSize[i] : 0;
+	}
+	command.hasLocalWorkSize = localWorkSize;
+	command.kernelState = kernelState;
+	command.firstArg = SIZE_MAX;
+
+	cl_int err = commands.push_back(command);
+	if (err != CL_SUCCESS) { return err; }
+	commandIndex = commands.length - 1;
+	return CL_SUCCESS;
+}
+
+cl_int CommandRecording::recordKernelArg(size_t commandIndex, cl_uint argIndex, size_t size, const void* value) noexcept {
+	if (finalized) { return CL_EXT_COMMAND_RECORDING_FINALIZED; }
+	if (commandIndex >= commands.length || commands[commandIndex].type != RecordedCommand_type::NDRANGE_KERNEL) { return CL_EXT_COMMAND_RECORDING_INVALID_COMMAND; }
+	size_t arg;
+	return storeArg(commandIndex, argIndex, size, value, arg);
+}
+
+cl_int CommandRecording::recordCopyBuffer(cl_mem srcBuffer, cl_mem dstBuffer, size_t srcOffset, size_t dstOffset, size_t size) noexcept {
+	if (finalized) { return CL_EXT_COMMAND_RECORDING_FINALIZED; }
+
+	Command command = { };
+	command.type = RecordedCommand_type::COPY_BUFFER;
+	command.srcBuffer = srcBuffer;
+	command.dstBuffer = dstBuffer;
+	command.srcOffset = srcOffset;
+	command.dstOffset = dstOffset;
+	command.size = size;
+	command.firstArg = SIZE_MAX;
+	return commands.push_back(command);
+}
+
+void CommandRecording::releaseCommandBuffer() noexcept {
+	if (commandBuffer) { functions.clReleaseCommandBufferKHR(commandBuffer); commandBuffer = nullptr; }
+	commandBufferStale = false;
+	// NOTE: The next command buffer is a new one, which isn't pending, so there's nothing to wait for anymore.
+	lastReplay.reset();
+}
+
+cl_int CommandRecording::buildCommandBuffer() noexcept {
+	releaseCommandBuffer();
+
+	cl_int err;
+	const cl_command_buffer_properties_khr properties[] = { CL_COMMAND_BUFFER_FLAGS_KHR, CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, 0 };
+	commandBuffer = functions.clCreateCommandBufferKHR(1, &queue, properties, &err);
+	simultaneousUse = err == CL_SUCCESS;
+	if (!simultaneousUse) {
+		// NOTE: Simultaneous use is an optional capability in newer revisions of the extension, so a refusal isn't the end of it.
+		commandBuffer = functions.clCreateCommandBufferKHR(1, &queue, nullptr, &err);
+		if (err != CL_SUCCESS) { commandBuffer = nullptr; return err; }
+	}
+
+	// NOTE: Commands in a command buffer only wait on what their sync point wait list says, so every command waits on the one
+	// before it, which gives the same order as the in-order queue of the emulated path.
+	cl_sync_point_khr previousSyncPoint;
+	for (size_t i = 0; i < commands.length; i++) {
+		const Command& command = commands[i];
+		cl_sync_point_khr syncPoint;
+		switch (command.type) {
+		case RecordedCommand_type::NDRANGE_KERNEL:
+			// NOTE: The command buffer captures the arguments that the kernel has at this point.
+			err = applyArgs(i);
+			if (err != CL_SUCCESS) { return err; }
+			err = functions.clCommandNDRangeKernelKHR(commandBuffer, nullptr, nullptr, command.kernel, command.workDim, nullptr, command.globalWorkSize,
+													  command.hasLocalWorkSize ? command.localWorkSize : nullptr, i ? 1 : 0, i ? &previousSyncPoint : nullptr, &syncPoint, nullptr);
+			break;
+		case RecordedCommand_type::COPY_BUFFER:
+			err = functions.clCommandCopyBufferKHR(commandBuffer, nullptr, nullptr, command.srcBuffer, command.dstBuffer, command.srcOffset, command.dstOffset, command.size,
+												   i ? 1 : 0, i ? &previousSyncPoint : nullptr, &syncPoint, nullptr);
+			break;
+		}
+		if (err != CL_SUCCESS) { return err; }
+		previousSyncPoint = syncPoint;
+	}
+
+	return functions.clFinalizeCommandBufferKHR(commandBuffer);
+}
+
+cl_int CommandRecording::finalize() noexcept {
+	if (finalized) { return CL_EXT_COMMAND_RECORDING_FINALIZED; }
+	finalized = true;
+
+	if (nativeSupported && commands.length) {
+		// NOTE: If the implementation doesn't like something about the command buffer (queue properties, a kernel it can't record, ...),
+		// fall back to emulation instead of failing. Real errors (bad arguments and such) still show up on the first replay.
+		if (buildCommandBuffer() != CL_SUCCESS) {
+			releaseCommandBuffer();
+			nativeSupported = false;
+		}
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int CommandRecording::replay(cl_uint numEventsInWaitList, const cl_event* eventWaitList, cl_event* event) noexcept {
+	if (!finalized) { return CL_INVALID_OPERATION; }
+
+	if (commandBufferStale) {
+		if (buildCommandBuffer() != CL_SUCCESS) {
+			releaseCommandBuffer();
+			nativeSupported = false;
+		}
+	}
+
+	if (commandBuffer) {
+		if (simultaneousUse) { return functions.clEnqueueCommandBufferKHR(0, nullptr, commandBuffer, numEventsInWaitList, eventWaitList, event); }
+
+		cl_int err;
+		if (lastReplay) {
+			cl_event previousReplay = lastReplay;
+			err = clWaitForEvents(1, &previousReplay);
+			if (err != CL_SUCCESS) { return err; }
+			lastReplay.reset();
+		}
+		cl_event replayEvent;
+		err = functions.clEnqueueCommandBufferKHR(0, nullptr, commandBuffer, numEventsInWaitList, eventWaitList, &replayEvent);
+		if (err != CL_SUCCESS) { return err; }
+		lastReplay.reset(replayEvent);
+		if (event) {
+			OpenCLEvent sharedEvent = lastReplay.share(err);
+			if (err != CL_SUCCESS) { return err; }
+			*event = sharedEvent.detach();
+		}
+		return CL_SUCCESS;
+	}
+
+	if (!commands.length) {
+		if (event || numEventsInWaitList) {
+			if (!clEnqueueMarkerWithWaitList) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+			return clEnqueueMarkerWithWaitList(queue, numEventsInWaitList, eventWaitList, event);
+		}
+		return CL_SUCCESS;
+	}
+
+	for (size_t i = 0; i < commands.length; i++) {
+		const Command& command = commands[i];
+		cl_uint waitCount = i ? 0 : numEventsInWaitList;
+		const cl_event* waitList = i ? nullptr : eventWaitList;
+		cl_event* commandEvent = i == commands.length - 1 ? event : nullptr;
+
+		cl_int err;
+		switch (command.type) {
+		case RecordedCommand_type::NDRANGE_KERNEL:
+			err = applyArgs(i);
+			if (err != CL_SUCCESS) { return err; }
+			err = clEnqueueNDRangeKernel(queue, command.kernel, command.workDim, nullptr, command.globalWorkSize, command.hasLocalWorkSize ? command.localWorkSize : nullptr,
+										 waitCount, waitList, commandEvent);
+			break;
+		case RecordedCommand_type::COPY_BUFFER:
+			err = clEnqueueCopyBuffer(queue, command.srcBuffer, command.dstBuffer, command.srcOffset, command.dstOffset, command.size, waitCount, waitList, commandEvent);
+			break;
+		}
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int CommandRecording::patchKernelArg(size_t commandIndex, cl_uint argIndex, size_t size, const void* value) noexcept {
+	if (commandIndex >= commands.length || commands[commandIndex].type != RecordedCommand_type::NDRANGE_KERNEL) { return CL_EXT_COMMAND_RECORDING_INVALID_COMMAND; }
+
+	size_t arg;
+	cl_int err = storeArg(commandIndex, argIndex, size, value, arg);
+	if (err != CL_SUCCESS) { return err; }
+
+	if (commandBuffer) { commandBufferStale = true; return CL_SUCCESS; }
+
+	// NOTE: If the kernel currently has this command's arguments, patch the kernel right away, so that the next replay doesn't have to look.
+	KernelState& state = kernelStates[commands[commandIndex].kernelState];
+	if (state.appliedCommand == commandIndex) {
+		err = setArg(commands[commandIndex].kernel, args[arg]);
+		if (err != CL_SUCCESS) { state.appliedCommand = SIZE_MAX; return err; }
+	}
+	return CL_SUCCESS;
+}
+
+void CommandRecording::invalidate_kernel_args() noexcept {
+	for (KernelState& state : kernelStates) { state.appliedCommand = SIZE_MAX; }
+}
+
+CommandRecording::~CommandRecording() noexcept { releaseCommandBuffer(); }
@@ -0,0 +1,33 @@
+#include "cl_event_futures.h"
+
+#include <new>							// For std::nothrow.
+
+#include <future>						// For std::promise and std::future.
+
+static void CL_CALLBACK fulfillEventPromise(cl_event event, cl_int event_command_status, void* user_data) noexcept {
+	std::promise<cl_int>* promise = (std::promise<cl_int>*)user_data;
+	promise->set_value(event_command_status < 0 ? event_command_status : CL_SUCCESS);
+	delete promise;
+	clReleaseEvent(event);			// NOTE: Pairs with the retain in getEventFuture().
+}
+
+std::future<cl_int> getEventFuture(cl_int& err, cl_event event) noexcept {
+	if (!clSetEventCallback) { err = CL_EXT_FUNCTION_UNAVAILABLE; return std::future<cl_int>(); }
+	std::promise<cl_int>* promise = new (std::nothrow) std::promise<cl_int>;
+	if (!promise) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return std::future<cl_int>(); }
+	std::future<cl_int> result = promise->get_future();
+
+	// NOTE: We hold on to the event ourselves until the callback has fired, so that the caller is free to release theirs whenever.
+	err = clRetainEvent(event);
+	if (err != CL_SUCCESS) { delete promise; return std::future<cl_int>(); }
+
+	err = clSetEventCallback(event, CL_COMPLETE, fulfillEventPromise, promise);
+	if (err != CL_SUCCESS) {
+		clReleaseEvent(event);
+		delete promise;
+		return std::future<cl_int>();
+	}
+
+	err = CL_SUCCESS;
+	return result;
+}
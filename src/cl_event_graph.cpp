@@ -0,0 +1,417 @@
+#include "cl_event_graph.h"
+
+#include <cstdint>						// For fixed-width types.
+
+#include <vector>						// For std::vector.
+
+#include <unordered_map>				// For tracking the last writer and readers of every buffer while deriving edges.
+
+#define INVALID_NODE ((EventGraph::node_id)-1)
+#define NO_QUEUE ((size_t)-1)
+
+EventGraph::EventGraph(cl_int& err, cl_context context, const cl_command_queue* queues, size_t queues_length) noexcept : context(context) {
+	if (!queues || queues_length == 0) { err = CL_INVALID_VALUE; return; }
+	this->queues.assign(queues, queues + queues_length);
+	unflushedQueues.assign(queues_length, false);
+	err = CL_SUCCESS;
+}
+
+EventGraph::node_id EventGraph::addNode(cl_int& err, EventGraphNode_type type, const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept {
+	// NOTE: The trampolines of an in-flight execution point into nodes, which we could reallocate here, so we have to wait first.
+	if (inFlight) {
+		err = wait();
+		if (err != CL_SUCCESS) { return INVALID_NODE; }
+	}
+
+	nodes.emplace_back();
+	Node& node = nodes.back();
+	node.type = type;
+	node.kernel = nullptr;
+	node.work_dim = 0;
+	node.has_local_work_size = false;
+	node.src_buffer = nullptr;
+	node.dst_buffer = nullptr;
+	node.src_offset = 0;
+	node.dst_offset = 0;
+	node.size = 0;
+	node.host_ptr = nullptr;
+	node.callback = nullptr;
+	node.callbackUserData = nullptr;
+	if (dependencies) { node.bufferDependencies.assign(dependencies, dependencies + dependencies_length); }
+	node.queueIndex = NO_QUEUE;
+	node.needsEvent = false;
+	node.isSink = false;
+	node.event = nullptr;
+
+	compiled = false;
+
+	err = CL_SUCCESS;
+	return nodes.size() - 1;
+}
+
+EventGraph::node_id EventGraph::addKernel(cl_int& err, cl_kernel kernel, cl_uint work_dim, const size_t* global_work_size, const size_t* local_work_size,
+										  const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept {
+	if (work_dim < 1 || work_dim > 3 || !global_work_size) { err = CL_INVALID_WORK_DIMENSION; return INVALID_NODE; }
+
+	node_id id = addNode(err, EventGraphNode_type::KERNEL, dependencies, dependencies_length);
+	if (err != CL_SUCCESS) { return INVALID_NODE; }
+
+	Node& node = nodes[id];
+	node.kernel = kernel;
+	node.work_dim = work_dim;
+	for (cl_uint i = 0; i < work_dim; i++) {
+		node.global_work_size[i] = global_work_size[i];
+		node.local_work_size[i] = local_work_size ? local_work_size[i] : 0;
+	}
+	node.has_local_work_size = local_work_size;
+
+	return id;
+}
+
+cl_int EventGraph::setKernelArg(node_id node, cl_uint arg_index, size_t arg_size, const void* arg_value) noexcept {
+	if (node >= nodes.size() || nodes[node].type != EventGraphNode_type::KERNEL) { return CL_EXT_EVENT_GRAPH_INVALID_NODE; }
+	Node& kernelNode = nodes[node];
+
+	// NOTE: If the arg was already set, we just drop the old entry. The old bytes stay in argBytes until the node dies, but that's fine,
+	// args are tiny and people don't reset them a thousand times before executing.
+	for (size_t i = 0; i < kernelNode.args.size(); i++) {
+		if (kernelNode.args[i].index == arg_index) { kernelNode.args.erase(kernelNode.args.begin() + i); break; }
+	}
+
+	KernelArg arg;
+	arg.index = arg_index;
+	arg.size = arg_size;
+	if (arg_value) {
+		arg.offset = kernelNode.argBytes.size();
+		const unsigned char* bytes = (const unsigned char*)arg_value;
+		kernelNode.argBytes.insert(kernelNode.argBytes.end(), bytes, bytes + arg_size);
+	} else { arg.offset = (size_t)-1; }
+	kernelNode.args.push_back(arg);
+
+	return CL_SUCCESS;
+}
+
+EventGraph::node_id EventGraph::addCopyBuffer(cl_int& err, cl_mem src_buffer, cl_mem dst_buffer, size_t src_offset, size_t dst_offset, size_t size) noexcept {
+	EventGraphBufferDependency dependencies[2] = { { src_buffer, EventGraphBufferAccess::READ }, { dst_buffer, EventGraphBufferAccess::WRITE } };
+	node_id id = addNode(err, EventGraphNode_type::COPY_BUFFER, dependencies, 2);
+	if (err != CL_SUCCESS) { return INVALID_NODE; }
+
+	Node& node = nodes[id];
+	node.src_buffer = src_buffer;
+	node.dst_buffer = dst_buffer;
+	node.src_offset = src_offset;
+	node.dst_offset = dst_offset;
+	node.size = size;
+
+	return id;
+}
+
+EventGraph::node_id EventGraph::addWriteBuffer(cl_int& err, cl_mem buffer, size_t offset, size_t size, const void* ptr) noexcept {
+	EventGraphBufferDependency dependency = { buffer, EventGraphBufferAccess::WRITE };
+	node_id id = addNode(err, EventGraphNode_type::WRITE_BUFFER, &dependency, 1);
+	if (err != CL_SUCCESS) { return INVALID_NODE; }
+
+	Node& node = nodes[id];
+	node.dst_buffer = buffer;
+	node.dst_offset = offset;
+	node.size = size;
+	node.host_ptr = (void*)ptr;
+
+	return id;
+}
+
+EventGraph::node_id EventGraph::addReadBuffer(cl_int& err, cl_mem buffer, size_t offset, size_t size, void* ptr) noexcept {
+	EventGraphBufferDependency dependency = { buffer, EventGraphBufferAccess::READ };
+	node_id id = addNode(err, EventGraphNode_type::READ_BUFFER, &dependency, 1);
+	if (err != CL_SUCCESS) { return INVALID_NODE; }
+
+	Node& node = nodes[id];
+	node.src_buffer = buffer;
+	node.src_offset = offset;
+	node.size = size;
+	node.host_ptr = ptr;
+
+	return id;
+}
+
+EventGraph::node_id EventGraph::addHostCallback(cl_int& err, EventGraphHostCallback callback, void* userData, const EventGraphBufferDependency* dependencies, size_t dependencies_length) noexcept {
+	if (!callback) { err = CL_INVALID_VALUE; return INVALID_NODE; }
+	// NOTE: Host callbacks are user events that get completed from event callbacks (with a marker in front if there's more than one
+	// event to wait for), which needs OpenCL 1.2. Graphs without host callbacks work with OpenCL 1.0.
+	if (!clCreateUserEvent || !clSetUserEventStatus || !clSetEventCallback || !clEnqueueMarkerWithWaitList) { err = CL_EXT_FUNCTION_UNAVAILABLE; return INVALID_NODE; }
+
+	node_id id = addNode(err, EventGraphNode_type::HOST_CALLBACK, dependencies, dependencies_length);
+	if (err != CL_SUCCESS) { return INVALID_NODE; }
+
+	Node& node = nodes[id];
+	node.callback = callback;
+	node.callbackUserData = userData;
+
+	return id;
+}
+
+cl_int EventGraph::addDependency(node_id before, node_id after) noexcept {
+	if (before >= nodes.size() || after >= nodes.size() || before == after) { return CL_EXT_EVENT_GRAPH_INVALID_NODE; }
+	if (inFlight) {
+		cl_int err = wait();
+		if (err != CL_SUCCESS) { return err; }
+	}
+	nodes[after].explicitPredecessors.push_back(before);
+	compiled = false;
+	return CL_SUCCESS;
+}
+
+cl_int EventGraph::compile() noexcept {
+	if (inFlight) {
+		cl_int err = wait();
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	size_t nodes_length = nodes.size();
+
+	// Derive the edges from the buffer dependencies. The order in which nodes were added is the program order, just like it would be
+	// for a single in-order queue: reads wait for the last write, writes wait for the last write and every read since then.
+	struct BufferState {
+		node_id lastWriter = INVALID_NODE;
+		std::vector<node_id> readersSinceLastWrite;
+	};
+	std::unordered_map<cl_mem, BufferState> bufferStates;
+
+	for (node_id i = 0; i < nodes_length; i++) {
+		Node& node = nodes[i];
+		node.predecessors.clear();
+
+		auto addPredecessor = [&node, i](node_id predecessor) noexcept {
+			if (predecessor == INVALID_NODE || predecessor == i) { return; }
+			for (node_id existing : node.predecessors) { if (existing == predecessor) { return; } }
+			node.predecessors.push_back(predecessor);
+		};
+
+		for (node_id predecessor : node.explicitPredecessors) { addPredecessor(predecessor); }
+
+		for (const EventGraphBufferDependency& dependency : node.bufferDependencies) {
+			BufferState& state = bufferStates[dependency.buffer];
+			addPredecessor(state.lastWriter);
+			if (dependency.access == EventGraphBufferAccess::READ) {
+				state.readersSinceLastWrite.push_back(i);
+				continue;
+			}
+			for (node_id reader : state.readersSinceLastWrite) { addPredecessor(reader); }
+			state.readersSinceLastWrite.clear();
+			state.lastWriter = i;
+		}
+	}
+
+	// Topological sort (Kahn's algorithm). Ready nodes get processed in the order they were added, so that the result stays close
+	// to what the user wrote, which keeps the queue assignment below predictable.
+	std::vector<size_t> unresolvedPredecessorCounts(nodes_length);
+	std::vector<std::vector<node_id>> successors(nodes_length);
+	for (node_id i = 0; i < nodes_length; i++) {
+		unresolvedPredecessorCounts[i] = nodes[i].predecessors.size();
+		for (node_id predecessor : nodes[i].predecessors) { successors[predecessor].push_back(i); }
+	}
+
+	executionOrder.clear();
+	executionOrder.reserve(nodes_length);
+	for (node_id i = 0; i < nodes_length; i++) {
+		if (unresolvedPredecessorCounts[i] == 0) { executionOrder.push_back(i); }
+	}
+	for (size_t cursor = 0; cursor < executionOrder.size(); cursor++) {
+		for (node_id successor : successors[executionOrder[cursor]]) {
+			if (--unresolvedPredecessorCounts[successor] == 0) { executionOrder.push_back(successor); }
+		}
+	}
+	if (executionOrder.size() != nodes_length) { executionOrder.clear(); return CL_EXT_EVENT_GRAPH_CYCLE_DETECTED; }
+
+	// Assign queues. A node continues the chain of one of its predecessors if that predecessor is still the last thing on its queue,
+	// since then the in-order queue gives us the dependency for free. Otherwise it starts a new branch on the least loaded queue.
+	size_t queues_length = queues.size();
+	std::vector<node_id> queueTails(queues_length, INVALID_NODE);
+	std::vector<size_t> queueLoads(queues_length, 0);
+
+	for (node_id i : executionOrder) {
+		Node& node = nodes[i];
+		node.needsEvent = false;
+		node.isSink = successors[i].empty();
+
+		if (node.type == EventGraphNode_type::HOST_CALLBACK) { node.queueIndex = NO_QUEUE; continue; }
+
+		size_t chosenQueue = NO_QUEUE;
+		for (node_id predecessor : node.predecessors) {
+			size_t predecessorQueue = nodes[predecessor].queueIndex;
+			if (predecessorQueue != NO_QUEUE && queueTails[predecessorQueue] == predecessor) { chosenQueue = predecessorQueue; break; }
+		}
+		if (chosenQueue == NO_QUEUE) {
+			chosenQueue = 0;
+			for (size_t j = 1; j < queues_length; j++) {
+				if (queueLoads[j] < queueLoads[chosenQueue]) { chosenQueue = j; }
+			}
+		}
+
+		node.queueIndex = chosenQueue;
+		queueTails[chosenQueue] = i;
+		queueLoads[chosenQueue]++;
+	}
+
+	// Work out the wait lists. Predecessors on the same queue are implicitly waited on because the queues are in-order,
+	// everything else needs an actual event.
+	for (node_id i : executionOrder) {
+		Node& node = nodes[i];
+		node.waitPredecessors.clear();
+		for (node_id predecessor : node.predecessors) {
+			Node& predecessorNode = nodes[predecessor];
+			if (node.type == EventGraphNode_type::HOST_CALLBACK || predecessorNode.type == EventGraphNode_type::HOST_CALLBACK || predecessorNode.queueIndex != node.queueIndex) {
+				node.waitPredecessors.push_back(predecessor);
+				predecessorNode.needsEvent = true;
+			}
+		}
+		if (node.isSink || node.type == EventGraphNode_type::HOST_CALLBACK) { node.needsEvent = true; }
+	}
+
+	compiled = true;
+	return CL_SUCCESS;
+}
+
+void CL_CALLBACK EventGraph::hostCallbackTrampoline(cl_event, cl_int event_command_status, void* user_data) noexcept {
+	Node* node = (Node*)user_data;
+	cl_event userEvent = node->event;
+	// NOTE: If something we depend on failed, we propagate the failure instead of running the callback, same as the device would.
+	if (event_command_status < 0) { clSetUserEventStatus(userEvent, event_command_status); return; }
+	node->callback(node->callbackUserData);
+	clSetUserEventStatus(userEvent, CL_COMPLETE);
+	// NOTE: Don't touch node after this point, wait() can return as soon as the user event is complete.
+}
+
+// NOTE: A command can only be relied upon to wait for events of another queue once that queue got flushed, otherwise implementations
+// that only submit on flush can deadlock. Same-queue predecessors aren't in the wait list, so they don't need one.
+cl_int EventGraph::flushWaitPredecessors(const Node& node) noexcept {
+	for (node_id predecessor : node.waitPredecessors) {
+		size_t predecessorQueue = nodes[predecessor].queueIndex;
+		if (predecessorQueue == NO_QUEUE || !unflushedQueues[predecessorQueue]) { continue; }
+		cl_int err = clFlush(queues[predecessorQueue]);
+		if (err != CL_SUCCESS) { return err; }
+		unflushedQueues[predecessorQueue] = false;
+	}
+	return CL_SUCCESS;
+}
+
+cl_int EventGraph::enqueueNode(Node& node) noexcept {
+	cl_int flushErr = flushWaitPredecessors(node);
+	if (flushErr != CL_SUCCESS) { return flushErr; }
+
+	waitListScratch.clear();
+	for (node_id predecessor : node.waitPredecessors) { waitListScratch.push_back(nodes[predecessor].event); }
+	cl_uint waitList_length = (cl_uint)waitListScratch.size();
+	const cl_event* waitList = waitList_length ? waitListScratch.data() : nullptr;
+	cl_event* event = node.needsEvent ? &node.event : nullptr;
+
+	switch (node.type) {
+	case EventGraphNode_type::KERNEL:
+		{
+			cl_command_queue queue = queues[node.queueIndex];
+			for (const KernelArg& arg : node.args) {
+				const void* value = arg.offset == (size_t)-1 ? nullptr : node.argBytes.data() + arg.offset;
+				cl_int err = clSetKernelArg(node.kernel, arg.index, arg.size, value);
+				if (err != CL_SUCCESS) { return err; }
+			}
+			return clEnqueueNDRangeKernel(queue, node.kernel, node.work_dim, nullptr, node.global_work_size,
+										  node.has_local_work_size ? node.local_work_size : nullptr, waitList_length, waitList, event);
+		}
+	case EventGraphNode_type::COPY_BUFFER:
+		return clEnqueueCopyBuffer(queues[node.queueIndex], node.src_buffer, node.dst_buffer, node.src_offset, node.dst_offset, node.size, waitList_length, waitList, event);
+	case EventGraphNode_type::WRITE_BUFFER:
+		return clEnqueueWriteBuffer(queues[node.queueIndex], node.dst_buffer, CL_FALSE, node.dst_offset, node.size, node.host_ptr, waitList_length, waitList, event);
+	case EventGraphNode_type::READ_BUFFER:
+		return clEnqueueReadBuffer(queues[node.queueIndex], node.src_buffer, CL_FALSE, node.src_offset, node.size, node.host_ptr, waitList_length, waitList, event);
+	case EventGraphNode_type::HOST_CALLBACK:
+		{
+			cl_int err;
+			node.event = clCreateUserEvent(context, &err);
+			if (err != CL_SUCCESS) { node.event = nullptr; return err; }
+
+			if (waitList_length == 0) {
+				node.callback(node.callbackUserData);
+				return clSetUserEventStatus(node.event, CL_COMPLETE);
+			}
+
+			cl_event triggerEvent = waitListScratch[0];
+			cl_event markerEvent = nullptr;
+			if (waitList_length > 1) {
+				// NOTE: Callbacks can only be attached to a single event, so we fold the wait list into a marker first.
+				// It doesn't matter which queue the marker goes on, since it only waits on the wait list.
+				err = clEnqueueMarkerWithWaitList(queues[0], waitList_length, waitList, &markerEvent);
+				if (err != CL_SUCCESS) { clSetUserEventStatus(node.event, err); return err; }
+				unflushedQueues[0] = true;
+				triggerEvent = markerEvent;
+			}
+
+			err = clSetEventCallback(triggerEvent, CL_COMPLETE, hostCallbackTrampoline, &node);
+			// NOTE: The implementation holds on to the marker until the callback has run, so we can drop our reference straight away.
+			if (markerEvent) { clReleaseEvent(markerEvent); }
+			// NOTE: If we can't register the callback, we fail the user event so that nothing that waits on it hangs forever.
+			if (err != CL_SUCCESS) { clSetUserEventStatus(node.event, err); return err; }
+			return CL_SUCCESS;
+		}
+	}
+	return CL_INVALID_VALUE;
+}
+
+cl_int EventGraph::execute() noexcept {
+	cl_int err;
+	if (inFlight) {
+		err = wait();
+		if (err != CL_SUCCESS) { return err; }
+	}
+	if (!compiled) {
+		err = compile();
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	inFlight = true;
+	for (node_id i : executionOrder) {
+		Node& node = nodes[i];
+		err = enqueueNode(node);
+		if (err != CL_SUCCESS) { return err; }		// NOTE: wait() (or the destructor) cleans up whatever did get enqueued.
+		if (node.queueIndex != NO_QUEUE) { unflushedQueues[node.queueIndex] = true; }
+	}
+
+	// NOTE: Flushing the rest gets the sinks (and the markers that host callbacks hang off of) going, instead of leaving them until wait().
+	for (size_t i = 0; i < queues.size(); i++) {
+		if (!unflushedQueues[i]) { continue; }
+		err = clFlush(queues[i]);
+		if (err != CL_SUCCESS) { return err; }
+		unflushedQueues[i] = false;
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int EventGraph::wait() noexcept {
+	if (!inFlight) { return CL_SUCCESS; }
+
+	// NOTE: Waiting on the sinks would be enough, since every node has a path to one, but if execute() failed halfway,
+	// some sinks might not exist. So we just wait on every event that does exist, which covers every callback that could still fire.
+	// The extra events cost next to nothing, since they've completed by the time the sinks have anyway.
+	pendingEventScratch.clear();
+	for (node_id i : executionOrder) {
+		if (nodes[i].event) { pendingEventScratch.push_back(nodes[i].event); }
+	}
+
+	cl_int err = CL_SUCCESS;
+	if (!pendingEventScratch.empty()) { err = clWaitForEvents((cl_uint)pendingEventScratch.size(), pendingEventScratch.data()); }
+
+	releaseEvents();
+	inFlight = false;
+
+	return err;
+}
+
+void EventGraph::releaseEvents() noexcept {
+	for (Node& node : nodes) {
+		if (node.event) { clReleaseEvent(node.event); node.event = nullptr; }
+	}
+}
+
+EventGraph::~EventGraph() noexcept {
+	wait();			// NOTE: Necessary, outstanding callbacks point into nodes.
+}
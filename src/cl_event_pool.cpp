@@ -0,0 +1,143 @@
+#include "cl_event_pool.h"
+
+#include <new>							// For std::nothrow.
+
+EventPool::EventPool(cl_int& err, size_t capacity) noexcept : capacity(capacity) {
+	slots = new (std::nothrow) Slot[capacity];
+	freeSlots = new (std::nothrow) size_t[capacity];
+	activeSlots = new (std::nothrow) size_t[capacity];
+	waitScratch = new (std::nothrow) cl_event[capacity];
+	if (!slots || !freeSlots || !activeSlots || !waitScratch) {
+		delete[] slots;				// NOTE: Doesn't do anything if the pointers are nullptr, don't worry.
+		delete[] freeSlots;
+		delete[] activeSlots;
+		delete[] waitScratch;
+		slots = nullptr;
+		freeSlots = nullptr;
+		activeSlots = nullptr;
+		waitScratch = nullptr;
+		this->capacity = 0;
+		err = CL_EXT_INSUFFICIENT_HOST_MEM;
+		return;
+	}
+
+	// NOTE: Pushed in reverse so that the first slots get handed out first, which is nicer for debugging and for the cache.
+	for (size_t i = 0; i < capacity; i++) {
+		slots[i].event = nullptr;
+		freeSlots[i] = capacity - 1 - i;
+	}
+	freeSlots_length = capacity;
+
+	err = CL_SUCCESS;
+}
+
+EventPool::EventPool(EventPool&& other) noexcept :
+	slots(other.slots), freeSlots(other.freeSlots), freeSlots_length(other.freeSlots_length),
+	activeSlots(other.activeSlots), activeSlots_length(other.activeSlots_length), waitScratch(other.waitScratch), capacity(other.capacity)
+{
+	other.slots = nullptr;
+	other.freeSlots = nullptr;
+	other.freeSlots_length = 0;
+	other.activeSlots = nullptr;
+	other.activeSlots_length = 0;
+	other.waitScratch = nullptr;
+	other.capacity = 0;
+}
+
+cl_int EventPool::acquire(size_t& slot, EventPoolCompletionCallback callback, void* userData) noexcept {
+	if (freeSlots_length == 0) { return CL_EXT_EVENT_POOL_EXHAUSTED; }
+
+	slot = freeSlots[--freeSlots_length];
+	Slot& newSlot = slots[slot];
+	newSlot.event = nullptr;
+	newSlot.callback = callback;
+	newSlot.userData = userData;
+	newSlot.activeIndex = activeSlots_length;
+	activeSlots[activeSlots_length++] = slot;
+
+	return CL_SUCCESS;
+}
+
+void EventPool::retireActiveSlot(size_t activeIndex, cl_int status) noexcept {
+	size_t slot = activeSlots[activeIndex];
+	Slot& retiredSlot = slots[slot];
+
+	if (retiredSlot.event) { clReleaseEvent(retiredSlot.event); retiredSlot.event = nullptr; }
+
+	// NOTE: Swap-remove, order doesn't matter in the active list.
+	size_t lastSlot = activeSlots[--activeSlots_length];
+	activeSlots[activeIndex] = lastSlot;
+	slots[lastSlot].activeIndex = activeIndex;
+
+	freeSlots[freeSlots_length++] = slot;
+
+	if (retiredSlot.callback) { retiredSlot.callback(slot, status, retiredSlot.userData); }
+}
+
+void EventPool::cancel(size_t slot) noexcept {
+	retireActiveSlot(slots[slot].activeIndex, CL_SUCCESS);
+}
+
+cl_int EventPool::poll(size_t& completedCount) noexcept {
+	completedCount = 0;
+
+	// NOTE: Walking backwards so that the swap-remove in retireActiveSlot() only ever moves slots that we've already looked at.
+	for (size_t i = activeSlots_length; i > 0; i--) {
+		size_t activeIndex = i - 1;
+		cl_event event = slots[activeSlots[activeIndex]].event;
+
+		cl_int status = CL_COMPLETE;
+		if (event) {
+			cl_int err = clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, nullptr);
+			if (err != CL_SUCCESS) { return err; }
+		}
+		if (status > CL_COMPLETE) { continue; }
+
+		retireActiveSlot(activeIndex, status < 0 ? status : CL_SUCCESS);
+		completedCount++;
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int EventPool::waitAll() noexcept {
+	cl_uint waitScratch_length = 0;
+	for (size_t i = 0; i < activeSlots_length; i++) {
+		cl_event event = slots[activeSlots[i]].event;
+		if (event) { waitScratch[waitScratch_length++] = event; }
+	}
+
+	cl_int waitErr = CL_SUCCESS;
+	if (waitScratch_length) { waitErr = clWaitForEvents(waitScratch_length, waitScratch); }
+
+	// NOTE: If one of the commands was terminated, clWaitForEvents returns CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST
+	// without telling us which one, so in that case we ask every event for its status so that the callbacks get the right one.
+	for (size_t i = activeSlots_length; i > 0; i--) {
+		size_t activeIndex = i - 1;
+		cl_int status = CL_SUCCESS;
+		cl_event event = slots[activeSlots[activeIndex]].event;
+		if (waitErr != CL_SUCCESS && event) {
+			cl_int executionStatus;
+			if (clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &executionStatus, nullptr) == CL_SUCCESS) {
+				if (executionStatus > CL_COMPLETE) { continue; }			// NOTE: Still running (wait failed for some other reason), leave it for later.
+				if (executionStatus < 0) { status = executionStatus; }
+			} else { status = waitErr; }
+		}
+		retireActiveSlot(activeIndex, status);
+	}
+
+	return waitErr;
+}
+
+EventPool::~EventPool() noexcept {
+	if (slots) {
+		for (size_t i = 0; i < activeSlots_length; i++) {
+			cl_event event = slots[activeSlots[i]].event;
+			if (event) { clReleaseEvent(event); }
+		}
+	}
+	delete[] waitScratch;
+	delete[] activeSlots;
+	delete[] freeSlots;
+	delete[] slots;
+}
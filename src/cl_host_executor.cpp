@@ -0,0 +1,157 @@
+#include "cl_host_executor.h"
+
+#include <new>							// For std::nothrow and std::align_val_t.
+
+#include <mutex>						// For std::mutex.
+
+#include <thread>						// For std::thread.
+
+#define HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT 64
+// NOTE: Work-group size along dimension 0 that the executor goes for when it gets to pick. Big enough for the inner loop to vectorize well,
+// small enough for a group's local memory to stay in L1.
+#define HOST_EXECUTOR_DEFAULT_WORK_GROUP_SIZE 64
+
+HostExecutor::HostExecutor(cl_int& err, size_t threadCount) noexcept {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) { threadCount = 1; }
+	}
+
+	workers = new (std::nothrow) Worker[threadCount];
+	if (!workers) { err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
+	workers_length = threadCount;
+
+	// NOTE: Worker 0 is the thread that calls execute(), so it doesn't get a thread of its own.
+	for (size_t i = 1; i < workers_length; i++) {
+		workers[i].thread = std::thread(&HostExecutor::workerLoop, this, i);
+	}
+
+	err = CL_SUCCESS;
+}
+
+void HostExecutor::workerLoop(size_t workerIndex) noexcept {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [&] { return shuttingDown || jobGeneration != seenGeneration; });
+			if (shuttingDown) { return; }
+			seenGeneration = jobGeneration;
+		}
+
+		workOnJob(workerIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkerCount == 0) { jobDone.notify_one(); }
+	}
+}
+
+void HostExecutor::workOnJob(size_t workerIndex) noexcept {
+	HostWorkGroup group = jobTemplate;
+	group.local_memory = group.local_memory_size ? workers[workerIndex].localMemory : nullptr;
+
+	// NOTE: Groups get handed out a couple at a time, so that tiny groups don't turn the counter into the bottleneck,
+	// while there are still enough batches per thread to even out groups that take longer than others.
+	size_t batchSize = jobGroupCount / (workers_length * 8);
+	if (batchSize == 0) { batchSize = 1; }
+
+	while (true) {
+		size_t batchBegin = nextGroup.fetch_add(batchSize, std::memory_order_relaxed);
+		if (batchBegin >= jobGroupCount) { return; }
+		size_t batchEnd = batchBegin + batchSize < jobGroupCount ? batchBegin + batchSize : jobGroupCount;
+		for (size_t i = batchBegin; i < batchEnd; i++) {
+			group.group_id[0] = i % group.num_groups[0];
+			group.group_id[1] = (i / group.num_groups[0]) % group.num_groups[1];
+			group.group_id[2] = i / (group.num_groups[0] * group.num_groups[1]);
+			jobFunction(group, jobUserData);
+		}
+	}
+}
+
+cl_int HostExecutor::reserveLocalMemory(size_t size) noexcept {
+	if (size == 0) { return CL_SUCCESS; }
+	for (size_t i = 0; i < workers_length; i++) {
+		Worker& worker = workers[i];
+		if (worker.localMemoryCapacity >= size) { continue; }
+		unsigned char* newLocalMemory = new (std::align_val_t(HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT), std::nothrow) unsigned char[size];
+		if (!newLocalMemory) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+		if (worker.localMemory) { ::operator delete[](worker.localMemory, std::align_val_t(HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT)); }
+		worker.localMemory = newLocalMemory;
+		worker.localMemoryCapacity = size;
+	}
+	return CL_SUCCESS;
+}
+
+cl_int HostExecutor::execute(const NDRange& globalSize, const NDRange& localSize, size_t localMemorySize, HostWorkGroupFunction function, void* userData) noexcept {
+	if (workers_length == 0) { return CL_INVALID_COMMAND_QUEUE; }
+	cl_uint dimensions = globalSize.dimensions;
+	if (dimensions < 1 || dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+	for (cl_uint i = 0; i < dimensions; i++) {
+		if (globalSize.sizes[i] == 0) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+	}
+
+	HostWorkGroup& group = jobTemplate;
+	group.dimensions = dimensions;
+	for (cl_uint i = 0; i < 3; i++) {
+		group.global_size[i] = i < dimensions ? globalSize.sizes[i] : 1;
+		group.local_size[i] = 1;
+	}
+
+	if (localSize.dimensions == 0) {
+		// NOTE: Only dimension 0 gets more than one work item, since that's the one the inner loop runs along.
+		for (size_t i = HOST_EXECUTOR_DEFAULT_WORK_GROUP_SIZE; i > 1; i--) {
+			if (group.global_size[0] % i == 0) { group.local_size[0] = i; break; }
+		}
+	} else {
+		if (localSize.dimensions != dimensions) { return CL_INVALID_WORK_GROUP_SIZE; }
+		for (cl_uint i = 0; i < dimensions; i++) {
+			if (localSize.sizes[i] == 0 || group.global_size[i] % localSize.sizes[i] != 0) { return CL_INVALID_WORK_GROUP_SIZE; }
+			group.local_size[i] = localSize.sizes[i];
+		}
+	}
+
+	for (cl_uint i = 0; i < 3; i++) { group.num_groups[i] = group.global_size[i] / group.local_size[i]; }
+
+	// NOTE: Rounded up to the alignment, so that a kernel can pad its local arrays to it without running off the end.
+	localMemorySize = (localMemorySize + HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT - 1) / HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT * HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT;
+	cl_int err = reserveLocalMemory(localMemorySize);
+	if (err != CL_SUCCESS) { return err; }
+	group.local_memory_size = localMemorySize;
+
+	jobFunction = function;
+	jobUserData = userData;
+	jobGroupCount = group.num_groups[0] * group.num_groups[1] * group.num_groups[2];
+	nextGroup.store(0, std::memory_order_relaxed);
+
+	if (workers_length > 1) {
+		std::lock_guard<std::mutex> lock(mutex);
+		busyWorkerCount = workers_length - 1;
+		jobGeneration++;
+		jobAvailable.notify_all();
+	}
+
+	workOnJob(0);
+
+	if (workers_length > 1) {
+		std::unique_lock<std::mutex> lock(mutex);
+		jobDone.wait(lock, [&] { return busyWorkerCount == 0; });
+	}
+
+	return CL_SUCCESS;
+}
+
+HostExecutor::~HostExecutor() noexcept {
+	if (!workers) { return; }
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shuttingDown = true;
+		jobAvailable.notify_all();
+	}
+
+	for (size_t i = 0; i < workers_length; i++) {
+		if (workers[i].thread.joinable()) { workers[i].thread.join(); }
+		if (workers[i].localMemory) { ::operator delete[](workers[i].localMemory, std::align_val_t(HOST_EXECUTOR_LOCAL_MEMORY_ALIGNMENT)); }
+	}
+	delete[] workers;
+}
@@ -0,0 +1,199 @@
+#include "cl_instrumentation.h"
+
+#include <cstdint>						// For fixed-width types.
+
+#include <atomic>						// For std::atomic.
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+#include <tuple>						// For std::tuple and std::apply.
+
+#include <type_traits>					// For std::is_same.
+
+#include <vector>						// For std::vector.
+
+// NOTE: Every error code (standard and CL_EXT) fits into this range with lots of room to spare. Anything outside of it goes into the last slot.
+#define ERROR_CODE_SLOT_OFFSET 128
+#define ERROR_CODE_SLOT_COUNT 257
+
+struct FunctionStatsStorage {
+	std::atomic<uint64_t> callCount { 0 };
+	std::atomic<uint64_t> errorCount { 0 };
+	std::atomic<uint64_t> bytesTransferred { 0 };
+	std::atomic<uint64_t> latencySum { 0 };
+	std::atomic<uint64_t> latencyMax { 0 };
+	std::atomic<uint64_t> errorCounts[ERROR_CODE_SLOT_COUNT + 1] { };
+	std::atomic<uint64_t> latencyCounts[LatencyHistogram::bucket_count] { };
+
+	void record(uint64_t latency, cl_int err, uint64_t bytes) noexcept {
+		callCount.fetch_add(1, std::memory_order_relaxed);
+		latencySum.fetch_add(latency, std::memory_order_relaxed);
+		latencyCounts[LatencyHistogram::get_bucket_index(latency)].fetch_add(1, std::memory_order_relaxed);
+		uint64_t previousMax = latencyMax.load(std::memory_order_relaxed);
+		while (latency > previousMax && !latencyMax.compare_exchange_weak(previousMax, latency, std::memory_order_relaxed)) { }
+		if (bytes) { bytesTransferred.fetch_add(bytes, std::memory_order_relaxed); }
+		if (err != CL_SUCCESS) {
+			errorCount.fetch_add(1, std::memory_order_relaxed);
+			int64_t slot = (int64_t)err + ERROR_CODE_SLOT_OFFSET;
+			if (slot < 0 || slot >= ERROR_CODE_SLOT_COUNT) { slot = ERROR_CODE_SLOT_COUNT; }
+			errorCounts[slot].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void reset() noexcept {
+		callCount.store(0, std::memory_order_relaxed);
+		errorCount.store(0, std::memory_order_relaxed);
+		bytesTransferred.store(0, std::memory_order_relaxed);
+		latencySum.store(0, std::memory_order_relaxed);
+		latencyMax.store(0, std::memory_order_relaxed);
+		for (std::atomic<uint64_t>& count : errorCounts) { count.store(0, std::memory_order_relaxed); }
+		for (std::atomic<uint64_t>& count : latencyCounts) { count.store(0, std::memory_order_relaxed); }
+	}
+};
+
+static std::atomic<bool> instrumentationEnabled { false };
+
+static uint64_t getInstrumentationTimestamp() noexcept {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#define DEFINE_INSTRUMENTATION_TAG(func) struct func##_instrumentation_tag { static constexpr const char* name = #func; static inline func##_func original; static inline FunctionStatsStorage stats; };
+CL_EXT_FOR_EACH_BOUND_FUNCTION(DEFINE_INSTRUMENTATION_TAG)
+
+// Works out how many bytes a call moves. Only the transfer functions have specializations, everything else moves nothing.
+template <typename tag_t>
+struct TransferredBytes {
+	template <typename... args_t>
+	static uint64_t get(const args_t&...) noexcept { return 0; }
+};
+
+template <>
+struct TransferredBytes<clEnqueueWriteBuffer_instrumentation_tag> {
+	static uint64_t get(cl_command_queue, cl_mem, cl_bool, size_t, size_t size, const void*, cl_uint, const cl_event*, cl_event*) noexcept { return size; }
+};
+
+template <>
+struct TransferredBytes<clEnqueueReadBuffer_instrumentation_tag> {
+	static uint64_t get(cl_command_queue, cl_mem, cl_bool, size_t, size_t size, void*, cl_uint, const cl_event*, cl_event*) noexcept { return size; }
+};
+
+template <>
+struct TransferredBytes<clEnqueueCopyBuffer_instrumentation_tag> {
+	static uint64_t get(cl_command_queue, cl_mem, cl_mem, size_t, size_t, size_t size, cl_uint, const cl_event*, cl_event*) noexcept { return size; }
+};
+
+static uint64_t getImageRegionBytes(cl_mem image, const size_t* region) noexcept {
+	// NOTE: We go straight to the function below our wrapper, so that this lookup doesn't show up in the statistics.
+	clGetImageInfo_func getImageInfo = clGetImageInfo_instrumentation_tag::original ? clGetImageInfo_instrumentation_tag::original : clGetImageInfo;
+	size_t elementSize;
+	if (!getImageInfo || getImageInfo(image, CL_IMAGE_ELEMENT_SIZE, sizeof(size_t), &elementSize, nullptr) != CL_SUCCESS) { return 0; }
+	return (uint64_t)elementSize * region[0] * region[1] * region[2];
+}
+
+template <>
+struct TransferredBytes<clEnqueueWriteImage_instrumentation_tag> {
+	static uint64_t get(cl_command_queue, cl_mem image, cl_bool, const size_t*, const size_t* region, size_t, size_t, const void*, cl_uint, const cl_event*, cl_event*) noexcept {
+		return getImageRegionBytes(image, region);
+	}
+};
+
+template <>
+struct TransferredBytes<clEnqueueReadImage_instrumentation_tag> {
+	static uint64_t get(cl_command_queue, cl_mem image, cl_bool, const size_t*, const size_t* region, size_t, size_t, void*, cl_uint, const cl_event*, cl_event*) noexcept {
+		return getImageRegionBytes(image, region);
+	}
+};
+
+template <typename tag_t, typename func_t>
+struct InstrumentedFunction;
+
+template <typename tag_t, typename return_t, typename... args_t>
+struct InstrumentedFunction<tag_t, return_t (CL_API_CALL*)(args_t...)> {
+	static return_t CL_API_CALL call(args_t... args) {
+		uint64_t start = getInstrumentationTimestamp();
+
+		if constexpr (std::is_same<return_t, cl_int>::value) {
+			cl_int result = tag_t::original(args...);
+			uint64_t latency = getInstrumentationTimestamp() - start;
+			tag_t::stats.record(latency, result, result == CL_SUCCESS ? TransferredBytes<tag_t>::get(args...) : 0);
+			return result;
+		} else if constexpr (std::is_same<return_t, void*>::value && !std::is_same<typename std::tuple_element<sizeof...(args_t) - 1, std::tuple<args_t...>>::type, cl_int*>::value) {
+			// NOTE: Address lookups (clGetExtensionFunctionAddressForPlatform) don't have an error code, a missing function is just nullptr,
+			// which isn't an error as far as the stats are concerned.
+			void* result = tag_t::original(args...);
+			tag_t::stats.record(getInstrumentationTimestamp() - start, CL_SUCCESS, 0);
+			return result;
+		} else {
+			// NOTE: Everything else returns a handle (or a mapped pointer) and reports errors through errcode_ret, which is always
+			// the last param. If the caller passed nullptr, we substitute our own so that we still get to see the error.
+			std::tuple<args_t...> argTuple(args...);
+			auto& errcode_ret = std::get<sizeof...(args_t) - 1>(argTuple);
+			static_assert(std::is_same<typename std::remove_reference<decltype(errcode_ret)>::type, cl_int*>::value, "InstrumentedFunction failed: last param of handle-returning function must be errcode_ret");
+			cl_int localErr;
+			if (!errcode_ret) { errcode_ret = &localErr; }
+
+			return_t result = std::apply(tag_t::original, argTuple);
+			uint64_t latency = getInstrumentationTimestamp() - start;
+			tag_t::stats.record(latency, *errcode_ret, 0);
+			return result;
+		}
+	}
+};
+
+#define INSTALL_INSTRUMENTATION_WRAPPER(func) if (func) { func##_instrumentation_tag::original = func; func = &InstrumentedFunction<func##_instrumentation_tag, func##_func>::call; }
+#define REMOVE_INSTRUMENTATION_WRAPPER(func) if (func == &InstrumentedFunction<func##_instrumentation_tag, func##_func>::call) { func = func##_instrumentation_tag::original; }
+
+cl_int enableOpenCLInstrumentation() noexcept {
+	if (instrumentationEnabled.load(std::memory_order_relaxed)) { return CL_SUCCESS; }
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(INSTALL_INSTRUMENTATION_WRAPPER)
+	instrumentationEnabled.store(true, std::memory_order_release);
+	return CL_SUCCESS;
+}
+
+void disableOpenCLInstrumentation() noexcept {
+	if (!instrumentationEnabled.load(std::memory_order_relaxed)) { return; }
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(REMOVE_INSTRUMENTATION_WRAPPER)
+	instrumentationEnabled.store(false, std::memory_order_release);
+}
+
+bool isOpenCLInstrumentationEnabled() noexcept { return instrumentationEnabled.load(std::memory_order_acquire); }
+
+static void appendFunctionStats(std::vector<OpenCLFunctionStats>& result, const char* name, const FunctionStatsStorage& storage) noexcept {
+	uint64_t callCount = storage.callCount.load(std::memory_order_relaxed);
+	if (callCount == 0) { return; }
+
+	OpenCLFunctionStats stats;
+	stats.name = name;
+	stats.call_count = callCount;
+	stats.error_count = storage.errorCount.load(std::memory_order_relaxed);
+	stats.bytes_transferred = storage.bytesTransferred.load(std::memory_order_relaxed);
+	for (size_t i = 0; i <= ERROR_CODE_SLOT_COUNT; i++) {
+		uint64_t count = storage.errorCounts[i].load(std::memory_order_relaxed);
+		if (count == 0) { continue; }
+		// NOTE: Codes that didn't fit into the slots are reported under INT32_MIN, since we don't know what they were anymore.
+		cl_int code = i == ERROR_CODE_SLOT_COUNT ? INT32_MIN : (cl_int)((int64_t)i - ERROR_CODE_SLOT_OFFSET);
+		stats.errors_by_code.push_back(std::make_pair(code, count));
+	}
+	for (size_t i = 0; i < LatencyHistogram::bucket_count; i++) {
+		uint64_t count = storage.latencyCounts[i].load(std::memory_order_relaxed);
+		stats.latency.counts[i] = count;
+		stats.latency.total_count += count;
+	}
+	stats.latency.sum = storage.latencySum.load(std::memory_order_relaxed);
+	stats.latency.max_value = storage.latencyMax.load(std::memory_order_relaxed);
+
+	result.push_back(std::move(stats));
+}
+
+#define APPEND_FUNCTION_STATS(func) appendFunctionStats(result, func##_instrumentation_tag::name, func##_instrumentation_tag::stats);
+#define RESET_FUNCTION_STATS(func) func##_instrumentation_tag::stats.reset();
+
+std::vector<OpenCLFunctionStats> getOpenCLInstrumentationStats() noexcept {
+	std::vector<OpenCLFunctionStats> result;
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(APPEND_FUNCTION_STATS)
+	return result;
+}
+
+void resetOpenCLInstrumentationStats() noexcept {
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(RESET_FUNCTION_STATS)
+}
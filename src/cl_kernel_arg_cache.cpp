@@ -0,0 +1,65 @@
+#include "cl_kernel_arg_cache.h"
+
+#include <new>							// For std::nothrow.
+
+#include <cstring>						// For std::memcmp and std::memcpy.
+
+#include <thread>						// For std::this_thread::get_id().
+
+KernelArgCache::KernelArgCache(cl_int& err, cl_kernel kernel) noexcept : kernel(kernel) {
+	err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &arg_count, nullptr);
+	if (err != CL_SUCCESS) { arg_count = 0; return; }
+
+	if (arg_count) {
+		args = new (std::nothrow) ShadowedArg[arg_count];
+		if (!args) { arg_count = 0; err = CL_EXT_INSUFFICIENT_HOST_MEM; return; }
+		invalidate();
+	}
+
+	err = CL_SUCCESS;
+}
+
+KernelArgCache::KernelArgCache(KernelArgCache&& other) noexcept : args(other.args), owner(other.owner), kernel(other.kernel), arg_count(other.arg_count),
+																	set_count(other.set_count), skip_count(other.skip_count) {
+	other.args = nullptr;
+	other.arg_count = 0;
+}
+
+cl_int KernelArgCache::set(cl_uint index, size_t size, const void* value) noexcept {
+	std::thread::id currentThread = std::this_thread::get_id();
+	if (owner == std::thread::id()) { owner = currentThread; }
+	else if (owner != currentThread) { return CL_EXT_KERNEL_WRONG_THREAD; }
+
+	// NOTE: Out of range indices go straight through, so that the implementation reports CL_INVALID_ARG_INDEX like it normally would.
+	if (index >= arg_count) { return clSetKernelArg(kernel, index, size, value); }
+	ShadowedArg& arg = args[index];
+
+	if (arg.isSet && arg.size == size) {
+		if (!value) {
+			if (arg.isLocal) { skip_count++; return CL_SUCCESS; }
+		} else if (!arg.isLocal && size <= KERNEL_ARG_CACHE_MAX_SHADOWED_SIZE && std::memcmp(arg.bytes, value, size) == 0) {
+			skip_count++;
+			return CL_SUCCESS;
+		}
+	}
+
+	cl_int err = clSetKernelArg(kernel, index, size, value);
+	set_count++;
+	if (err != CL_SUCCESS) {
+		// NOTE: We don't know what state the argument is in now, so the next set() has to go through no matter what.
+		arg.isSet = false;
+		return err;
+	}
+
+	arg.size = size;
+	arg.isLocal = !value;
+	arg.isSet = arg.isLocal || size <= KERNEL_ARG_CACHE_MAX_SHADOWED_SIZE;
+	if (value && arg.isSet) { std::memcpy(arg.bytes, value, size); }
+	return CL_SUCCESS;
+}
+
+void KernelArgCache::invalidate() noexcept {
+	for (cl_uint i = 0; i < arg_count; i++) { args[i].isSet = false; }
+}
+
+KernelArgCache::~KernelArgCache() noexcept { delete[] args; }
@@ -0,0 +1,470 @@
+#include "cl_kernel_modules.h"
+
+#include <cstdint>						// For fixed-width types.
+
+#include <cstring>						// For std::strncmp, std::strlen and std::memcmp.
+
+#include <string>						// For std::string and std::to_string.
+
+#include <vector>						// For std::vector.
+
+#include <filesystem>					// For std::filesystem.
+
+#include <fstream>						// For std::ifstream and std::ofstream.
+
+#include <iterator>						// For std::istreambuf_iterator.
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hashBytes(uint64_t hash, const char* bytes, size_t length) noexcept {
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static uint64_t hashValue(uint64_t hash, uint64_t value) noexcept {
+	for (int i = 0; i < 8; i++) {
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// NOTE: Binary cache files are the magic, the key, the size of the binary and then the binary itself.
+#define BINARY_CACHE_MAGIC "CLBINV01"
+#define BINARY_CACHE_MAGIC_LENGTH 8
+
+static cl_int getDeviceInfoString(cl_device_id device, cl_device_info param, std::string& value) noexcept {
+	size_t size;
+	cl_int err = clGetDeviceInfo(device, param, 0, nullptr, &size);
+	if (err != CL_SUCCESS) { return err; }
+	value.resize(size);
+	return clGetDeviceInfo(device, param, size, value.data(), nullptr);
+}
+
+static bool isHorizontalSpace(char character) noexcept { return character == ' ' || character == '\t'; }
+
+// Finds the #include and #pragma once directives of a file. Block comments get tracked across lines, so commented-out includes don't count.
+// NOTE: Only the start of a line can hold a directive, so strings and line comments only matter for finding where block comments start.
+void KernelModuleLoader::parseDirectives(const std::string& content, std::vector<IncludeDirective>& directives, bool& pragmaOnce) {
+	directives.clear();
+	pragmaOnce = false;
+
+	bool inBlockComment = false;
+	size_t lineBegin = 0;
+	for (size_t lineNumber = 1; lineBegin <= content.size(); lineNumber++) {
+		size_t lineEnd = content.find('\n', lineBegin);
+		if (lineEnd == std::string::npos) { lineEnd = content.size(); }
+
+		if (!inBlockComment) {
+			size_t i = lineBegin;
+			while (i < lineEnd && isHorizontalSpace(content[i])) { i++; }
+			if (i < lineEnd && content[i] == '#') {
+				i++;
+				while (i < lineEnd && isHorizontalSpace(content[i])) { i++; }
+				const char* directive = content.c_str() + i;
+				if (lineEnd - i >= 7 && std::strncmp(directive, "include", 7) == 0) {
+					i += 7;
+					while (i < lineEnd && isHorizontalSpace(content[i])) { i++; }
+					// NOTE: Anything other than "name" or <name> is a macro, which is left for the compiler.
+					if (i < lineEnd && (content[i] == '"' || content[i] == '<')) {
+						char terminator = content[i] == '"' ? '"' : '>';
+						size_t nameEnd = content.find(terminator, i + 1);
+						if (nameEnd != std::string::npos && nameEnd < lineEnd) {
+							directives.push_back({ lineBegin, lineEnd, lineNumber, false, terminator == '"', content.substr(i + 1, nameEnd - i - 1) });
+						}
+					}
+				} else if (lineEnd - i >= 6 && std::strncmp(directive, "pragma", 6) == 0) {
+					i += 6;
+					while (i < lineEnd && isHorizontalSpace(content[i])) { i++; }
+					if (lineEnd - i >= 4 && std::strncmp(content.c_str() + i, "once", 4) == 0) {
+						directives.push_back({ lineBegin, lineEnd, lineNumber, true, false, std::string() });
+						pragmaOnce = true;
+					}
+				}
+			}
+		}
+
+		for (size_t i = lineBegin; i < lineEnd; i++) {
+			if (inBlockComment) {
+				if (content[i] == '*' && i + 1 < lineEnd && content[i + 1] == '/') { inBlockComment = false; i++; }
+				continue;
+			}
+			if (content[i] == '/' && i + 1 < lineEnd && content[i + 1] == '/') { break; }
+			if (content[i] == '/' && i + 1 < lineEnd && content[i + 1] == '*') { inBlockComment = true; i++; continue; }
+			if (content[i] == '"' || content[i] == '\'') {
+				char quote = content[i];
+				for (i++; i < lineEnd && content[i] != quote; i++) {
+					if (content[i] == '\\') { i++; }
+				}
+			}
+		}
+
+		lineBegin = lineEnd + 1;
+	}
+}
+
+// #line "file" string for a path. Backslashes would be escape sequences, so the generic format with forward slashes gets used.
+static std::string getLineDirectiveFileName(const std::string& path) {
+	std::string genericPath = std::filesystem::path(path).generic_string();
+	std::string result;
+	result.reserve(genericPath.size() + 2);
+	result += '"';
+	for (char character : genericPath) {
+		if (character == '"' || character == '\\') { result += '\\'; }
+		result += character;
+	}
+	result += '"';
+	return result;
+}
+
+bool KernelModuleLoader::ProgramKey::operator<(const ProgramKey& right) const noexcept {
+	if (root_path != right.root_path) { return root_path < right.root_path; }
+	if (context != right.context) { return std::less<cl_context>()(context, right.context); }
+	if (device != right.device) { return std::less<cl_device_id>()(device, right.device); }
+	return build_options < right.build_options;
+}
+
+cl_int KernelModuleLoader::addIncludeDirectory(const char* directory) noexcept {
+	if (!directory) { return CL_INVALID_VALUE; }
+	includeDirectories.push_back(directory);
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::setBinaryCacheDirectory(const char* directory) noexcept {
+	if (!directory) { binaryCacheDirectory.clear(); return CL_SUCCESS; }
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error || !std::filesystem::is_directory(directory, error)) { return CL_EXT_FILE_OPEN_FAILED; }
+	binaryCacheDirectory = directory;
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::resolveInclude(const std::string& includingFile, const std::string& name, bool quoted, std::string& path) const noexcept {
+	std::error_code error;
+	auto tryCandidate = [&](const std::filesystem::path& candidate) {
+		if (!std::filesystem::is_regular_file(candidate, error)) { return false; }
+		// NOTE: Canonical paths, so that the same file reached through different relative paths is one node in the graph.
+		std::filesystem::path canonicalPath = std::filesystem::canonical(candidate, error);
+		if (error) { return false; }
+		path = canonicalPath.string();
+		return true;
+	};
+
+	if (quoted && tryCandidate(std::filesystem::path(includingFile).parent_path() / name)) { return CL_SUCCESS; }
+	for (const std::string& directory : includeDirectories) {
+		if (tryCandidate(std::filesystem::path(directory) / name)) { return CL_SUCCESS; }
+	}
+	return CL_EXT_FILE_OPEN_FAILED;
+}
+
+cl_int KernelModuleLoader::refreshFile(const std::string& path, std::string& log) noexcept {
+	SourceFile& file = files[path];
+	if (file.checked_generation == generation) { return CL_SUCCESS; }
+
+	std::error_code error;
+	uintmax_t size = std::filesystem::file_size(path, error);
+	std::filesystem::file_time_type writeTime;
+	if (!error) { writeTime = std::filesystem::last_write_time(path, error); }
+	if (error) {
+		files.erase(path);
+		log = "can't open " + path;
+		return CL_EXT_FILE_OPEN_FAILED;
+	}
+
+	if (file.checked_generation && size == file.size && writeTime == file.write_time) {
+		file.checked_generation = generation;
+		return CL_SUCCESS;
+	}
+
+	std::ifstream sourceFile(path);
+	if (!sourceFile.is_open()) {
+		files.erase(path);
+		log = "can't open " + path;
+		return CL_EXT_FILE_OPEN_FAILED;
+	}
+	file.content.assign(std::istreambuf_iterator<char>(sourceFile), std::istreambuf_iterator<char>());
+	file_read_count++;
+
+	// NOTE: If the content didn't actually change, neither does the hash, so nothing that depends on the file gets rebuilt.
+	file.content_hash = hashBytes(FNV_OFFSET_BASIS, file.content.c_str(), file.content.size());
+	parseDirectives(file.content, file.directives, file.pragma_once);
+	file.size = size;
+	file.write_time = writeTime;
+	file.checked_generation = generation;
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::walk(const std::string& path, std::vector<std::string>& stack, std::vector<std::string>& included, uint64_t& hash,
+								std::string* source, std::string& log) noexcept {
+	bool alreadyIncluded = false;
+	for (const std::string& includedPath : included) {
+		if (includedPath == path) { alreadyIncluded = true; break; }
+	}
+	// NOTE: #pragma once comes before the cycle check, like in a real preprocessor, so that two files with #pragma once can include each
+	// other. Included files (everything on the stack too) have already been refreshed in this walk, so their entry is up to date.
+	if (alreadyIncluded && files.find(path)->second.pragma_once) { return CL_SUCCESS; }
+
+	for (size_t i = 0; i < stack.size(); i++) {
+		if (stack[i] != path) { continue; }
+		log = "include cycle: ";
+		for (; i < stack.size(); i++) { log += stack[i] + " -> "; }
+		log += path;
+		return CL_EXT_KERNEL_INCLUDE_CYCLE;
+	}
+
+	cl_int err = refreshFile(path, log);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: The file can't change until the walk is over (it only gets refreshed once per generation), so the reference stays valid
+	// even though the recursion adds entries to the map.
+	const SourceFile& file = files.find(path)->second;
+	if (!alreadyIncluded) { included.push_back(path); }
+
+	// NOTE: The path goes into the hash too, since the same content in a different file still means a different graph.
+	hash = hashBytes(hash, path.c_str(), path.size());
+	hash = hashValue(hash, file.content_hash);
+
+	std::string lineDirectiveFileName;
+	if (source) {
+		lineDirectiveFileName = getLineDirectiveFileName(path);
+		*source += "#line 1 " + lineDirectiveFileName + "\n";
+	}
+
+	stack.push_back(path);
+	size_t position = 0;
+	for (const IncludeDirective& directive : file.directives) {
+		// NOTE: The directive line gets cut out, its newline stays, so the line numbers of the rest of the file don't move.
+		if (source) { source->append(file.content, position, directive.line_begin - position); }
+		position = directive.line_end;
+		if (directive.is_pragma_once) { continue; }
+
+		std::string includedPath;
+		err = resolveInclude(path, directive.name, directive.quoted, includedPath);
+		if (err != CL_SUCCESS) {
+			log = path + ":" + std::to_string(directive.line_number) + ": can't find include " + (directive.quoted ? "\"" : "<") + directive.name + (directive.quoted ? "\"" : ">");
+			stack.pop_back();
+			return err;
+		}
+
+		err = walk(includedPath, stack, included, hash, source, log);
+		if (err != CL_SUCCESS) { stack.pop_back(); return err; }
+
+		if (source) {
+			if (!source->empty() && source->back() != '\n') { *source += '\n'; }
+			// NOTE: No newline, that comes from the directive line that got cut out. The line after it is directive.line_number + 1.
+			*source += "#line " + std::to_string(directive.line_number + 1) + " " + lineDirectiveFileName;
+		}
+	}
+	stack.pop_back();
+
+	if (source) {
+		source->append(file.content, position, std::string::npos);
+		if (!source->empty() && source->back() != '\n') { *source += '\n'; }
+	}
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::walkRoot(const char* rootFile, std::string& rootPath, uint64_t& hash, std::string* source, std::vector<std::string>* dependencies,
+									std::string& log) noexcept {
+	if (!rootFile) { return CL_INVALID_VALUE; }
+	generation++;
+
+	std::error_code error;
+	std::filesystem::path canonicalPath = std::filesystem::canonical(rootFile, error);
+	if (error) {
+		log = std::string("can't open ") + rootFile;
+		return CL_EXT_FILE_OPEN_FAILED;
+	}
+	rootPath = canonicalPath.string();
+
+	std::vector<std::string> stack;
+	std::vector<std::string> included;
+	hash = FNV_OFFSET_BASIS;
+	if (source) { source->clear(); }
+	cl_int err = walk(rootPath, stack, included, hash, source, log);
+	if (err != CL_SUCCESS) { return err; }
+
+	if (dependencies) { *dependencies = std::move(included); }
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::getBinaryKey(cl_device_id device, uint64_t sourceHash, const char* buildOptions, uint64_t& key) const noexcept {
+	std::string deviceName;
+	cl_int err = getDeviceInfoString(device, CL_DEVICE_NAME, deviceName);
+	if (err != CL_SUCCESS) { return err; }
+	std::string driverVersion;
+	err = getDeviceInfoString(device, CL_DRIVER_VERSION, driverVersion);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: The info strings come with their null terminators, which keeps the fields apart in the hash.
+	key = hashValue(FNV_OFFSET_BASIS, sourceHash);
+	key = hashBytes(key, deviceName.data(), deviceName.size());
+	key = hashBytes(key, driverVersion.data(), driverVersion.size());
+	if (buildOptions) { key = hashBytes(key, buildOptions, std::strlen(buildOptions)); }
+	return CL_SUCCESS;
+}
+
+std::string KernelModuleLoader::getBinaryPath(uint64_t key) const {
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string name(16, '0');
+	for (int i = 0; i < 16; i++) { name[15 - i] = hexDigits[(key >> (i * 4)) & 0xF]; }
+	return (std::filesystem::path(binaryCacheDirectory) / (name + ".bin")).string();
+}
+
+bool KernelModuleLoader::loadBinary(cl_context context, cl_device_id device, uint64_t key, const char* buildOptions, OpenCLProgram& program) noexcept {
+	std::ifstream file(getBinaryPath(key), std::ios::binary);
+	if (!file) { return false; }
+
+	char magic[BINARY_CACHE_MAGIC_LENGTH];
+	uint64_t fileKey;
+	uint64_t binarySize;
+	file.read(magic, BINARY_CACHE_MAGIC_LENGTH);
+	file.read((char*)&fileKey, sizeof(fileKey));
+	file.read((char*)&binarySize, sizeof(binarySize));
+	// NOTE: The key check catches hash collisions in the file name, the size check truncated files (a process that died while writing).
+	if (!file || std::memcmp(magic, BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC_LENGTH) != 0 || fileKey != key || binarySize == 0) {
+		binary_reject_count++;
+		return false;
+	}
+	std::vector<unsigned char> binary((size_t)binarySize);
+	file.read((char*)binary.data(), (std::streamsize)binary.size());
+	if (!file || file.peek() != std::ifstream::traits_type::eof()) { binary_reject_count++; return false; }
+
+	const unsigned char* binaryData = binary.data();
+	size_t binaryLength = binary.size();
+	cl_int binaryStatus;
+	cl_int err;
+	OpenCLProgram newProgram(clCreateProgramWithBinary(context, 1, &device, &binaryLength, &binaryData, &binaryStatus, &err));
+	if (!newProgram) { binary_reject_count++; return false; }
+	// NOTE: Binaries still need a build, which is quick for device binaries, but it can fail too, for example for an intermediate
+	// representation that the driver doesn't take anymore.
+	if (clBuildProgram(newProgram, 1, &device, buildOptions, nullptr, nullptr) != CL_SUCCESS) { binary_reject_count++; return false; }
+
+	program = std::move(newProgram);
+	binary_load_count++;
+	return true;
+}
+
+void KernelModuleLoader::saveBinary(cl_device_id device, cl_program program, uint64_t key) noexcept {
+	// NOTE: Programs that were built from source are built for every device of the context, so first find the binary of the device.
+	cl_uint deviceCount;
+	if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(deviceCount), &deviceCount, nullptr) != CL_SUCCESS || deviceCount == 0) { return; }
+	std::vector<cl_device_id> devices(deviceCount);
+	if (clGetProgramInfo(program, CL_PROGRAM_DEVICES, deviceCount * sizeof(cl_device_id), devices.data(), nullptr) != CL_SUCCESS) { return; }
+	size_t deviceIndex = 0;
+	while (deviceIndex < deviceCount && devices[deviceIndex] != device) { deviceIndex++; }
+	if (deviceIndex == deviceCount) { return; }
+
+	std::vector<size_t> binarySizes(deviceCount);
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, deviceCount * sizeof(size_t), binarySizes.data(), nullptr) != CL_SUCCESS) { return; }
+	if (binarySizes[deviceIndex] == 0) { return; }
+	std::vector<unsigned char> binary(binarySizes[deviceIndex]);
+	// NOTE: Only the device's entry points anywhere, the implementation skips the nullptr ones.
+	std::vector<unsigned char*> binaries(deviceCount, nullptr);
+	binaries[deviceIndex] = binary.data();
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, deviceCount * sizeof(unsigned char*), binaries.data(), nullptr) != CL_SUCCESS) { return; }
+
+	// NOTE: Written under a temporary name and renamed into place, so that other processes never see half a file.
+	std::string path = getBinaryPath(key);
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file) { return; }
+		uint64_t binarySize = binary.size();
+		file.write(BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC_LENGTH);
+		file.write((const char*)&key, sizeof(key));
+		file.write((const char*)&binarySize, sizeof(binarySize));
+		file.write((const char*)binary.data(), (std::streamsize)binary.size());
+		if (!file) { file.close(); std::error_code error; std::filesystem::remove(temporaryPath, error); return; }
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) { std::filesystem::remove(temporaryPath, error); return; }
+	binary_save_count++;
+}
+
+cl_int KernelModuleLoader::getProgram(cl_context context, cl_device_id device, const char* rootFile, OpenCLProgram& program, std::string& buildLog,
+									  const char* buildOptions) noexcept {
+	std::string rootPath;
+	uint64_t hash;
+	cl_int err = walkRoot(rootFile, rootPath, hash, nullptr, nullptr, buildLog);
+	if (err != CL_SUCCESS) { return err; }
+
+	ProgramKey key { rootPath, context, device, buildOptions ? buildOptions : "" };
+	auto entry = programs.find(key);
+	if (entry != programs.end() && entry->second.source_hash == hash) {
+		OpenCLProgram sharedProgram = entry->second.program.share(err);
+		if (err != CL_SUCCESS) { return err; }
+		program = std::move(sharedProgram);
+		reuse_count++;
+		return CL_SUCCESS;
+	}
+
+	// NOTE: Devices that can't report their name or driver version just don't get the binary cache.
+	uint64_t binaryKey = 0;
+	bool useBinaryCache = !binaryCacheDirectory.empty() && getBinaryKey(device, hash, buildOptions, binaryKey) == CL_SUCCESS;
+
+	OpenCLProgram newProgram;
+	if (!useBinaryCache || !loadBinary(context, device, binaryKey, buildOptions, newProgram)) {
+		// NOTE: Flattening walks the files again, which is cheap next to the build. The hash of that walk is the one that gets stored,
+		// in case a file changed in between.
+		std::string source;
+		err = walkRoot(rootFile, rootPath, hash, &source, nullptr, buildLog);
+		if (err != CL_SUCCESS) { return err; }
+
+		err = buildProgramFromString(context, device, source.c_str(), newProgram, buildLog, buildOptions);
+		if (err != CL_SUCCESS) {
+			// NOTE: The old program is out of date either way, so there's no point in keeping it around.
+			if (entry != programs.end()) { programs.erase(entry); }
+			return err;
+		}
+		build_count++;
+
+		if (useBinaryCache && getBinaryKey(device, hash, buildOptions, binaryKey) == CL_SUCCESS) { saveBinary(device, newProgram, binaryKey); }
+	}
+
+	OpenCLProgram sharedProgram = newProgram.share(err);
+	if (err != CL_SUCCESS) { return err; }
+
+	CachedProgram& cachedProgram = programs[key];
+	cachedProgram.program = std::move(newProgram);
+	cachedProgram.source_hash = hash;
+	program = std::move(sharedProgram);
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::setupComputeKernel(cl_context context, cl_device_id device, const char* rootFile, const char* kernelName, OpenCLProgram& program, OpenCLKernel& kernel,
+											  size_t& kernelWorkGroupSize, std::string& buildLog, const char* buildOptions) noexcept {
+	OpenCLProgram newProgram;
+	cl_int err = getProgram(context, device, rootFile, newProgram, buildLog, buildOptions);
+	if (err != CL_SUCCESS) { return err; }
+
+	OpenCLKernel newKernel;
+	err = setupComputeKernelFromProgram(device, newProgram, kernelName, newKernel, kernelWorkGroupSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	program = std::move(newProgram);
+	kernel = std::move(newKernel);
+	return CL_SUCCESS;
+}
+
+cl_int KernelModuleLoader::preprocess(const char* rootFile, std::string& source, std::string& log) noexcept {
+	std::string rootPath;
+	uint64_t hash;
+	return walkRoot(rootFile, rootPath, hash, &source, nullptr, log);
+}
+
+cl_int KernelModuleLoader::getDependencies(const char* rootFile, std::vector<std::string>& dependencies, std::string& log) noexcept {
+	std::string rootPath;
+	uint64_t hash;
+	return walkRoot(rootFile, rootPath, hash, nullptr, &dependencies, log);
+}
+
+cl_int KernelModuleLoader::getSourceHash(const char* rootFile, uint64_t& hash, std::string& log) noexcept {
+	std::string rootPath;
+	return walkRoot(rootFile, rootPath, hash, nullptr, nullptr, log);
+}
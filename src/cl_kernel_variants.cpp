@@ -0,0 +1,97 @@
+#include "cl_kernel_variants.h"
+
+#include "cl_autotuner.h"
+
+#include <cstdint>						// For fixed-width types.
+
+bool KernelVariantSelector::ShapeKey::operator<(const ShapeKey& right) const noexcept {
+	if (dimensions != right.dimensions) { return dimensions < right.dimensions; }
+	for (cl_uint i = 0; i < 3; i++) {
+		if (size_class[i] != right.size_class[i]) { return size_class[i] < right.size_class[i]; }
+	}
+	return false;
+}
+
+KernelVariantSelector::ShapeKey KernelVariantSelector::getShapeKey(const NDRange& globalSize) noexcept {
+	ShapeKey key;
+	key.dimensions = globalSize.dimensions;
+	// NOTE: Unused dimensions are 1, which is size class 0.
+	for (cl_uint i = 0; i < 3; i++) { key.size_class[i] = calcWorkSizeClass(globalSize.sizes[i]); }
+	return key;
+}
+
+bool KernelVariantSelector::isApplicable(const Variant& variant, const NDRange& globalSize) const noexcept {
+	if (variant.local_size.dimensions && variant.local_size.dimensions != globalSize.dimensions) { return false; }
+	if (variant.global_multiple.dimensions && variant.global_multiple.dimensions != globalSize.dimensions) { return false; }
+	for (cl_uint i = 0; i < globalSize.dimensions; i++) {
+		if (variant.local_size.dimensions && globalSize.sizes[i] % variant.local_size.sizes[i] != 0) { return false; }
+		if (variant.global_multiple.dimensions && globalSize.sizes[i] % variant.global_multiple.sizes[i] != 0) { return false; }
+	}
+	return true;
+}
+
+cl_int KernelVariantSelector::addVariant(const char* buildOptions, const NDRange& localSize, const NDRange& globalMultiple, size_t& variant) noexcept {
+	if (localSize.dimensions > 3 || globalMultiple.dimensions > 3) { return CL_INVALID_VALUE; }
+	if (localSize.dimensions && globalMultiple.dimensions && localSize.dimensions != globalMultiple.dimensions) { return CL_INVALID_VALUE; }
+	for (cl_uint i = 0; i < 3; i++) {
+		// NOTE: Zero sizes would divide by zero in isApplicable().
+		if ((i < localSize.dimensions && localSize.sizes[i] == 0) || (i < globalMultiple.dimensions && globalMultiple.sizes[i] == 0)) { return CL_INVALID_VALUE; }
+	}
+
+	Variant newVariant;
+	newVariant.build_options = buildOptions ? buildOptions : "";
+	newVariant.local_size = localSize;
+	newVariant.global_multiple = globalMultiple;
+	variant = variants.size();
+	variants.push_back(std::move(newVariant));
+
+	// NOTE: The new variant hasn't been measured anywhere, so every size class has to explore it.
+	for (auto& entry : timings) { entry.second.resize(variants.size()); }
+	return CL_SUCCESS;
+}
+
+cl_int KernelVariantSelector::select(const NDRange& globalSize, size_t& variant, bool& measure) const noexcept {
+	if (globalSize.dimensions < 1 || globalSize.dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+
+	auto entry = timings.find(getShapeKey(globalSize));
+	const VariantTiming* shapeTimings = entry != timings.end() ? entry->second.data() : nullptr;
+
+	size_t bestVariant = (size_t)-1;
+	uint64_t bestTime = (uint64_t)-1;
+	for (size_t i = 0; i < variants.size(); i++) {
+		if (!isApplicable(variants[i], globalSize)) { continue; }
+
+		// NOTE: Explore in registration order, one variant at a time, until each of them has enough samples.
+		if (!shapeTimings || shapeTimings[i].sample_count < samples_per_variant) {
+			variant = i;
+			measure = true;
+			return CL_SUCCESS;
+		}
+		if (bestVariant == (size_t)-1 || shapeTimings[i].best_time < bestTime) {
+			bestVariant = i;
+			bestTime = shapeTimings[i].best_time;
+		}
+	}
+	if (bestVariant == (size_t)-1) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+
+	variant = bestVariant;
+	measure = false;
+	return CL_SUCCESS;
+}
+
+void KernelVariantSelector::record(const NDRange& globalSize, size_t variant, uint64_t time) noexcept {
+	if (variant >= variants.size()) { return; }
+
+	std::vector<VariantTiming>& shapeTimings = timings[getShapeKey(globalSize)];
+	if (shapeTimings.size() < variants.size()) { shapeTimings.resize(variants.size()); }
+	VariantTiming& timing = shapeTimings[variant];
+	// NOTE: The fastest launch counts, like in the autotuner. Slower ones are mostly noise (other processes, clock ramp-up, cold caches).
+	if (time < timing.best_time) { timing.best_time = time; }
+	timing.sample_count++;
+}
+
+uint64_t KernelVariantSelector::get_best_time(const NDRange& globalSize, size_t variant) const noexcept {
+	auto entry = timings.find(getShapeKey(globalSize));
+	if (entry == timings.end() || variant >= entry->second.size()) { return (uint64_t)-1; }
+	return entry->second[variant].best_time;
+}
@@ -0,0 +1,350 @@
+#include "cl_multi_device.h"
+
+#include <new>							// For std::nothrow.
+
+#include <string>						// For std::string.
+
+#include <vector>						// For std::vector.
+
+#include <atomic>						// For std::atomic.
+
+#include <thread>						// For std::thread.
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+MultiDeviceExecutor::MultiDeviceExecutor(cl_int& err, const OpenCLDeviceCollection& collection, const OpenCLDeviceIndexCollection& selectedDevices,
+										 const char* sourceCodeString, const char* kernelName, std::string& buildLog) noexcept {
+	if (selectedDevices.length == 0) { err = CL_EXT_NO_DEVICES_FOUND; return; }
+
+	devices.resize(selectedDevices.length);
+	// NOTE: Index of the program of every context in programs, so that every context only builds once.
+	std::vector<size_t> contextPrograms(collection.contexts_length, SIZE_MAX);
+
+	for (size_t i = 0; i < selectedDevices.length; i++) {
+		Device& device = devices[i];
+		size_t deviceIndex = selectedDevices[i];
+		size_t contextIndex = collection.getContextIndexForDeviceIndex(deviceIndex);
+		device.device = collection[deviceIndex];
+		device.context = collection.contexts[contextIndex];
+
+		if (contextPrograms[contextIndex] == SIZE_MAX) {
+			OpenCLProgram program;
+			size_t kernelWorkGroupSize;
+			err = setupComputeKernelFromString(device.context, device.device, sourceCodeString, kernelName, program, device.kernel, kernelWorkGroupSize, buildLog);
+			if (err != CL_SUCCESS) { release(); return; }
+			contextPrograms[contextIndex] = programs.size();
+			programs.push_back(std::move(program));
+		} else {
+			device.kernel.reset(clCreateKernel(programs[contextPrograms[contextIndex]], kernelName, &err));
+			if (err != CL_SUCCESS) { release(); return; }
+		}
+
+		device.queue.reset(clCreateCommandQueue(device.context, device.device, CL_QUEUE_PROFILING_ENABLE, &err));
+		if (err != CL_SUCCESS) { release(); return; }
+
+		cl_uint computeUnits;
+		err = clGetDeviceInfo(device.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, nullptr);
+		if (err != CL_SUCCESS) { release(); return; }
+		cl_uint clockFrequency;
+		err = clGetDeviceInfo(device.device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &clockFrequency, nullptr);
+		if (err != CL_SUCCESS) { release(); return; }
+		// NOTE: Only the ratios between the devices matter, so the unit of the estimate doesn't have to match the measured unit.
+		// The first measurement replaces the estimate completely (see run()).
+		device.throughput = (double)(computeUnits ? computeUnits : 1) * (double)(clockFrequency ? clockFrequency : 1);
+		device.start = 0;
+		device.count = 0;
+	}
+
+	err = CL_SUCCESS;
+}
+
+MultiDeviceExecutor::MultiDeviceExecutor(MultiDeviceExecutor&& other) noexcept : devices(std::move(other.devices)), programs(std::move(other.programs)), args(std::move(other.args)),
+																				 partitionGranularity(other.partitionGranularity), throughput_smoothing(other.throughput_smoothing),
+																				 target_chunk_latency(other.target_chunk_latency) {
+	other.devices.clear();
+	other.programs.clear();
+}
+
+cl_int MultiDeviceExecutor::setBufferArg(cl_uint argIndex, MultiDeviceBuffer_mode mode, void* hostData, size_t size) noexcept {
+	if (!hostData || size == 0) { return CL_INVALID_VALUE; }
+	if (argIndex >= args.size()) {
+		args.resize(argIndex + 1);
+		for (Device& device : devices) { device.buffers.resize(argIndex + 1); }
+	}
+	Arg& arg = args[argIndex];
+	arg.type = Arg_type::BUFFER;
+	arg.mode = mode;
+	arg.hostData = hostData;
+	arg.size = size;
+	return CL_SUCCESS;
+}
+
+cl_int MultiDeviceExecutor::setScalarArg(cl_uint argIndex, size_t size, const void* value) noexcept {
+	if (!value || size == 0) { return CL_INVALID_VALUE; }
+	if (argIndex >= args.size()) {
+		args.resize(argIndex + 1);
+		for (Device& device : devices) { device.buffers.resize(argIndex + 1); }
+	}
+	Arg& arg = args[argIndex];
+	arg.type = Arg_type::SCALAR;
+	arg.scalarValue.assign((const unsigned char*)value, (const unsigned char*)value + size);
+	return CL_SUCCESS;
+}
+
+cl_int MultiDeviceExecutor::setPartitionOffsetArg(cl_uint argIndex) noexcept {
+	if (argIndex >= args.size()) {
+		args.resize(argIndex + 1);
+		for (Device& device : devices) { device.buffers.resize(argIndex + 1); }
+	}
+	args[argIndex].type = Arg_type::PARTITION_OFFSET;
+	return CL_SUCCESS;
+}
+
+void MultiDeviceExecutor::partition(size_t totalCount) noexcept {
+	double totalThroughput = 0;
+	for (const Device& device : devices) { totalThroughput += device.throughput; }
+
+	size_t start = 0;
+	for (size_t i = 0; i < devices.size(); i++) {
+		Device& device = devices[i];
+		device.start = start;
+		if (i == devices.size() - 1) { device.count = totalCount - start; break; }
+
+		size_t count = (size_t)((double)totalCount * (device.throughput / totalThroughput) + 0.5);
+		count = count / partitionGranularity * partitionGranularity;
+		if (count > totalCount - start) { count = (totalCount - start) / partitionGranularity * partitionGranularity; }
+		device.count = count;
+		start += count;
+	}
+}
+
+cl_int MultiDeviceExecutor::prepareDevice(Device& device, const NDRange& range, const NDRange& localSize, bool uploadBroadcastBuffers) noexcept {
+	cl_int err;
+	for (cl_uint i = 0; i < args.size(); i++) {
+		Arg& arg = args[i];
+		switch (arg.type) {
+		case Arg_type::UNSET: return CL_INVALID_KERNEL_ARGS;
+		case Arg_type::SCALAR:
+			err = clSetKernelArg(device.kernel, i, arg.scalarValue.size(), arg.scalarValue.data());
+			if (err != CL_SUCCESS) { return err; }
+			break;
+		case Arg_type::PARTITION_OFFSET:
+			{
+				cl_ulong offset = device.start;
+				err = clSetKernelArg(device.kernel, i, sizeof(cl_ulong), &offset);
+				if (err != CL_SUCCESS) { return err; }
+				break;
+			}
+		case Arg_type::BUFFER:
+			{
+				size_t requiredSize = arg.mode == MultiDeviceBuffer_mode::BROADCAST_INPUT ? arg.size : arg.size * device.count;
+				DeviceBuffer& buffer = device.buffers[i];
+				if (buffer.capacity < requiredSize) {
+					buffer.buffer.reset();
+					buffer.capacity = 0;
+					buffer.buffer.reset(clCreateBuffer(device.context, CL_MEM_READ_WRITE, requiredSize, nullptr, &err));
+					if (err != CL_SUCCESS) { return err; }
+					buffer.capacity = requiredSize;
+				}
+
+				bool upload = arg.mode == MultiDeviceBuffer_mode::BROADCAST_INPUT ? uploadBroadcastBuffers : arg.mode != MultiDeviceBuffer_mode::PARTITIONED_OUTPUT;
+				if (upload) {
+					const char* source = (const char*)arg.hostData;
+					if (arg.mode != MultiDeviceBuffer_mode::BROADCAST_INPUT) { source += arg.size * device.start; }
+					err = clEnqueueWriteBuffer(device.queue, buffer.buffer, CL_FALSE, 0, requiredSize, source, 0, nullptr, nullptr);
+					if (err != CL_SUCCESS) { return err; }
+				}
+
+				err = clSetKernelArg(device.kernel, i, sizeof(cl_mem), buffer.buffer.get_address());
+				if (err != CL_SUCCESS) { return err; }
+				break;
+			}
+		}
+	}
+
+	NDRange deviceRange = range;
+	deviceRange.sizes[range.dimensions - 1] = device.count;
+	err = clEnqueueNDRangeKernel(device.queue, device.kernel, deviceRange.dimensions, nullptr, deviceRange.sizes, localSize.get_sizes_ptr(), 0, nullptr, &device.kernelEvent);
+	if (err != CL_SUCCESS) { device.kernelEvent = nullptr; return err; }
+
+	for (cl_uint i = 0; i < args.size(); i++) {
+		Arg& arg = args[i];
+		if (arg.type != Arg_type::BUFFER) { continue; }
+		if (arg.mode != MultiDeviceBuffer_mode::PARTITIONED_OUTPUT && arg.mode != MultiDeviceBuffer_mode::PARTITIONED_INPUT_OUTPUT) { continue; }
+		err = clEnqueueReadBuffer(device.queue, device.buffers[i].buffer, CL_FALSE, 0, arg.size * device.count, (char*)arg.hostData + arg.size * device.start, 0, nullptr, nullptr);
+		if (err != CL_SUCCESS) { return err; }
+	}
+
+	return clFlush(device.queue);
+}
+
+cl_int MultiDeviceExecutor::run(const NDRange& range, const NDRange& localSize) noexcept {
+	if (devices.empty()) { return CL_EXT_NO_DEVICES_FOUND; }
+	if (range.dimensions < 1 || range.dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+
+	partition(range.sizes[range.dimensions - 1]);
+
+	// NOTE: Everything gets enqueued and flushed first, so that the devices work at the same time, and only then do we wait.
+	cl_int err = CL_SUCCESS;
+	for (Device& device : devices) {
+		device.kernelEvent = nullptr;
+		if (device.count == 0) { continue; }
+		if (err == CL_SUCCESS) { err = prepareDevice(device, range, localSize, true); }
+	}
+
+	// NOTE: Even if something failed, we have to wait for what did get enqueued, since it could still be reading from or writing to host memory.
+	for (Device& device : devices) {
+		if (device.count == 0) { continue; }
+		cl_int finishErr = clFinish(device.queue);
+		if (err == CL_SUCCESS) { err = finishErr; }
+	}
+
+	for (Device& device : devices) {
+		if (!device.kernelEvent) { continue; }
+		if (err == CL_SUCCESS) { recordKernelTime(device); }
+		clReleaseEvent(device.kernelEvent);
+		device.kernelEvent = nullptr;
+	}
+
+	fillInUnmeasuredThroughputs();
+
+	return err;
+}
+
+void MultiDeviceExecutor::fillInUnmeasuredThroughputs() noexcept {
+	// NOTE: Devices that haven't been measured yet (because they got nothing) still have an estimate, which is in a different unit.
+	// Giving them the lowest measured throughput gets them a bit of work next time, so that they get measured too.
+	double lowestMeasuredThroughput = 0;
+	for (const Device& device : devices) {
+		if (device.measuredOnce && (lowestMeasuredThroughput == 0 || device.throughput < lowestMeasuredThroughput)) { lowestMeasuredThroughput = device.throughput; }
+	}
+	if (lowestMeasuredThroughput != 0) {
+		for (Device& device : devices) {
+			if (!device.measuredOnce) { device.throughput = lowestMeasuredThroughput; }
+		}
+	}
+}
+
+void MultiDeviceExecutor::recordKernelTime(Device& device) noexcept {
+	cl_ulong start, end;
+	if (clGetEventProfilingInfo(device.kernelEvent, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr) != CL_SUCCESS ||
+		clGetEventProfilingInfo(device.kernelEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr) != CL_SUCCESS || end <= start) { return; }
+
+	double measuredThroughput = (double)device.count / (double)(end - start);
+	// NOTE: The estimate is in a different unit, so the first measurement of every device has to replace it instead of being blended in.
+	device.throughput = device.measuredOnce ? device.throughput * (1 - throughput_smoothing) + measuredThroughput * throughput_smoothing : measuredThroughput;
+	device.measuredOnce = true;
+}
+
+cl_int MultiDeviceExecutor::workOnChunks(size_t deviceIndex, WorkStealingRange* ranges, const NDRange& range, const NDRange& localSize, std::atomic<bool>& failed) noexcept {
+	Device& device = devices[deviceIndex];
+	size_t totalCount = range.sizes[range.dimensions - 1];
+	size_t totalBlocks = (totalCount + partitionGranularity - 1) / partitionGranularity;
+	bool uploadBroadcastBuffers = true;
+
+	while (!failed.load(std::memory_order_relaxed)) {
+		// NOTE: Until the device has been measured, it starts with a small chunk, so that it can't hog too much of the range.
+		uint32_t chunkBlocks;
+		if (device.chunkThroughput > 0) {
+			double blocks = device.chunkThroughput * (double)target_chunk_latency / (double)partitionGranularity;
+			chunkBlocks = blocks < 1 ? 1 : blocks > (double)UINT32_MAX ? UINT32_MAX : (uint32_t)blocks;
+		} else {
+			size_t blocks = totalBlocks / (devices.size() * 16);
+			chunkBlocks = blocks < 1 ? 1 : (uint32_t)blocks;
+		}
+
+		uint32_t beginBlock, blockCount;
+		if (!ranges[deviceIndex].take(chunkBlocks, beginBlock, blockCount)) {
+			// NOTE: Steals from whoever has the most left, since that's the device that is most likely to finish last.
+			size_t victim = SIZE_MAX;
+			uint32_t mostRemaining = 0;
+			for (size_t i = 0; i < devices.size(); i++) {
+				uint32_t remaining = ranges[i].get_remaining();
+				if (remaining > mostRemaining) { mostRemaining = remaining; victim = i; }
+			}
+			if (victim == SIZE_MAX) { return CL_SUCCESS; }
+			if (!ranges[victim].steal(chunkBlocks, beginBlock, blockCount)) { continue; }
+		}
+
+		device.start = (size_t)beginBlock * partitionGranularity;
+		device.count = (size_t)blockCount * partitionGranularity;
+		if (device.start + device.count > totalCount) { device.count = totalCount - device.start; }
+
+		std::chrono::steady_clock::time_point chunkStart = std::chrono::steady_clock::now();
+		device.kernelEvent = nullptr;
+		cl_int err = prepareDevice(device, range, localSize, uploadBroadcastBuffers);
+		uploadBroadcastBuffers = false;
+		// NOTE: Has to wait even if something failed, since reads and writes could still be using host memory.
+		cl_int finishErr = clFinish(device.queue);
+		if (err == CL_SUCCESS) { err = finishErr; }
+		if (device.kernelEvent) {
+			if (err == CL_SUCCESS) { recordKernelTime(device); }
+			clReleaseEvent(device.kernelEvent);
+			device.kernelEvent = nullptr;
+		}
+		if (err != CL_SUCCESS) { failed.store(true, std::memory_order_relaxed); return err; }
+
+		uint64_t chunkTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - chunkStart).count();
+		double measuredChunkThroughput = (double)device.count / (double)(chunkTime ? chunkTime : 1);
+		device.chunkThroughput = device.chunkThroughput > 0 ? device.chunkThroughput * (1 - throughput_smoothing) + measuredChunkThroughput * throughput_smoothing : measuredChunkThroughput;
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int MultiDeviceExecutor::runDynamic(const NDRange& range, const NDRange& localSize) noexcept {
+	if (devices.empty()) { return CL_EXT_NO_DEVICES_FOUND; }
+	if (range.dimensions < 1 || range.dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+	size_t totalCount = range.sizes[range.dimensions - 1];
+	if ((totalCount + partitionGranularity - 1) / partitionGranularity > UINT32_MAX) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+
+	// NOTE: The initial shares come from the same split as run(), so that stealing only has to correct the estimate instead of doing everything.
+	partition(totalCount);
+	WorkStealingRange* ranges = new (std::nothrow) WorkStealingRange[devices.size()];
+	if (!ranges) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+	for (size_t i = 0; i < devices.size(); i++) {
+		const Device& device = devices[i];
+		ranges[i].reset((uint32_t)(device.start / partitionGranularity), (uint32_t)((device.start + device.count + partitionGranularity - 1) / partitionGranularity));
+	}
+
+	std::atomic<bool> failed { false };
+	std::vector<cl_int> results(devices.size(), CL_SUCCESS);
+	std::vector<std::thread> workers;
+	workers.reserve(devices.size() - 1);
+	// NOTE: The calling thread works for the first device itself, so one device means no extra threads at all.
+	for (size_t i = 1; i < devices.size(); i++) {
+		workers.emplace_back([this, i, ranges, &range, &localSize, &failed, &results]() noexcept { results[i] = workOnChunks(i, ranges, range, localSize, failed); });
+	}
+	results[0] = workOnChunks(0, ranges, range, localSize, failed);
+	for (std::thread& worker : workers) { worker.join(); }
+	delete[] ranges;
+
+	fillInUnmeasuredThroughputs();
+
+	for (cl_int result : results) {
+		if (result != CL_SUCCESS) { return result; }
+	}
+	return CL_SUCCESS;
+}
+
+cl_int MultiDeviceExecutor::calibrate(const NDRange& range, cl_uint repetitions) noexcept {
+	for (cl_uint i = 0; i < repetitions; i++) {
+		cl_int err = run(range);
+		if (err != CL_SUCCESS) { return err; }
+	}
+	return CL_SUCCESS;
+}
+
+double MultiDeviceExecutor::get_share(size_t index) const noexcept {
+	double totalThroughput = 0;
+	for (const Device& device : devices) { totalThroughput += device.throughput; }
+	return devices[index].throughput / totalThroughput;
+}
+
+void MultiDeviceExecutor::release() noexcept {
+	// NOTE: The handles release themselves. Devices go first, so that the kernels are gone before the programs they came from.
+	devices.clear();
+	programs.clear();
+}
+
+MultiDeviceExecutor::~MultiDeviceExecutor() noexcept { release(); }
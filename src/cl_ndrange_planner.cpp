@@ -0,0 +1,116 @@
+#include "cl_ndrange_planner.h"
+
+#include <new>							// For std::nothrow.
+
+cl_int getNDRangeLimits(cl_kernel kernel, cl_device_id device, NDRangeLimits& limits) noexcept {
+	cl_int err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &limits.max_work_group_size, nullptr);
+	if (err != CL_SUCCESS) { return err; }
+	err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &limits.preferred_work_group_size_multiple, nullptr);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: The device reports one size per dimension that it supports, which is at least 3 but can be more, and asking for
+	// less than the whole array is an error, so we have to go through a temporary array.
+	size_t maxWorkItemSizesSize;
+	err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, 0, nullptr, &maxWorkItemSizesSize);
+	if (err != CL_SUCCESS) { return err; }
+	size_t dimensionCount = maxWorkItemSizesSize / sizeof(size_t);
+	if (dimensionCount < 3) { return CL_INVALID_VALUE; }
+	size_t* maxWorkItemSizes = new (std::nothrow) size_t[dimensionCount];
+	if (!maxWorkItemSizes) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+	err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, dimensionCount * sizeof(size_t), maxWorkItemSizes, nullptr);
+	if (err == CL_SUCCESS) {
+		for (size_t i = 0; i < 3; i++) { limits.max_work_item_sizes[i] = maxWorkItemSizes[i]; }
+	}
+	delete[] maxWorkItemSizes;
+	return err;
+}
+
+static size_t calcSmallestPrimeFactor(size_t value) noexcept {
+	for (size_t i = 2; i * i <= value; i++) {
+		if (value % i == 0) { return i; }
+	}
+	return value;
+}
+
+cl_int planNDRange(const NDRange& problemShape, const NDRangeLimits& limits, NDRangePlan& plan) noexcept {
+	cl_uint dimensions = problemShape.dimensions;
+	if (dimensions < 1 || dimensions > 3) { return CL_INVALID_WORK_DIMENSION; }
+	for (cl_uint i = 0; i < dimensions; i++) {
+		if (problemShape.sizes[i] == 0) { return CL_INVALID_GLOBAL_WORK_SIZE; }
+	}
+
+	// NOTE: Same rounding as in setupComputeKernelFromString(), so that the work-group size is a multiple of the preferred multiple if possible.
+	size_t workGroupSize = limits.max_work_group_size;
+	if (limits.preferred_work_group_size_multiple && limits.preferred_work_group_size_multiple <= workGroupSize) {
+		workGroupSize -= workGroupSize % limits.preferred_work_group_size_multiple;
+	}
+	if (workGroupSize == 0) { workGroupSize = 1; }
+
+	size_t localSizes[3] = { 1, 1, 1 };
+	switch (dimensions) {
+	case 1: localSizes[0] = workGroupSize; break;
+	case 2:
+		{
+			std::pair<size_t, size_t> box = calcSmallestBoundingBox(workGroupSize);
+			localSizes[0] = box.second;
+			localSizes[1] = box.first;
+			break;
+		}
+	case 3:
+		{
+			// NOTE: z gets the biggest divisor that's at most the cube root, the rest gets split between x and y like in the 2D case.
+			size_t z = 1;
+			for (size_t i = 2; i * i * i <= workGroupSize; i++) {
+				if (workGroupSize % i == 0) { z = i; }
+			}
+			std::pair<size_t, size_t> box = calcSmallestBoundingBox(workGroupSize / z);
+			localSizes[0] = box.second;
+			localSizes[1] = box.first;
+			localSizes[2] = z;
+			break;
+		}
+	}
+
+	// NOTE: A dimension can't be bigger than the device allows, and there's no point in it being bigger than the problem either,
+	// since that would only add padding. Excess factors move to the first dimension that has room for them, or get dropped.
+	size_t caps[3];
+	for (cl_uint i = 0; i < dimensions; i++) {
+		caps[i] = limits.max_work_item_sizes[i] < problemShape.sizes[i] ? limits.max_work_item_sizes[i] : problemShape.sizes[i];
+		if (caps[i] == 0) { caps[i] = 1; }
+	}
+	for (cl_uint i = 0; i < dimensions; i++) {
+		while (localSizes[i] > caps[i]) {
+			size_t factor = calcSmallestPrimeFactor(localSizes[i]);
+			localSizes[i] /= factor;
+			for (cl_uint j = 0; j < dimensions; j++) {
+				if (j != i && localSizes[j] * factor <= caps[j]) { localSizes[j] *= factor; break; }
+			}
+		}
+	}
+
+	size_t globalSizes[3] = { 1, 1, 1 };
+	plan.is_padded = false;
+	for (cl_uint i = 0; i < 3; i++) {
+		plan.bounds[i] = i < dimensions ? problemShape.sizes[i] : 1;
+		if (i >= dimensions) { continue; }
+		globalSizes[i] = (problemShape.sizes[i] + localSizes[i] - 1) / localSizes[i] * localSizes[i];
+		if (globalSizes[i] != problemShape.sizes[i]) { plan.is_padded = true; }
+	}
+
+	switch (dimensions) {
+	case 1:
+		plan.global_size = NDRange(globalSizes[0]);
+		plan.local_size = NDRange(localSizes[0]);
+		break;
+	case 2:
+		plan.global_size = NDRange(globalSizes[0], globalSizes[1]);
+		plan.local_size = NDRange(localSizes[0], localSizes[1]);
+		break;
+	case 3:
+		plan.global_size = NDRange(globalSizes[0], globalSizes[1], globalSizes[2]);
+		plan.local_size = NDRange(localSizes[0], localSizes[1], localSizes[2]);
+		break;
+	}
+
+	return CL_SUCCESS;
+}
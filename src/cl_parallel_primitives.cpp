@@ -0,0 +1,638 @@
+#include "cl_parallel_primitives.h"
+
+#include "cl_kernel_launcher.h"			// For KernelArgSetter and LocalMemory.
+
+#include <utility>						// For std::move and std::swap.
+
+#define PRIMITIVE_SCAN_ITEMS 4			// NOTE: Elements per work item in the scan kernels, has to match ITEMS in the kernel source.
+#define PRIMITIVE_RADIX_BITS 4
+#define PRIMITIVE_RADIX_DIGITS (1 << PRIMITIVE_RADIX_BITS)
+
+// NOTE: Gets prefixed with the defines for T, OP and IDENTITY of the respective (type, operation) combination, see getScanPrograms().
+static const char scanKernelSource[] = R"CLC(
+#define ITEMS 4
+
+__kernel void reduce(__global const T* input, ulong count, __global T* output, __local T* scratch) {
+	size_t lid = get_local_id(0);
+	T accumulator = IDENTITY;
+	for (ulong i = get_global_id(0); i < count; i += get_global_size(0)) { accumulator = OP(accumulator, input[i]); }
+	scratch[lid] = accumulator;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (size_t stride = get_local_size(0) / 2; stride > 0; stride /= 2) {
+		if (lid < stride) { scratch[lid] = OP(scratch[lid], scratch[lid + stride]); }
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0) { output[get_group_id(0)] = scratch[0]; }
+}
+
+// Scans one tile of get_local_size(0) * ITEMS elements. Every work item scans ITEMS consecutive elements, the totals of the work items
+// get scanned with Hillis-Steele in between.
+__kernel void scan_tiles(__global const T* input, __global T* output, __global T* tileTotals, ulong count, int exclusive, __local T* tile, __local T* sums) {
+	size_t lid = get_local_id(0);
+	size_t wg = get_local_size(0);
+	ulong base = (ulong)get_group_id(0) * wg * ITEMS;
+
+	for (size_t i = lid; i < wg * ITEMS; i += wg) { tile[i] = base + i < count ? input[base + i] : IDENTITY; }
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	T accumulator = IDENTITY;
+	for (size_t i = 0; i < ITEMS; i++) { accumulator = OP(accumulator, tile[lid * ITEMS + i]); }
+
+	__local T* from = sums;
+	__local T* to = sums + wg;
+	from[lid] = accumulator;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (size_t offset = 1; offset < wg; offset *= 2) {
+		to[lid] = lid >= offset ? OP(from[lid - offset], from[lid]) : from[lid];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		__local T* swap = from;
+		from = to;
+		to = swap;
+	}
+	if (lid == wg - 1) { tileTotals[get_group_id(0)] = from[lid]; }
+
+	T prefix = lid ? from[lid - 1] : IDENTITY;
+	for (size_t i = 0; i < ITEMS; i++) {
+		T next = OP(prefix, tile[lid * ITEMS + i]);
+		tile[lid * ITEMS + i] = exclusive ? prefix : next;
+		prefix = next;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t i = lid; i < wg * ITEMS; i += wg) {
+		if (base + i < count) { output[base + i] = tile[i]; }
+	}
+}
+
+__kernel void add_tile_offsets(__global T* data, __global const T* tileOffsets, ulong count) {
+	size_t wg = get_local_size(0);
+	ulong base = (ulong)get_group_id(0) * wg * ITEMS;
+	T offset = tileOffsets[get_group_id(0)];
+	for (size_t i = get_local_id(0); i < wg * ITEMS; i += wg) {
+		if (base + i < count) { data[base + i] = OP(offset, data[base + i]); }
+	}
+}
+
+// Same as scan_tiles, but on (value, flag) pairs. A set flag cuts off everything before it: (a, fa) + (b, fb) = (fb ? b : OP(a, b), fa | fb).
+// outputFlags says whether a segment started somewhere in the tile before the element (including the element for inclusive scans),
+// which is where the offset of the tile must not be applied.
+__kernel void segmented_scan_tiles(__global const T* input, __global const uint* flags, __global T* output, __global uint* outputFlags,
+								   __global T* tileTotals, __global uint* tileFlags, ulong count, int exclusive,
+								   __local T* tile, __local uint* tileFlagBits, __local T* sums, __local uint* sumFlags) {
+	size_t lid = get_local_id(0);
+	size_t wg = get_local_size(0);
+	ulong base = (ulong)get_group_id(0) * wg * ITEMS;
+
+	for (size_t i = lid; i < wg * ITEMS; i += wg) {
+		bool valid = base + i < count;
+		tile[i] = valid ? input[base + i] : IDENTITY;
+		tileFlagBits[i] = valid && flags[base + i] ? 1 : 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	T accumulator = IDENTITY;
+	uint accumulatorFlag = 0;
+	for (size_t i = 0; i < ITEMS; i++) {
+		T element = tile[lid * ITEMS + i];
+		accumulator = tileFlagBits[lid * ITEMS + i] ? element : OP(accumulator, element);
+		accumulatorFlag |= tileFlagBits[lid * ITEMS + i];
+	}
+
+	__local T* from = sums;
+	__local T* to = sums + wg;
+	__local uint* fromFlags = sumFlags;
+	__local uint* toFlags = sumFlags + wg;
+	from[lid] = accumulator;
+	fromFlags[lid] = accumulatorFlag;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (size_t offset = 1; offset < wg; offset *= 2) {
+		if (lid >= offset) {
+			to[lid] = fromFlags[lid] ? from[lid] : OP(from[lid - offset], from[lid]);
+			toFlags[lid] = fromFlags[lid - offset] | fromFlags[lid];
+		} else {
+			to[lid] = from[lid];
+			toFlags[lid] = fromFlags[lid];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		__local T* swap = from;
+		from = to;
+		to = swap;
+		__local uint* swapFlags = fromFlags;
+		fromFlags = toFlags;
+		toFlags = swapFlags;
+	}
+	if (lid == wg - 1) {
+		tileTotals[get_group_id(0)] = from[lid];
+		tileFlags[get_group_id(0)] = fromFlags[lid];
+	}
+
+	T prefix = lid ? from[lid - 1] : IDENTITY;
+	uint prefixFlag = lid ? fromFlags[lid - 1] : 0;
+	for (size_t i = 0; i < ITEMS; i++) {
+		T element = tile[lid * ITEMS + i];
+		uint elementFlag = tileFlagBits[lid * ITEMS + i];
+		T next = elementFlag ? element : OP(prefix, element);
+		uint nextFlag = prefixFlag | elementFlag;
+		tile[lid * ITEMS + i] = exclusive ? prefix : next;
+		tileFlagBits[lid * ITEMS + i] = exclusive ? prefixFlag : nextFlag;
+		prefix = next;
+		prefixFlag = nextFlag;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t i = lid; i < wg * ITEMS; i += wg) {
+		if (base + i < count) {
+			output[base + i] = tile[i];
+			outputFlags[base + i] = tileFlagBits[i];
+		}
+	}
+}
+
+__kernel void add_segmented_tile_offsets(__global T* data, __global const uint* dataFlags, __global const T* tileOffsets, ulong count) {
+	size_t wg = get_local_size(0);
+	ulong base = (ulong)get_group_id(0) * wg * ITEMS;
+	T offset = tileOffsets[get_group_id(0)];
+	for (size_t i = get_local_id(0); i < wg * ITEMS; i += wg) {
+		if (base + i < count && !dataFlags[base + i]) { data[base + i] = OP(offset, data[base + i]); }
+	}
+}
+)CLC";
+
+static const char uintKernelSource[] = R"CLC(
+#define RADIX_BITS 4
+#define RADIX_DIGITS 16
+
+__kernel void fill_uint(__global uint* buffer, ulong count, uint value) {
+	ulong i = get_global_id(0);
+	if (i < count) { buffer[i] = value; }
+}
+
+__kernel void histogram_local(__global const uint* keys, ulong count, __global uint* bins, uint binCount, __local uint* localBins) {
+	size_t lid = get_local_id(0);
+	size_t wg = get_local_size(0);
+	for (uint i = lid; i < binCount; i += wg) { localBins[i] = 0; }
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (ulong i = get_global_id(0); i < count; i += get_global_size(0)) {
+		uint key = keys[i];
+		if (key < binCount) { atomic_inc(&localBins[key]); }
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint i = lid; i < binCount; i += wg) {
+		uint binCountInGroup = localBins[i];
+		if (binCountInGroup) { atomic_add(&bins[i], binCountInGroup); }
+	}
+}
+
+__kernel void histogram_global(__global const uint* keys, ulong count, __global uint* bins, uint binCount) {
+	for (ulong i = get_global_id(0); i < count; i += get_global_size(0)) {
+		uint key = keys[i];
+		if (key < binCount) { atomic_inc(&bins[key]); }
+	}
+}
+
+// Counts the digits of one tile (one element per work item). The table is digit-major, so that an exclusive scan over the whole table
+// gives every (digit, tile) pair its start position in the output.
+// NOTE: digitMask is RADIX_DIGITS - 1, except in the last pass, where it only keeps the key bits that are left, so that bits above keyBits
+// don't get sorted on.
+__kernel void radix_count(__global const uint* keys, ulong count, uint shift, uint digitMask, __global uint* digitCounts, uint tileCount, __local uint* localCounts) {
+	size_t lid = get_local_id(0);
+	size_t wg = get_local_size(0);
+	for (size_t d = lid; d < RADIX_DIGITS; d += wg) { localCounts[d] = 0; }
+	barrier(CLK_LOCAL_MEM_FENCE);
+	ulong index = get_global_id(0);
+	if (index < count) { atomic_inc(&localCounts[(keys[index] >> shift) & digitMask]); }
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (size_t d = lid; d < RADIX_DIGITS; d += wg) { digitCounts[d * tileCount + get_group_id(0)] = localCounts[d]; }
+}
+
+// Sorts one tile by the digit locally (one stable 1-bit split per digit bit) and writes every element to the start of its (digit, tile)
+// pair plus its rank among the elements of the tile with the same digit. Elements past the end count as the highest digit, so that
+// they end up behind every real element, and don't get written.
+__kernel void radix_scatter(__global const uint* keysIn, __global const uint* valuesIn, __global uint* keysOut, __global uint* valuesOut,
+							ulong count, uint shift, uint digitMask, __global const uint* digitOffsets, uint tileCount, int hasValues,
+							__local uint* localKeys, __local uint* localValues, __local uint* localDigits, __local uint* scratch, __local uint* digitStarts) {
+	size_t lid = get_local_id(0);
+	size_t wg = get_local_size(0);
+	ulong index = get_global_id(0);
+	bool valid = index < count;
+	ulong remaining = count - (ulong)get_group_id(0) * wg;
+	size_t validCount = remaining < wg ? (size_t)remaining : wg;
+
+	uint key = valid ? keysIn[index] : 0;
+	uint value = valid && hasValues ? valuesIn[index] : 0;
+	uint digit = valid ? (key >> shift) & digitMask : RADIX_DIGITS - 1;
+
+	for (uint bit = 0; bit < RADIX_BITS; bit++) {
+		uint isZero = ((digit >> bit) & 1) ? 0 : 1;
+		__local uint* from = scratch;
+		__local uint* to = scratch + wg;
+		from[lid] = isZero;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		for (size_t offset = 1; offset < wg; offset *= 2) {
+			to[lid] = lid >= offset ? from[lid - offset] + from[lid] : from[lid];
+			barrier(CLK_LOCAL_MEM_FENCE);
+			__local uint* swap = from;
+			from = to;
+			to = swap;
+		}
+		uint zerosBefore = from[lid] - isZero;
+		uint totalZeros = from[wg - 1];
+		size_t position = isZero ? zerosBefore : totalZeros + lid - zerosBefore;
+		localKeys[position] = key;
+		localValues[position] = value;
+		localDigits[position] = digit;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		key = localKeys[lid];
+		value = localValues[lid];
+		digit = localDigits[lid];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (lid == 0 || localDigits[lid - 1] != digit) { digitStarts[digit] = lid; }
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (lid < validCount) {
+		uint position = digitOffsets[digit * tileCount + get_group_id(0)] + (uint)(lid - digitStarts[digit]);
+		keysOut[position] = key;
+		if (hasValues) { valuesOut[position] = value; }
+	}
+}
+)CLC";
+
+template <typename... args_t>
+static cl_int setPrimitiveKernelArgs(cl_kernel kernel, const args_t&... args) noexcept {
+	cl_uint index = 0;
+	cl_int err = CL_SUCCESS;
+	((err == CL_SUCCESS ? (err = KernelArgSetter<args_t>::set(kernel, index++, args)) : err), ...);
+	return err;
+}
+
+static cl_int enqueuePrimitiveKernel(cl_command_queue queue, cl_kernel kernel, size_t groupCount, size_t workGroupSize) noexcept {
+	size_t globalSize = groupCount * workGroupSize;
+	return clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalSize, &workGroupSize, 0, nullptr, nullptr);
+}
+
+static size_t getPrimitiveElementSize(PrimitiveType type) noexcept {
+	switch (type) {
+	case PrimitiveType::INT: return sizeof(cl_int);
+	case PrimitiveType::UINT: return sizeof(cl_uint);
+	default: return CL_EXT_FLOAT_SIZE;
+	}
+}
+
+// NOTE: Smallest CL_KERNEL_WORK_GROUP_SIZE of the given kernels, rounded down to a power of two, since the tree reductions and the
+// Hillis-Steele scans rely on that.
+static cl_int getCommonWorkGroupSize(cl_device_id device, const cl_kernel* kernels, size_t kernelCount, size_t& workGroupSize) noexcept {
+	size_t smallest = SIZE_MAX;
+	for (size_t i = 0; i < kernelCount; i++) {
+		size_t kernelWorkGroupSize;
+		cl_int err = clGetKernelWorkGroupInfo(kernels[i], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelWorkGroupSize, nullptr);
+		if (err != CL_SUCCESS) { return CL_EXT_GET_KERNEL_WORK_GROUP_INFO_FAILED; }
+		if (kernelWorkGroupSize < smallest) { smallest = kernelWorkGroupSize; }
+	}
+	workGroupSize = 1;
+	while (workGroupSize * 2 <= smallest) { workGroupSize *= 2; }
+	return CL_SUCCESS;
+}
+
+ParallelPrimitives::ParallelPrimitives(cl_int& err, cl_context context, cl_device_id device, cl_command_queue queue) noexcept : context(context), device(device), queue(queue) {
+	err = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemorySize, nullptr);
+	if (err != CL_SUCCESS) { return; }
+	err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, nullptr);
+	if (err != CL_SUCCESS) { return; }
+	if (!computeUnits) { computeUnits = 1; }
+}
+
+cl_int ParallelPrimitives::ensureScratch(ScratchBuffer& scratch, size_t size) noexcept {
+	if (scratch.capacity >= size) { return CL_SUCCESS; }
+
+	cl_int err;
+	OpenCLMemObject buffer(clCreateBuffer(context, CL_MEM_READ_WRITE, size, nullptr, &err));
+	if (!buffer) { return err; }
+	scratch.buffer = std::move(buffer);
+	scratch.capacity = size;
+	return CL_SUCCESS;
+}
+
+cl_int ParallelPrimitives::getScanPrograms(PrimitiveType type, PrimitiveOperation operation, ScanPrograms*& programs) noexcept {
+	ScanPrograms& result = scanPrograms[(size_t)type][(size_t)operation];
+	if (result.program) {
+		programs = &result;
+		return CL_SUCCESS;
+	}
+
+	static const char* const typeNames[] = { "int", "uint", "float" };
+	static const char* const operationDefines[] = { "#define OP(a, b) ((a) + (b))\n", "#define OP(a, b) min((a), (b))\n", "#define OP(a, b) max((a), (b))\n" };
+	static const char* const identities[3][3] = {
+		{ "0", "INT_MAX", "INT_MIN" },
+		{ "0u", "UINT_MAX", "0u" },
+		{ "0.0f", "INFINITY", "-INFINITY" }
+	};
+
+	std::string source = std::string("#define T ") + typeNames[(size_t)type] + "\n" +
+						 operationDefines[(size_t)operation] +
+						 "#define IDENTITY (" + identities[(size_t)type][(size_t)operation] + ")\n" +
+						 scanKernelSource;
+
+	ScanPrograms newPrograms;
+	size_t unusedWorkGroupSize;
+	cl_int err = setupComputeKernelFromString(context, device, source.c_str(), "reduce", newPrograms.program, newPrograms.reduce, unusedWorkGroupSize, build_log);
+	if (err != CL_SUCCESS) { return err; }
+
+	newPrograms.scanTiles.reset(clCreateKernel(newPrograms.program, "scan_tiles", &err));
+	if (!newPrograms.scanTiles) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.addTileOffsets.reset(clCreateKernel(newPrograms.program, "add_tile_offsets", &err));
+	if (!newPrograms.addTileOffsets) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.segmentedScanTiles.reset(clCreateKernel(newPrograms.program, "segmented_scan_tiles", &err));
+	if (!newPrograms.segmentedScanTiles) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.addSegmentedTileOffsets.reset(clCreateKernel(newPrograms.program, "add_segmented_tile_offsets", &err));
+	if (!newPrograms.addSegmentedTileOffsets) { return CL_EXT_CREATE_KERNEL_FAILED; }
+
+	const cl_kernel kernels[] = { newPrograms.reduce, newPrograms.scanTiles, newPrograms.addTileOffsets, newPrograms.segmentedScanTiles, newPrograms.addSegmentedTileOffsets };
+	err = getCommonWorkGroupSize(device, kernels, sizeof(kernels) / sizeof(cl_kernel), newPrograms.workGroupSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: The segmented tile kernel needs the most local memory: the tile and two rows of partial sums, each with a flag per element.
+	size_t elementSize = getPrimitiveElementSize(type);
+	while (newPrograms.workGroupSize > 1 &&
+		   (newPrograms.workGroupSize * PRIMITIVE_SCAN_ITEMS + 2 * newPrograms.workGroupSize) * (elementSize + sizeof(cl_uint)) > localMemorySize) {
+		newPrograms.workGroupSize /= 2;
+	}
+
+	result = std::move(newPrograms);
+	programs = &result;
+	return CL_SUCCESS;
+}
+
+cl_int ParallelPrimitives::getUintPrograms(UintPrograms*& programs) noexcept {
+	if (uintPrograms.program) {
+		programs = &uintPrograms;
+		return CL_SUCCESS;
+	}
+
+	UintPrograms newPrograms;
+	size_t unusedWorkGroupSize;
+	cl_int err = setupComputeKernelFromString(context, device, uintKernelSource, "fill_uint", newPrograms.program, newPrograms.fill, unusedWorkGroupSize, build_log);
+	if (err != CL_SUCCESS) { return err; }
+
+	newPrograms.histogramLocal.reset(clCreateKernel(newPrograms.program, "histogram_local", &err));
+	if (!newPrograms.histogramLocal) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.histogramGlobal.reset(clCreateKernel(newPrograms.program, "histogram_global", &err));
+	if (!newPrograms.histogramGlobal) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.radixCount.reset(clCreateKernel(newPrograms.program, "radix_count", &err));
+	if (!newPrograms.radixCount) { return CL_EXT_CREATE_KERNEL_FAILED; }
+	newPrograms.radixScatter.reset(clCreateKernel(newPrograms.program, "radix_scatter", &err));
+	if (!newPrograms.radixScatter) { return CL_EXT_CREATE_KERNEL_FAILED; }
+
+	const cl_kernel kernels[] = { newPrograms.fill, newPrograms.histogramLocal, newPrograms.histogramGlobal, newPrograms.radixCount, newPrograms.radixScatter };
+	err = getCommonWorkGroupSize(device, kernels, sizeof(kernels) / sizeof(cl_kernel), newPrograms.workGroupSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: radix_scatter needs keys, values, digits and two rows of the split scan per work item, plus the digit starts.
+	while (newPrograms.workGroupSize > 1 && (5 * newPrograms.workGroupSize + PRIMITIVE_RADIX_DIGITS) * sizeof(cl_uint) > localMemorySize) {
+		newPrograms.workGroupSize /= 2;
+	}
+
+	uintPrograms = std::move(newPrograms);
+	programs = &uintPrograms;
+	return CL_SUCCESS;
+}
+
+cl_int ParallelPrimitives::get_work_group_size(PrimitiveType type, PrimitiveOperation operation, size_t& workGroupSize) noexcept {
+	ScanPrograms* programs;
+	cl_int err = getScanPrograms(type, operation, programs);
+	if (err != CL_SUCCESS) { return err; }
+	workGroupSize = programs->workGroupSize;
+	return CL_SUCCESS;
+}
+
+// NOTE: Scans count elements with one work group per tile. If there's more than one tile, the tile totals get scanned (exclusively)
+// by the next level, which recurses until everything fits into one tile, and the resulting offsets get added to the tiles on the way back.
+// flags == nullptr means a normal scan, anything else a segmented one.
+cl_int ParallelPrimitives::scanLevel(ScanPrograms& programs, size_t elementSize, size_t level, cl_mem input, cl_mem flags, cl_mem output, size_t count, bool exclusive) noexcept {
+	size_t workGroupSize = programs.workGroupSize;
+	size_t tileSize = workGroupSize * PRIMITIVE_SCAN_ITEMS;
+	size_t tileCount = (count + tileSize - 1) / tileSize;
+
+	if (scanLevels.size() <= level) { scanLevels.resize(level + 1); }
+	// NOTE: No references into scanLevels past this point, the recursion can resize it.
+	cl_int err = ensureScratch(scanLevels[level].totals, tileCount * elementSize);
+	if (err != CL_SUCCESS) { return err; }
+	cl_mem totals = scanLevels[level].totals.buffer;
+	cl_mem totalFlags = nullptr;
+	cl_mem outputFlags = nullptr;
+	if (flags) {
+		err = ensureScratch(scanLevels[level].totalFlags, tileCount * sizeof(cl_uint));
+		if (err != CL_SUCCESS) { return err; }
+		err = ensureScratch(scanLevels[level].outputFlags, count * sizeof(cl_uint));
+		if (err != CL_SUCCESS) { return err; }
+		totalFlags = scanLevels[level].totalFlags.buffer;
+		outputFlags = scanLevels[level].outputFlags.buffer;
+	}
+
+	cl_ulong deviceCount = count;
+	cl_int deviceExclusive = exclusive;
+	if (flags) {
+		err = setPrimitiveKernelArgs(programs.segmentedScanTiles, input, flags, output, outputFlags, totals, totalFlags, deviceCount, deviceExclusive,
+									 LocalMemory(tileSize * elementSize), LocalMemory(tileSize * sizeof(cl_uint)),
+									 LocalMemory(2 * workGroupSize * elementSize), LocalMemory(2 * workGroupSize * sizeof(cl_uint)));
+		if (err != CL_SUCCESS) { return err; }
+		err = enqueuePrimitiveKernel(queue, programs.segmentedScanTiles, tileCount, workGroupSize);
+	} else {
+		err = setPrimitiveKernelArgs(programs.scanTiles, input, output, totals, deviceCount, deviceExclusive, LocalMemory(tileSize * elementSize), LocalMemory(2 * workGroupSize * elementSize));
+		if (err != CL_SUCCESS) { return err; }
+		err = enqueuePrimitiveKernel(queue, programs.scanTiles, tileCount, workGroupSize);
+	}
+	if (err != CL_SUCCESS) { return err; }
+
+	if (tileCount == 1) { return CL_SUCCESS; }
+
+	err = scanLevel(programs, elementSize, level + 1, totals, totalFlags, totals, tileCount, true);
+	if (err != CL_SUCCESS) { return err; }
+
+	if (flags) {
+		err = setPrimitiveKernelArgs(programs.addSegmentedTileOffsets, output, outputFlags, totals, deviceCount);
+		if (err != CL_SUCCESS) { return err; }
+		return enqueuePrimitiveKernel(queue, programs.addSegmentedTileOffsets, tileCount, workGroupSize);
+	}
+	err = setPrimitiveKernelArgs(programs.addTileOffsets, output, totals, deviceCount);
+	if (err != CL_SUCCESS) { return err; }
+	return enqueuePrimitiveKernel(queue, programs.addTileOffsets, tileCount, workGroupSize);
+}
+
+cl_int ParallelPrimitives::reduce(PrimitiveType type, PrimitiveOperation operation, cl_mem input, size_t count, cl_mem result) noexcept {
+	ScanPrograms* programs;
+	cl_int err = getScanPrograms(type, operation, programs);
+	if (err != CL_SUCCESS) { return err; }
+	size_t workGroupSize = programs->workGroupSize;
+	size_t elementSize = getPrimitiveElementSize(type);
+
+	// NOTE: A few groups per compute unit is enough to fill the device, every work item accumulates a strided range on its own before the tree reduction.
+	size_t groupCount = (count + workGroupSize - 1) / workGroupSize;
+	if (groupCount > (size_t)computeUnits * 4) { groupCount = (size_t)computeUnits * 4; }
+	if (!groupCount) { groupCount = 1; }
+
+	cl_ulong deviceCount = count;
+	if (groupCount == 1) {
+		err = setPrimitiveKernelArgs(programs->reduce, input, deviceCount, result, LocalMemory(workGroupSize * elementSize));
+		if (err != CL_SUCCESS) { return err; }
+		return enqueuePrimitiveKernel(queue, programs->reduce, 1, workGroupSize);
+	}
+
+	err = ensureScratch(reducePartials, groupCount * elementSize);
+	if (err != CL_SUCCESS) { return err; }
+	cl_mem partials = reducePartials.buffer;
+
+	err = setPrimitiveKernelArgs(programs->reduce, input, deviceCount, partials, LocalMemory(workGroupSize * elementSize));
+	if (err != CL_SUCCESS) { return err; }
+	err = enqueuePrimitiveKernel(queue, programs->reduce, groupCount, workGroupSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	cl_ulong partialCount = groupCount;
+	err = setPrimitiveKernelArgs(programs->reduce, partials, partialCount, result, LocalMemory(workGroupSize * elementSize));
+	if (err != CL_SUCCESS) { return err; }
+	return enqueuePrimitiveKernel(queue, programs->reduce, 1, workGroupSize);
+}
+
+cl_int ParallelPrimitives::inclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem output, size_t count) noexcept {
+	if (!count) { return CL_SUCCESS; }
+	ScanPrograms* programs;
+	cl_int err = getScanPrograms(type, operation, programs);
+	if (err != CL_SUCCESS) { return err; }
+	return scanLevel(*programs, getPrimitiveElementSize(type), 0, input, nullptr, output, count, false);
+}
+
+cl_int ParallelPrimitives::exclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem output, size_t count) noexcept {
+	if (!count) { return CL_SUCCESS; }
+	ScanPrograms* programs;
+	cl_int err = getScanPrograms(type, operation, programs);
+	if (err != CL_SUCCESS) { return err; }
+	return scanLevel(*programs, getPrimitiveElementSize(type), 0, input, nullptr, output, count, true);
+}
+
+cl_int ParallelPrimitives::segmentedInclusiveScan(PrimitiveType type, PrimitiveOperation operation, cl_mem input, cl_mem flags, cl_mem output, size_t count) noexcept {
+	if (!count) { return CL_SUCCESS; }
+	if (!flags) { return CL_INVALID_MEM_OBJECT; }
+	ScanPrograms* programs;
+	cl_int err = getScanPrograms(type, operation, programs);
+	if (err != CL_SUCCESS) { return err; }
+	return scanLevel(*programs, getPrimitiveElementSize(type), 0, input, flags, output, count, false);
+}
+
+cl_int ParallelPrimitives::fillUint(cl_mem buffer, size_t count, cl_uint value) noexcept {
+	UintPrograms* programs;
+	cl_int err = getUintPrograms(programs);
+	if (err != CL_SUCCESS) { return err; }
+
+	cl_ulong deviceCount = count;
+	err = setPrimitiveKernelArgs(programs->fill, buffer, deviceCount, value);
+	if (err != CL_SUCCESS) { return err; }
+	return enqueuePrimitiveKernel(queue, programs->fill, (count + programs->workGroupSize - 1) / programs->workGroupSize, programs->workGroupSize);
+}
+
+cl_int ParallelPrimitives::histogram(cl_mem keys, size_t count, cl_mem bins, cl_uint binCount) noexcept {
+	if (!binCount) { return CL_SUCCESS; }
+	UintPrograms* programs;
+	cl_int err = getUintPrograms(programs);
+	if (err != CL_SUCCESS) { return err; }
+	size_t workGroupSize = programs->workGroupSize;
+
+	err = fillUint(bins, binCount, 0);
+	if (err != CL_SUCCESS) { return err; }
+	if (!count) { return CL_SUCCESS; }
+
+	size_t groupCount = (count + workGroupSize - 1) / workGroupSize;
+	if (groupCount > (size_t)computeUnits * 4) { groupCount = (size_t)computeUnits * 4; }
+
+	cl_ulong deviceCount = count;
+	// NOTE: Leaves some room for whatever the implementation puts into local memory itself.
+	if ((cl_ulong)binCount * sizeof(cl_uint) <= localMemorySize / 2) {
+		err = setPrimitiveKernelArgs(programs->histogramLocal, keys, deviceCount, bins, binCount, LocalMemory(binCount * sizeof(cl_uint)));
+		if (err != CL_SUCCESS) { return err; }
+		return enqueuePrimitiveKernel(queue, programs->histogramLocal, groupCount, workGroupSize);
+	}
+
+	err = setPrimitiveKernelArgs(programs->histogramGlobal, keys, deviceCount, bins, binCount);
+	if (err != CL_SUCCESS) { return err; }
+	return enqueuePrimitiveKernel(queue, programs->histogramGlobal, groupCount, workGroupSize);
+}
+
+cl_int ParallelPrimitives::radixSort(cl_mem keys, cl_mem values, size_t count, cl_uint keyBits) noexcept {
+	if (count < 2 || !keyBits) { return CL_SUCCESS; }
+	if (keyBits > 32) { keyBits = 32; }
+	// NOTE: The digit table gets scanned with 32-bit positions.
+	if (count > 0xFFFFFFFF) { return CL_INVALID_BUFFER_SIZE; }
+
+	UintPrograms* programs;
+	cl_int err = getUintPrograms(programs);
+	if (err != CL_SUCCESS) { return err; }
+	ScanPrograms* scan;
+	err = getScanPrograms(PrimitiveType::UINT, PrimitiveOperation::SUM, scan);
+	if (err != CL_SUCCESS) { return err; }
+	size_t workGroupSize = programs->workGroupSize;
+	size_t tileCount = (count + workGroupSize - 1) / workGroupSize;
+	if (tileCount * PRIMITIVE_RADIX_DIGITS > 0xFFFFFFFF) { return CL_INVALID_BUFFER_SIZE; }
+
+	err = ensureScratch(radixKeys, count * sizeof(cl_uint));
+	if (err != CL_SUCCESS) { return err; }
+	if (values) {
+		err = ensureScratch(radixValues, count * sizeof(cl_uint));
+		if (err != CL_SUCCESS) { return err; }
+	}
+	err = ensureScratch(radixDigitCounts, tileCount * PRIMITIVE_RADIX_DIGITS * sizeof(cl_uint));
+	if (err != CL_SUCCESS) { return err; }
+
+	cl_mem keysFrom = keys;
+	cl_mem keysTo = radixKeys.buffer;
+	cl_mem valuesFrom = values;
+	cl_mem valuesTo = values ? radixValues.buffer.get() : nullptr;
+	cl_mem digitCounts = radixDigitCounts.buffer;
+	cl_ulong deviceCount = count;
+	cl_uint deviceTileCount = (cl_uint)tileCount;
+	cl_int hasValues = values ? 1 : 0;
+
+	cl_uint passCount = (keyBits + PRIMITIVE_RADIX_BITS - 1) / PRIMITIVE_RADIX_BITS;
+	for (cl_uint pass = 0; pass < passCount; pass++) {
+		cl_uint shift = pass * PRIMITIVE_RADIX_BITS;
+		cl_uint remainingBits = keyBits - shift;
+		cl_uint digitMask = remainingBits < PRIMITIVE_RADIX_BITS ? ((cl_uint)1 << remainingBits) - 1 : PRIMITIVE_RADIX_DIGITS - 1;
+
+		err = setPrimitiveKernelArgs(programs->radixCount, keysFrom, deviceCount, shift, digitMask, digitCounts, deviceTileCount, LocalMemory(PRIMITIVE_RADIX_DIGITS * sizeof(cl_uint)));
+		if (err != CL_SUCCESS) { return err; }
+		err = enqueuePrimitiveKernel(queue, programs->radixCount, tileCount, workGroupSize);
+		if (err != CL_SUCCESS) { return err; }
+
+		err = scanLevel(*scan, sizeof(cl_uint), 0, digitCounts, nullptr, digitCounts, tileCount * PRIMITIVE_RADIX_DIGITS, true);
+		if (err != CL_SUCCESS) { return err; }
+
+		err = setPrimitiveKernelArgs(programs->radixScatter, keysFrom, valuesFrom, keysTo, valuesTo, deviceCount, shift, digitMask, digitCounts, deviceTileCount, hasValues,
+									 LocalMemory(workGroupSize * sizeof(cl_uint)), LocalMemory(workGroupSize * sizeof(cl_uint)), LocalMemory(workGroupSize * sizeof(cl_uint)),
+									 LocalMemory(2 * workGroupSize * sizeof(cl_uint)), LocalMemory(PRIMITIVE_RADIX_DIGITS * sizeof(cl_uint)));
+		if (err != CL_SUCCESS) { return err; }
+		err = enqueuePrimitiveKernel(queue, programs->radixScatter, tileCount, workGroupSize);
+		if (err != CL_SUCCESS) { return err; }
+
+		std::swap(keysFrom, keysTo);
+		std::swap(valuesFrom, valuesTo);
+	}
+
+	// NOTE: An odd number of passes leaves the result in the scratch buffers.
+	if (keysFrom != keys) {
+		err = clEnqueueCopyBuffer(queue, keysFrom, keys, 0, 0, count * sizeof(cl_uint), 0, nullptr, nullptr);
+		if (err != CL_SUCCESS) { return err; }
+		if (values) {
+			err = clEnqueueCopyBuffer(queue, valuesFrom, values, 0, 0, count * sizeof(cl_uint), 0, nullptr, nullptr);
+			if (err != CL_SUCCESS) { return err; }
+		}
+	}
+
+	return CL_SUCCESS;
+}
+
+void ParallelPrimitives::release_scratch() noexcept {
+	scanLevels.clear();
+	reducePartials = ScratchBuffer();
+	radixKeys = ScratchBuffer();
+	radixValues = ScratchBuffer();
+	radixDigitCounts = ScratchBuffer();
+}
@@ -0,0 +1,172 @@
+#include "cl_peer_migration.h"
+
+#include <cstdlib>						// For malloc and free.
+
+#include <utility>						// For std::move.
+
+PeerBufferMigrator::PeerBufferMigrator(cl_int& err, cl_context sourceContext, cl_command_queue sourceQueue, cl_context destinationContext, cl_command_queue destinationQueue,
+									   const PeerMigrationConfig& config) noexcept
+	: sourceContext(sourceContext), sourceQueue(sourceQueue), destinationContext(destinationContext), destinationQueue(destinationQueue), config(config) {
+	if (!sourceContext || !sourceQueue || !destinationContext || !destinationQueue) { err = CL_INVALID_VALUE; return; }
+	// NOTE: The pipeline reads the next chunk before the previous one is written out, so it needs two staging buffers at least.
+	if (config.chunk_size == 0 || config.staging_buffer_count < 2) { err = CL_INVALID_VALUE; return; }
+	err = CL_SUCCESS;
+}
+
+cl_int PeerBufferMigrator::enqueueSourceMarker(OpenCLEvent& marker) noexcept {
+	// NOTE: Same queue means the in-order queue already takes care of it.
+	if (sourceQueue == destinationQueue) { marker.reset(); return CL_SUCCESS; }
+	if (!clEnqueueMarkerWithWaitList) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+	cl_event newMarker;
+	cl_int err = clEnqueueMarkerWithWaitList(sourceQueue, 0, nullptr, &newMarker);
+	if (err != CL_SUCCESS) { return err; }
+	marker.reset(newMarker);
+	// NOTE: Another queue waits for the marker, which is only guaranteed to work once the source queue got flushed. Implementations that
+	// only submit on flush would otherwise never get to the marker.
+	return clFlush(sourceQueue);
+}
+
+cl_int PeerBufferMigrator::ensureStaging(size_t size) noexcept {
+	if (stagingBuffers.length && stagingCapacity >= size) { return CL_SUCCESS; }
+	releaseStaging();
+
+	cl_int err = stagingBuffers.reserve(config.staging_buffer_count);
+	if (err != CL_SUCCESS) { return err; }
+	for (cl_uint i = 0; i < config.staging_buffer_count; i++) {
+		StagingBuffer stagingBuffer;
+		// NOTE: Pinned in the source context, since the source device reads into it. The destination implementation gets a normal
+		// host pointer, which it can't know is pinned, but that side has to copy it into its own memory either way.
+		if (config.pinned_staging) {
+			OpenCLMemObject pinnedBuffer(clCreateBuffer(sourceContext, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &err));
+			if (pinnedBuffer) {
+				void* mapped = clEnqueueMapBuffer(sourceQueue, pinnedBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &err);
+				if (err == CL_SUCCESS) {
+					stagingBuffer.pinnedBuffer = std::move(pinnedBuffer);
+					stagingBuffer.hostData = mapped;
+				}
+			}
+		}
+		if (!stagingBuffer.hostData) {
+			stagingBuffer.hostData = malloc(size);
+			if (!stagingBuffer.hostData) { releaseStaging(); return CL_EXT_INSUFFICIENT_HOST_MEM; }
+		}
+		stagingBuffers.push_back(std::move(stagingBuffer));			// NOTE: Can't fail, the space is reserved.
+	}
+	stagingCapacity = size;
+	return CL_SUCCESS;
+}
+
+void PeerBufferMigrator::drainStaging() noexcept {
+	for (size_t i = 0; i < stagingBuffers.length; i++) {
+		StagingBuffer& stagingBuffer = stagingBuffers[i];
+		// NOTE: Errors aren't handled here, this only runs on the way out of a failed copy, which already has an error to report.
+		if (stagingBuffer.read) { cl_event read = stagingBuffer.read; clWaitForEvents(1, &read); stagingBuffer.read.reset(); }
+		if (stagingBuffer.write) { cl_event write = stagingBuffer.write; clWaitForEvents(1, &write); stagingBuffer.write.reset(); }
+	}
+}
+
+void PeerBufferMigrator::releaseStaging() noexcept {
+	drainStaging();
+	for (size_t i = 0; i < stagingBuffers.length; i++) {
+		StagingBuffer& stagingBuffer = stagingBuffers[i];
+		if (stagingBuffer.pinnedBuffer) {
+			clEnqueueUnmapMemObject(sourceQueue, stagingBuffer.pinnedBuffer, stagingBuffer.hostData, 0, nullptr, nullptr);
+		} else {
+			free(stagingBuffer.hostData);
+		}
+	}
+	stagingBuffers.clear();
+	stagingCapacity = 0;
+}
+
+cl_int PeerBufferMigrator::copy(cl_mem sourceBuffer, size_t sourceOffset, cl_mem destinationBuffer, size_t destinationOffset, size_t size, cl_event* event) noexcept {
+	if (!sourceBuffer || !destinationBuffer || size == 0) { return CL_INVALID_VALUE; }
+
+	if (is_same_context()) {
+		OpenCLEvent marker;
+		cl_int err = enqueueSourceMarker(marker);
+		if (err != CL_SUCCESS) { return err; }
+		cl_event waitEvent = marker;
+		err = clEnqueueCopyBuffer(destinationQueue, sourceBuffer, destinationBuffer, sourceOffset, destinationOffset, size, waitEvent ? 1 : 0, waitEvent ? &waitEvent : nullptr, event);
+		if (err != CL_SUCCESS) { return err; }
+		direct_copy_count++;
+		return CL_SUCCESS;
+	}
+
+	size_t chunkSize = size < config.chunk_size ? size : config.chunk_size;
+	cl_int err = ensureStaging(chunkSize);
+	if (err != CL_SUCCESS) { return err; }
+
+	// NOTE: Every iteration starts the read of the next chunk and then hands the chunk before it (whose read had an iteration's worth of
+	// time to finish) to the destination device. A staging buffer gets reused once the write that used it is done.
+	size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+	for (size_t chunk = 0; chunk <= chunkCount; chunk++) {
+		if (chunk < chunkCount) {
+			StagingBuffer& stagingBuffer = stagingBuffers[chunk % stagingBuffers.length];
+			if (stagingBuffer.write) {
+				cl_event write = stagingBuffer.write;
+				err = clWaitForEvents(1, &write);
+				if (err != CL_SUCCESS) { drainStaging(); return err; }
+				stagingBuffer.write.reset();
+			}
+
+			size_t offset = chunk * chunkSize;
+			size_t currentSize = size - offset < chunkSize ? size - offset : chunkSize;
+			cl_event read;
+			err = clEnqueueReadBuffer(sourceQueue, sourceBuffer, CL_FALSE, sourceOffset + offset, currentSize, stagingBuffer.hostData, 0, nullptr, &read);
+			if (err != CL_SUCCESS) { drainStaging(); return err; }
+			stagingBuffer.read.reset(read);
+			// NOTE: Flush, so that the read gets going while the host waits for the previous one.
+			clFlush(sourceQueue);
+		}
+
+		if (chunk > 0) {
+			size_t previousChunk = chunk - 1;
+			StagingBuffer& stagingBuffer = stagingBuffers[previousChunk % stagingBuffers.length];
+			cl_event read = stagingBuffer.read;
+			err = clWaitForEvents(1, &read);
+			if (err != CL_SUCCESS) { drainStaging(); return err; }
+			stagingBuffer.read.reset();
+
+			size_t offset = previousChunk * chunkSize;
+			size_t currentSize = size - offset < chunkSize ? size - offset : chunkSize;
+			cl_event write;
+			err = clEnqueueWriteBuffer(destinationQueue, destinationBuffer, CL_FALSE, destinationOffset + offset, currentSize, stagingBuffer.hostData, 0, nullptr, &write);
+			if (err != CL_SUCCESS) { drainStaging(); return err; }
+			stagingBuffer.write.reset(write);
+			clFlush(destinationQueue);
+		}
+	}
+
+	// NOTE: The staging buffers have to stay untouched until the destination device has its data, so the last writes get waited for here.
+	for (size_t i = 0; i < stagingBuffers.length; i++) {
+		StagingBuffer& stagingBuffer = stagingBuffers[i];
+		if (!stagingBuffer.write) { continue; }
+		cl_event write = stagingBuffer.write;
+		err = clWaitForEvents(1, &write);
+		if (err != CL_SUCCESS) { drainStaging(); return err; }
+		stagingBuffer.write.reset();
+	}
+
+	staged_copy_count++;
+	bytes_staged += size;
+	return CL_SUCCESS;
+}
+
+cl_int PeerBufferMigrator::migrate(cl_mem buffer, bool contentUndefined, cl_event* event) noexcept {
+	if (!buffer) { return CL_INVALID_VALUE; }
+	if (!is_same_context()) { return CL_INVALID_CONTEXT; }
+	if (!clEnqueueMigrateMemObjects) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+
+	OpenCLEvent marker;
+	cl_int err = enqueueSourceMarker(marker);
+	if (err != CL_SUCCESS) { return err; }
+	cl_event waitEvent = marker;
+	cl_mem_migration_flags flags = contentUndefined ? CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED : 0;
+	err = clEnqueueMigrateMemObjects(destinationQueue, 1, &buffer, flags, waitEvent ? 1 : 0, waitEvent ? &waitEvent : nullptr, event);
+	if (err != CL_SUCCESS) { return err; }
+	migration_count++;
+	return CL_SUCCESS;
+}
+
+PeerBufferMigrator::~PeerBufferMigrator() noexcept { releaseStaging(); }
@@ -0,0 +1,148 @@
+#include "cl_profiling.h"
+
+#include <new>							// For std::nothrow.
+
+#include <string>						// For std::string.
+
+#include <vector>						// For std::vector.
+
+#include <mutex>						// For std::mutex and std::lock_guard.
+
+#include <thread>						// For std::this_thread::yield().
+
+KernelProfiler::Entry* KernelProfiler::getEntry(const char* name) noexcept {
+	// NOTE: Caller has to hold the mutex.
+	Entry& entry = entries[name];
+	entry.profiler = this;
+	if (entry.name.empty()) { entry.name = name; }
+	return &entry;
+}
+
+void CL_CALLBACK KernelProfiler::collectCallback(cl_event event, cl_int event_command_status, void* user_data) noexcept {
+	Entry* entry = (Entry*)user_data;
+	KernelProfiler* profiler = entry->profiler;
+
+	ProfiledCommand command;
+	command.name = entry->name.c_str();
+	bool timestampsAvailable = event_command_status >= 0;
+	if (timestampsAvailable) {
+		timestampsAvailable = clGetEventInfo(event, CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &command.queue, nullptr) == CL_SUCCESS &&
+							  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &command.queued, nullptr) == CL_SUCCESS &&
+							  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &command.submit, nullptr) == CL_SUCCESS &&
+							  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &command.start, nullptr) == CL_SUCCESS &&
+							  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &command.end, nullptr) == CL_SUCCESS;
+	}
+
+	ProfiledCommandSink sink;
+	void* sinkUserData;
+	{
+		std::lock_guard<std::mutex> lock(profiler->mutex);
+		if (timestampsAvailable) {
+			// NOTE: Some implementations have been known to report slightly out of order timestamps, so we clamp instead of underflowing.
+			entry->deviceTime.record(command.end > command.start ? command.end - command.start : 0);
+			entry->queueLatency.record(command.start > command.queued ? command.start - command.queued : 0);
+		} else { entry->failed_count++; }
+		sink = profiler->sink;
+		sinkUserData = profiler->sinkUserData;
+	}
+
+	if (timestampsAvailable && sink) { sink(command, sinkUserData); }
+
+	// NOTE: Has to be the very last thing, the profiler can be destroyed as soon as this hits zero.
+	profiler->pendingCount.fetch_sub(1, std::memory_order_release);
+}
+
+cl_int KernelProfiler::recordIntoEntry(cl_event event, Entry* entry) noexcept {
+	pendingCount.fetch_add(1, std::memory_order_relaxed);
+	cl_int err = clSetEventCallback(event, CL_COMPLETE, collectCallback, entry);
+	if (err != CL_SUCCESS) { pendingCount.fetch_sub(1, std::memory_order_release); return err; }
+	return CL_SUCCESS;
+}
+
+cl_int KernelProfiler::record(cl_event event, const char* name) noexcept {
+	if (!clSetEventCallback) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+	Entry* entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entry = getEntry(name);
+	}
+	return recordIntoEntry(event, entry);
+}
+
+cl_int KernelProfiler::recordKernel(cl_event event, cl_kernel kernel) noexcept {
+	if (!clSetEventCallback) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto cachedEntry = kernelEntryCache.find(kernel);
+		if (cachedEntry != kernelEntryCache.end()) { entry = cachedEntry->second; }
+	}
+
+	if (!entry) {
+		// NOTE: Looked up outside of the lock, clGetKernelInfo can take a while on some implementations.
+		size_t nameSize;
+		cl_int err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &nameSize);
+		if (err != CL_SUCCESS) { return err; }
+		char* name = new (std::nothrow) char[nameSize];
+		if (!name) { return CL_EXT_INSUFFICIENT_HOST_MEM; }
+		err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, nameSize, name, nullptr);
+		if (err != CL_SUCCESS) { delete[] name; return err; }
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			entry = getEntry(name);
+			kernelEntryCache[kernel] = entry;
+		}
+		delete[] name;
+	}
+
+	return recordIntoEntry(event, entry);
+}
+
+void KernelProfiler::forgetKernel(cl_kernel kernel) noexcept {
+	std::lock_guard<std::mutex> lock(mutex);
+	kernelEntryCache.erase(kernel);
+}
+
+void KernelProfiler::set_sink(ProfiledCommandSink sink, void* userData) noexcept {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->sink = sink;
+	sinkUserData = userData;
+}
+
+std::vector<KernelProfileSummary> KernelProfiler::summarize() noexcept {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<KernelProfileSummary> result;
+	result.reserve(entries.size());
+	for (const auto& namedEntry : entries) {
+		const Entry& entry = namedEntry.second;
+		KernelProfileSummary summary;
+		summary.name = entry.name;
+		summary.count = entry.deviceTime.total_count;
+		summary.total_device_time = entry.deviceTime.sum;
+		summary.device_time_p50 = entry.deviceTime.get_percentile(50);
+		summary.device_time_p99 = entry.deviceTime.get_percentile(99);
+		summary.device_time_max = entry.deviceTime.max_value;
+		summary.total_queue_latency = entry.queueLatency.sum;
+		summary.queue_latency_p50 = entry.queueLatency.get_percentile(50);
+		summary.queue_latency_p99 = entry.queueLatency.get_percentile(99);
+		summary.failed_count = entry.failed_count;
+		result.push_back(summary);
+	}
+	return result;
+}
+
+void KernelProfiler::reset() noexcept {
+	std::lock_guard<std::mutex> lock(mutex);
+	// NOTE: We can't erase the entries, pending callbacks might still point to them.
+	for (auto& namedEntry : entries) {
+		namedEntry.second.deviceTime.reset();
+		namedEntry.second.queueLatency.reset();
+		namedEntry.second.failed_count = 0;
+	}
+}
+
+void KernelProfiler::waitForPendingCallbacks() const noexcept {
+	while (pendingCount.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+}
@@ -0,0 +1,128 @@
+#include "cl_submission_batcher.h"
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+static uint64_t getBatcherTimestamp() noexcept {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SubmissionBatcher::SubmissionBatcher(cl_command_queue queue, const SubmissionPolicy& policy) noexcept : queue(queue), policy(policy) {
+	batchLimit = policy.max_batch_commands;
+}
+
+bool SubmissionBatcher::isDeviceIdle(cl_int& err) noexcept {
+	err = CL_SUCCESS;
+	if (deviceKnownIdle) { return true; }
+	if (!lastFlushMarker) { return false; }			// NOTE: No markers (below OpenCL 1.2), so there's no telling.
+
+	cl_int status;
+	err = clGetEventInfo(lastFlushMarker, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, nullptr);
+	if (err != CL_SUCCESS) { return false; }
+	// NOTE: Negative statuses mean the command was terminated, which also means there's nothing left for the device to do.
+	if (status > CL_COMPLETE) { return false; }
+
+	deviceKnownIdle = true;
+	lastFlushMarker.reset();
+	return true;
+}
+
+cl_int SubmissionBatcher::flushPending() noexcept {
+	cl_int err;
+	if (clEnqueueMarkerWithWaitList) {
+		cl_event marker = nullptr;
+		err = clEnqueueMarkerWithWaitList(queue, 0, nullptr, &marker);
+		if (err != CL_SUCCESS) { return err; }
+		lastFlushMarker.reset(marker);
+	}
+	deviceKnownIdle = false;
+
+	err = clFlush(queue);
+	if (err != CL_SUCCESS) { return err; }
+
+	pendingCommands = 0;
+	pendingWork = 0;
+	flush_count++;
+	return CL_SUCCESS;
+}
+
+cl_int SubmissionBatcher::recordEnqueue(uint64_t estimatedWork) noexcept {
+	uint64_t now = 0;
+	if (policy.max_batch_delay) {
+		now = getBatcherTimestamp();
+		if (!pendingCommands) { firstPendingTime = now; }
+	}
+	pendingCommands++;
+	pendingWork += estimatedWork;
+	command_count++;
+
+	cl_int err;
+	if (pendingCommands >= batchLimit) {
+		if (policy.adaptive) {
+			bool idle = isDeviceIdle(err);
+			if (err != CL_SUCCESS) { return err; }
+			// NOTE: Still busy at the limit means the batches could be bigger without starving the device.
+			if (!idle && batchLimit < policy.max_batch_commands) {
+				batchLimit = batchLimit * 2 < policy.max_batch_commands ? batchLimit * 2 : policy.max_batch_commands;
+			}
+		}
+		return flushPending();
+	}
+
+	if (policy.max_batch_work && pendingWork >= policy.max_batch_work) { return flushPending(); }
+	if (policy.max_batch_delay && now - firstPendingTime >= policy.max_batch_delay) { return flushPending(); }
+
+	return poll();
+}
+
+cl_int SubmissionBatcher::enqueueNDRangeKernel(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize,
+											   cl_uint numEventsInWaitList, const cl_event* eventWaitList, cl_event* event) noexcept {
+	cl_int err = clEnqueueNDRangeKernel(queue, kernel, workDim, nullptr, globalWorkSize, localWorkSize, numEventsInWaitList, eventWaitList, event);
+	if (err != CL_SUCCESS) { return err; }
+
+	uint64_t workItems = 1;
+	for (cl_uint i = 0; i < workDim; i++) { workItems *= globalWorkSize[i]; }
+	return recordEnqueue(workItems);
+}
+
+cl_int SubmissionBatcher::poll() noexcept {
+	if (!pendingCommands) { return CL_SUCCESS; }
+
+	if (policy.max_batch_delay && getBatcherTimestamp() - firstPendingTime >= policy.max_batch_delay) { return flushPending(); }
+
+	if (policy.flush_when_idle) {
+		cl_int err;
+		bool idle = isDeviceIdle(err);
+		if (err != CL_SUCCESS) { return err; }
+		if (idle) {
+			// NOTE: The device ran dry before the batch was full, so smaller batches would've kept it busy.
+			if (policy.adaptive) {
+				batchLimit = batchLimit / 2 > policy.min_batch_commands ? batchLimit / 2 : policy.min_batch_commands;
+			}
+			idle_flush_count++;
+			return flushPending();
+		}
+	}
+
+	return CL_SUCCESS;
+}
+
+cl_int SubmissionBatcher::flush() noexcept {
+	if (!pendingCommands) { return CL_SUCCESS; }
+	return flushPending();
+}
+
+cl_int SubmissionBatcher::finish() noexcept {
+	if (pendingCommands) { flush_count++; }
+	cl_int err = clFinish(queue);
+	if (err != CL_SUCCESS) { return err; }
+
+	mark_flushed();
+	deviceKnownIdle = true;
+	lastFlushMarker.reset();
+	return CL_SUCCESS;
+}
+
+void SubmissionBatcher::mark_flushed() noexcept {
+	pendingCommands = 0;
+	pendingWork = 0;
+}
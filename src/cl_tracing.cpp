@@ -0,0 +1,313 @@
+#include "cl_tracing.h"
+
+#include <cstdint>						// For fixed-width types.
+
+#include <cinttypes>					// For PRIu64 and friends.
+
+#include <cstdio>						// For snprintf.
+
+#include <new>							// For std::nothrow.
+
+#include <atomic>						// For std::atomic.
+
+#include <mutex>						// For std::mutex and std::lock_guard.
+
+#include <chrono>						// For std::chrono::steady_clock.
+
+#include <vector>						// For std::vector.
+
+#include <string>						// For std::string.
+
+#include <unordered_set>				// For interning device command names.
+
+#include <fstream>						// For writing the trace file.
+
+enum class TraceEvent_kind : uint8_t {
+	API_CALL,
+	HOST_REGION,
+	DEVICE_COMMAND
+};
+
+struct TraceEvent {
+	const char* name;
+	uint64_t start;					// NOTE: Host clock for host events, raw device clock for device events (converted when dumping).
+	uint64_t duration;
+	uint32_t track;					// NOTE: Thread index for host events, queue index for device events.
+	TraceEvent_kind kind;
+};
+
+struct TraceBuffer {
+	TraceEvent* events;
+	uint64_t capacity_mask;
+	std::atomic<uint64_t> head { 0 };		// NOTE: Only ever written by the owning thread.
+	uint32_t threadIndex;
+};
+
+struct TraceQueueClock {
+	cl_command_queue queue;
+	int64_t offset;					// NOTE: host time = device time + offset
+	bool calibrated;				// NOTE: Set by calibrateTraceDeviceClock(), after which the estimates don't touch the offset anymore.
+	bool estimated;
+};
+
+static std::atomic<bool> tracingEnabled { false };
+
+static std::mutex bufferRegistryMutex;
+static std::vector<TraceBuffer*> traceBuffers;
+static uint64_t configuredEventsPerThread = 65536;
+
+// NOTE: Buffers are never freed, since dumping has to work even after the thread that recorded them is gone.
+static thread_local TraceBuffer* threadTraceBuffer = nullptr;
+static thread_local bool threadTraceBufferFailed = false;
+
+static std::mutex queueClockMutex;
+static std::vector<TraceQueueClock> queueClocks;
+static std::unordered_set<std::string> internedNames;
+
+uint64_t getTraceTimestamp() noexcept {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceBuffer* getThreadTraceBuffer() noexcept {
+	if (threadTraceBuffer) { return threadTraceBuffer; }
+	if (threadTraceBufferFailed) { return nullptr; }		// NOTE: So that we don't retry the allocation on every single call.
+
+	std::lock_guard<std::mutex> lock(bufferRegistryMutex);
+
+	TraceBuffer* buffer = new (std::nothrow) TraceBuffer;
+	if (!buffer) { threadTraceBufferFailed = true; return nullptr; }
+	buffer->events = new (std::nothrow) TraceEvent[configuredEventsPerThread];
+	if (!buffer->events) { delete buffer; threadTraceBufferFailed = true; return nullptr; }
+	buffer->capacity_mask = configuredEventsPerThread - 1;
+	buffer->threadIndex = (uint32_t)traceBuffers.size();
+	traceBuffers.push_back(buffer);
+
+	threadTraceBuffer = buffer;
+	return buffer;
+}
+
+static void recordTraceEvent(const char* name, uint64_t start, uint64_t duration, uint32_t track, TraceEvent_kind kind) noexcept {
+	TraceBuffer* buffer = getThreadTraceBuffer();
+	if (!buffer) { return; }
+
+	uint64_t index = buffer->head.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer->events[index & buffer->capacity_mask];
+	event.name = name;
+	event.start = start;
+	event.duration = duration;
+	event.track = track == (uint32_t)-1 ? buffer->threadIndex : track;
+	event.kind = kind;
+	buffer->head.store(index + 1, std::memory_order_release);		// NOTE: Publishes the event to the dumping thread.
+}
+
+template <typename tag_t, typename func_t>
+struct TracedFunction;
+
+template <typename tag_t, typename return_t, typename... args_t>
+struct TracedFunction<tag_t, return_t (CL_API_CALL*)(args_t...)> {
+	static return_t CL_API_CALL call(args_t... args) {
+		uint64_t start = getTraceTimestamp();
+		return_t result = tag_t::original(args...);
+		recordTraceEvent(tag_t::name, start, getTraceTimestamp() - start, (uint32_t)-1, TraceEvent_kind::API_CALL);
+		return result;
+	}
+};
+
+#define DEFINE_TRACE_TAG(func) struct func##_trace_tag { static constexpr const char* name = #func; static inline func##_func original; };
+CL_EXT_FOR_EACH_BOUND_FUNCTION(DEFINE_TRACE_TAG)
+
+// NOTE: Functions that haven't been bound (lazy binding) are left alone.
+#define INSTALL_TRACE_WRAPPER(func) if (func) { func##_trace_tag::original = func; func = &TracedFunction<func##_trace_tag, func##_func>::call; }
+#define REMOVE_TRACE_WRAPPER(func) if (func == &TracedFunction<func##_trace_tag, func##_func>::call) { func = func##_trace_tag::original; }
+
+cl_int enableOpenCLTracing(size_t eventsPerThread) noexcept {
+	{
+		std::lock_guard<std::mutex> lock(bufferRegistryMutex);
+		uint64_t capacity = 1;
+		while (capacity < eventsPerThread) { capacity <<= 1; }
+		configuredEventsPerThread = capacity;
+	}
+
+	if (tracingEnabled.load(std::memory_order_relaxed)) { return CL_SUCCESS; }
+
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(INSTALL_TRACE_WRAPPER)
+	tracingEnabled.store(true, std::memory_order_release);
+
+	return CL_SUCCESS;
+}
+
+void disableOpenCLTracing() noexcept {
+	if (!tracingEnabled.load(std::memory_order_relaxed)) { return; }
+	CL_EXT_FOR_EACH_BOUND_FUNCTION(REMOVE_TRACE_WRAPPER)
+	tracingEnabled.store(false, std::memory_order_release);
+}
+
+bool isOpenCLTracingEnabled() noexcept { return tracingEnabled.load(std::memory_order_acquire); }
+
+void traceHostRegion(const char* name, uint64_t start, uint64_t duration) noexcept {
+	if (!tracingEnabled.load(std::memory_order_relaxed)) { return; }
+	recordTraceEvent(name, start, duration, (uint32_t)-1, TraceEvent_kind::HOST_REGION);
+}
+
+static size_t getQueueClockIndex(cl_command_queue queue) noexcept {
+	// NOTE: Caller has to hold queueClockMutex. Linear search is fine, nobody has more than a handful of queues.
+	for (size_t i = 0; i < queueClocks.size(); i++) {
+		if (queueClocks[i].queue == queue) { return i; }
+	}
+	queueClocks.push_back({ queue, 0, false, false });
+	return queueClocks.size() - 1;
+}
+
+void traceProfiledCommandSink(const ProfiledCommand& command, void*) noexcept {
+	if (!tracingEnabled.load(std::memory_order_relaxed)) { return; }
+	uint64_t now = getTraceTimestamp();
+
+	const char* name;
+	size_t queueIndex;
+	{
+		std::lock_guard<std::mutex> lock(queueClockMutex);
+		queueIndex = getQueueClockIndex(command.queue);
+		TraceQueueClock& clock = queueClocks[queueIndex];
+		if (!clock.calibrated) {
+			// NOTE: The callback always arrives after the command ended, so every estimate is too big by the callback latency.
+			// The smallest one we've seen is the best one.
+			int64_t estimate = (int64_t)now - (int64_t)command.end;
+			if (!clock.estimated || estimate < clock.offset) { clock.offset = estimate; clock.estimated = true; }
+		}
+		// NOTE: The name belongs to the profiler, which might be gone by the time we dump, so we keep our own copy.
+		name = internedNames.insert(command.name).first->c_str();
+	}
+
+	recordTraceEvent(name, command.start, command.end > command.start ? command.end - command.start : 0, (uint32_t)queueIndex, TraceEvent_kind::DEVICE_COMMAND);
+}
+
+cl_int calibrateTraceDeviceClock(cl_command_queue queue) noexcept {
+	if (!clEnqueueMarkerWithWaitList) { return CL_EXT_FUNCTION_UNAVAILABLE; }
+	cl_event marker;
+	uint64_t before = getTraceTimestamp();
+	cl_int err = clEnqueueMarkerWithWaitList(queue, 0, nullptr, &marker);
+	uint64_t after = getTraceTimestamp();
+	if (err != CL_SUCCESS) { return err; }
+
+	err = clWaitForEvents(1, &marker);
+	if (err != CL_SUCCESS) { clReleaseEvent(marker); return err; }
+
+	cl_ulong queued;
+	err = clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, nullptr);
+	clReleaseEvent(marker);
+	if (err != CL_SUCCESS) { return err; }
+
+	std::lock_guard<std::mutex> lock(queueClockMutex);
+	TraceQueueClock& clock = queueClocks[getQueueClockIndex(queue)];
+	clock.offset = (int64_t)(before + (after - before) / 2) - (int64_t)queued;
+	clock.calibrated = true;
+
+	return CL_SUCCESS;
+}
+
+static void writeJSONEscapedString(std::ofstream& file, const char* string) noexcept {
+	file.put('"');
+	for (; *string != '\0'; string++) {
+		if (*string == '"' || *string == '\\') { file.put('\\'); }
+		if ((unsigned char)*string < 0x20) { continue; }		// NOTE: Control characters have no business being in names anyway.
+		file.put(*string);
+	}
+	file.put('"');
+}
+
+cl_int dumpChromeTrace(const char* path) noexcept {
+	struct DumpedEvent {
+		TraceEvent event;
+		int64_t hostStart;
+	};
+	std::vector<DumpedEvent> dumpedEvents;
+	size_t threadCount;
+
+	{
+		std::lock_guard<std::mutex> lock(bufferRegistryMutex);
+		threadCount = traceBuffers.size();
+		for (TraceBuffer* buffer : traceBuffers) {
+			uint64_t headBefore = buffer->head.load(std::memory_order_acquire);
+			uint64_t capacity = buffer->capacity_mask + 1;
+			uint64_t firstIndex = headBefore > capacity ? headBefore - capacity : 0;
+			size_t firstDumpedEvent = dumpedEvents.size();
+			for (uint64_t i = firstIndex; i < headBefore; i++) { dumpedEvents.push_back({ buffer->events[i & buffer->capacity_mask], 0 }); }
+
+			// NOTE: Anything that the owning thread might have overwritten while we were copying gets thrown away.
+			// The thread could be halfway through writing index headAfter as well, which overwrites index headAfter - capacity.
+			uint64_t headAfter = buffer->head.load(std::memory_order_acquire);
+			uint64_t firstValidIndex = headAfter + 1 > capacity ? headAfter + 1 - capacity : 0;
+			if (firstValidIndex > firstIndex) {
+				size_t invalidCount = (size_t)(firstValidIndex - firstIndex);
+				if (invalidCount > headBefore - firstIndex) { invalidCount = (size_t)(headBefore - firstIndex); }
+				dumpedEvents.erase(dumpedEvents.begin() + firstDumpedEvent, dumpedEvents.begin() + firstDumpedEvent + invalidCount);
+			}
+		}
+	}
+
+	size_t queueCount;
+	{
+		std::lock_guard<std::mutex> lock(queueClockMutex);
+		queueCount = queueClocks.size();
+		for (DumpedEvent& dumpedEvent : dumpedEvents) {
+			if (dumpedEvent.event.kind == TraceEvent_kind::DEVICE_COMMAND) {
+				dumpedEvent.hostStart = (int64_t)dumpedEvent.event.start + queueClocks[dumpedEvent.event.track].offset;
+			} else { dumpedEvent.hostStart = (int64_t)dumpedEvent.event.start; }
+		}
+	}
+
+	// NOTE: Timestamps are written relative to the earliest event, the absolute values are meaningless anyway.
+	int64_t baseTimestamp = 0;
+	if (!dumpedEvents.empty()) {
+		baseTimestamp = dumpedEvents[0].hostStart;
+		for (const DumpedEvent& dumpedEvent : dumpedEvents) {
+			if (dumpedEvent.hostStart < baseTimestamp) { baseTimestamp = dumpedEvent.hostStart; }
+		}
+	}
+
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) { return CL_EXT_FILE_OPEN_FAILED; }
+
+	char numberBuffer[128];
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"host\"}},\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"device queues\"}}";
+	for (size_t i = 0; i < threadCount; i++) {
+		snprintf(numberBuffer, sizeof(numberBuffer), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"thread %zu\"}}", i, i);
+		file << numberBuffer;
+	}
+	for (size_t i = 0; i < queueCount; i++) {
+		snprintf(numberBuffer, sizeof(numberBuffer), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%zu,\"args\":{\"name\":\"queue %zu\"}}", i, i);
+		file << numberBuffer;
+	}
+
+	for (const DumpedEvent& dumpedEvent : dumpedEvents) {
+		const TraceEvent& event = dumpedEvent.event;
+		const char* category;
+		switch (event.kind) {
+		case TraceEvent_kind::API_CALL: category = "api"; break;
+		case TraceEvent_kind::HOST_REGION: category = "host"; break;
+		default: category = "device"; break;
+		}
+
+		file << ",\n{\"name\":";
+		writeJSONEscapedString(file, event.name);
+		// NOTE: Chrome traces are in microseconds, but they take fractions, so we don't lose the nanoseconds.
+		uint64_t relativeStart = (uint64_t)(dumpedEvent.hostStart - baseTimestamp);
+		snprintf(numberBuffer, sizeof(numberBuffer), ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 "}",
+				 category, event.kind == TraceEvent_kind::DEVICE_COMMAND ? 2 : 1, event.track,
+				 relativeStart / 1000, relativeStart % 1000, event.duration / 1000, event.duration % 1000);
+		file << numberBuffer;
+	}
+
+	file << "\n]}\n";
+	file.close();
+	if (file.fail()) { return CL_EXT_FILE_OPEN_FAILED; }
+
+	return CL_SUCCESS;
+}
+
+void clearTrace() noexcept {
+	std::lock_guard<std::mutex> lock(bufferRegistryMutex);
+	for (TraceBuffer* buffer : traceBuffers) { buffer->head.store(0, std::memory_order_release); }
+}